@@ -0,0 +1,163 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// sequential vs. parallel cube pruning with a toy boundary-word feature:
+// forests derived by the parallel version must be identical to the sequential ones.
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "apply_cube_prune.hpp"
+#include "apply_cube_prune_parallel.hpp"
+#include "hypergraph.hpp"
+#include "model.hpp"
+#include "feature_function.hpp"
+
+#include "operation/functional.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/getline.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::HyperGraph hypergraph_type;
+typedef cicada::Model      model_type;
+typedef cicada::FeatureFunction feature_function_type;
+
+typedef std::vector<hypergraph_type, std::allocator<hypergraph_type> > hypergraph_set_type;
+typedef std::vector<model_type, std::allocator<model_type> > model_set_type;
+
+// remember the leftmost and the rightmost words, and score the adjacent word pairs at the boundaries
+struct Boundary : public feature_function_type
+{
+  typedef cicada::Symbol::id_type id_type;
+
+  Boundary() : feature_function_type(sizeof(id_type) * 2, "boundary") {}
+
+  void apply(state_ptr_type& state,
+	     const state_ptr_set_type& states,
+	     const edge_type& edge,
+	     feature_set_type& features,
+	     const bool final) const
+  {
+    id_type* context = reinterpret_cast<id_type*>(state);
+
+    context[0] = id_type(-1);
+    context[1] = id_type(-1);
+
+    double score = 0.0;
+    int non_terminal_pos = 0;
+
+    rule_type::symbol_set_type::const_iterator riter_end = edge.rule->rhs.end();
+    for (rule_type::symbol_set_type::const_iterator riter = edge.rule->rhs.begin(); riter != riter_end; ++ riter) {
+      id_type first = riter->id();
+      id_type last  = riter->id();
+
+      if (riter->is_non_terminal()) {
+	const int __non_terminal_index = riter->non_terminal_index() - 1;
+	const int antecedent_index = utils::bithack::branch(__non_terminal_index < 0, non_terminal_pos, __non_terminal_index);
+	++ non_terminal_pos;
+
+	const id_type* antecedent = reinterpret_cast<const id_type*>(states[antecedent_index]);
+
+	first = antecedent[0];
+	last  = antecedent[1];
+      }
+
+      if (context[1] != id_type(-1))
+	score += pair(context[1], first);
+      else
+	context[0] = first;
+
+      context[1] = last;
+    }
+
+    if (final)
+      score += pair(context[1], id_type(-1));
+
+    features[feature_name()] = score;
+  }
+
+  void apply_coarse(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+  void apply_predict(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+  void apply_scan(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, const int dot, feature_set_type& features, const bool final) const {}
+  void apply_complete(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+
+  feature_function_ptr_type clone() const { return feature_function_ptr_type(new Boundary(*this)); }
+
+  static double pair(const id_type prev, const id_type next)
+  {
+    return - double((size_t(prev) * 2654435761u + size_t(next) * 40503u) % 1024) / 1024.0;
+  }
+};
+
+typedef cicada::semiring::Logprob<double> weight_type;
+typedef cicada::operation::weight_function<weight_type> function_type;
+
+int main(int argc, char** argv)
+{
+  try {
+    const int cube_size = (argc > 1 ? utils::lexical_cast<int>(argv[1]) : 200);
+    const int threads   = (argc > 2 ? utils::lexical_cast<int>(argv[2]) : 4);
+
+    hypergraph_set_type graphs;
+
+    std::string line;
+    while (utils::getline(std::cin, line))
+      if (! line.empty()) {
+	graphs.push_back(hypergraph_type());
+	graphs.back().assign(line);
+      }
+
+    model_type model(feature_function_type::feature_function_ptr_type(new Boundary()));
+
+    cicada::WeightVector<double> weights;
+    weights[cicada::Feature("boundary")] = 1.0;
+
+    const function_type function(weights);
+
+    hypergraph_set_type applied(graphs.size());
+
+    {
+      utils::resource start;
+      for (size_t i = 0; i != graphs.size(); ++ i)
+	cicada::apply_cube_prune(model, graphs[i], applied[i], function, cube_size);
+      utils::resource end;
+
+      std::cout << "sequential: " << (end.cpu_time() - start.cpu_time()) << " cpu "
+		<< (end.user_time() - start.user_time()) << " user"
+		<< std::endl;
+    }
+
+    for (int num_thread = 1; num_thread <= threads; num_thread *= 2) {
+      model_set_type models;
+      for (int i = 0; i != num_thread; ++ i)
+	models.push_back(model.clone());
+
+      hypergraph_set_type applied_parallel(graphs.size());
+
+      utils::resource start;
+      for (size_t i = 0; i != graphs.size(); ++ i)
+	cicada::apply_cube_prune(models, graphs[i], applied_parallel[i], function, cube_size);
+      utils::resource end;
+
+      size_t num_diff = 0;
+      for (size_t i = 0; i != graphs.size(); ++ i)
+	num_diff += (applied_parallel[i] != applied[i]);
+
+      std::cout << "parallel threads: " << num_thread << " "
+		<< (end.cpu_time() - start.cpu_time()) << " cpu "
+		<< (end.user_time() - start.user_time()) << " user"
+		<< " different forests: " << num_diff
+		<< std::endl;
+    }
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
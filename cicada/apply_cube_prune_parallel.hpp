@@ -0,0 +1,549 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__APPLY_CUBE_PRUNE_PARALLEL__HPP__
+#define __CICADA__APPLY_CUBE_PRUNE_PARALLEL__HPP__ 1
+
+//
+// intra-sentence parallel cube pruning:
+//
+// Nodes of the input forest are grouped into topological levels, so that all the antecedents of a node
+// are found in the lower levels. Nodes in the same level are independent, and we run the per-node
+// candidate heaps of a level concurrently, one model (thus, one state allocator) per thread.
+// Each thread keeps the states of the nodes derived from the input node v in states[v], and refers to them by
+// their local index k. When a level is finished, a single thread assigns compact ids, offsets[v] + k, to the
+// derived nodes, appends their states to node_states and rewrites D, so that D and node_states can be
+// shared without locking. The output forest is constructed after all the levels are processed by replaying
+// the popped items in the input node order, which yields exactly the same forest as ApplyCubePrune.
+//
+
+#include <vector>
+#include <algorithm>
+
+#include <cicada/apply_cube_prune.hpp>
+#include <cicada/apply_state_less.hpp>
+#include <cicada/hypergraph.hpp>
+#include <cicada/model.hpp>
+
+#include <cicada/semiring/traits.hpp>
+
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/exception_ptr.hpp>
+
+#include <utils/compact_map.hpp>
+#include <utils/chunk_vector.hpp>
+#include <utils/atomicop.hpp>
+#include <utils/bithack.hpp>
+
+namespace cicada
+{
+
+  template <typename Semiring, typename Function>
+  struct ApplyCubePruneParallel
+  {
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef HyperGraph hypergraph_type;
+
+    typedef hypergraph_type::id_type   id_type;
+    typedef hypergraph_type::node_type node_type;
+    typedef hypergraph_type::edge_type edge_type;
+
+    typedef hypergraph_type::feature_set_type feature_set_type;
+    typedef hypergraph_type::attribute_set_type attribute_set_type;
+
+    typedef feature_set_type::feature_type     feature_type;
+    typedef attribute_set_type::attribute_type attribute_type;
+
+    typedef Model model_type;
+    typedef std::vector<model_type, std::allocator<model_type> > model_set_type;
+
+    typedef model_type::state_type     state_type;
+    typedef model_type::state_set_type state_set_type;
+
+    typedef Semiring semiring_type;
+    typedef Semiring score_type;
+
+    typedef Function function_type;
+
+    typedef ApplyCubePrune<Semiring, Function> cube_prune_type;
+
+    typedef typename cube_prune_type::index_set_type       index_set_type;
+    typedef typename cube_prune_type::candidate_type       candidate_type;
+    typedef typename cube_prune_type::candidate_set_type   candidate_set_type;
+    typedef typename cube_prune_type::node_score_type      node_score_type;
+    typedef typename cube_prune_type::node_score_list_type node_score_list_type;
+    typedef typename cube_prune_type::node_score_set_type  node_score_set_type;
+    typedef typename cube_prune_type::compare_estimate_type compare_estimate_type;
+    typedef typename cube_prune_type::candidate_heap_type  candidate_heap_type;
+
+    typedef utils::compact_map<state_type, size_type,
+			       model_type::state_unassigned, model_type::state_unassigned,
+			       model_type::state_hash, model_type::state_equal,
+			       std::allocator<std::pair<const state_type, size_type> > > state_node_map_type;
+
+    // popped item: the output edge with virtual tails, and the index of the node derived from its head
+    struct Item
+    {
+      edge_type edge;
+      size_type head;
+
+      Item(const size_type& __head) : edge(), head(__head) {}
+    };
+    typedef Item item_type;
+    typedef utils::chunk_vector<item_type, 1024 / sizeof(item_type), std::allocator<item_type> > item_list_type;
+    typedef std::vector<item_list_type, std::allocator<item_list_type> > item_set_type;
+
+    typedef std::vector<id_type, std::allocator<id_type> > node_set_type;
+    typedef std::vector<node_set_type, std::allocator<node_set_type> > level_set_type;
+    typedef std::vector<size_type, std::allocator<size_type> > position_set_type;
+    typedef std::vector<state_set_type, std::allocator<state_set_type> > state_map_type;
+
+    struct Worker
+    {
+      Worker(ApplyCubePruneParallel& __applier, const model_type& __model)
+	: applier(__applier), model(__model) {}
+
+      void operator()(const hypergraph_type& graph_in)
+      {
+	for (size_type level = 0; level != applier.levels.size(); ++ level) {
+	  const node_set_type& nodes = applier.levels[level];
+
+	  // an exception is kept by the applier, and we still arrive at the barrier so that others do not wait forever
+	  try {
+	    for (;;) {
+	      const size_type pos = utils::atomicop::fetch_and_add(applier.positions[level], size_type(1));
+
+	      if (pos >= nodes.size()) break;
+
+	      kbest(nodes[pos], graph_in);
+	    }
+	  }
+	  catch (...) {
+	    applier.failure(boost::current_exception());
+	  }
+
+	  // wait until all the nodes in this level are processed, then one of us assigns their node ids
+	  if (applier.barrier->wait())
+	    applier.finish(level);
+	  applier.barrier->wait();
+
+	  // every worker observes the same failure after the barrier, thus quit at the same level
+	  if (applier.error) break;
+	}
+      }
+
+      void kbest(id_type v, const hypergraph_type& graph_in)
+      {
+	candidates.clear();
+	scores.clear();
+
+	const node_type& node = graph_in.nodes[v];
+	const bool is_goal(v == graph_in.goal);
+
+	cand.clear();
+	cand.reserve(node.edges.size() * applier.cube_size_max);
+
+	node_type::edge_set_type::const_iterator eiter_end = node.edges.end();
+	for (node_type::edge_set_type::const_iterator eiter = node.edges.begin(); eiter != eiter_end; ++ eiter) {
+	  const edge_type& edge = graph_in.edges[*eiter];
+	  const index_set_type j(edge.tails.size(), 0);
+
+	  cand.push(make_candidate(edge, j, is_goal));
+	}
+
+	state_node_map_type buf(cand.size(), model_type::state_hash(model.state_size()), model_type::state_equal(model.state_size()));
+
+	item_list_type& items = applier.items[v];
+
+	for (size_type num_pop = 0; !cand.empty() && num_pop != applier.cube_size_max; ++ num_pop) {
+	  const candidate_type* item = cand.top();
+	  cand.pop();
+
+	  push_succ(*item, is_goal);
+	  append_item(*item, v, is_goal, buf, items);
+	}
+
+	// the goal is never used as an antecedent
+	if (! is_goal) {
+	  node_score_list_type& D = applier.D[v];
+
+	  D.assign(scores.begin(), scores.end());
+
+	  std::sort(D.begin(), D.end(), compare_estimate_type());
+	}
+
+	typename candidate_heap_type::const_iterator hiter_end = cand.end();
+	for (typename candidate_heap_type::const_iterator hiter = cand.begin(); hiter != hiter_end; ++ hiter)
+	  model.deallocate((*hiter)->state);
+      }
+
+      void append_item(const candidate_type& item,
+		       const id_type v,
+		       const bool is_goal,
+		       state_node_map_type& buf,
+		       item_list_type& items)
+      {
+	size_type head = 0;
+
+	if (is_goal) {
+	  // perform hypothesis re-combination toward goal-node...
+	  if (scores.empty()) {
+	    scores.push_back(node_score_type(0, item.score));
+	    applier.states[v].push_back(item.state);
+	  } else
+	    model.deallocate(item.state);
+	} else {
+	  typedef std::pair<typename state_node_map_type::iterator, bool> result_type;
+
+	  result_type result = buf.insert(std::make_pair(item.state, scores.size()));
+
+	  if (result.second) {
+	    scores.push_back(node_score_type(scores.size(), item.score));
+	    applier.states[v].push_back(item.state);
+	  } else
+	    model.deallocate(item.state);
+
+	  head = result.first->second;
+
+	  if (item.score > scores[head].score)
+	    scores[head].score = item.score;
+	}
+
+	// we will not use the popped candidate any more, so simply move its output edge
+	candidate_type& candidate = const_cast<candidate_type&>(item);
+
+	items.push_back(item_type(head));
+
+	edge_type& edge = items.back().edge;
+
+	edge.tails.swap(candidate.out_edge.tails);
+	edge.features.swap(candidate.out_edge.features);
+	edge.attributes.swap(candidate.out_edge.attributes);
+	edge.rule = candidate.out_edge.rule;
+      }
+
+      // Faster Cube Pruning: Algorithm 2, as in ApplyCubePrune
+      void push_succ(const candidate_type& candidate, const bool is_goal)
+      {
+	index_set_type j = candidate.j;
+	for (size_t i = 0; i != candidate.j.size(); ++ i) {
+	  ++ j[i];
+
+	  if (j[i] < static_cast<int>(applier.D[candidate.in_edge->tails[i]].size()))
+	    cand.push(make_candidate(*candidate.in_edge, j, is_goal));
+
+	  if (candidate.j[i] != 0) break;
+
+	  -- j[i];
+	}
+      }
+
+      const candidate_type* make_candidate(const edge_type& edge, const index_set_type& j, const bool is_goal)
+      {
+	candidates.push_back(candidate_type(edge, j));
+
+	candidate_type& candidate = candidates.back();
+
+	candidate.out_edge.tails = edge_type::node_set_type(j.size());
+
+	candidate.score = semiring::traits<score_type>::one();
+	for (size_t i = 0; i != j.size(); ++ i) {
+	  const node_score_type& antecedent = applier.D[edge.tails[i]][j[i]];
+
+	  candidate.out_edge.tails[i] = antecedent.node;
+	  candidate.score *= antecedent.score;
+	}
+
+	candidate.state = model.apply(applier.node_states, candidate.out_edge, candidate.out_edge.features, is_goal);
+	candidate.score *= applier.function(candidate.out_edge.features);
+
+	return &candidate;
+      }
+
+      ApplyCubePruneParallel& applier;
+      const model_type& model;
+
+      candidate_set_type   candidates;
+      candidate_heap_type  cand;
+      node_score_list_type scores;
+    };
+
+    typedef Worker worker_type;
+
+    struct Task
+    {
+      Task(worker_type& __worker, const hypergraph_type& __graph) : worker(__worker), graph(__graph) {}
+
+      void operator()() { worker(graph); }
+
+      worker_type& worker;
+      const hypergraph_type& graph;
+    };
+
+    ApplyCubePruneParallel(const model_set_type& _models,
+			   const function_type& _function,
+			   const int _cube_size_max,
+			   const bool _prune_bin=false)
+      : models(_models),
+	function(_function),
+	cube_size_max(_cube_size_max),
+	prune_bin(_prune_bin),
+	attr_prune_bin(_prune_bin ? "prune-bin" : ""),
+	barrier(0),
+	error()
+    {
+      if (models.empty())
+	throw std::runtime_error("no models for parallel cube pruning");
+    }
+
+    void operator()(const hypergraph_type& graph_in,
+		    hypergraph_type&       graph_out)
+    {
+      for (size_type i = 0; i != models.size(); ++ i)
+	const_cast<model_type&>(models[i]).initialize();
+
+      const model_type& model = models.front();
+
+      if (model.is_stateless()) {
+	ApplyStateLess __applier(model, prune_bin);
+	__applier(graph_in, graph_out);
+      } else {
+	compute_levels(graph_in);
+
+	D.clear();
+	D.resize(graph_in.nodes.size());
+
+	items.clear();
+	items.resize(graph_in.nodes.size());
+
+	states.clear();
+	states.resize(graph_in.nodes.size());
+
+	offsets.clear();
+	offsets.resize(graph_in.nodes.size(), 0);
+
+	node_states.clear();
+
+	// we do not need more threads than the widest level
+	size_type width = 0;
+	for (size_type level = 0; level != levels.size(); ++ level)
+	  width = std::max(width, levels[level].size());
+
+	const size_type num_thread = utils::bithack::max(size_type(1), utils::bithack::min(models.size(), width));
+
+	std::vector<worker_type, std::allocator<worker_type> > workers;
+	workers.reserve(num_thread);
+	for (size_type i = 0; i != num_thread; ++ i)
+	  workers.push_back(worker_type(*this, models[i]));
+
+	boost::barrier __barrier(num_thread);
+	barrier = &__barrier;
+
+	boost::thread_group threads;
+	for (size_type i = 1; i < num_thread; ++ i)
+	  threads.add_thread(new boost::thread(Task(workers[i], graph_in)));
+
+	workers.front()(graph_in);
+
+	threads.join_all();
+
+	barrier = 0;
+	workers.clear();
+
+	if (error) {
+	  const boost::exception_ptr __error = error;
+	  error = boost::exception_ptr();
+
+	  D.clear();
+	  items.clear();
+	  states.clear();
+	  offsets.clear();
+	  node_states.clear();
+
+	  for (size_type i = 0; i != models.size(); ++ i)
+	    const_cast<model_type&>(models[i]).initialize();
+
+	  boost::rethrow_exception(__error);
+	}
+
+	commit(graph_in, graph_out);
+
+	// topologically sort...
+	graph_out.topologically_sort();
+
+	D.clear();
+	items.clear();
+	states.clear();
+	offsets.clear();
+	node_states.clear();
+
+	// re-initialize again...
+	for (size_type i = 0; i != models.size(); ++ i)
+	  const_cast<model_type&>(models[i]).initialize();
+      }
+    }
+
+  private:
+    // keep the first exception thrown by a worker, which is rethrown after joining
+    void failure(const boost::exception_ptr& __error)
+    {
+      boost::mutex::scoped_lock lock(mutex);
+
+      if (! error)
+	error = __error;
+    }
+
+    // called by a single worker between the barriers: assign compact ids to the nodes derived in this level
+    void finish(const size_type level)
+    {
+      if (error) return;
+
+      try {
+	const node_set_type& nodes = levels[level];
+
+	for (size_type pos = 0; pos != nodes.size(); ++ pos) {
+	  const id_type v = nodes[pos];
+
+	  state_set_type& states_v = states[v];
+
+	  if (node_states.size() + states_v.size() >= size_type(hypergraph_type::invalid))
+	    throw std::runtime_error("too many nodes for parallel cube pruning");
+
+	  offsets[v] = node_states.size();
+
+	  node_states.insert(node_states.end(), states_v.begin(), states_v.end());
+	  state_set_type().swap(states_v);
+
+	  typename node_score_list_type::iterator diter_end = D[v].end();
+	  for (typename node_score_list_type::iterator diter = D[v].begin(); diter != diter_end; ++ diter)
+	    diter->node += offsets[v];
+	}
+      }
+      catch (...) {
+	failure(boost::current_exception());
+      }
+    }
+
+    // group nodes into levels: a node's level is one plus the maximum level of its antecedents
+    void compute_levels(const hypergraph_type& graph)
+    {
+      position_set_type node_levels(graph.nodes.size(), 0);
+
+      levels.clear();
+
+      hypergraph_type::node_set_type::const_iterator niter_end = graph.nodes.end();
+      for (hypergraph_type::node_set_type::const_iterator niter = graph.nodes.begin(); niter != niter_end; ++ niter) {
+	const node_type& node = *niter;
+
+	size_type level = 0;
+
+	node_type::edge_set_type::const_iterator eiter_end = node.edges.end();
+	for (node_type::edge_set_type::const_iterator eiter = node.edges.begin(); eiter != eiter_end; ++ eiter) {
+	  const edge_type& edge = graph.edges[*eiter];
+
+	  edge_type::node_set_type::const_iterator titer_end = edge.tails.end();
+	  for (edge_type::node_set_type::const_iterator titer = edge.tails.begin(); titer != titer_end; ++ titer)
+	    level = utils::bithack::max(level, node_levels[*titer] + 1);
+	}
+
+	node_levels[node.id] = level;
+
+	if (level >= levels.size())
+	  levels.resize(level + 1);
+	levels[level].push_back(node.id);
+      }
+
+      positions.clear();
+      positions.resize(levels.size(), 0);
+    }
+
+    // replay the popped items in the input node order, as in ApplyCubePrune::append_item
+    void commit(const hypergraph_type& graph_in, hypergraph_type& graph_out)
+    {
+      graph_out.clear();
+
+      node_set_type node_map(node_states.size(), hypergraph_type::invalid);
+
+      for (size_type v = 0; v != graph_in.nodes.size(); ++ v) {
+	const bool is_goal(v == graph_in.goal);
+
+	typename item_list_type::iterator iter_end = items[v].end();
+	for (typename item_list_type::iterator iter = items[v].begin(); iter != iter_end; ++ iter) {
+	  edge_type::node_set_type::iterator titer_end = iter->edge.tails.end();
+	  for (edge_type::node_set_type::iterator titer = iter->edge.tails.begin(); titer != titer_end; ++ titer)
+	    *titer = node_map[*titer];
+
+	  edge_type& edge_new = graph_out.add_edge(iter->edge);
+
+	  // prune-bin attribute
+	  if (prune_bin)
+	    edge_new.attributes[attr_prune_bin] = attribute_set_type::int_type(v);
+
+	  if (is_goal) {
+	    if (graph_out.goal == hypergraph_type::invalid)
+	      graph_out.goal = graph_out.add_node().id;
+
+	    graph_out.connect_edge(edge_new.id, graph_out.goal);
+	  } else {
+	    id_type& head = node_map[offsets[v] + iter->head];
+
+	    if (head == hypergraph_type::invalid)
+	      head = graph_out.add_node().id;
+
+	    graph_out.connect_edge(edge_new.id, head);
+	  }
+	}
+
+	item_list_type().swap(items[v]);
+      }
+    }
+
+  private:
+    level_set_type      levels;
+    position_set_type   positions;
+
+    node_score_set_type D;
+    state_set_type      node_states;
+    state_map_type      states;
+    position_set_type   offsets;
+    item_set_type       items;
+
+    const model_set_type& models;
+    const function_type& function;
+    size_type  cube_size_max;
+    bool prune_bin;
+
+    attribute_type attr_prune_bin;
+
+    boost::barrier* barrier;
+
+    boost::mutex        mutex;
+    boost::exception_ptr error;
+  };
+
+  template <typename Function>
+  inline
+  void apply_cube_prune(const std::vector<Model, std::allocator<Model> >& models, const HyperGraph& source, HyperGraph& target, const Function& func, const int cube_size, const bool prune_bin=false)
+  {
+    ApplyCubePruneParallel<typename Function::value_type, Function>(models, func, cube_size, prune_bin)(source, target);
+  }
+
+  template <typename Function>
+  inline
+  void apply_cube_prune(const std::vector<Model, std::allocator<Model> >& models, HyperGraph& source, const Function& func, const int cube_size, const bool prune_bin=false)
+  {
+    HyperGraph target;
+
+    ApplyCubePruneParallel<typename Function::value_type, Function>(models, func, cube_size, prune_bin)(source, target);
+
+    source.swap(target);
+  }
+
+};
+
+#endif
@@ -0,0 +1,216 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__CKY_CHART__HPP__
+#define __CICADA__CKY_CHART__HPP__ 1
+
+//
+// flat charts for CKY parsing
+//
+// CKYChart keeps the passive items of all the spans in parallel arrays of non-terminal labels and
+// back-pointers, and CKYScoreChart additionally keeps their scores. Since a span is completed only
+// once in CKY, the items of a span are appended at once, and a span is simply a range of positions
+// in the arrays. A position is stable during parsing, thus, active items refer to passive items by
+// their positions.
+//
+// CKYActiveSet is a cell of active items kept as parallel arrays of transducer states, ids of
+// antecedents and ids of features, not as a vector of heavy structures with their own copies of
+// antecedents and features.
+//
+
+#include <vector>
+
+#include <cicada/symbol.hpp>
+#include <cicada/transducer.hpp>
+
+#include <utils/chart.hpp>
+
+namespace cicada
+{
+  template <typename Pointer>
+  class CKYChart
+  {
+  public:
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef Symbol  symbol_type;
+    typedef Pointer pointer_type;
+
+    struct Range
+    {
+      size_type first;
+      size_type last;
+
+      Range() : first(0), last(0) {}
+      Range(const size_type& __first, const size_type& __last) : first(__first), last(__last) {}
+
+      bool empty() const { return first == last; }
+      size_type size() const { return last - first; }
+    };
+
+    typedef Range range_type;
+
+    typedef std::vector<symbol_type, std::allocator<symbol_type> >   label_set_type;
+    typedef std::vector<pointer_type, std::allocator<pointer_type> > pointer_set_type;
+
+    typedef utils::chart<range_type, std::allocator<range_type> > range_chart_type;
+
+  public:
+    CKYChart() {}
+    CKYChart(size_type size) { initialize(size); }
+
+  public:
+    // initialize for a lattice of size
+    void initialize(size_type size)
+    {
+      clear();
+
+      spans.reserve(size + 1);
+      spans.resize(size + 1);
+    }
+
+    void reserve(size_type size)
+    {
+      labels.reserve(size);
+      pointers.reserve(size);
+    }
+
+    void clear()
+    {
+      spans.clear();
+      labels.clear();
+      pointers.clear();
+    }
+
+    void swap(CKYChart& x)
+    {
+      spans.swap(x.spans);
+      labels.swap(x.labels);
+      pointers.swap(x.pointers);
+    }
+
+    // append an item, and return its position
+    size_type push_back(const symbol_type& label, const pointer_type& pointer)
+    {
+      labels.push_back(label);
+      pointers.push_back(pointer);
+
+      return labels.size() - 1;
+    }
+
+    // the items appended after position are the items of [first, last)
+    void close(size_type first, size_type last, size_type position)
+    {
+      spans(first, last) = range_type(position, labels.size());
+    }
+
+    size_type size() const { return labels.size(); }
+    bool empty() const { return labels.empty(); }
+
+    const range_type& operator()(size_type first, size_type last) const { return spans(first, last); }
+
+    const symbol_type&  label(size_type pos) const { return labels[pos]; }
+    const pointer_type& pointer(size_type pos) const { return pointers[pos]; }
+
+  private:
+    range_chart_type spans;
+
+    label_set_type   labels;
+    pointer_set_type pointers;
+  };
+
+  template <typename Pointer, typename Score>
+  class CKYScoreChart : public CKYChart<Pointer>
+  {
+  public:
+    typedef CKYChart<Pointer> base_type;
+
+    typedef typename base_type::size_type    size_type;
+    typedef typename base_type::symbol_type  symbol_type;
+    typedef typename base_type::pointer_type pointer_type;
+
+    typedef Score score_type;
+
+    typedef std::vector<score_type, std::allocator<score_type> > score_set_type;
+
+  public:
+    CKYScoreChart() {}
+    CKYScoreChart(size_type size) : base_type(size) {}
+
+  public:
+    void initialize(size_type size)
+    {
+      base_type::initialize(size);
+      scores.clear();
+    }
+
+    void reserve(size_type size)
+    {
+      base_type::reserve(size);
+      scores.reserve(size);
+    }
+
+    void clear()
+    {
+      base_type::clear();
+      scores.clear();
+    }
+
+    void swap(CKYScoreChart& x)
+    {
+      base_type::swap(x);
+      scores.swap(x.scores);
+    }
+
+    size_type push_back(const symbol_type& label, const score_type& score, const pointer_type& pointer)
+    {
+      scores.push_back(score);
+      return base_type::push_back(label, pointer);
+    }
+
+    const score_type& score(size_type pos) const { return scores[pos]; }
+
+  private:
+    score_set_type scores;
+  };
+
+  struct CKYActiveSet
+  {
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef Transducer::id_type state_type;
+    typedef size_type           id_type;
+
+    typedef std::vector<state_type, std::allocator<state_type> > state_set_type;
+    typedef std::vector<id_type, std::allocator<id_type> >       id_set_type;
+
+    CKYActiveSet() : states(), tails(), features() {}
+
+    void push_back(const state_type& state, const id_type& __tails, const id_type& __features)
+    {
+      states.push_back(state);
+      tails.push_back(__tails);
+      features.push_back(__features);
+    }
+
+    void clear()
+    {
+      states.clear();
+      tails.clear();
+      features.clear();
+    }
+
+    size_type size() const { return states.size(); }
+    bool empty() const { return states.empty(); }
+
+    state_set_type states;
+    id_set_type    tails;
+    id_set_type    features;
+  };
+};
+
+#endif
@@ -17,13 +17,14 @@
 #include <cicada/grammar.hpp>
 #include <cicada/transducer.hpp>
 #include <cicada/hypergraph.hpp>
+#include <cicada/cky_chart.hpp>
 
-#include <utils/chunk_vector.hpp>
 #include <utils/chart.hpp>
 #include <utils/hashmurmur3.hpp>
 #include <utils/indexed_set.hpp>
 #include <utils/compact_map.hpp>
 #include <utils/compact_set.hpp>
+#include <utils/mulvector2.hpp>
 #include <utils/unordered_map.hpp>
 
 namespace cicada
@@ -75,44 +76,23 @@ namespace cicada
       goal_rule = rule_type::create(rule_type(vocab_type::GOAL, rule_type::symbol_set_type(1, goal.non_terminal())));
     }
     
-    struct Active
-    {
-      Active(const transducer_type::id_type& __node,
-	     const hypergraph_type::edge_type::node_set_type& __tails,
-	     const feature_set_type& __features,
-	     const attribute_set_type& __attributes)
-	: node(__node),
-	  tails(__tails),
-	  features(__features),
-	  attributes(__attributes) {}
-      Active(const transducer_type::id_type& __node,
-	     const feature_set_type& __features,
-	     const attribute_set_type& __attributes)
-	: node(__node),
-	  tails(),
-	  features(__features),
-	  attributes(__attributes) {}
-      Active(const transducer_type::id_type& __node)
-	: node(__node),
-	  tails(),
-	  features(),
-	  attributes() {}
-      
-      transducer_type::id_type                  node;
-      hypergraph_type::edge_type::node_set_type tails;
-      feature_set_type                          features;
-      attribute_set_type                        attributes;
-    };
-    
-    typedef Active active_type;
-    typedef utils::chunk_vector<active_type, 4096 / sizeof(active_type), std::allocator<active_type> > active_set_type;
+    typedef CKYActiveSet active_set_type;
 
     typedef utils::chart<active_set_type, std::allocator<active_set_type> > active_chart_type;
     typedef std::vector<active_chart_type, std::allocator<active_chart_type> > active_chart_set_type;
 
     typedef hypergraph_type::id_type passive_type;
     typedef std::vector<passive_type, std::allocator<passive_type> > passive_set_type;
-    typedef utils::chart<passive_set_type, std::allocator<passive_set_type> > passive_chart_type;
+    typedef CKYChart<passive_type> passive_chart_type;
+    typedef passive_chart_type::range_type passive_range_type;
+
+    typedef utils::mulvector2<passive_type, std::allocator<passive_type> > tails_map_type;
+    typedef tails_map_type::const_reference tails_mapped_type;
+
+    typedef std::vector<passive_type, std::allocator<passive_type> > tails_type;
+
+    typedef std::vector<feature_set_type, std::allocator<feature_set_type> > feature_map_type;
+    typedef size_type feature_id_type;
 
     typedef std::pair<symbol_type, int> symbol_level_type;
     
@@ -217,10 +197,15 @@ namespace cicada
       non_terminals.clear();
       
       actives.reserve(grammar.size());
-      passives.reserve(lattice.size() + 1);
-      
       actives.resize(grammar.size(), active_chart_type(lattice.size() + 1));
-      passives.resize(lattice.size() + 1);
+      
+      passives.initialize(lattice.size());
+      
+      tails_map.clear();
+      tails_map.push_back();
+      
+      features_map.clear();
+      features_map.push_back(feature_set_type());
 
       frontiers_source.clear();
       frontiers_target.clear();
@@ -231,7 +216,7 @@ namespace cicada
 	
 	for (size_t pos = 0; pos != lattice.size(); ++ pos)
 	  if (grammar[table].valid_span(pos, pos, 0))
-	    actives[table](pos, pos).push_back(active_type(root));
+	    actives[table](pos, pos).push_back(root, 0, 0);
       }
       
       for (size_t length = 1; length <= lattice.size(); ++ length)
@@ -241,6 +226,7 @@ namespace cicada
 	  if (pruner(first, last)) continue;
 	  
 	  node_map.clear();
+	  passive_arcs.clear();
 	  
 	  //std::cerr << "span: " << first << ".." << last << " distance: " << lattice.shortest_distance(first, last) << std::endl;
 	  
@@ -254,8 +240,8 @@ namespace cicada
 	      // first, extend active items...
 	      active_set_type& cell = actives[table](first, last);
 	      for (size_t middle = first + 1; middle < last; ++ middle) {
-		const active_set_type&  active_arcs  = actives[table](first, middle);
-		const passive_set_type& passive_arcs = passives(middle, last);
+		const active_set_type& active_arcs   = actives[table](first, middle);
+		const passive_range_type passive_arcs = passives(middle, last);
 		
 		extend_actives(transducer, active_arcs, passive_arcs, cell);
 	      }
@@ -265,48 +251,23 @@ namespace cicada
 		const active_set_type&  active_arcs  = actives[table](first, last - 1);
 		const lattice_type::arc_set_type& passive_arcs = lattice[last - 1];
 		
-		active_set_type::const_iterator aiter_begin = active_arcs.begin();
-		active_set_type::const_iterator aiter_end = active_arcs.end();
-		
-		if (aiter_begin != aiter_end) {
-		  if (pos_mode) {
-		    lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
-		    for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
-		      const symbol_type terminal = piter->label.terminal();
-		      
-		      active_set_type& cell = actives[table](first, last - 1 + piter->distance);
-		      
-		      // handling of EPSILON rule...
-		      if (terminal == vocab_type::EPSILON) {
-			for (active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-			  cell.push_back(active_type(aiter->node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-		      } else {
-			for (active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter) {
-			  const transducer_type::id_type node = transducer.next(aiter->node, terminal);
-			  if (node == transducer.root()) continue;
-			  
-			  cell.push_back(active_type(node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-			}
-		      }
-		    }
-		  } else {
-		    lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
-		    for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
-		      const symbol_type& terminal = piter->label;
-		      
-		      active_set_type& cell = actives[table](first, last - 1 + piter->distance);
-		      
-		      // handling of EPSILON rule...
-		      if (terminal == vocab_type::EPSILON) {
-			for (active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-			  cell.push_back(active_type(aiter->node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-		      } else {
-			for (active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter) {
-			  const transducer_type::id_type node = transducer.next(aiter->node, terminal);
-			  if (node == transducer.root()) continue;
-			  
-			  cell.push_back(active_type(node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-			}
+		if (! active_arcs.empty()) {
+		  lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
+		  for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
+		    const symbol_type terminal = (pos_mode ? piter->label.terminal() : piter->label);
+		    
+		    active_set_type& cell = actives[table](first, last - 1 + piter->distance);
+		    
+		    // handling of EPSILON rule...
+		    if (terminal == vocab_type::EPSILON) {
+		      for (size_type a = 0; a != active_arcs.size(); ++ a)
+			cell.push_back(active_arcs.states[a], active_arcs.tails[a], extend_features(active_arcs.features[a], piter->features));
+		    } else {
+		      for (size_type a = 0; a != active_arcs.size(); ++ a) {
+			const transducer_type::id_type node = transducer.next(active_arcs.states[a], terminal);
+			if (node == transducer.root()) continue;
+			
+			cell.push_back(node, active_arcs.tails[a], extend_features(active_arcs.features[a], piter->features));
 		      }
 		    }
 		  }
@@ -318,15 +279,16 @@ namespace cicada
 	    // lattice structure...
 	    // apply rules on actives at [first, last)
 	    
-	    active_set_type&  cell         = actives[table](first, last);
-	    passive_set_type& passive_arcs = passives(first, last);
+	    const active_set_type& cell = actives[table](first, last);
 	    
-	    active_set_type::const_iterator citer_end = cell.end();
-	    for (active_set_type::const_iterator citer = cell.begin(); citer != citer_end; ++ citer) {
-	      const transducer_type::rule_pair_set_type& rules = transducer.rules(citer->node);
+	    for (size_type a = 0; a != cell.size(); ++ a) {
+	      const transducer_type::rule_pair_set_type& rules = transducer.rules(cell.states[a]);
 	      
 	      if (rules.empty()) continue;
 	      
+	      const tails_mapped_type tails = tails_map[cell.tails[a]];
+	      const feature_set_type& features = features_map[cell.features[a]];
+	      
 	      transducer_type::rule_pair_set_type::const_iterator riter_begin = rules.begin();
 	      transducer_type::rule_pair_set_type::const_iterator riter_end   = rules.end();
 	      
@@ -338,24 +300,22 @@ namespace cicada
 		
 		if (frontier)
 		  apply_rule(rule,
-			     riter->features + citer->features,
-			     riter->attributes + citer->attributes + frontier_attributes(riter->source, riter->target),
-			     citer->tails.begin(), citer->tails.end(), passive_arcs, graph,
+			     riter->features + features,
+			     riter->attributes + frontier_attributes(riter->source, riter->target),
+			     tails.begin(), tails.end(), passive_arcs, graph,
 			     first, last);
 		else 
 		  apply_rule(rule,
-			     riter->features + citer->features,
-			     riter->attributes + citer->attributes,
-			     citer->tails.begin(), citer->tails.end(), passive_arcs, graph,
+			     riter->features + features,
+			     riter->attributes,
+			     tails.begin(), tails.end(), passive_arcs, graph,
 			     first, last);
 	      }
 	    }
 	  }
 	  
-	  if (! passives(first, last).empty()) {
-	    //std::cerr << "closure from passives: " << passives(first, last).size() << std::endl;
-
-	    passive_set_type& passive_arcs = passives(first, last);
+	  if (! passive_arcs.empty()) {
+	    //std::cerr << "closure from passives: " << passive_arcs.size() << std::endl;
 	    
 	    size_t passive_first = 0;
 	    
@@ -391,6 +351,8 @@ namespace cicada
 		  
 		  closure_tail.insert(non_terminal);
 		  
+		  const passive_type tail = passive_arcs[p];
+		  
 		  transducer_type::rule_pair_set_type::const_iterator riter_end = rules.end();
 		  for (transducer_type::rule_pair_set_type::const_iterator riter = rules.begin(); riter != riter_end; ++ riter) {
 		    const rule_ptr_type& rule = (yield_source ? riter->source : riter->target);
@@ -407,13 +369,13 @@ namespace cicada
 		      apply_rule(rule,
 				 riter->features,
 				 riter->attributes + frontier_attributes(riter->source, riter->target),
-				 &passive_arcs[p], (&passive_arcs[p]) + 1, passive_arcs, graph,
+				 &tail, (&tail) + 1, passive_arcs, graph,
 				 first, last, level + 1);
 		    else
 		      apply_rule(rule,
 				 riter->features,
 				 riter->attributes,
-				 &passive_arcs[p], (&passive_arcs[p]) + 1, passive_arcs, graph,
+				 &tail, (&tail) + 1, passive_arcs, graph,
 				 first, last, level + 1);
 		  }
 		}
@@ -443,14 +405,21 @@ namespace cicada
 	    }
 	  }
 	  
+	  if (passive_arcs.empty()) continue;
+	  
 	  {
-	    // sort passives at passives(first, last) wrt non-terminal label in non_terminals
-	    passive_set_type& passive_arcs = passives(first, last);
-	    
-	    passive_set_type(passive_arcs).swap(passive_arcs);
+	    // sort passives at [first, last) wrt non-terminal label in non_terminals, and keep them in the chart
 	    std::sort(passive_arcs.begin(), passive_arcs.end(), less_non_terminal(non_terminals));
-	  }
 	    
+	    const size_type position = passives.size();
+	    
+	    passive_set_type::const_iterator piter_end = passive_arcs.end();
+	    for (passive_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter)
+	      passives.push_back(non_terminals[*piter], *piter);
+	    
+	    passives.close(first, last, position);
+	  }
+	  
 	  //std::cerr << "span: " << first << ".." << last << " passives: " << passives(first, last).size() << std::endl;
 	  
 	  // extend root with passive items at [first, last)
@@ -459,8 +428,8 @@ namespace cicada
 	    
 	    if (! transducer.valid_span(first, last, lattice.shortest_distance(first, last))) continue;
 	    
-	    const active_set_type&  active_arcs  = actives[table](first, first);
-	    const passive_set_type& passive_arcs = passives(first, last);
+	    const active_set_type& active_arcs   = actives[table](first, first);
+	    const passive_range_type passive_arcs = passives(first, last);
 	    
 	    active_set_type& cell = actives[table](first, last);
 	    
@@ -472,21 +441,21 @@ namespace cicada
       // passive arcs will not be updated!
       
       if (unique_goal) {
-	passive_set_type& passive_arcs = passives(0, lattice.size());
-	for (size_t p = 0; p != passive_arcs.size(); ++ p)
-	  if (non_terminals[passive_arcs[p]] == goal) {
+	const passive_range_type passive_arcs = passives(0, lattice.size());
+	for (size_t p = passive_arcs.first; p != passive_arcs.last; ++ p)
+	  if (passives.label(p) == goal) {
 	    if (graph.is_valid())
-	      throw std::runtime_error("multiple goal? " + boost::lexical_cast<std::string>(graph.goal) + " " + boost::lexical_cast<std::string>(passive_arcs[p]));
+	      throw std::runtime_error("multiple goal? " + boost::lexical_cast<std::string>(graph.goal) + " " + boost::lexical_cast<std::string>(passives.pointer(p)));
 	    
-	    graph.goal = passive_arcs[p];
+	    graph.goal = passives.pointer(p);
 	  }
       } else {
-	passive_set_type& passive_arcs = passives(0, lattice.size());
-	for (size_t p = 0; p != passive_arcs.size(); ++ p)
-	  if (non_terminals[passive_arcs[p]] == goal) {
-	    //std::cerr << "goal node: " << passive_arcs[p] << std::endl;
+	const passive_range_type passive_arcs = passives(0, lattice.size());
+	for (size_t p = passive_arcs.first; p != passive_arcs.last; ++ p)
+	  if (passives.label(p) == goal) {
+	    //std::cerr << "goal node: " << passives.pointer(p) << std::endl;
 	    
-	    hypergraph_type::edge_type& edge = graph.add_edge(&(passive_arcs[p]), (&passive_arcs[p]) + 1);
+	    hypergraph_type::edge_type& edge = graph.add_edge(&passives.pointer(p), (&passives.pointer(p)) + 1);
 	    edge.rule = goal_rule;
 	    
 	    edge.attributes[attr_span_first] = attribute_set_type::int_type(0);
@@ -503,7 +472,10 @@ namespace cicada
       
       actives.clear();
       passives.clear();
+      passive_arcs.clear();
       non_terminals.clear();
+      tails_map.clear();
+      features_map.clear();
       
       // we will sort to remove unreachable nodes......
       if (graph.is_valid())
@@ -610,39 +582,44 @@ namespace cicada
       
     }
     
+    feature_id_type extend_features(const feature_id_type& id, const feature_set_type& features)
+    {
+      if (features.empty()) return id;
+      
+      features_map.push_back(features_map[id] + features);
+      
+      return features_map.size() - 1;
+    }
+    
     bool extend_actives(const transducer_type& transducer,
-			const active_set_type& actives, 
-			const passive_set_type& passives,
+			const active_set_type& active_arcs,
+			const passive_range_type& passive_arcs,
 			active_set_type& cell)
     {
-      active_set_type::const_iterator aiter_begin = actives.begin();
-      active_set_type::const_iterator aiter_end   = actives.end();
-      
-      passive_set_type::const_iterator piter_begin = passives.begin();
-      passive_set_type::const_iterator piter_end   = passives.end();
-
       bool found = false;
       
-      if (piter_begin != piter_end)
-	for (active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-	  if (transducer.has_next(aiter->node)) {
+      if (! passive_arcs.empty())
+	for (size_type a = 0; a != active_arcs.size(); ++ a)
+	  if (transducer.has_next(active_arcs.states[a])) {
 	    symbol_type label;
 	    transducer_type::id_type node = transducer.root();
 	    
-	    hypergraph_type::edge_type::node_set_type tails(aiter->tails.size() + 1);
-	    std::copy(aiter->tails.begin(), aiter->tails.end(), tails.begin());
+	    const tails_mapped_type tails_prev = tails_map[active_arcs.tails[a]];
 	    
-	    for (passive_set_type::const_iterator piter = piter_begin; piter != piter_end; ++ piter) {
-	      const symbol_type& non_terminal = non_terminals[*piter];
+	    tails_extended.resize(tails_prev.size() + 1);
+	    std::copy(tails_prev.begin(), tails_prev.end(), tails_extended.begin());
+	    
+	    for (size_type p = passive_arcs.first; p != passive_arcs.last; ++ p) {
+	      const symbol_type& non_terminal = passives.label(p);
 	      
 	      if (label != non_terminal) {
-		node = transducer.next(aiter->node, non_terminal);
+		node = transducer.next(active_arcs.states[a], non_terminal);
 		label = non_terminal;
 	      }
 	      if (node == transducer.root()) continue;
 	      
-	      tails.back() = *piter;
-	      cell.push_back(active_type(node, tails, aiter->features, aiter->attributes));
+	      tails_extended.back() = passives.pointer(p);
+	      cell.push_back(node, tails_map.push_back(tails_extended.begin(), tails_extended.end()), active_arcs.features[a]);
 	      
 	      found = true;
 	    }
@@ -669,6 +646,11 @@ namespace cicada
 
     active_chart_set_type  actives;
     passive_chart_type     passives;
+    passive_set_type       passive_arcs;
+
+    tails_map_type   tails_map;
+    tails_type       tails_extended;
+    feature_map_type features_map;
 
     node_map_type         node_map;
     closure_level_type    closure;
@@ -0,0 +1,712 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__COMPOSE_PHRASE_STACK__HPP__
+#define __CICADA__COMPOSE_PHRASE_STACK__HPP__ 1
+
+//
+// phrase-based stack decoding with the stateful feature functions scored immediately.
+//
+// Hypotheses are organized by stacks indexed by the number of covered lattice positions. A stack
+// is pruned by its histogram (size) and threshold (ratio to the best) by the hypothesis score
+// combined with the future cost estimate of its uncovered spans, then, the survivors are extended
+// into the succeeding stacks. Hypotheses with the same coverage and the same model state are
+// recombined. Only the survivors are kept in the resulting hypergraph, which shares the same
+// structure as the one by compose-phrase after apply, thus, downstream operations keep working.
+//
+
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+
+#include <cicada/symbol.hpp>
+#include <cicada/vocab.hpp>
+#include <cicada/lattice.hpp>
+#include <cicada/grammar.hpp>
+#include <cicada/transducer.hpp>
+#include <cicada/hypergraph.hpp>
+#include <cicada/model.hpp>
+#include <cicada/compose_phrase.hpp>
+
+#include <cicada/semiring/traits.hpp>
+
+#include <utils/chunk_vector.hpp>
+#include <utils/hashmurmur3.hpp>
+#include <utils/bit_vector.hpp>
+#include <utils/compact_map.hpp>
+#include <utils/compact_set.hpp>
+#include <utils/bithack.hpp>
+
+namespace cicada
+{
+  // implementation of
+  //
+  // @InProceedings{koehn:2004:AMTA,
+  //  author    = {Koehn, Philipp},
+  //  title     = {Pharaoh: A Beam Search Decoder for Phrase-Based Statistical Machine Translation Models},
+  //  booktitle = {Proceedings of the 6th Conference of the Association for Machine Translation in the Americas},
+  //  year      = {2004},
+  //  pages     = {115--124},
+  //  }
+  //
+
+  template <typename Semiring, typename Function>
+  struct ComposePhraseStack
+  {
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef Symbol symbol_type;
+    typedef Vocab  vocab_type;
+
+    typedef Lattice    lattice_type;
+    typedef Grammar    grammar_type;
+    typedef Transducer transducer_type;
+    typedef HyperGraph hypergraph_type;
+    typedef Model      model_type;
+
+    typedef hypergraph_type::id_type            id_type;
+    typedef hypergraph_type::node_type          node_type;
+    typedef hypergraph_type::edge_type          edge_type;
+    typedef hypergraph_type::feature_set_type   feature_set_type;
+    typedef hypergraph_type::attribute_set_type attribute_set_type;
+
+    typedef attribute_set_type::attribute_type attribute_type;
+
+    typedef hypergraph_type::rule_type     rule_type;
+    typedef hypergraph_type::rule_ptr_type rule_ptr_type;
+
+    typedef model_type::state_type     state_type;
+    typedef model_type::state_set_type state_set_type;
+
+    typedef Semiring semiring_type;
+    typedef Semiring score_type;
+
+    typedef Function function_type;
+
+    typedef ComposePhrase::coverage_type        coverage_type;
+    typedef ComposePhrase::coverage_set_type    coverage_set_type;
+    typedef ComposePhrase::span_node_type       span_node_type;
+    typedef ComposePhrase::span_node_unassigned span_node_unassigned;
+    typedef ComposePhrase::frontier_set_type    frontier_set_type;
+    typedef ComposePhrase::node_set_type        node_set_type;
+
+    // a phrase starting at a lattice position, and ending at last
+    struct Phrase
+    {
+      int        last;
+      id_type    node;
+      score_type score;
+      score_type estimate;
+
+      feature_set_type features;
+
+      Phrase(const int& __last, const id_type& __node, const score_type& __score, const score_type& __estimate, const feature_set_type& __features)
+	: last(__last), node(__node), score(__score), estimate(__estimate), features(__features) {}
+    };
+
+    typedef Phrase phrase_type;
+    typedef std::vector<phrase_type, std::allocator<phrase_type> > phrase_set_type;
+    typedef std::vector<phrase_set_type, std::allocator<phrase_set_type> > phrase_map_type;
+
+    // phrase nodes and their scores, shared by the lattice paths which derive the same span
+    typedef std::pair<id_type, score_type> phrase_node_type;
+    typedef std::vector<phrase_node_type, std::allocator<phrase_node_type> > phrase_node_set_type;
+    typedef std::pair<size_type, size_type> phrase_range_type;
+
+    typedef utils::compact_map<span_node_type, phrase_range_type,
+			       span_node_unassigned, span_node_unassigned,
+			       utils::hashmurmur3<size_t>, std::equal_to<span_node_type>,
+			       std::allocator<std::pair<const span_node_type, phrase_range_type> > > span_node_map_type;
+
+    // a state when traversing the transducers along the lattice
+    struct Span
+    {
+      int grammar_id;
+      transducer_type::id_type node;
+      int last;
+
+      feature_set_type features;
+
+      Span(const int& __grammar_id, const transducer_type::id_type& __node, const int& __last, const feature_set_type& __features)
+	: grammar_id(__grammar_id), node(__node), last(__last), features(__features) {}
+    };
+
+    typedef Span span_type;
+    typedef std::vector<span_type, std::allocator<span_type> > span_set_type;
+
+    typedef std::vector<edge_type, std::allocator<edge_type> > edge_set_type;
+
+    struct Hypothesis
+    {
+      const coverage_type* coverage;
+      state_type state;
+      score_type score;
+      score_type estimate;
+      id_type    node;
+
+      // incoming edges, which are added to the hypergraph only when survived
+      edge_set_type edges;
+
+      Hypothesis(const coverage_type* __coverage, const state_type& __state, const score_type& __score, const score_type& __estimate)
+	: coverage(__coverage), state(__state), score(__score), estimate(__estimate), node(hypergraph_type::invalid), edges() {}
+    };
+
+    typedef Hypothesis hypothesis_type;
+    typedef utils::chunk_vector<hypothesis_type, 4096 / sizeof(hypothesis_type), std::allocator<hypothesis_type> > hypothesis_set_type;
+
+    typedef std::vector<hypothesis_type*, std::allocator<hypothesis_type*> > stack_type;
+    typedef std::vector<stack_type, std::allocator<stack_type> > stack_set_type;
+
+    struct hypothesis_unassigned
+    {
+      hypothesis_type* operator()() const { return 0; }
+    };
+
+    struct hypothesis_hash_type : public utils::hashmurmur3<size_t>
+    {
+      hypothesis_hash_type(size_t __state_size) : state_hash(__state_size) {}
+
+      size_t operator()(const hypothesis_type* x) const
+      {
+	return (x == 0 ? size_t(0) : utils::hashmurmur3<size_t>::operator()(x->coverage, state_hash(x->state)));
+      }
+
+      model_type::state_hash state_hash;
+    };
+
+    struct hypothesis_equal_type
+    {
+      hypothesis_equal_type(size_t __state_size) : state_equal(__state_size) {}
+
+      bool operator()(const hypothesis_type* x, const hypothesis_type* y) const
+      {
+	return x == y || (x && y && x->coverage == y->coverage && state_equal(x->state, y->state));
+      }
+
+      model_type::state_equal state_equal;
+    };
+
+    typedef utils::compact_set<hypothesis_type*,
+			       hypothesis_unassigned, hypothesis_unassigned,
+			       hypothesis_hash_type, hypothesis_equal_type,
+			       std::allocator<hypothesis_type*> > recombination_type;
+    typedef std::vector<recombination_type, std::allocator<recombination_type> > recombination_set_type;
+
+    typedef std::vector<score_type, std::allocator<score_type> > future_cost_type;
+
+    struct compare_estimate_type
+    {
+      bool operator()(const hypothesis_type* x, const hypothesis_type* y) const
+      {
+	return x->estimate > y->estimate;
+      }
+    };
+
+    struct threshold_type
+    {
+      threshold_type(const score_type& __cutoff) : cutoff(__cutoff) {}
+
+      bool operator()(const hypothesis_type* x) const
+      {
+	return ! (x->estimate < cutoff);
+      }
+
+      score_type cutoff;
+    };
+
+    ComposePhraseStack(const symbol_type& non_terminal,
+		       const grammar_type& __grammar,
+		       const model_type& __model,
+		       const function_type& __function,
+		       const int& __stack_size,
+		       const double& __threshold,
+		       const int& __max_distortion,
+		       const bool __yield_source,
+		       const bool __frontier)
+      : grammar(__grammar),
+	model(__model),
+	function(__function),
+	stack_size(__stack_size),
+	threshold(__threshold),
+	max_distortion(__max_distortion),
+	yield_source(__yield_source),
+	frontier(__frontier),
+	attr_phrase_span_first("phrase-span-first"),
+	attr_phrase_span_last("phrase-span-last"),
+	attr_frontier_source(__frontier ? "frontier-source" : ""),
+        attr_frontier_target(__frontier ? "frontier-target" : "")
+    {
+      rule_goal = rule_type::create(rule_type(vocab_type::GOAL, rule_type::symbol_set_type(1, non_terminal.non_terminal(1))));
+
+      std::vector<symbol_type, std::allocator<symbol_type> > sequence(2);
+      sequence.front() = non_terminal.non_terminal(1);
+      sequence.back()  = non_terminal.non_terminal(2);
+
+      rule_x1_x2 = rule_type::create(rule_type(non_terminal.non_terminal(), sequence.begin(), sequence.end()));
+      rule_x1    = rule_type::create(rule_type(non_terminal.non_terminal(), sequence.begin(), sequence.begin() + 1));
+    }
+
+    void operator()(const lattice_type& lattice, hypergraph_type& graph)
+    {
+      graph.clear();
+
+      if (lattice.empty()) return;
+
+      const_cast<model_type&>(model).initialize();
+
+      const size_type lattice_size = lattice.size();
+
+      node_states.clear();
+      coverages.clear();
+      hypotheses.clear();
+
+      frontiers_source.clear();
+      frontiers_target.clear();
+
+      stacks.clear();
+      stacks.resize(lattice_size + 1);
+
+      recombinations.clear();
+      recombinations.resize(lattice_size + 1, recombination_type(8,
+								  hypothesis_hash_type(model.state_size()),
+								  hypothesis_equal_type(model.state_size())));
+
+      // phrases and their future costs
+      compose_phrases(lattice, graph);
+
+      compute_future_costs(lattice_size);
+
+      // the initial hypothesis, which is never added to the hypergraph
+      hypotheses.push_back(hypothesis_type(coverage_vector(coverage_type()).first,
+					   state_type(),
+					   semiring::traits<score_type>::one(),
+					   future_cost(0, lattice_size)));
+      stacks.front().push_back(&hypotheses.back());
+
+      for (size_type covered = 0; covered != lattice_size; ++ covered) {
+	if (covered)
+	  prune(covered, graph);
+
+	typename stack_type::const_iterator siter_end = stacks[covered].end();
+	for (typename stack_type::const_iterator siter = stacks[covered].begin(); siter != siter_end; ++ siter)
+	  extend(*(*siter), covered, lattice, graph);
+
+	stack_type().swap(stacks[covered]);
+      }
+
+      prune(lattice_size, graph);
+
+      // finally, the goal...
+      const stack_type& stack_goal = stacks.back();
+
+      typename stack_type::const_iterator siter_end = stack_goal.end();
+      for (typename stack_type::const_iterator siter = stack_goal.begin(); siter != siter_end; ++ siter) {
+	edge_type edge(&((*siter)->node), &((*siter)->node) + 1);
+	edge.rule = rule_goal;
+
+	const state_type state = model.apply(node_states, edge, edge.features, true);
+
+	if (graph.goal == hypergraph_type::invalid) {
+	  graph.goal = graph.add_node().id;
+	  node_states.push_back(state);
+	} else
+	  model.deallocate(state);
+
+	edge_type& edge_goal = graph.add_edge(edge);
+
+	graph.connect_edge(edge_goal.id, graph.goal);
+      }
+
+      // unused phrases are not reachable from the goal, and removed
+      if (graph.goal != hypergraph_type::invalid)
+	graph.topologically_sort();
+      else
+	graph.clear();
+
+      const_cast<model_type&>(model).initialize();
+    }
+
+  private:
+    // traverse the transducers from each lattice position, and collect phrases together with
+    // their nodes in the hypergraph, which are scored by the model without antecedents.
+    void compose_phrases(const lattice_type& lattice, hypergraph_type& graph)
+    {
+      const size_type lattice_size = lattice.size();
+
+      phrases.clear();
+      phrases.resize(lattice_size);
+
+      phrase_nodes.clear();
+      span_nodes.clear();
+
+      for (size_type first = 0; first != lattice_size; ++ first) {
+	spans.clear();
+
+	for (size_t table = 0; table != grammar.size(); ++ table)
+	  spans.push_back(span_type(table, grammar[table].root(), first, feature_set_type()));
+
+	for (size_type pos = 0; pos != spans.size(); ++ pos) {
+	  // copy, since spans may be reallocated
+	  const span_type span = spans[pos];
+
+	  const transducer_type& transducer = grammar[span.grammar_id];
+	  const transducer_type::rule_pair_set_type& rules = transducer.rules(span.node);
+
+	  if (! rules.empty() && span.last != static_cast<int>(first)) {
+	    const phrase_range_type range = phrase_node(span.grammar_id, span.node, first, span.last, rules, graph);
+
+	    const score_type score_arcs = function(span.features);
+
+	    for (size_type i = range.first; i != range.second; ++ i)
+	      phrases[first].push_back(phrase_type(span.last,
+						   phrase_nodes[i].first,
+						   phrase_nodes[i].second,
+						   phrase_nodes[i].second * score_arcs,
+						   span.features));
+	  }
+
+	  if (span.last == static_cast<int>(lattice_size)) continue;
+
+	  lattice_type::arc_set_type::const_iterator aiter_end = lattice[span.last].end();
+	  for (lattice_type::arc_set_type::const_iterator aiter = lattice[span.last].begin(); aiter != aiter_end; ++ aiter) {
+	    if (aiter->label == vocab_type::EPSILON)
+	      spans.push_back(span_type(span.grammar_id, span.node, span.last + aiter->distance, span.features + aiter->features));
+	    else {
+	      const transducer_type::id_type node = transducer.next(span.node, aiter->label);
+	      if (node == transducer.root()) continue;
+
+	      spans.push_back(span_type(span.grammar_id, node, span.last + aiter->distance, span.features + aiter->features));
+	    }
+	  }
+	}
+      }
+    }
+
+    phrase_range_type phrase_node(const int grammar_id,
+				  const transducer_type::id_type& node_transducer,
+				  const int first,
+				  const int last,
+				  const transducer_type::rule_pair_set_type& rules,
+				  hypergraph_type& graph)
+    {
+      std::pair<typename span_node_map_type::iterator, bool> result = span_nodes.insert(std::make_pair(span_node_type(grammar_id, node_transducer, first, last),
+												       phrase_range_type(0, 0)));
+      if (! result.second)
+	return result.first->second;
+
+      result.first->second.first = phrase_nodes.size();
+
+      transducer_type::rule_pair_set_type::const_iterator riter_end = rules.end();
+      for (transducer_type::rule_pair_set_type::const_iterator riter = rules.begin(); riter != riter_end; ++ riter) {
+	edge_type edge;
+	edge.rule = (yield_source ? riter->source : riter->target);
+	edge.features = riter->features;
+	edge.attributes = riter->attributes;
+
+	edge.attributes[attr_phrase_span_first] = attribute_set_type::int_type(first);
+	edge.attributes[attr_phrase_span_last]  = attribute_set_type::int_type(last);
+
+	if (frontier) {
+	  if (riter->source)
+	    edge.attributes[attr_frontier_source] = frontier_string(riter->source, frontiers_source);
+	  if (riter->target)
+	    edge.attributes[attr_frontier_target] = frontier_string(riter->target, frontiers_target);
+	}
+
+	// each rule has its own node, since the model state differs by the rule
+	const state_type state = model.apply(node_states, edge, edge.features, false);
+
+	const id_type node_id = graph.add_node().id;
+	node_states.push_back(state);
+
+	edge_type& edge_phrase = graph.add_edge(edge);
+	graph.connect_edge(edge_phrase.id, node_id);
+
+	phrase_nodes.push_back(phrase_node_type(node_id, function(edge_phrase.features)));
+      }
+
+      result.first->second.second = phrase_nodes.size();
+
+      return result.first->second;
+    }
+
+    const std::string& frontier_string(const rule_ptr_type& rule, frontier_set_type& frontiers)
+    {
+      typename frontier_set_type::iterator fiter = frontiers.find(rule);
+      if (fiter == frontiers.end()) {
+	std::ostringstream os;
+	os << rule->rhs;
+
+	fiter = frontiers.insert(std::make_pair(rule, os.str())).first;
+      }
+      return fiter->second;
+    }
+
+    // future cost for the span [first, last) by the best phrase scores, combined over the
+    // segmentations of the span.
+    void compute_future_costs(const size_type lattice_size)
+    {
+      future_costs.clear();
+      future_costs.resize((lattice_size + 1) * (lattice_size + 1), semiring::traits<score_type>::zero());
+
+      for (size_type first = 0; first != lattice_size; ++ first) {
+	typename phrase_set_type::const_iterator piter_end = phrases[first].end();
+	for (typename phrase_set_type::const_iterator piter = phrases[first].begin(); piter != piter_end; ++ piter) {
+	  score_type& cost = future_cost(first, piter->last);
+
+	  cost = std::max(cost, piter->estimate);
+	}
+      }
+
+      for (size_type length = 2; length <= lattice_size; ++ length)
+	for (size_type first = 0; first + length <= lattice_size; ++ first) {
+	  const size_type last = first + length;
+
+	  score_type& cost = future_cost(first, last);
+
+	  for (size_type middle = first + 1; middle != last; ++ middle)
+	    cost = std::max(cost, future_cost(first, middle) * future_cost(middle, last));
+	}
+    }
+
+    score_type& future_cost(const size_type first, const size_type last)
+    {
+      return future_costs[first * (stacks.size()) + last];
+    }
+
+    score_type future_cost_uncovered(const coverage_type& coverage, const size_type lattice_size)
+    {
+      score_type cost = semiring::traits<score_type>::one();
+
+      size_type first = 0;
+      while (first != lattice_size) {
+	if (coverage.test(first)) {
+	  ++ first;
+	  continue;
+	}
+
+	size_type last = first + 1;
+	while (last != lattice_size && ! coverage.test(last))
+	  ++ last;
+
+	cost *= future_cost(first, last);
+
+	first = last;
+      }
+
+      return cost;
+    }
+
+    // extend a hypothesis by the phrases within the distortion limit from the first uncovered position
+    void extend(const hypothesis_type& hyp, const size_type covered, const lattice_type& lattice, hypergraph_type& graph)
+    {
+      const size_type lattice_size = lattice.size();
+      const coverage_type& coverage = *hyp.coverage;
+
+      const int first = coverage.select(1, false);
+      const int last  = utils::bithack::min(static_cast<int>(lattice_size), first + max_distortion + 1);
+
+      coverage_type visited;
+      node_set_type& nodes = nodes_local;
+      node_set_type& nodes_next = nodes_local_next;
+
+      nodes.clear();
+      nodes_next.clear();
+
+      nodes.push_back(first);
+      visited.set(first);
+
+      for (int i = first; i != last && ! nodes.empty(); ++ i) {
+	nodes_next.clear();
+
+	node_set_type::const_iterator niter_end = nodes.end();
+	for (node_set_type::const_iterator niter = nodes.begin(); niter != niter_end; ++ niter) {
+	  if (! coverage.test(*niter)) {
+	    const size_type rank_first = (*niter == 0 ? size_type(0) : coverage.rank(*niter - 1, true));
+
+	    typename phrase_set_type::const_iterator piter_end = phrases[*niter].end();
+	    for (typename phrase_set_type::const_iterator piter = phrases[*niter].begin(); piter != piter_end; ++ piter)
+	      if (coverage.rank(piter->last - 1, true) == rank_first)
+		extend(hyp, covered, *niter, *piter, lattice_size, graph);
+	  }
+
+	  lattice_type::arc_set_type::const_iterator aiter_end = lattice[*niter].end();
+	  for (lattice_type::arc_set_type::const_iterator aiter = lattice[*niter].begin(); aiter != aiter_end; ++ aiter) {
+	    const int next = *niter + aiter->distance;
+
+	    if (next != static_cast<int>(lattice_size) && ! visited[next]) {
+	      nodes_next.push_back(next);
+	      visited.set(next);
+	    }
+	  }
+	}
+
+	nodes.swap(nodes_next);
+      }
+    }
+
+    void extend(const hypothesis_type& hyp,
+		const size_type covered,
+		const int first,
+		const phrase_type& phrase,
+		const size_type lattice_size,
+		hypergraph_type& graph)
+    {
+      coverage_type __coverage_new = *hyp.coverage;
+      for (int i = first; i != phrase.last; ++ i)
+	__coverage_new.set(i);
+
+      const coverage_type* coverage_new = coverage_vector(__coverage_new).first;
+      const size_type covered_new = covered + (phrase.last - first);
+
+      edge_type edge;
+      if (hyp.node == hypergraph_type::invalid) {
+	edge.tails = edge_type::node_set_type(1, phrase.node);
+	edge.rule = rule_x1;
+      } else {
+	const id_type tails[2] = {hyp.node, phrase.node};
+	edge.tails = edge_type::node_set_type(tails, tails + 2);
+	edge.rule = rule_x1_x2;
+      }
+      edge.features = phrase.features;
+
+      const state_type state = model.apply(node_states, edge, edge.features, false);
+      const score_type score = hyp.score * phrase.score * function(edge.features);
+
+      hypotheses.push_back(hypothesis_type(coverage_new, state, score, score));
+
+      hypothesis_type* hyp_new = &hypotheses.back();
+
+      std::pair<typename recombination_type::iterator, bool> result = recombinations[covered_new].insert(hyp_new);
+
+      if (result.second) {
+	hyp_new->estimate = score * future_cost_uncovered(*coverage_new, lattice_size);
+	hyp_new->edges.push_back(edge);
+
+	stacks[covered_new].push_back(hyp_new);
+      } else {
+	model.deallocate(state);
+	hypotheses.pop_back();
+
+	hypothesis_type& hyp_prev = *(*result.first);
+
+	hyp_prev.edges.push_back(edge);
+
+	if (score > hyp_prev.score) {
+	  hyp_prev.score    = score;
+	  hyp_prev.estimate = score * future_cost_uncovered(*coverage_new, lattice_size);
+	}
+      }
+    }
+
+    // histogram and threshold pruning of a stack. The survivors are added to the hypergraph.
+    void prune(const size_type covered, hypergraph_type& graph)
+    {
+      stack_type& stack = stacks[covered];
+
+      recombination_type(8, hypothesis_hash_type(model.state_size()), hypothesis_equal_type(model.state_size())).swap(recombinations[covered]);
+
+      if (stack.empty()) return;
+
+      typename stack_type::iterator siter_last = stack.end();
+
+      if (stack_size > 0 && stack.size() > static_cast<size_type>(stack_size)) {
+	siter_last = stack.begin() + stack_size;
+
+	std::nth_element(stack.begin(), siter_last, stack.end(), compare_estimate_type());
+      }
+
+      if (threshold > 0.0) {
+	const score_type best = (*std::min_element(stack.begin(), siter_last, compare_estimate_type()))->estimate;
+	const score_type cutoff = best * semiring::traits<score_type>::exp(std::log(threshold));
+
+	siter_last = std::partition(stack.begin(), siter_last, threshold_type(cutoff));
+      }
+
+      for (typename stack_type::iterator siter = stack.begin(); siter != siter_last; ++ siter) {
+	hypothesis_type& hyp = *(*siter);
+
+	hyp.node = graph.add_node().id;
+	node_states.push_back(hyp.state);
+
+	typename edge_set_type::const_iterator eiter_end = hyp.edges.end();
+	for (typename edge_set_type::const_iterator eiter = hyp.edges.begin(); eiter != eiter_end; ++ eiter) {
+	  edge_type& edge = graph.add_edge(*eiter);
+
+	  graph.connect_edge(edge.id, hyp.node);
+	}
+
+	edge_set_type().swap(hyp.edges);
+      }
+
+      for (typename stack_type::iterator siter = siter_last; siter != stack.end(); ++ siter) {
+	model.deallocate((*siter)->state);
+
+	edge_set_type().swap((*siter)->edges);
+      }
+
+      stack.erase(siter_last, stack.end());
+    }
+
+    std::pair<const coverage_type*, bool> coverage_vector(const coverage_type& coverage)
+    {
+      std::pair<coverage_set_type::iterator, bool> result = coverages.insert(coverage);
+
+      return std::make_pair(&(*result.first), result.second);
+    }
+
+  private:
+    const grammar_type&  grammar;
+    const model_type&    model;
+    const function_type& function;
+
+    const int    stack_size;
+    const double threshold;
+    const int    max_distortion;
+    const bool   yield_source;
+    const bool   frontier;
+
+    const attribute_type attr_phrase_span_first;
+    const attribute_type attr_phrase_span_last;
+    const attribute_type attr_frontier_source;
+    const attribute_type attr_frontier_target;
+
+    state_set_type      node_states;
+    coverage_set_type   coverages;
+    hypothesis_set_type hypotheses;
+
+    stack_set_type         stacks;
+    recombination_set_type recombinations;
+
+    phrase_map_type      phrases;
+    phrase_node_set_type phrase_nodes;
+    span_node_map_type   span_nodes;
+    span_set_type        spans;
+    future_cost_type     future_costs;
+
+    node_set_type nodes_local;
+    node_set_type nodes_local_next;
+
+    rule_ptr_type rule_goal;
+    rule_ptr_type rule_x1_x2;
+    rule_ptr_type rule_x1;
+
+    frontier_set_type frontiers_source;
+    frontier_set_type frontiers_target;
+  };
+
+  template <typename Function>
+  inline
+  void compose_phrase_stack(const Symbol& non_terminal, const Grammar& grammar, const Model& model, const Function& function, const int stack_size, const double threshold, const int max_distortion, const Lattice& lattice, HyperGraph& graph, const bool yield_source=false, const bool frontier=false)
+  {
+    ComposePhraseStack<typename Function::value_type, Function> __composer(non_terminal, grammar, model, function, stack_size, threshold, max_distortion, yield_source, frontier);
+    __composer(lattice, graph);
+  }
+
+};
+
+#endif
@@ -0,0 +1,277 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of words] [distortion] [stack size] [threshold] [exhaustive]
+//
+// phrase-based stack decoding vs. compose-phrase followed by apply, with a toy target bigram feature.
+// Without pruning (stack size 0 and threshold 0), the viterbi derivations by the stack decoding must
+// score the same as those by compose-phrase + apply-exact over small random lattices. Then, we report
+// the time and memory by the pruned stack decoding over a long input with a large distortion limit,
+// or by compose-phrase + apply-exact when exhaustive, run separately so that the max rss is its own.
+//
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/random.hpp>
+
+#include "compose_phrase.hpp"
+#include "compose_phrase_stack.hpp"
+#include "apply_exact.hpp"
+#include "viterbi.hpp"
+#include "grammar.hpp"
+#include "grammar_mutable.hpp"
+#include "hypergraph.hpp"
+#include "lattice.hpp"
+#include "sentence.hpp"
+#include "model.hpp"
+#include "feature_function.hpp"
+#include "semiring.hpp"
+
+#include "operation/functional.hpp"
+#include "operation/traversal.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/malloc_stats.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::HyperGraph      hypergraph_type;
+typedef cicada::Lattice         lattice_type;
+typedef cicada::Sentence        sentence_type;
+typedef cicada::Grammar         grammar_type;
+typedef cicada::GrammarMutable  grammar_mutable_type;
+typedef cicada::Model           model_type;
+typedef cicada::FeatureFunction feature_function_type;
+typedef cicada::Symbol          symbol_type;
+
+typedef cicada::semiring::Logprob<double> weight_type;
+typedef cicada::operation::weight_function<weight_type> function_type;
+
+// remember the leftmost and the rightmost words, and score the adjacent target word pairs
+struct Bigram : public feature_function_type
+{
+  typedef cicada::Symbol::id_type id_type;
+
+  Bigram() : feature_function_type(sizeof(id_type) * 2, "bigram") {}
+
+  void apply(state_ptr_type& state,
+	     const state_ptr_set_type& states,
+	     const edge_type& edge,
+	     feature_set_type& features,
+	     const bool final) const
+  {
+    id_type* context = reinterpret_cast<id_type*>(state);
+
+    context[0] = id_type(-1);
+    context[1] = id_type(-1);
+
+    double score = 0.0;
+    int non_terminal_pos = 0;
+
+    rule_type::symbol_set_type::const_iterator riter_end = edge.rule->rhs.end();
+    for (rule_type::symbol_set_type::const_iterator riter = edge.rule->rhs.begin(); riter != riter_end; ++ riter) {
+      id_type first = riter->id();
+      id_type last  = riter->id();
+
+      if (riter->is_non_terminal()) {
+	const int __non_terminal_index = riter->non_terminal_index() - 1;
+	const int antecedent_index = utils::bithack::branch(__non_terminal_index < 0, non_terminal_pos, __non_terminal_index);
+	++ non_terminal_pos;
+
+	const id_type* antecedent = reinterpret_cast<const id_type*>(states[antecedent_index]);
+
+	first = antecedent[0];
+	last  = antecedent[1];
+      }
+
+      if (context[1] != id_type(-1))
+	score += pair(context[1], first);
+      else
+	context[0] = first;
+
+      context[1] = last;
+    }
+
+    if (final)
+      score += pair(id_type(-1), context[0]) + pair(context[1], id_type(-1));
+
+    features[feature_name()] = score;
+  }
+
+  void apply_coarse(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+  void apply_predict(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+  void apply_scan(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, const int dot, feature_set_type& features, const bool final) const {}
+  void apply_complete(state_ptr_type& state, const state_ptr_set_type& states, const edge_type& edge, feature_set_type& features, const bool final) const {}
+
+  feature_function_ptr_type clone() const { return feature_function_ptr_type(new Bigram(*this)); }
+
+  static double pair(const id_type prev, const id_type next)
+  {
+    return - double((size_t(prev) * 2654435761u + size_t(next) * 40503u) % 1024) / 1024.0;
+  }
+};
+
+// a random sentence of size words, and the phrases of up to three words, each with two translations
+void generate(const int size, boost::mt19937& generator, sentence_type& sentence, grammar_type& grammar)
+{
+  boost::random::uniform_int_distribution<int>     word(0, 49);
+  boost::random::uniform_real_distribution<double> score(-2.0, 0.0);
+
+  sentence.clear();
+  for (int i = 0; i != size; ++ i)
+    sentence.push_back("s" + utils::lexical_cast<std::string>(word(generator)));
+
+  boost::shared_ptr<grammar_mutable_type> phrases(new grammar_mutable_type());
+
+  for (int first = 0; first != size; ++ first)
+    for (int last = first + 1; last <= std::min(first + 3, size); ++ last)
+      for (int k = 0; k != 2; ++ k) {
+	std::ostringstream os;
+
+	os << "[x] |||";
+	for (int i = first; i != last; ++ i)
+	  os << ' ' << sentence[i];
+	os << " |||";
+	for (int i = first; i != last; ++ i)
+	  os << " t" << sentence[i].id() << '_' << k;
+	os << " ||| phrase=" << score(generator);
+
+	phrases->insert(os.str());
+      }
+
+  grammar.clear();
+  grammar.push_back(phrases);
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const int words      = (argc > 1 ? utils::lexical_cast<int>(argv[1]) : 60);
+    const int distortion = (argc > 2 ? utils::lexical_cast<int>(argv[2]) : 8);
+    const int stack_size = (argc > 3 ? utils::lexical_cast<int>(argv[3]) : 100);
+    const double threshold = (argc > 4 ? utils::lexical_cast<double>(argv[4]) : 0.0);
+    const bool exhaustive  = (argc > 5 ? utils::lexical_cast<bool>(argv[5]) : false);
+
+    const symbol_type goal("[x]");
+
+    model_type model(feature_function_type::feature_function_ptr_type(new Bigram()));
+
+    cicada::WeightVector<double> weights;
+    weights[cicada::Feature("bigram")] = 1.0;
+    weights[cicada::Feature("phrase")] = 1.0;
+
+    const function_type function(weights);
+
+    boost::mt19937 generator;
+
+    // exactness without pruning
+    {
+      size_t num_lattice = 0;
+      size_t num_diff = 0;
+
+      for (int size = 2; size <= 7; ++ size)
+	for (int dist = 0; dist <= 3; ++ dist)
+	  for (int trial = 0; trial != 4; ++ trial, ++ num_lattice) {
+	    sentence_type sentence;
+	    grammar_type  grammar;
+
+	    generate(size, generator, sentence, grammar);
+
+	    const lattice_type lattice(sentence);
+
+	    hypergraph_type composed;
+	    hypergraph_type applied;
+	    hypergraph_type stacked;
+
+	    cicada::compose_phrase(goal, grammar, dist, lattice, composed);
+	    cicada::apply_exact(model, composed, applied);
+
+	    cicada::compose_phrase_stack(goal, grammar, model, function, 0, 0.0, dist, lattice, stacked);
+
+	    sentence_type yield_applied;
+	    sentence_type yield_stacked;
+	    weight_type   weight_applied;
+	    weight_type   weight_stacked;
+
+	    cicada::viterbi(applied, yield_applied, weight_applied, cicada::operation::sentence_traversal(), function);
+	    cicada::viterbi(stacked, yield_stacked, weight_stacked, cicada::operation::sentence_traversal(), function);
+
+	    const double logprob_applied = cicada::semiring::log(weight_applied);
+	    const double logprob_stacked = cicada::semiring::log(weight_stacked);
+
+	    if (! (std::fabs(logprob_applied - logprob_stacked) <= 1e-9 * std::max(1.0, std::fabs(logprob_applied)))) {
+	      ++ num_diff;
+
+	      std::cerr << "different: words=" << size << " distortion=" << dist
+			<< " compose+apply=" << logprob_applied << " " << yield_applied
+			<< " stack=" << logprob_stacked << " " << yield_stacked
+			<< std::endl;
+	    }
+	  }
+
+      std::cout << "exact: lattices: " << num_lattice << " different: " << num_diff << std::endl;
+
+      if (num_diff)
+	return 1;
+    }
+
+    // the pruned stack decoding, or compose-phrase + apply-exact when exhaustive, over a long input
+    {
+      sentence_type sentence;
+      grammar_type  grammar;
+
+      generate(words, generator, sentence, grammar);
+
+      const lattice_type lattice(sentence);
+
+      hypergraph_type composed;
+      hypergraph_type applied;
+
+      const size_t used_start = utils::malloc_stats::used();
+      utils::resource start;
+
+      if (exhaustive) {
+	cicada::compose_phrase(goal, grammar, distortion, lattice, composed);
+	cicada::apply_exact(model, composed, applied);
+      } else
+	cicada::compose_phrase_stack(goal, grammar, model, function, stack_size, threshold, distortion, lattice, applied);
+
+      utils::resource end;
+      const size_t used_end = utils::malloc_stats::used();
+
+      sentence_type yield;
+      weight_type   weight;
+
+      cicada::viterbi(applied, yield, weight, cicada::operation::sentence_traversal(), function);
+
+      struct rusage usage;
+      ::getrusage(RUSAGE_SELF, &usage);
+
+      std::cout << (exhaustive ? "compose+apply:" : "stack:")
+		<< " words: " << words << " distortion: " << distortion;
+      if (exhaustive)
+	std::cout << " composed nodes: " << composed.nodes.size() << " edges: " << composed.edges.size();
+      else
+	std::cout << " size: " << stack_size << " threshold: " << threshold;
+      std::cout << " nodes: " << applied.nodes.size() << " edges: " << applied.edges.size()
+		<< " cpu: " << (end.cpu_time() - start.cpu_time())
+		<< " user: " << (end.user_time() - start.user_time())
+		<< " memory: " << (used_end > used_start ? used_end - used_start : size_t(0))
+		<< " max-rss: " << usage.ru_maxrss << "k"
+		<< " viterbi: " << cicada::semiring::log(weight)
+		<< std::endl;
+    }
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
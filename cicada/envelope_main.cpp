@@ -0,0 +1,259 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// line search over forests from stdin, as performed by cicada_mert: compute the upper envelope
+// along random directions, and recover the yield of each line. We compare the shared_ptr based
+// Envelope with the arena based EnvelopeArena, which should produce identical lines and yields.
+//
+// As a regression check of the envelopes themselves, the x of each line of a goal envelope should
+// be the intersection with its preceding line, and the line should score the viterbi derivation
+// computed independently at a point between its x and the next x. Envelopes which took -inf for
+// the lines multiplied by a single edge line violate both.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#include <boost/random.hpp>
+
+#include "hypergraph.hpp"
+#include "inside_outside.hpp"
+#include "weight_vector.hpp"
+#include "sentence.hpp"
+#include "dot_product.hpp"
+
+#include "semiring/envelope.hpp"
+#include "semiring/envelope_arena.hpp"
+
+#include "operation/traversal.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/getline.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::HyperGraph hypergraph_type;
+typedef cicada::Sentence   sentence_type;
+typedef cicada::WeightVector<double> weight_set_type;
+
+typedef std::vector<hypergraph_type, std::allocator<hypergraph_type> > hypergraph_set_type;
+typedef std::vector<weight_set_type, std::allocator<weight_set_type> > weight_set_set_type;
+
+// each line of the goal envelopes
+struct point_type
+{
+  point_type(const double& __x, const double& __m, const double& __y, const sentence_type& __yield)
+    : x(__x), m(__m), y(__y), yield(__yield) {}
+  
+  double x;
+  double m;
+  double y;
+  sentence_type yield;
+  
+  friend
+  bool operator==(const point_type& a, const point_type& b)
+  {
+    return a.x == b.x && a.m == b.m && a.y == b.y && a.yield == b.yield;
+  }
+  
+  friend
+  bool operator!=(const point_type& a, const point_type& b)
+  {
+    return ! (a == b);
+  }
+};
+typedef std::vector<point_type, std::allocator<point_type> > point_set_type;
+
+// the best derivation score under origin + gamma * direction, by the max-plus over the topologically sorted forest
+double viterbi(const hypergraph_type& graph, const weight_set_type& origin, const weight_set_type& direction, const double& gamma)
+{
+  std::vector<double, std::allocator<double> > scores(graph.nodes.size(), - std::numeric_limits<double>::infinity());
+  
+  hypergraph_type::node_set_type::const_iterator niter_end = graph.nodes.end();
+  for (hypergraph_type::node_set_type::const_iterator niter = graph.nodes.begin(); niter != niter_end; ++ niter) {
+    const hypergraph_type::node_type& node = *niter;
+    
+    hypergraph_type::node_type::edge_set_type::const_iterator eiter_end = node.edges.end();
+    for (hypergraph_type::node_type::edge_set_type::const_iterator eiter = node.edges.begin(); eiter != eiter_end; ++ eiter) {
+      const hypergraph_type::edge_type& edge = graph.edges[*eiter];
+      
+      double score = cicada::dot_product(edge.features, origin) + gamma * cicada::dot_product(edge.features, direction);
+      
+      hypergraph_type::edge_type::node_set_type::const_iterator titer_end = edge.tails.end();
+      for (hypergraph_type::edge_type::node_set_type::const_iterator titer = edge.tails.begin(); titer != titer_end; ++ titer)
+	score += scores[*titer];
+      
+      scores[node.id] = std::max(scores[node.id], score);
+    }
+  }
+  
+  return scores[graph.goal];
+}
+
+// the number of lines of a goal envelope which violate either 1) x is the intersection with the
+// preceding line, or 2) the line scores the viterbi derivation at a point of its interval.
+size_t verify(const hypergraph_type& graph, const weight_set_type& origin, const weight_set_type& direction,
+	      point_set_type::const_iterator first, point_set_type::const_iterator last)
+{
+  size_t violated = 0;
+  
+  for (point_set_type::const_iterator iter = first; iter != last; ++ iter) {
+    if (iter == first)
+      violated += (iter->x != - std::numeric_limits<double>::infinity());
+    else {
+      const double x = ((iter - 1)->y - iter->y) / (iter->m - (iter - 1)->m);
+      
+      violated += (! (std::fabs(iter->x - x) <= 1e-9 * std::max(1.0, std::fabs(x))) || ! ((iter - 1)->x < iter->x));
+    }
+    
+    const double lower = (iter == first ? - std::numeric_limits<double>::infinity() : iter->x);
+    const double upper = (iter + 1 == last ? std::numeric_limits<double>::infinity() : (iter + 1)->x);
+    
+    double gamma = 0.0;
+    if (lower == - std::numeric_limits<double>::infinity())
+      gamma = (upper == std::numeric_limits<double>::infinity() ? 0.0 : upper - 1.0);
+    else
+      gamma = (upper == std::numeric_limits<double>::infinity() ? lower + 1.0 : 0.5 * (lower + upper));
+    
+    const double score = iter->m * gamma + iter->y;
+    const double best = viterbi(graph, origin, direction, gamma);
+    
+    violated += ! (std::fabs(score - best) <= 1e-9 * std::max(1.0, std::fabs(best)));
+  }
+  
+  return violated;
+}
+
+void envelope(const hypergraph_set_type& graphs, const weight_set_type& origin, const weight_set_type& direction, point_set_type& points, size_t& violated)
+{
+  typedef cicada::semiring::Envelope envelope_type;
+  typedef std::vector<envelope_type, std::allocator<envelope_type> > envelope_set_type;
+
+  envelope_set_type envelopes;
+
+  for (size_t seg = 0; seg != graphs.size(); ++ seg) {
+    envelopes.clear();
+    envelopes.resize(graphs[seg].nodes.size());
+
+    cicada::inside(graphs[seg], envelopes, cicada::semiring::EnvelopeFunction<weight_set_type>(origin, direction));
+
+    envelope_type& envelope = envelopes[graphs[seg].goal];
+    envelope.sort();
+
+    const size_t first = points.size();
+
+    envelope_type::const_iterator eiter_end = envelope.end();
+    for (envelope_type::const_iterator eiter = envelope.begin(); eiter != eiter_end; ++ eiter)
+      points.push_back(point_type((*eiter)->x, (*eiter)->m, (*eiter)->y, (*eiter)->yield(cicada::operation::sentence_traversal())));
+
+    violated += verify(graphs[seg], origin, direction, points.begin() + first, points.end());
+  }
+}
+
+void envelope_arena(const hypergraph_set_type& graphs, const weight_set_type& origin, const weight_set_type& direction, point_set_type& points, size_t& violated)
+{
+  typedef cicada::semiring::EnvelopeArena envelope_type;
+  typedef std::vector<envelope_type, std::allocator<envelope_type> > envelope_set_type;
+
+  envelope_type::arena_type arena;
+  envelope_set_type envelopes;
+
+  for (size_t seg = 0; seg != graphs.size(); ++ seg) {
+    arena.clear();
+    envelopes.clear();
+    envelopes.resize(graphs[seg].nodes.size());
+
+    cicada::inside(graphs[seg], envelopes, cicada::semiring::EnvelopeArenaFunction<weight_set_type>(arena, origin, direction));
+
+    envelope_type& envelope = envelopes[graphs[seg].goal];
+    envelope.sort();
+
+    const size_t first = points.size();
+
+    envelope_type::const_iterator eiter_end = envelope.end();
+    for (envelope_type::const_iterator eiter = envelope.begin(); eiter != eiter_end; ++ eiter)
+      points.push_back(point_type(arena[*eiter].x, arena[*eiter].m, arena[*eiter].y, arena.yield(*eiter, cicada::operation::sentence_traversal())));
+
+    violated += verify(graphs[seg], origin, direction, points.begin() + first, points.end());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const int directions = (argc > 1 ? utils::lexical_cast<int>(argv[1]) : 10);
+
+    hypergraph_set_type graphs;
+
+    std::string line;
+    while (utils::getline(std::cin, line))
+      if (! line.empty()) {
+	graphs.push_back(hypergraph_type());
+	graphs.back().assign(line);
+
+	if (! graphs.back().is_valid())
+	  graphs.pop_back();
+      }
+
+    // random origin and directions over the features in the forests
+    boost::mt19937 generator;
+    boost::random::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    weight_set_type origin;
+    weight_set_set_type direction(directions);
+
+    for (size_t seg = 0; seg != graphs.size(); ++ seg) {
+      hypergraph_type::edge_set_type::const_iterator eiter_end = graphs[seg].edges.end();
+      for (hypergraph_type::edge_set_type::const_iterator eiter = graphs[seg].edges.begin(); eiter != eiter_end; ++ eiter) {
+	hypergraph_type::feature_set_type::const_iterator fiter_end = eiter->features.end();
+	for (hypergraph_type::feature_set_type::const_iterator fiter = eiter->features.begin(); fiter != fiter_end; ++ fiter)
+	  if (origin[fiter->first] == 0.0) {
+	    origin[fiter->first] = uniform(generator);
+
+	    for (int i = 0; i != directions; ++ i)
+	      direction[i][fiter->first] = uniform(generator);
+	  }
+      }
+    }
+
+    point_set_type points;
+    point_set_type points_arena;
+    size_t violated = 0;
+    size_t violated_arena = 0;
+
+    utils::resource start;
+    for (int i = 0; i != directions; ++ i)
+      envelope(graphs, origin, direction[i], points, violated);
+    utils::resource end;
+
+    utils::resource start_arena;
+    for (int i = 0; i != directions; ++ i)
+      envelope_arena(graphs, origin, direction[i], points_arena, violated_arena);
+    utils::resource end_arena;
+
+    std::cout << "forests: " << graphs.size()
+	      << " directions: " << directions
+	      << " lines: " << points.size()
+	      << std::endl;
+    std::cout << "envelope: " << (end.cpu_time() - start.cpu_time()) << " cpu "
+	      << (end.user_time() - start.user_time()) << " user"
+	      << " violated: " << violated
+	      << std::endl;
+    std::cout << "arena:    " << (end_arena.cpu_time() - start_arena.cpu_time()) << " cpu "
+	      << (end_arena.user_time() - start_arena.user_time()) << " user"
+	      << " violated: " << violated_arena
+	      << " different: " << (points != points_arena)
+	      << std::endl;
+    
+    if (violated || violated_arena || points != points_arena)
+      return 1;
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
@@ -5,15 +5,15 @@
 #include "decode.hpp"
 #include "encode.hpp"
  
+#include <stdint.h>
+
 #include <algorithm>
-#include <set>
 #include <iterator>
 
 #include "ter.hpp"
 
 #include <boost/functional/hash.hpp>
 
-#include <utils/compact_set.hpp>
 #include <utils/vector2.hpp>
 #include <utils/unordered_map.hpp>
 #include <utils/bithack.hpp>
@@ -141,6 +141,20 @@ namespace cicada
     };
         
     // Do we really implement this...???
+    //
+    // Everything which depends only on the reference is computed once in the constructor, and shared
+    // by all the hypotheses scored against the reference:
+    //
+    // - the reference words are mapped into "rows" and a hypothesis is represented by the rows of its words,
+    //   with zero for the words not in the reference.
+    // - the n-grams of the reference, up to max_shift_size, are indexed by a trie over rows, of which node
+    //   keeps the starting positions of the n-gram in the reference.
+    // - the match vectors of the rows for the bit-parallel edit distance (Myers 1999, Hyyro 2001), one bit
+    //   for each reference position, split into 64-bit blocks.
+    //
+    // When the edit costs are unit, and no approximate matcher is used, the costs of the shifted
+    // candidates are computed by the bit-parallel edit distance, and the edit path, which determines the
+    // next shift candidates, is computed only for the best candidate by the dynamic programming.
     class TERScorerImpl : public TERScorerConstant
     {
     private:
@@ -155,10 +169,7 @@ namespace cicada
 
       typedef cicada::Matcher matcher_type;
       
-      typedef utils::compact_set<word_type,
-				 utils::unassigned<word_type>, utils::unassigned<word_type>,
-				 boost::hash<word_type>, std::equal_to<word_type>,
-				 std::allocator<word_type> > word_set_type;
+      typedef uint64_t block_type;
 
       struct Score
       {
@@ -198,14 +209,19 @@ namespace cicada
       typedef std::vector<bool, std::allocator<bool> > error_set_type;
       typedef std::vector<int, std::allocator<int> > align_set_type;
 
-      typedef sentence_type ngram_type;
-      typedef std::set<int, std::less<int>, std::allocator<int> > index_set_type;
+      typedef std::vector<int, std::allocator<int> > row_set_type;
+      typedef std::vector<block_type, std::allocator<block_type> > block_set_type;
+      
+      typedef utils::unordered_map<word_type, int, boost::hash<word_type>, std::equal_to<word_type>,
+				   std::allocator<std::pair<const word_type, int> > >::type row_map_type;
       
-      typedef utils::unordered_map<ngram_type, index_set_type, boost::hash<ngram_type>, std::equal_to<ngram_type>,
-				   std::allocator<std::pair<const ngram_type, index_set_type> > >::type ngram_index_map_type;
+      // ngram index: node and row to the child node, and the starting positions of each node
+      typedef utils::unordered_map<uint64_t, int, boost::hash<uint64_t>, std::equal_to<uint64_t>,
+				   std::allocator<std::pair<const uint64_t, int> > >::type ngram_index_map_type;
+      typedef std::vector<row_set_type, std::allocator<row_set_type> > ngram_position_set_type;
       
       TERScorerImpl(const sentence_type& __ref)
-	: ref(__ref) {  }
+	: ref(__ref) { initialize(); }
       
       value_type operator()(const sentence_type& sentence, const weights_type& weights, const matcher_type* matcher) const
       {
@@ -233,36 +249,115 @@ namespace cicada
       }
 
     private:
+      
+      void initialize()
+      {
+	// rows, zero is reserved for the words not in the reference
+	rows_ref.clear();
+	rows_ref.reserve(ref.size());
+	
+	sentence_type::const_iterator riter_end = ref.end();
+	for (sentence_type::const_iterator riter = ref.begin(); riter != riter_end; ++ riter) {
+	  std::pair<row_map_type::iterator, bool> result = rows.insert(std::make_pair(*riter, 0));
+	  if (result.second)
+	    result.first->second = rows.size();
+	  
+	  rows_ref.push_back(result.first->second);
+	}
+	
+	// match vectors
+	blocks = (ref.size() + 63) / 64;
+	
+	peq.clear();
+	peq.resize((rows.size() + 1) * blocks, 0);
+	
+	for (int pos = 0; pos != static_cast<int>(ref.size()); ++ pos)
+	  peq[rows_ref[pos] * blocks + (pos >> 6)] |= block_type(1) << (pos & 63);
+	
+	// ngram index, the root is zero
+	ngram_index.clear();
+	ngram_positions.clear();
+	ngram_positions.resize(1);
+	
+	for (int start = 0; start != static_cast<int>(ref.size()); ++ start) {
+	  const int max_length = utils::bithack::min(max_shift_size, static_cast<int>(ref.size() - start));
+	  
+	  int node = 0;
+	  for (int length = 0; length != max_length; ++ length) {
+	    std::pair<ngram_index_map_type::iterator, bool> result = ngram_index.insert(std::make_pair(ngram_key(node, rows_ref[start + length]), 0));
+	    if (result.second) {
+	      result.first->second = ngram_positions.size();
+	      ngram_positions.push_back(row_set_type());
+	    }
+	    
+	    node = result.first->second;
+	    
+	    // start is increasing, thus, the positions are sorted
+	    ngram_positions[node].push_back(start);
+	  }
+	}
+      }
+      
+      static uint64_t ngram_key(const int node, const int row)
+      {
+	return (uint64_t(node) << 32) | uint64_t(row);
+      }
+      
+      // child node of the ngram index, or -1 if not found
+      int ngram_next(const int node, const int row) const
+      {
+	if (! row) return -1;
+	
+	ngram_index_map_type::const_iterator niter = ngram_index.find(ngram_key(node, row));
+	
+	return (niter != ngram_index.end() ? niter->second : -1);
+      }
+      
+      void map_rows(const sentence_type& hyp, row_set_type& rows_hyp) const
+      {
+	rows_hyp.clear();
+	rows_hyp.reserve(hyp.size());
+	
+	sentence_type::const_iterator hiter_end = hyp.end();
+	for (sentence_type::const_iterator hiter = hyp.begin(); hiter != hiter_end; ++ hiter) {
+	  row_map_type::const_iterator riter = rows.find(*hiter);
+	  
+	  rows_hyp.push_back(riter != rows.end() ? riter->second : 0);
+	}
+      }
 
       double calculate_shifts(const sentence_type& hyp_orig, const sentence_type& ref, value_type& value, const weights_type& weights, const matcher_type* matcher) const
       {
 	value = value_type();
 	
 	sentence_type hyp = hyp_orig;
+	row_set_type  rows_hyp;
 	path_type     path;
 	double        cost = minimum_edit_distance(hyp, ref, path, weights, matcher);
+	
+	map_rows(hyp, rows_hyp);
 
 	//std::cerr << "initial cost: " << cost << std::endl;
 	
 	sentence_type hyp_new;
+	row_set_type  rows_new;
 	path_type     path_new;
 	double        cost_new;
 	
-	ngram_index_map_type ngram_index;
-	build_ngram_matches(hyp, ngram_index);
-	
 	while (1) {
 	  hyp_new.clear();
+	  rows_new.clear();
 	  path_new.clear();
 	  cost_new = 0;
 
-	  if (! calculate_best_shift(hyp, path, cost, hyp_new, path_new, cost_new, ngram_index, weights, matcher))
+	  if (! calculate_best_shift(hyp, rows_hyp, path, cost, hyp_new, rows_new, path_new, cost_new, weights, matcher))
 	    break;
 	  
 	  value.score += weights.shift;
 	  ++ value.shift;
 	  
 	  hyp.swap(hyp_new);
+	  rows_hyp.swap(rows_new);
 	  path.swap(path_new);
 	  cost = cost_new;
 
@@ -295,28 +390,6 @@ namespace cicada
 	return value.score;
       }
 
-      void build_ngram_matches(const sentence_type& hyp, ngram_index_map_type& ngram_index) const
-      {
-	ngram_index.clear();
-	
-	word_set_type words_intersect;
-	words_intersect.insert(hyp.begin(), hyp.end());
-
-	word_set_type::const_iterator iiter_end = words_intersect.end();
-	
-	ngram_type ngram;
-	
-	for (int start = 0; start != static_cast<int>(ref.size()); ++ start) {
-	  ngram.clear();
-	  const int max_length = utils::bithack::min(max_shift_size, static_cast<int>(ref.size() - start));
-	  for (int length = 0; length != max_length && words_intersect.find(ref[start + length]) != iiter_end; ++ length) {
-	    ngram.push_back(ref[start + length]);
-	    
-	    ngram_index[ngram].insert(start);
-	  }
-	}
-      }
-      
       void find_alignment_error(const path_type& path,
 				error_set_type& herr,
 				error_set_type& rerr,
@@ -369,12 +442,13 @@ namespace cicada
       }
       
       bool calculate_best_shift(const sentence_type& hyp,
+				const row_set_type& rows_hyp,
 				const path_type& path,
 				const double cost,
 				sentence_type& hyp_best,
+				row_set_type& rows_best,
 				path_type& path_best,
 				double& cost_best,
-				const ngram_index_map_type& ngram_index,
 				const weights_type& weights,
 				const matcher_type* matcher) const
       {
@@ -407,15 +481,24 @@ namespace cicada
 	
 	shift_matrix_type shifts(max_shift_size + 1);
 	
-	gather_all_possible_shifts(hyp, ralign, herr, rerr, ngram_index, shifts);
+	gather_all_possible_shifts(rows_hyp, ralign, herr, rerr, shifts);
+	
+	const bool bit_parallel = (! matcher
+				   && weights.insertion == 1.0
+				   && weights.deletion == 1.0
+				   && weights.substitution == 1.0);
 	
 	double cost_shift_best = 0;
 	cost_best = cost;
 	bool found = false;
+	shift_type shift_best;
 	
 	// enumerate from max-shifts
-	sentence_type hyp_shifted(hyp.size());
-	path_type     path_shifted;
+	sentence_type  hyp_shifted(hyp.size());
+	row_set_type   rows_shifted(rows_hyp.size());
+	path_type      path_shifted;
+	block_set_type pv;
+	block_set_type mv;
 	
 	for (int i = shifts.size() - 1; i >= 0; -- i) 
 	  if (! shifts[i].empty()) {
@@ -433,9 +516,17 @@ namespace cicada
 	    
 	      //std::cerr << "candidate shift: [" << shift.begin << ", " << shift.end << "]: " << shift.reloc << std::endl;
 	      
-	      perform_shift(hyp, shift, hyp_shifted);
-	    
-	      const double cost_shifted = minimum_edit_distance(hyp_shifted, ref, path_shifted, weights, matcher);
+	      double cost_shifted = 0.0;
+	      if (bit_parallel) {
+		perform_shift(rows_hyp, shift, rows_shifted);
+		
+		cost_shifted = edit_distance(rows_shifted, pv, mv);
+	      } else {
+		perform_shift(hyp, shift, hyp_shifted);
+		
+		cost_shifted = minimum_edit_distance(hyp_shifted, ref, path_shifted, weights, matcher);
+	      }
+	      
 	      const double gain = (cost_best + cost_shift_best) - (cost_shifted + weights.shift);
 	      
 	      //std::cerr << "hyp original: " << hyp << std::endl;
@@ -445,29 +536,44 @@ namespace cicada
 	      if (gain > 0 || (cost_shift_best == 0 && gain == 0)) {
 		cost_best       = cost_shifted;
 		cost_shift_best = weights.shift;
-		
-		path_best.swap(path_shifted);
-		hyp_best.swap(hyp_shifted);
+		shift_best      = shift;
 		found = true;
 		
+		if (! bit_parallel) {
+		  path_best.swap(path_shifted);
+		  hyp_best.swap(hyp_shifted);
+		}
+		
 		//std::cerr << "better shift: [" << shift.begin << ", " << shift.end << "]: " << shift.reloc << std::endl;
 	      }
 	    }
 	  }
+	
+	if (found) {
+	  perform_shift(rows_hyp, shift_best, rows_best);
+	  
+	  // the edit path only for the best shift
+	  if (bit_parallel) {
+	    perform_shift(hyp, shift_best, hyp_best);
+	    
+	    minimum_edit_distance(hyp_best, ref, path_best, weights, matcher);
+	  }
+	}
 
 	return found;
       }
 
-      void perform_shift(const sentence_type& sentence,
+      template <typename Sequence>
+      void perform_shift(const Sequence& sentence,
 			 const shift_type& shift,
-			 sentence_type& shifted) const
+			 Sequence& shifted) const
       {
 	shifted.clear();
 	
-	std::back_insert_iterator<sentence_type> oiter(shifted);
+	std::back_insert_iterator<Sequence> oiter(shifted);
 	
-	sentence_type::const_iterator siter_begin = sentence.begin();
-	sentence_type::const_iterator siter_end = sentence.end();
+	typename Sequence::const_iterator siter_begin = sentence.begin();
+	typename Sequence::const_iterator siter_end = sentence.end();
 
 	if (shift.reloc == -1) {
 	  std::copy(siter_begin + shift.begin, siter_begin + shift.end + 1, oiter);
@@ -496,44 +602,35 @@ namespace cicada
 				   + " shifted: "  + utils::lexical_cast<std::string>(shifted.size()));
       }
 
-      void gather_all_possible_shifts(const sentence_type& hyp,
+      void gather_all_possible_shifts(const row_set_type& hyp,
 				      const align_set_type& ralign,
 				      const error_set_type& herr,
 				      const error_set_type& rerr,
-				      const ngram_index_map_type& ngram_index,
 				      shift_matrix_type& shifts) const
       {
-	ngram_type ngram;
-	
 	for (int start = 0; start != static_cast<int>(hyp.size()); ++ start) {
-	  ngram.clear();
-	  ngram.push_back(hyp[start]);
-	  
-	  ngram_index_map_type::const_iterator niter = ngram_index.find(ngram);
-	  if (niter == ngram_index.end()) continue;
+	  const int unigram = ngram_next(0, hyp[start]);
+	  if (unigram < 0) continue;
 	  
 	  bool found = false;
-	  index_set_type::const_iterator iiter_end = niter->second.end();
-	  for (index_set_type::const_iterator iiter = niter->second.begin(); iiter != iiter_end && ! found; ++ iiter) {
+	  row_set_type::const_iterator iiter_end = ngram_positions[unigram].end();
+	  for (row_set_type::const_iterator iiter = ngram_positions[unigram].begin(); iiter != iiter_end && ! found; ++ iiter) {
 	    const int moveto = *iiter;
 	    found = (start != ralign[moveto] && (ralign[moveto] - start <= max_shift_dist) && (start - ralign[moveto] - 1 <= max_shift_dist));
 	  }
 	  
 	  if (! found) continue;
 	  
-	  ngram.clear();
+	  int node = 0;
 	  const int last = utils::bithack::min(start + max_shift_size, static_cast<int>(hyp.size()));
 	  for (int end = start; found && end != last; ++ end) {
-	    ngram.push_back(hyp[end]);
-	    
 	    //std::cerr << "range: [" << start << ", " << end << "]" << std::endl;
 	    
 	    found = false;
 	    
-	    ngram_index_map_type::const_iterator niter = ngram_index.find(ngram);
-	    if (niter == ngram_index.end()) break;
-
-	    //std::cerr << "found ngram: " << niter->first << std::endl;
+	    node = ngram_next(node, hyp[end]);
+	    if (node < 0) break;
+	    
 	    
 	    error_set_type::const_iterator hiter_begin = herr.begin() + start;
 	    error_set_type::const_iterator hiter_end   = herr.begin() + end + 1;
@@ -542,8 +639,8 @@ namespace cicada
 	      continue;
 	    }
 	    
-	    index_set_type::const_iterator iiter_end = niter->second.end();
-	    for (index_set_type::const_iterator iiter = niter->second.begin(); iiter != iiter_end; ++ iiter) {
+	    row_set_type::const_iterator iiter_end = ngram_positions[node].end();
+	    for (row_set_type::const_iterator iiter = ngram_positions[node].begin(); iiter != iiter_end; ++ iiter) {
 	      const int moveto = *iiter;
 	      
 	      if (ralign[moveto] != start
@@ -573,6 +670,56 @@ namespace cicada
 	}
       }
       
+      // unit-cost edit distance between the rows of a hypothesis and the reference by the bit-parallel
+      // algorithm of Myers (1999) with the blocks of Hyyro (2001): the vertical differences of a column
+      // are kept in the bit-vectors pv (+1) and mv (-1), and the horizontal difference of the last row
+      // is accumulated into the distance.
+      double edit_distance(const row_set_type& hyp, block_set_type& pv, block_set_type& mv) const
+      {
+	pv.clear();
+	mv.clear();
+	pv.resize(blocks, ~block_type(0));
+	mv.resize(blocks, block_type(0));
+	
+	const block_type last = block_type(1) << ((ref.size() - 1) & 63);
+	
+	int distance = ref.size();
+	
+	row_set_type::const_iterator hiter_end = hyp.end();
+	for (row_set_type::const_iterator hiter = hyp.begin(); hiter != hiter_end; ++ hiter) {
+	  const block_type* eqs = &(*peq.begin()) + (*hiter) * blocks;
+	  
+	  // the first row is the insertions, thus, always +1
+	  int hin = 1;
+	  
+	  for (size_t block = 0; block != blocks; ++ block) {
+	    const block_type Pv = pv[block];
+	    const block_type Mv = mv[block];
+	    const block_type Xv = eqs[block] | Mv;
+	    const block_type Eq = eqs[block] | block_type(hin < 0);
+	    const block_type Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+	    
+	    block_type Ph = Mv | ~(Xh | Pv);
+	    block_type Mh = Pv & Xh;
+	    
+	    const block_type high = (block + 1 == blocks ? last : block_type(1) << 63);
+	    const int hout = int((Ph & high) != 0) - int((Mh & high) != 0);
+	    
+	    Ph = (Ph << 1) | block_type(hin > 0);
+	    Mh = (Mh << 1) | block_type(hin < 0);
+	    
+	    pv[block] = Mh | ~(Xv | Ph);
+	    mv[block] = Ph & Xv;
+	    
+	    hin = hout;
+	  }
+	  
+	  distance += hin;
+	}
+	
+	return distance;
+      }
+      
       double minimum_edit_distance(const sentence_type& hyp, const sentence_type& ref, path_type& path, const weights_type& weights, const matcher_type* matcher) const
       {
 	typedef utils::vector2<transition_type, std::allocator<transition_type> > matrix_transition_type;
@@ -640,6 +787,15 @@ namespace cicada
       
     private:
       sentence_type ref;
+      
+      row_map_type  rows;
+      row_set_type  rows_ref;
+      
+      size_t         blocks;
+      block_set_type peq;
+      
+      ngram_index_map_type    ngram_index;
+      ngram_position_set_type ngram_positions;
     };
    
     TERScorer::TERScorer(const TERScorer& x)
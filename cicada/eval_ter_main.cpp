@@ -0,0 +1,114 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of segments] [# of hypotheses per segment] [vocabulary size]
+//
+// score k-best-like hypotheses, random edits and block moves of a random reference, by TER and report
+// the throughput in sentences/sec together with the accumulated score.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+
+#include "eval/ter.hpp"
+#include "sentence.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+#include <boost/random.hpp>
+
+typedef cicada::Sentence sentence_type;
+typedef cicada::eval::TERScorer scorer_type;
+typedef cicada::eval::Score score_type;
+
+int main(int argc, char** argv)
+{
+  try {
+    const size_t num_segment    = (argc > 1 ? utils::lexical_cast<size_t>(argv[1]) : size_t(100));
+    const size_t num_hypothesis = (argc > 2 ? utils::lexical_cast<size_t>(argv[2]) : size_t(100));
+    const size_t num_vocabulary = (argc > 3 ? utils::lexical_cast<size_t>(argv[3]) : size_t(1000));
+
+    boost::mt19937 generator;
+    boost::random::uniform_int_distribution<size_t> word_dist(0, num_vocabulary - 1);
+    boost::random::uniform_int_distribution<size_t> length_dist(10, 60);
+    boost::random::uniform_int_distribution<size_t> edit_dist(0, 9);
+
+    std::vector<sentence_type::word_type, std::allocator<sentence_type::word_type> > vocabulary;
+    for (size_t i = 0; i != num_vocabulary; ++ i)
+      vocabulary.push_back("word" + utils::lexical_cast<std::string>(i));
+
+    score_type::score_ptr_type score_total;
+    double time_total = 0.0;
+    size_t sentences = 0;
+
+    for (size_t segment = 0; segment != num_segment; ++ segment) {
+      sentence_type reference;
+
+      const size_t length = length_dist(generator);
+      for (size_t i = 0; i != length; ++ i)
+	reference.push_back(vocabulary[word_dist(generator)]);
+
+      std::vector<sentence_type, std::allocator<sentence_type> > hypotheses(num_hypothesis);
+      for (size_t k = 0; k != num_hypothesis; ++ k) {
+	sentence_type& hyp = hypotheses[k];
+
+	for (size_t i = 0; i != reference.size(); ++ i)
+	  switch (edit_dist(generator)) {
+	  case 0: break;                                                          // deletion
+	  case 1: hyp.push_back(vocabulary[word_dist(generator)]); break;         // substitution
+	  case 2: hyp.push_back(reference[i]); hyp.push_back(vocabulary[word_dist(generator)]); break; // insertion
+	  default: hyp.push_back(reference[i]);
+	  }
+
+	// block moves
+	for (int moves = edit_dist(generator) % 3; moves && hyp.size() > 4; -- moves) {
+	  boost::random::uniform_int_distribution<size_t> pos_dist(0, hyp.size() - 4);
+
+	  const size_t first = pos_dist(generator);
+	  const size_t last  = first + 1 + edit_dist(generator) % 3;
+	  const size_t moveto = pos_dist(generator);
+
+	  sentence_type block(hyp.begin() + first, hyp.begin() + last);
+	  hyp.erase(hyp.begin() + first, hyp.begin() + last);
+	  hyp.insert(hyp.begin() + std::min(moveto, hyp.size()), block.begin(), block.end());
+	}
+      }
+
+      utils::resource start;
+
+      scorer_type scorer;
+      scorer.insert(reference);
+
+      for (size_t k = 0; k != num_hypothesis; ++ k) {
+	score_type::score_ptr_type score = scorer.score(hypotheses[k]);
+
+	if (! score_total)
+	  score_total = score;
+	else
+	  *score_total += *score;
+      }
+
+      utils::resource end;
+
+      time_total += end.user_time() - start.user_time();
+      sentences += num_hypothesis;
+    }
+
+    std::cout << "sentences: " << sentences
+	      << " user time: " << time_total
+	      << " sentences/sec: " << (sentences / time_total)
+	      << std::endl;
+    if (score_total)
+      std::cout << *score_total << std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -2,8 +2,11 @@
 //  Copyright(C) 2010-2011 Taro Watanabe <taro.watanabe@nict.go.jp>
 //
 
+#include <algorithm>
+
 #include <utils/config.hpp>
 #include <utils/thread_specific_ptr.hpp>
+#include <utils/array_power2.hpp>
 
 #include "feature.hpp"
 
@@ -13,6 +16,17 @@ namespace cicada
   struct FeatureImpl
   {
     typedef Feature::feature_map_type feature_map_type;
+    typedef Feature::id_type          id_type;
+
+    // per-thread string-to-id cache in front of the interning table, indexed by the hash value
+    struct intern_cache_type
+    {
+      typedef utils::array_power2<id_type, 1024 * 4, std::allocator<id_type> > id_set_type;
+
+      intern_cache_type() { std::fill(ids.begin(), ids.end(), id_type(-1)); }
+
+      id_set_type ids;
+    };
   };
   
   Feature::ticket_type    Feature::__mutex;
@@ -44,4 +58,49 @@ namespace cicada
     return *feature_maps;
 #endif
   }
+
+  // function-local, since features are interned during the static initialization
+  static FeatureImpl::intern_cache_type& intern_cache()
+  {
+    static utils::thread_specific_ptr<FeatureImpl::intern_cache_type> caches;
+#ifdef HAVE_TLS
+    static __thread FeatureImpl::intern_cache_type* caches_tls = 0;
+
+    if (! caches_tls) {
+      caches.reset(new FeatureImpl::intern_cache_type());
+      caches_tls = caches.get();
+    }
+
+    return *caches_tls;
+#else
+    if (! caches.get())
+      caches.reset(new FeatureImpl::intern_cache_type());
+
+    return *caches;
+#endif
+  }
+
+  Feature::id_type Feature::__allocate(const piece_type& x)
+  {
+    feature_set_type& features = __features();
+
+    const feature_set_type::hash_type hash = feature_set_type::hash(x);
+
+    FeatureImpl::intern_cache_type& caches = intern_cache();
+
+    id_type& cache = caches.ids[hash & (caches.ids.size() - 1)];
+
+    if (cache != id_type(-1) && features[cache] == x)
+      return cache;
+
+    cache = features.find(x, hash);
+
+    if (cache == feature_set_type::npos) {
+      ticket_type::scoped_writer_lock lock(__mutex);
+
+      cache = features.insert(x, hash).first;
+    }
+
+    return cache;
+  }
 };
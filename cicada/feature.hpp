@@ -17,6 +17,7 @@
 
 #include <utils/indexed_set.hpp>
 #include <utils/rwticket.hpp>
+#include <utils/intern_set.hpp>
 #include <utils/piece.hpp>
 #include <utils/chunk_vector.hpp>
 #include <utils/traits.hpp>
@@ -81,11 +82,8 @@ namespace cicada
 	maps.reserve(power2);
 	maps.resize(power2, 0);
       }
-      if (! maps[__id]) {
-	ticket_type::scoped_reader_lock lock(__mutex);
-	
+      if (! maps[__id])
 	maps[__id] = &(__features()[__id]);
-      }
       
       return *maps[__id];
     }
@@ -127,24 +125,18 @@ namespace cicada
     bool operator>=(const Feature& x, const Feature& y);
     
   private:
-    typedef utils::indexed_set<piece_type, boost::hash<piece_type>, std::equal_to<piece_type>, std::allocator<piece_type> > feature_index_type;
-    typedef utils::chunk_vector<feature_type, 4096 / sizeof(feature_type), std::allocator<feature_type> > feature_set_type;
+    typedef utils::intern_set feature_set_type;
     typedef std::vector<const feature_type*, std::allocator<const feature_type*> > feature_map_type;
     
   public:
+    // lookups are lock-free. Only the insertion of a new feature takes the writer lock.
     static bool exists(const piece_type& x)
     {
-      ticket_type::scoped_reader_lock lock(__mutex);
-      
-      const feature_index_type& index = __index();
-      
-      return index.find(x) != index.end();
+      return __features().find(x) != feature_set_type::npos;
     }
     
     static size_t allocated()
     {
-      ticket_type::scoped_reader_lock lock(__mutex);
-      
       return __features().size();
     }
     
@@ -159,34 +151,13 @@ namespace cicada
       return feats;
     }
     
-    static feature_index_type& __index()
-    {
-      static feature_index_type index;
-      return index;
-    }
-    
     static const id_type& __allocate_empty()
     {
       static const id_type __id = __allocate("");
       return __id;
     }
     
-    static id_type __allocate(const piece_type& x)
-    {
-      ticket_type::scoped_writer_lock lock(__mutex);
-      
-      feature_index_type& index = __index();
-      
-      std::pair<feature_index_type::iterator, bool> result = index.insert(x);
-      
-      if (result.second) {
-	feature_set_type& features = __features();
-	features.push_back(x);
-	const_cast<piece_type&>(*result.first) = features.back();
-      }
-      
-      return result.first - index.begin();
-    }
+    static id_type __allocate(const piece_type& x);
     
   private:
     id_type __id;
@@ -492,6 +492,7 @@ namespace cicada
       bool        skip_sgml_tag = false;
       bool        split_estimate = false;
       bool        no_bos_eos = false;
+      size_t      cache_size = 0;
       
       path_type   coarse_path;
       bool        coarse_populate = false;
@@ -515,6 +516,8 @@ namespace cicada
 	  no_bos_eos = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "split-estimate")
 	  split_estimate = utils::lexical_cast<bool>(piter->second);	
+	else if (utils::ipiece(piter->first) == "cache-size")
+	  cache_size = utils::lexical_cast<size_t>(piter->second);
 	else if (utils::ipiece(piter->first) == "coarse-file")
 	  coarse_path = piter->second;
 	else if (utils::ipiece(piter->first) == "coarse-populate")
@@ -545,6 +548,10 @@ namespace cicada
       ngram_impl->skip_sgml_tag  = skip_sgml_tag;
       ngram_impl->split_estimate = split_estimate;
       
+      // the ngram is shared by all the clones, thus, the cache is also shared by all the threads
+      if (cache_size)
+	ngram_impl->ngram->reserve_cache(cache_size);
+      
       if (! cluster_path.empty()) {
 	if (! boost::filesystem::exists(cluster_path))
 	  throw std::runtime_error("no cluster file: " + cluster_path.string());
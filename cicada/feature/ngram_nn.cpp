@@ -85,8 +85,8 @@ namespace cicada
       static const symbol_type::id_type id_star;
 
     public:
-      NGramNNImpl(const path_type& __path, const int __order, const bool populate)
-	: ngram(&ngram_type::create(__path)),
+      NGramNNImpl(const path_type& __path, const int __order, const bool populate, const bool precompute)
+	: ngram(&ngram_type::create(__path, precompute)),
 	  order(__order), no_bos_eos(false), skip_sgml_tag(false), split_estimate(false)
       {
 	order = utils::bithack::min(order, ngram->order());
@@ -102,7 +102,7 @@ namespace cicada
       }
 
       NGramNNImpl(const NGramNNImpl& x)
-	: ngram(&ngram_type::create(x.ngram->path())),
+	: ngram(&ngram_type::create(x.ngram->path(), x.ngram->precomputed())),
 	  order(x.order),
 	  no_bos_eos(x.no_bos_eos),
 	  skip_sgml_tag(x.skip_sgml_tag),
@@ -120,7 +120,7 @@ namespace cicada
 
       NGramNNImpl& operator=(const NGramNNImpl& x)
       {
-	ngram = &ngram_type::create(x.ngram->path());
+	ngram = &ngram_type::create(x.ngram->path(), x.ngram->precomputed());
 	order = x.order;
 	
 	no_bos_eos     = x.no_bos_eos;
@@ -174,16 +174,8 @@ namespace cicada
 	  cache.context.assign(first, iter);
 	  cache.ngram.assign(iter, last);
 	  
-	  buffer_type& buffer = const_cast<buffer_type&>(buffer_score_impl);
-	  buffer.clear();
-	  buffer.insert(buffer.end(), first, iter);
-	  
-	  cache.score = 0.0;
-	  for (/**/; iter != last; ++ iter) {
-	    buffer.push_back(*iter);
-	    
-	    cache.score += ngram->operator()(std::max(buffer.begin(), buffer.end() - order), buffer.end());
-	  }
+	  // score all the ngrams at once
+	  cache.score = ngram->operator()(first, iter, last, order);
 	}
 	
 	return cache.score;
@@ -201,23 +193,8 @@ namespace cicada
 
 	  cache.assign(cache_pos, first, last);
 	  
-	  buffer_type& buffer = const_cast<buffer_type&>(buffer_score_impl);
-	  buffer.clear();
-	  
 	  // skip initial bos...
-	  if (*first == id_bos) {
-	    buffer.push_back(*first);
-	    ++ first;
-	  }
-	  
-	  double score = 0.0;
-	  for (/**/; first != last; ++ first) {
-	    buffer.push_back(*first);
-	    
-	    score += ngram->operator()(buffer.begin(), buffer.end());
-	  }
-	  
-	  cache[cache_pos] = score;
+	  cache[cache_pos] = ngram->operator()(first, first + (*first == id_bos), last, ngram->order());
 	}
 	
 	return cache_estimate[cache_pos];
@@ -571,7 +548,6 @@ namespace cicada
       
       // actual buffers...
       buffer_type    buffer_impl;
-      buffer_type    buffer_score_impl;
       
       // ngrams
       ngram_type*     ngram;
@@ -606,6 +582,7 @@ namespace cicada
 
       path_type   path;
       bool        populate = false;
+      bool        precompute = false;
       int         order = 3;
       bool        skip_sgml_tag = false;
       bool        split_estimate = false;
@@ -622,6 +599,8 @@ namespace cicada
 	  path = piter->second;
 	else if (utils::ipiece(piter->first) == "populate")
 	  populate = utils::lexical_cast<bool>(piter->second);
+	else if (utils::ipiece(piter->first) == "precompute")
+	  precompute = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "order")
 	  order = utils::lexical_cast<int>(piter->second);
 	else if (utils::ipiece(piter->first) == "skip-sgml-tag")
@@ -653,7 +632,7 @@ namespace cicada
       if (! coarse_path.empty() && ! boost::filesystem::exists(coarse_path))
 	throw std::runtime_error("no coarse ngram language model? " + coarse_path.string());
       
-      std::auto_ptr<impl_type> ngram_impl(new impl_type(path, order, populate));
+      std::auto_ptr<impl_type> ngram_impl(new impl_type(path, order, populate, precompute));
       
       ngram_impl->no_bos_eos     = no_bos_eos;
       ngram_impl->skip_sgml_tag  = skip_sgml_tag;
@@ -677,7 +656,7 @@ namespace cicada
 	  throw std::runtime_error("coarse order must be non-zero!");
 	
 	if (! coarse_path.empty()) {
-	  std::auto_ptr<impl_type> ngram_impl(new impl_type(coarse_path, coarse_order, coarse_populate));
+	  std::auto_ptr<impl_type> ngram_impl(new impl_type(coarse_path, coarse_order, coarse_populate, precompute));
 
 	  ngram_impl->no_bos_eos = no_bos_eos;
 	  ngram_impl->skip_sgml_tag = skip_sgml_tag;
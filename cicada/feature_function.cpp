@@ -163,6 +163,7 @@ ngram: ngram language model\n\
 \tno-bos-eos=[true|false] do not add bos/eos\n\
 \tsplit-estimate=[true|false] split estimated ngram score\n\
 \tskip-sgml-tag=[true|false] skip sgml tags\n\
+\tcache-size=<size> # of entries of the ngram result cache shared by threads (default: 0, no cache)\n\
 \tcoarse-file=<file>   ngram for coarrse heuristic\n\
 \tcoarse-populate=[true|false] \"populate\" by pre-fetching\n\
 \tcoarse-cluster=<word class> word class for coarse heuristics\n\
@@ -170,6 +171,7 @@ ngram: ngram language model\n\
 ngram-nn: neural network ngram language model\n\
 \tfile=<file>\n\
 \tpopulate=[true|false] \"populate\" by pre-fetching\n\
+\tprecompute=[true|false] precompute the context layer for each word\n\
 \torder=<order>\n\
 \tname=feature-name(default: ngram-nn)\n\
 \tno-bos-eos=[true|false] do not add bos/eos\n\
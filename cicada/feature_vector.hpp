@@ -382,6 +382,7 @@ namespace cicada
 
     void reserve(size_type x) { __vector.rehash(x); }
     void rehash(size_type x) { __vector.rehash(x); }
+    size_type bucket_count() const { return __vector.bucket_count(); }
     
     void clear()
     {
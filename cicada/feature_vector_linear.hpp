@@ -448,7 +448,18 @@ namespace cicada
     FeatureVectorLinear<T1,A1> operator*(const FeatureVectorLinear<T1,A1>& x, const FeatureVectorCompact& y);
     
     friend
-    size_t hash_value(FeatureVectorLinear const& x) { return utils::hashmurmur3<size_t>()(x.__map.begin(), x.__map.end(), 0); }
+    size_t hash_value(FeatureVectorLinear const& x)
+    {
+      typedef utils::hashmurmur3<size_t> hasher_type;
+      
+      // features and values are hashed separately, since a pair may hold padding bytes
+      size_t seed = 0;
+      typename map_type::const_iterator iter_end = x.__map.end();
+      for (typename map_type::const_iterator iter = x.__map.begin(); iter != iter_end; ++ iter)
+	seed = hasher_type()(iter->second, hasher_type()(iter->first, seed));
+      
+      return seed;
+    }
     
     friend bool operator==(const FeatureVectorLinear& x, const FeatureVectorLinear& y) { return x.__map == y.__map; }
     friend bool operator!=(const FeatureVectorLinear& x, const FeatureVectorLinear& y) { return x.__map != y.__map; }
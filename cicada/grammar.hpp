@@ -119,6 +119,20 @@ namespace cicada
       for (transducer_ptr_set_type::const_iterator iter = transducers.begin(); iter != iter_end; ++ iter)
 	const_cast<transducer_ptr_type&>(*iter)->assign(hypergraph, lattice);
     }
+    
+    // the # of cache hits and misses, accumulated over transducers
+    typedef std::pair<transducer_type::size_type, transducer_type::size_type> cache_stat_type;
+    
+    cache_stat_type cache_statistics() const
+    {
+      cache_stat_type stat(0, 0);
+      
+      transducer_ptr_set_type::const_iterator iter_end = transducers.end();
+      for (transducer_ptr_set_type::const_iterator iter = transducers.begin(); iter != iter_end; ++ iter)
+	(*iter)->cache_statistics(stat.first, stat.second);
+      
+      return stat;
+    }
 
   public:    
     static const char* lists() { return transducer_type::lists(); }
@@ -10,6 +10,9 @@
 #include "grammar_static.hpp"
 #include "parameter.hpp"
 #include "quantizer.hpp"
+#include "lattice.hpp"
+#include "sentence.hpp"
+#include "vocab.hpp"
 
 #include "feature_vector_codec.hpp"
 #include "attribute_vector_codec.hpp"
@@ -36,9 +39,11 @@
 #include "utils/succinct_vector.hpp"
 #include "utils/resource.hpp"
 #include "utils/unordered_map.hpp"
+#include "utils/unordered_set.hpp"
 #include "utils/getline.hpp"
 #include "utils/hashmurmur.hpp"
 #include "utils/hashmurmur3.hpp"
+#include "utils/spinlock.hpp"
 
 #include <boost/lexical_cast.hpp>
 #include <boost/bind.hpp>
@@ -54,6 +59,7 @@
 #include <boost/fusion/include/std_pair.hpp>
 
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace cicada
 {
@@ -274,9 +280,73 @@ namespace cicada
     typedef std::vector<score_set_type, std::allocator<score_set_type> > score_db_type;
     
     // caching...
-    typedef utils::arc_list<size_type, rule_pair_set_type, 4,
+    typedef boost::shared_ptr<const rule_pair_set_type> rule_pair_set_ptr_type;
+    
+    typedef utils::arc_list<size_type, rule_pair_set_ptr_type, 4,
 			    std::equal_to<size_type>,
-			    std::allocator<std::pair<size_type, rule_pair_set_type> > > cache_rule_set_type;
+			    std::allocator<std::pair<size_type, rule_pair_set_ptr_type> > > cache_rule_set_type;
+    
+    // decoded rule sets shared by all the clones, keyed by trie node. This is direct-mapped, bounded by
+    // the # of entries, and sharded by spinlocks. Entries are shared_ptrs, so that an evicted rule set
+    // remains valid while a clone holds it in its own cache.
+    class cache_shared_type : private boost::noncopyable
+    {
+    private:
+      typedef utils::spinlock mutex_type;
+      typedef mutex_type::scoped_lock lock_type;
+      
+      struct entry_type
+      {
+	size_type              node;
+	rule_pair_set_ptr_type rules;
+	
+	entry_type() : node(size_type(-1)), rules() {}
+      };
+      
+      typedef std::vector<entry_type, std::allocator<entry_type> > entry_set_type;
+      
+      static const size_type shard_size = 64;
+      
+    public:
+      cache_shared_type(const size_type size)
+	: entries(utils::bithack::max(utils::bithack::branch(utils::bithack::is_power2(size),
+							     size,
+							     size_type(utils::bithack::next_largest_power2(size))),
+				      size_type(shard_size))) {}
+      
+      size_type size() const { return entries.size(); }
+      
+      rule_pair_set_ptr_type find(const size_type node) const
+      {
+	const size_type pos = node & (entries.size() - 1);
+	
+	lock_type lock(const_cast<mutex_type&>(mutexes[pos & (shard_size - 1)]));
+	
+	return (entries[pos].node == node ? entries[pos].rules : rule_pair_set_ptr_type());
+      }
+      
+      void insert(const size_type node, const rule_pair_set_ptr_type& rules)
+      {
+	const size_type pos = node & (entries.size() - 1);
+	
+	rule_pair_set_ptr_type evicted(rules);
+	
+	{
+	  lock_type lock(mutexes[pos & (shard_size - 1)]);
+	  
+	  entries[pos].node = node;
+	  entries[pos].rules.swap(evicted);
+	}
+	
+	// the evicted rule set, if any, is released outside of the lock
+      }
+      
+    private:
+      entry_set_type entries;
+      mutex_type     mutexes[shard_size];
+    };
+    
+    typedef boost::shared_ptr<cache_shared_type> cache_shared_ptr_type;
 
     struct cache_phrase_type
     {
@@ -322,7 +392,9 @@ namespace cicada
 
   public:
     GrammarStaticImpl(const std::string& parameter)
-      : max_span(0),
+      : cache_hit(0),
+	cache_miss(0),
+	max_span(0),
 	debug(0)
     {
       read(parameter);
@@ -341,6 +413,9 @@ namespace cicada
 	vocab(x.vocab),
 	feature_names(x.feature_names),
 	attribute_names(x.attribute_names),
+	cache_shared(x.cache_shared),
+	cache_hit(0),
+	cache_miss(0),
 	max_span(x.max_span),
 	debug(x.debug)
     { }
@@ -361,6 +436,7 @@ namespace cicada
       vocab           = x.vocab;
       feature_names   = x.feature_names;
       attribute_names = x.attribute_names;
+      cache_shared    = x.cache_shared;
       max_span        = x.max_span;
       debug           = x.debug;
       
@@ -389,6 +465,10 @@ namespace cicada
       cache_targets.clear();
       cache_nodes.clear();
       cache_root.clear();
+      
+      cache_shared.reset();
+      cache_hit  = 0;
+      cache_miss = 0;
 
       max_span = 0;
     }
@@ -441,124 +521,150 @@ namespace cicada
     
     const rule_pair_set_type& read_rule_set(size_type node) const
     {
-      FeatureVectorCODEC   feature_codec;
-      AttributeVectorCODEC attribute_codec;
-      
       const size_type cache_pos = node & (cache_rule_sets.size() - 1);
       cache_rule_set_type& cache = const_cast<cache_rule_set_type&>(cache_rule_sets[cache_pos]);
       
       std::pair<cache_rule_set_type::iterator, bool> result = cache.find(node);
       if (! result.second) {
-	typedef utils::piece code_set_type;
+	if (cache_shared) {
+	  result.first->second = cache_shared->find(node);
+	  
+	  if (result.first->second)
+	    ++ const_cast<size_type&>(cache_hit);
+	  else {
+	    result.first->second = decode_rule_set(node);
+	    
+	    cache_shared->insert(node, result.first->second);
+	    
+	    ++ const_cast<size_type&>(cache_miss);
+	  }
+	} else
+	  result.first->second = decode_rule_set(node);
+      }
+      
+      return *result.first->second;
+    }
+    
+    void cache_statistics(size_type& hit, size_type& miss) const
+    {
+      hit  += cache_hit;
+      miss += cache_miss;
+    }
+    
+  private:
+    rule_pair_set_ptr_type decode_rule_set(size_type node) const
+    {
+      typedef utils::piece code_set_type;
+      
+      FeatureVectorCODEC   feature_codec;
+      AttributeVectorCODEC attribute_codec;
+      
+      boost::shared_ptr<rule_pair_set_type> options_ptr(new rule_pair_set_type());
+      rule_pair_set_type& options = *options_ptr;
+      
+      rule_db_type::cursor cursor_end = rule_db.cend(node);
+      for (rule_db_type::cursor cursor = rule_db.cbegin(node); cursor != cursor_end; ++ cursor) {
+	const size_type pos = cursor.node();
 	
-	rule_pair_set_type& options = result.first->second;
-	options.clear();
+	code_set_type codes(rule_db[pos].begin(), rule_db[pos].end());
 	
-	rule_db_type::cursor cursor_end = rule_db.cend(node);
-	for (rule_db_type::cursor cursor = rule_db.cbegin(node); cursor != cursor_end; ++ cursor) {
-	  const size_type pos = cursor.node();
-	  
-	  code_set_type codes(rule_db[pos].begin(), rule_db[pos].end());
-	  
-	  code_set_type::const_iterator hiter = codes.begin();
-	  code_set_type::const_iterator citer = codes.begin();
-	  code_set_type::const_iterator citer_end = codes.end();
-	  
-	  id_type pos_feature;
-	  id_type pos_source;
-	  id_type pos_target;
-	  
-	  size_type code_pos = 0;
+	code_set_type::const_iterator hiter = codes.begin();
+	code_set_type::const_iterator citer = codes.begin();
+	code_set_type::const_iterator citer_end = codes.end();
+	
+	id_type pos_feature;
+	id_type pos_source;
+	id_type pos_target;
+	
+	size_type code_pos = 0;
+	
+	const size_type offset_feature = utils::group_aligned_decode(pos_feature, &(*hiter), code_pos);
+	citer = hiter + offset_feature;
+	hiter += offset_feature & (- size_type((code_pos & 0x03) == 0x03));
+	++ code_pos;
+	
+	const size_type offset_source = utils::group_aligned_decode(pos_source, &(*hiter), code_pos);
+	citer = hiter + offset_source;
+	hiter += offset_source & (- size_type((code_pos & 0x03) == 0x03));
+	++ code_pos;
+	
+	while (citer != citer_end) {
 	  
-	  const size_type offset_feature = utils::group_aligned_decode(pos_feature, &(*hiter), code_pos);
-	  citer = hiter + offset_feature;
-	  hiter += offset_feature & (- size_type((code_pos & 0x03) == 0x03));
+	  id_type id_lhs;
+	  const size_type offset_lhs = utils::group_aligned_decode(id_lhs, &(*hiter), code_pos);
+	  citer = hiter + offset_lhs;
+	  hiter += offset_lhs & (- size_type((code_pos & 0x03) == 0x03));
 	  ++ code_pos;
 	  
-	  const size_type offset_source = utils::group_aligned_decode(pos_source, &(*hiter), code_pos);
-	  citer = hiter + offset_source;
-	  hiter += offset_source & (- size_type((code_pos & 0x03) == 0x03));
+	  const size_type offset_target = utils::group_aligned_decode(pos_target, &(*hiter), code_pos);
+	  citer = hiter + offset_target;
+	  hiter += offset_target & (- size_type((code_pos & 0x03) == 0x03));
 	  ++ code_pos;
 	  
-	  while (citer != citer_end) {
-	    
-	    id_type id_lhs;
-	    const size_type offset_lhs = utils::group_aligned_decode(id_lhs, &(*hiter), code_pos);
-	    citer = hiter + offset_lhs;
-	    hiter += offset_lhs & (- size_type((code_pos & 0x03) == 0x03));
-	    ++ code_pos;
-	    
-	    const size_type offset_target = utils::group_aligned_decode(pos_target, &(*hiter), code_pos);
-	    citer = hiter + offset_target;
-	    hiter += offset_target & (- size_type((code_pos & 0x03) == 0x03));
-	    ++ code_pos;
-	    
-	    const symbol_type lhs = vocab[id_lhs];
-	    
-	    const rule_ptr_type rule_source = read_phrase(lhs, pos_source, cache_sources, source_db);
-	    const rule_ptr_type rule_target = read_phrase(lhs, pos_target, cache_targets, target_db);
-	    
-	    if (rule_target->rhs.empty())
-	      options.push_back(rule_pair_type(rule_source, rule_target));
-	    else {
-	      rule_type rule_sorted_source(*rule_source);
-	      rule_type rule_sorted_target(*rule_target);
-	      
-	      cicada::sort(rule_sorted_source, rule_sorted_target);
-	      
-	      options.push_back(rule_pair_type(rule_type::create(rule_sorted_source), rule_type::create(rule_sorted_target)));
-	    }
+	  const symbol_type lhs = vocab[id_lhs];
+	  
+	  const rule_ptr_type rule_source = read_phrase(lhs, pos_source, cache_sources, source_db);
+	  const rule_ptr_type rule_target = read_phrase(lhs, pos_target, cache_targets, target_db);
+	  
+	  if (rule_target->rhs.empty())
+	    options.push_back(rule_pair_type(rule_source, rule_target));
+	  else {
+	    rule_type rule_sorted_source(*rule_source);
+	    rule_type rule_sorted_target(*rule_target);
 	    
-	    if (! feature_data.empty())
-	      feature_codec.decode(feature_data[pos_feature].begin(),
-				   feature_data[pos_feature].end(),
-				   feature_vocab,
-				   options.back().features);
+	    cicada::sort(rule_sorted_source, rule_sorted_target);
 	    
-	    if (! attribute_data.empty())
-	      attribute_codec.decode(attribute_data[pos_feature].begin(),
-				     attribute_data[pos_feature].end(),
-				     attribute_vocab,
-				     options.back().attributes);
+	    options.push_back(rule_pair_type(rule_type::create(rule_sorted_source), rule_type::create(rule_sorted_target)));
+	  }
+	  
+	  if (! feature_data.empty())
+	    feature_codec.decode(feature_data[pos_feature].begin(),
+				 feature_data[pos_feature].end(),
+				 feature_vocab,
+				 options.back().features);
+	  
+	  if (! attribute_data.empty())
+	    attribute_codec.decode(attribute_data[pos_feature].begin(),
+				   attribute_data[pos_feature].end(),
+				   attribute_vocab,
+				   options.back().attributes);
+	  
+	  // rehash...
+	  options.back().features.rehash(score_db.size());
+	  
+	  for (size_t feature = 0; feature < score_db.size(); ++ feature) {
+	    const score_type score = score_db[feature][pos_feature];
 	    
-	    // rehash...
-	    options.back().features.rehash(score_db.size());
+	    // ignore zero score...
+	    if (score == 0.0) continue;
 	    
-	    for (size_t feature = 0; feature < score_db.size(); ++ feature) {
-	      const score_type score = score_db[feature][pos_feature];
-	      
-	      // ignore zero score...
-	      if (score == 0.0) continue;
-	      
-	      // when zero, we will use inifinity...
-	      options.back().features[feature_names[feature]] = (score <= boost::numeric::bounds<score_type>::lowest()
-								 ? - std::numeric_limits<feature_set_type::mapped_type>::infinity()
-								 : (score >= boost::numeric::bounds<score_type>::highest()
-								    ? std::numeric_limits<feature_set_type::mapped_type>::infinity()
-								    : feature_set_type::mapped_type(score)));
-	    }
+	    // when zero, we will use inifinity...
+	    options.back().features[feature_names[feature]] = (score <= boost::numeric::bounds<score_type>::lowest()
+							       ? - std::numeric_limits<feature_set_type::mapped_type>::infinity()
+							       : (score >= boost::numeric::bounds<score_type>::highest()
+								  ? std::numeric_limits<feature_set_type::mapped_type>::infinity()
+								  : feature_set_type::mapped_type(score)));
+	  }
 
-	    for (size_t attr = 0; attr < attr_db.size(); ++ attr) {
-	      const score_type score = attr_db[attr][pos_feature];
-	      
-	      options.back().attributes[attribute_names[attr]] = (score <= boost::numeric::bounds<score_type>::lowest()
-								  ? - std::numeric_limits<feature_set_type::mapped_type>::infinity()
-								  : (score >= boost::numeric::bounds<score_type>::highest()
-								     ? std::numeric_limits<feature_set_type::mapped_type>::infinity()
-								     : feature_set_type::mapped_type(score)));
-	    }
+	  for (size_t attr = 0; attr < attr_db.size(); ++ attr) {
+	    const score_type score = attr_db[attr][pos_feature];
 	    
-	    ++ pos_feature;
+	    options.back().attributes[attribute_names[attr]] = (score <= boost::numeric::bounds<score_type>::lowest()
+								? - std::numeric_limits<feature_set_type::mapped_type>::infinity()
+								: (score >= boost::numeric::bounds<score_type>::highest()
+								   ? std::numeric_limits<feature_set_type::mapped_type>::infinity()
+								   : feature_set_type::mapped_type(score)));
 	  }
+	  
+	  ++ pos_feature;
 	}
-	
-	rule_pair_set_type(options).swap(options);
       }
       
-      return result.first->second;
+      rule_pair_set_type(options).swap(options);
+      
+      return options_ptr;
     }
 
-  private:    
     typedef std::vector<symbol_type, std::allocator<symbol_type> > sequence_type;
     typedef std::vector<word_type::id_type, std::allocator<word_type::id_type> > id_set_type;
 
@@ -662,6 +768,8 @@ namespace cicada
     void read_keyed_text(const std::string& path);
     void read_text(const std::string& path);
     void read_binary(const std::string& path);
+    
+    void filter(const path_type& input, const bool input_lattice);
 
   private:
     
@@ -693,6 +801,10 @@ namespace cicada
     
     cache_node_set_type   cache_nodes;
     cache_root_type       cache_root;
+    
+    cache_shared_ptr_type cache_shared;
+    size_type             cache_hit;
+    size_type             cache_miss;
 
   public:
     int max_span;
@@ -1053,10 +1165,29 @@ namespace cicada
     parameter_type::const_iterator siter = param.find("max-span");
     if (siter != param.end())
       max_span = utils::lexical_cast<int>(siter->second);
+    
+    // filtering by the input, then, the filtered grammar is always populated
+    parameter_type::const_iterator fiter = param.find("filter");
+    if (fiter != param.end()) {
+      bool filter_lattice = false;
+      parameter_type::const_iterator liter = param.find("filter-lattice");
+      if (liter != param.end())
+	filter_lattice = utils::lexical_cast<bool>(liter->second);
+      
+      filter(fiter->second, filter_lattice);
+    }
 
     parameter_type::const_iterator piter = param.find("populate");
-    if (piter != param.end() && utils::lexical_cast<bool>(piter->second))
+    if (fiter != param.end() || (piter != param.end() && utils::lexical_cast<bool>(piter->second)))
       populate();
+    
+    parameter_type::const_iterator citer = param.find("cache-size");
+    if (citer != param.end()) {
+      const size_type cache_size = utils::lexical_cast<size_type>(citer->second);
+      
+      if (cache_size)
+	cache_shared.reset(new cache_shared_type(cache_size));
+    }
   }
   
   void GrammarStaticImpl::write(const path_type& file) const
@@ -1328,6 +1459,15 @@ namespace cicada
 	os_offset.write((char*)&offset, sizeof(off_type));
       }
       
+      // insert already encoded data
+      void insert(const utils::piece& data)
+      {
+	offset += data.size();
+	
+	os_data.write(data.data(), data.size());
+	os_offset.write((char*)&offset, sizeof(off_type));
+      }
+      
       void clear()
       {
 	offset = 0;
@@ -2114,6 +2254,377 @@ namespace cicada
   }
   
   
+  void GrammarStaticImpl::filter(const path_type& input, const bool input_lattice)
+  {
+    typedef succinctdb::succinct_hash<byte_type, std::allocator<byte_type> > phrase_map_type;
+    
+    typedef ScoreSetStream score_stream_type;
+    typedef std::vector<score_stream_type, std::allocator<score_stream_type> > score_stream_set_type;
+    
+    // feature-id, lhs-id, target-id
+    typedef boost::tuple<id_type, symbol_type::id_type, id_type> rule_option_type;
+    typedef std::vector<rule_option_type, std::allocator<rule_option_type> > rule_option_set_type;
+    
+    typedef std::vector<word_type::id_type, std::allocator<word_type::id_type> > id_set_type;
+    typedef std::vector<byte_type, std::allocator<byte_type> >  code_set_type;
+    
+    typedef std::vector<size_type, std::allocator<size_type> > node_set_type;
+    
+    // trie node and lattice position
+    typedef std::pair<size_type, size_type> state_type;
+    typedef std::vector<state_type, std::allocator<state_type> > state_set_type;
+    typedef utils::unordered_set<state_type, boost::hash<state_type>, std::equal_to<state_type>,
+				 std::allocator<state_type> >::type state_unique_type;
+    
+    typedef utils::unordered_map<size_type, node_set_type, boost::hash<size_type>, std::equal_to<size_type>,
+				 std::allocator<std::pair<const size_type, node_set_type> > >::type non_terminal_map_type;
+    
+    if (input != "-" && ! boost::filesystem::exists(input))
+      throw std::runtime_error(std::string("no filter input? ") + input.string());
+    
+    utils::resource traverse_start;
+    
+    // first, we will collect trie nodes reachable by the terminals of the input and non-terminals
+    // which may span any (non-empty) range. Epsilons in lattices do not advance the trie.
+    node_set_type nodes;
+    
+    {
+      non_terminal_map_type non_terminals;
+      state_set_type        stack;
+      state_unique_type     states;
+      
+      Lattice lattice;
+      
+      utils::compress_istream is(input, 1024 * 1024);
+      std::string line;
+      
+      while (utils::getline(is, line)) {
+	if (input_lattice)
+	  lattice.assign(line);
+	else
+	  lattice = Lattice(Sentence(line));
+	
+	states.clear();
+	
+	for (size_type first = 0; first != lattice.size(); ++ first)
+	  stack.push_back(state_type(0, first));
+	
+	while (! stack.empty()) {
+	  const state_type state = stack.back();
+	  stack.pop_back();
+	  
+	  if (! states.insert(state).second) continue;
+	  
+	  const size_type node = state.first;
+	  const size_type pos  = state.second;
+	  
+	  if (node && exists(node))
+	    nodes.push_back(node);
+	  
+	  if (pos == lattice.size() || ! has_children(node)) continue;
+	  
+	  Lattice::arc_set_type::const_iterator aiter_end = lattice[pos].end();
+	  for (Lattice::arc_set_type::const_iterator aiter = lattice[pos].begin(); aiter != aiter_end; ++ aiter) {
+	    if (aiter->label == vocab_type::EPSILON)
+	      stack.push_back(state_type(node, pos + aiter->distance));
+	    else {
+	      const size_type next = find(aiter->label, node);
+	      
+	      if (is_valid(next))
+		stack.push_back(state_type(next, pos + aiter->distance));
+	    }
+	  }
+	  
+	  // non-terminal children. Children sharing the same index-stripped non-terminal are stored as
+	  // siblings, and we will follow the first one, as in find()
+	  non_terminal_map_type::iterator niter = non_terminals.find(node);
+	  if (niter == non_terminals.end()) {
+	    niter = non_terminals.insert(std::make_pair(node, node_set_type())).first;
+	    
+	    const std::pair<size_type, size_type> range = rule_db.range(node);
+	    
+	    rule_db_type::const_index_iterator iiter = rule_db.ibegin(node);
+	    for (size_type child = range.first; child != range.second; ++ child, ++ iiter)
+	      if ((child == range.first || *iiter != *(iiter - 1)) && vocab[*iiter].is_non_terminal())
+		niter->second.push_back(child);
+	  }
+	  
+	  node_set_type::const_iterator citer_end = niter->second.end();
+	  for (node_set_type::const_iterator citer = niter->second.begin(); citer != citer_end; ++ citer)
+	    for (size_type last = pos + 1; last <= lattice.size(); ++ last)
+	      stack.push_back(state_type(*citer, last));
+	}
+      }
+    }
+    
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    
+    utils::resource traverse_end;
+    
+    if (debug)
+      std::cerr << "filtered # of nodes: " << nodes.size()
+		<< " cpu time: " << traverse_end.cpu_time() - traverse_start.cpu_time()
+		<< " user time: " << traverse_end.user_time() - traverse_start.user_time()
+		<< std::endl;
+    
+    // second, we will copy the rule sets of the reached nodes, with the phrases, scores etc. re-numbered.
+    // The vocabularies are shared with the original grammar.
+    
+    utils::resource index_start;
+    
+    const path_type tmp_dir = utils::tempfile::tmp_dir();
+    
+    const path_type path_rule   = utils::tempfile::directory_name(tmp_dir / "cicada.rule.XXXXXX");
+    const path_type path_source = utils::tempfile::directory_name(tmp_dir / "cicada.source.XXXXXX");
+    const path_type path_target = utils::tempfile::directory_name(tmp_dir / "cicada.target.XXXXXX");
+    
+    const path_type path_feature_data   = utils::tempfile::directory_name(tmp_dir / "cicada.feature-data.XXXXXX");
+    const path_type path_attribute_data = utils::tempfile::directory_name(tmp_dir / "cicada.attribute-data.XXXXXX");
+    
+    utils::tempfile::insert(path_rule);
+    utils::tempfile::insert(path_source);
+    utils::tempfile::insert(path_target);
+    utils::tempfile::insert(path_feature_data);
+    utils::tempfile::insert(path_attribute_data);
+    
+    rule_db_type rule_filtered;
+    rule_filtered.open(path_rule, rule_db_type::WRITE);
+    
+    std::auto_ptr<phrase_map_type> source_map(new phrase_map_type());
+    std::auto_ptr<phrase_map_type> target_map(new phrase_map_type());
+    
+    std::auto_ptr<GrammarParser::feature_stream_type>   feature_stream;
+    std::auto_ptr<GrammarParser::attribute_stream_type> attribute_stream;
+    
+    if (! feature_data.empty())
+      feature_stream.reset(new GrammarParser::feature_stream_type(path_feature_data));
+    if (! attribute_data.empty())
+      attribute_stream.reset(new GrammarParser::attribute_stream_type(path_attribute_data));
+    
+    score_stream_set_type score_streams(score_db.size());
+    score_stream_set_type attr_streams(attr_db.size());
+    
+    for (size_t feature = 0; feature < score_db.size(); ++ feature) {
+      score_streams[feature].path = utils::tempfile::file_name(tmp_dir / "cicada.feature.XXXXXX");
+      utils::tempfile::insert(score_streams[feature].path);
+      
+      score_streams[feature].ostream.reset(new utils::compress_ostream(score_streams[feature].path, 1024 * 1024));
+    }
+    
+    for (size_t attr = 0; attr < attr_db.size(); ++ attr) {
+      attr_streams[attr].path = utils::tempfile::file_name(tmp_dir / "cicada.attribute.XXXXXX");
+      utils::tempfile::insert(attr_streams[attr].path);
+      
+      attr_streams[attr].ostream.reset(new utils::compress_ostream(attr_streams[attr].path, 1024 * 1024));
+    }
+    
+    id_type id_rule = 0;
+    
+    id_set_type key;
+    
+    code_set_type codes_option;
+    rule_option_set_type rule_options;
+    
+    node_set_type::const_iterator niter_end = nodes.end();
+    for (node_set_type::const_iterator niter = nodes.begin(); niter != niter_end; ++ niter) {
+      // index-stripped source, by traversing toward the root
+      key.clear();
+      for (size_type node = *niter; node; /**/) {
+	const size_type parent = rule_db.parent(node);
+	
+	key.push_back(*(rule_db.ibegin(parent) + (node - rule_db.range(parent).first)));
+	node = parent;
+      }
+      std::reverse(key.begin(), key.end());
+      
+      rule_db_type::cursor cursor_end = rule_db.cend(*niter);
+      for (rule_db_type::cursor cursor = rule_db.cbegin(*niter); cursor != cursor_end; ++ cursor) {
+	typedef utils::piece code_set_type;
+	
+	const size_type pos = cursor.node();
+	
+	code_set_type codes(rule_db[pos].begin(), rule_db[pos].end());
+	
+	code_set_type::const_iterator hiter = codes.begin();
+	code_set_type::const_iterator citer = codes.begin();
+	code_set_type::const_iterator citer_end = codes.end();
+	
+	id_type pos_feature;
+	id_type pos_source;
+	id_type pos_target;
+	
+	size_type code_pos = 0;
+	
+	const size_type offset_feature = utils::group_aligned_decode(pos_feature, &(*hiter), code_pos);
+	citer = hiter + offset_feature;
+	hiter += offset_feature & (- size_type((code_pos & 0x03) == 0x03));
+	++ code_pos;
+	
+	const size_type offset_source = utils::group_aligned_decode(pos_source, &(*hiter), code_pos);
+	citer = hiter + offset_source;
+	hiter += offset_source & (- size_type((code_pos & 0x03) == 0x03));
+	++ code_pos;
+	
+	const code_set_type codes_source(source_db[pos_source].begin(), source_db[pos_source].end());
+	
+	const id_type id_source = source_map->insert(codes_source.begin(), codes_source.size(),
+						     hasher_type::operator()(codes_source.begin(), codes_source.end(), 0));
+	
+	rule_options.clear();
+	
+	while (citer != citer_end) {
+	  id_type id_lhs;
+	  const size_type offset_lhs = utils::group_aligned_decode(id_lhs, &(*hiter), code_pos);
+	  citer = hiter + offset_lhs;
+	  hiter += offset_lhs & (- size_type((code_pos & 0x03) == 0x03));
+	  ++ code_pos;
+	  
+	  const size_type offset_target = utils::group_aligned_decode(pos_target, &(*hiter), code_pos);
+	  citer = hiter + offset_target;
+	  hiter += offset_target & (- size_type((code_pos & 0x03) == 0x03));
+	  ++ code_pos;
+	  
+	  const code_set_type codes_target(target_db[pos_target].begin(), target_db[pos_target].end());
+	  
+	  const id_type id_target = target_map->insert(codes_target.begin(), codes_target.size(),
+						       hasher_type::operator()(codes_target.begin(), codes_target.end(), 0));
+	  
+	  for (size_t feature = 0; feature < score_db.size(); ++ feature) {
+	    const score_type score = score_db[feature][pos_feature];
+	    
+	    score_streams[feature].ostream->write((char*) &score, sizeof(score_type));
+	  }
+	  
+	  for (size_t attr = 0; attr < attr_db.size(); ++ attr) {
+	    const score_type score = attr_db[attr][pos_feature];
+	    
+	    attr_streams[attr].ostream->write((char*) &score, sizeof(score_type));
+	  }
+	  
+	  if (feature_stream.get())
+	    feature_stream->insert(feature_data[pos_feature]);
+	  if (attribute_stream.get())
+	    attribute_stream->insert(attribute_data[pos_feature]);
+	  
+	  rule_options.push_back(boost::make_tuple(id_rule ++, id_lhs, id_target));
+	  
+	  ++ pos_feature;
+	}
+	
+	encode_options(rule_options, codes_option, id_source);
+	
+	rule_filtered.insert(&(*key.begin()), key.size(), &(*codes_option.begin()), codes_option.size());
+      }
+    }
+    
+    source_map->prune(static_cast<const hasher_type&>(*this));
+    source_map->write(path_source);
+    source_map.reset();
+    
+    target_map->prune(static_cast<const hasher_type&>(*this));
+    target_map->write(path_target);
+    target_map.reset();
+    
+    feature_stream.reset();
+    attribute_stream.reset();
+    
+    rule_filtered.close();
+    
+    while (! phrase_db_type::exists(path_source)) {
+      ::sync();
+      boost::thread::yield();
+    }
+    while (! phrase_db_type::exists(path_target)) {
+      ::sync();
+      boost::thread::yield();
+    }
+    while (! rule_db_type::exists(path_rule)) {
+      ::sync();
+      boost::thread::yield();
+    }
+    
+    // quantized grammar will be re-quantized
+    bool quantized = false;
+    for (size_t feature = 0; feature < score_db.size(); ++ feature)
+      quantized |= score_db[feature].quantized.is_open();
+    for (size_t attr = 0; attr < attr_db.size(); ++ attr)
+      quantized |= attr_db[attr].quantized.is_open();
+    
+    source_db.open(path_source);
+    target_db.open(path_target);
+    rule_db.open(path_rule);
+    
+    if (! feature_data.empty()) {
+      while (! feature_data_type::exists(path_feature_data)) {
+	::sync();
+	boost::thread::yield();
+      }
+      
+      feature_data.open(path_feature_data);
+    }
+    
+    if (! attribute_data.empty()) {
+      while (! attribute_data_type::exists(path_attribute_data)) {
+	::sync();
+	boost::thread::yield();
+      }
+      
+      attribute_data.open(path_attribute_data);
+    }
+    
+    for (size_t feature = 0; feature < score_db.size(); ++ feature) {
+      score_streams[feature].ostream->reset();
+      
+      while (! score_set_type::score_set_type::exists(score_streams[feature].path)) {
+	::sync();
+	boost::thread::yield();
+      }
+      
+      utils::tempfile::permission(score_streams[feature].path);
+      
+      score_db[feature].clear();
+      score_db[feature].score.open(score_streams[feature].path);
+    }
+    
+    for (size_t attr = 0; attr < attr_db.size(); ++ attr) {
+      attr_streams[attr].ostream->reset();
+      
+      while (! score_set_type::score_set_type::exists(attr_streams[attr].path)) {
+	::sync();
+	boost::thread::yield();
+      }
+      
+      utils::tempfile::permission(attr_streams[attr].path);
+      
+      attr_db[attr].clear();
+      attr_db[attr].score.open(attr_streams[attr].path);
+    }
+    
+    // the caches are keyed by the nodes of the unfiltered trie
+    cache_rule_sets.clear();
+    cache_sources.clear();
+    cache_targets.clear();
+    cache_nodes.clear();
+    cache_root.clear();
+    
+    if (cache_shared)
+      cache_shared.reset(new cache_shared_type(cache_shared->size()));
+    
+    utils::resource index_end;
+    
+    if (debug)
+      std::cerr << "filtered # of rules: " << id_rule
+		<< " cpu time: " << index_end.cpu_time() - index_start.cpu_time()
+		<< " user time: " << index_end.user_time() - index_start.user_time()
+		<< std::endl;
+    
+    binarize();
+    
+    if (quantized)
+      quantize();
+  }
+  
   GrammarStatic::GrammarStatic(const std::string& parameter)
     : pimpl(new impl_type(parameter)) {}
 
@@ -2164,6 +2675,17 @@ namespace cicada
     return (pimpl->is_valid(node) && pimpl->exists(node) ? pimpl->read_rule_set(node) : __empty);
   }
   
+  void GrammarStatic::cache_statistics(size_type& hit, size_type& miss) const
+  {
+    pimpl->cache_statistics(hit, miss);
+  }
+  
+  void GrammarStatic::filter(const path_type& input, const bool input_lattice)
+  {
+    pimpl->filter(input, input_lattice);
+    pimpl->populate();
+  }
+  
   void GrammarStatic::quantize()
   {
     pimpl->quantize();
@@ -38,6 +38,9 @@ namespace cicada
     // key,value: key, value pair... valid pairs are:
     //
     //    max-span = 15 : maximum non-terminals span
+    //    cache-size = 0 : # of decoded rule sets cached and shared by all the clones (0 for no sharing)
+    //    filter = file-name : keep only the rules matching the input sentences (or lattices), and populate
+    //    filter-lattice = false : the filter input is lattices
     // 
     //    feature0 = feature-name0
     //    feature1 = feature-name1
@@ -61,8 +64,12 @@ namespace cicada
     id_type next(const id_type& node, const symbol_type& symbol) const;
     bool has_next(const id_type& node) const;
     const rule_pair_set_type& rules(const id_type& node) const;
+    void cache_statistics(size_type& hit, size_type& miss) const;
 
     // grammar_static specific members
+    
+    // keep only the rules reachable by the input sentences (or lattices), then populate
+    void filter(const path_type& input, const bool input_lattice=false);
     void quantize();
     void write(const path_type& path) const;
     
@@ -6,6 +6,7 @@
 #define PHOENIX_THREADSAFE
 
 #include "hypergraph.hpp"
+#include "hypergraph_binary.hpp"
 #include "sort_topologically.hpp"
 #include "unite.hpp"
 
@@ -22,6 +23,8 @@
 
 #include <boost/thread.hpp>
 
+#include <deque>
+
 #include "utils/config.hpp"
 #include "utils/array_power2.hpp"
 #include "utils/hashmurmur3.hpp"
@@ -52,6 +55,156 @@ namespace cicada
   {
     cicada::unite(*this, x);
   }
+
+  struct HyperGraphArena
+  {
+    typedef HyperGraph::feature_set_type          feature_set_type;
+    typedef HyperGraph::attribute_set_type        attribute_set_type;
+    typedef HyperGraph::node_type::edge_set_type  edge_set_type;
+    
+    // each pooled storage is kept together with its (approximate) size in bytes
+    typedef std::pair<feature_set_type, size_t>   feature_pooled_type;
+    typedef std::pair<attribute_set_type, size_t> attribute_pooled_type;
+    typedef std::pair<edge_set_type, size_t>      edge_pooled_type;
+    
+    typedef std::deque<feature_pooled_type, std::allocator<feature_pooled_type> >     feature_pool_type;
+    typedef std::deque<attribute_pooled_type, std::allocator<attribute_pooled_type> > attribute_pool_type;
+    typedef std::deque<edge_pooled_type, std::allocator<edge_pooled_type> >           edge_pool_type;
+    
+    // we do not keep too many, nor too large, storage.
+    // The pools of a thread together hold at most pool_bytes, so that a single large forest
+    // does not leave each worker with a large amount of idle memory.
+    // Feature vectors are kept only when they are small enough to be scanned linearly by compact_hashtable
+    // (up to 128 bytes), so that the iteration order of a reused vector is the same as a fresh one.
+    static const size_t pool_bytes = 16 * 1024 * 1024;
+    static const size_t feature_size = 128 / sizeof(feature_set_type::value_type);
+    static const size_t attribute_size = 16;
+    static const size_t edge_size = 64;
+    
+    HyperGraphArena() : bytes(0), enabled(true) {}
+    
+    // empty is an empty storage which does not allocate
+    template <typename Pool, typename Tp>
+    void recycle(Pool& pool, Tp& x, const Tp& empty, size_t size)
+    {
+      size += sizeof(typename Pool::value_type);
+      
+      if (bytes + size > pool_bytes) return;
+      
+      x.clear();
+      pool.push_back(typename Pool::value_type(empty, size));
+      pool.back().first.swap(x);
+      
+      bytes += size;
+    }
+    
+    template <typename Pool, typename Tp>
+    void reuse(Pool& pool, Tp& x)
+    {
+      if (pool.empty()) return;
+      
+      x.swap(pool.back().first);
+      bytes -= pool.back().second;
+      pool.pop_back();
+    }
+    
+    void clear()
+    {
+      feature_pool_type().swap(features);
+      attribute_pool_type().swap(attributes);
+      edge_pool_type().swap(edges);
+      
+      bytes = 0;
+    }
+    
+    feature_pool_type   features;
+    attribute_pool_type attributes;
+    edge_pool_type      edges;
+    
+    size_t bytes;
+    bool enabled;
+  };
+
+#ifdef HAVE_TLS
+  static __thread HyperGraphArena* __hypergraph_arena_tls = 0;
+  static utils::thread_specific_ptr<HyperGraphArena> __hypergraph_arena;
+#else
+  static utils::thread_specific_ptr<HyperGraphArena> __hypergraph_arena;
+#endif
+
+  static inline
+  HyperGraphArena& hypergraph_arena()
+  {
+#ifdef HAVE_TLS
+    if (! __hypergraph_arena_tls) {
+      __hypergraph_arena.reset(new HyperGraphArena());
+      __hypergraph_arena_tls = __hypergraph_arena.get();
+    }
+    
+    return *__hypergraph_arena_tls;
+#else
+    if (! __hypergraph_arena.get())
+      __hypergraph_arena.reset(new HyperGraphArena());
+    
+    return *__hypergraph_arena;
+#endif
+  }
+  
+  void HyperGraph::arena(const bool enabled)
+  {
+    HyperGraphArena& arena = hypergraph_arena();
+    
+    arena.enabled = enabled;
+    
+    if (! enabled)
+      arena.clear();
+  }
+  
+  bool HyperGraph::arena()
+  {
+    return hypergraph_arena().enabled;
+  }
+  
+  void HyperGraph::arena_recycle()
+  {
+    if (edges.empty() && nodes.empty()) return;
+    
+    HyperGraphArena& arena = hypergraph_arena();
+    
+    if (! arena.enabled) return;
+    
+    // AttributeVector does not expose its capacity, thus we use its size as an estimate
+    edge_set_type::iterator eiter_end = edges.end();
+    for (edge_set_type::iterator eiter = edges.begin(); eiter != eiter_end && arena.bytes < HyperGraphArena::pool_bytes; ++ eiter) {
+      if (eiter->features.bucket_count() && eiter->features.bucket_count() <= HyperGraphArena::feature_size)
+	arena.recycle(arena.features, eiter->features, feature_set_type(0),
+		      eiter->features.bucket_count() * sizeof(feature_set_type::value_type));
+      if (! eiter->attributes.empty() && eiter->attributes.size() <= HyperGraphArena::attribute_size)
+	arena.recycle(arena.attributes, eiter->attributes, attribute_set_type(),
+		      eiter->attributes.size() * sizeof(attribute_set_type::value_type));
+    }
+    
+    node_set_type::iterator niter_end = nodes.end();
+    for (node_set_type::iterator niter = nodes.begin(); niter != niter_end && arena.bytes < HyperGraphArena::pool_bytes; ++ niter)
+      if (niter->edges.capacity() && niter->edges.capacity() <= HyperGraphArena::edge_size)
+	arena.recycle(arena.edges, niter->edges, node_type::edge_set_type(),
+		      niter->edges.capacity() * sizeof(node_type::edge_set_type::value_type));
+  }
+  
+  void HyperGraph::arena_reuse(edge_type& edge)
+  {
+    HyperGraphArena& arena = hypergraph_arena();
+    
+    arena.reuse(arena.features, edge.features);
+    arena.reuse(arena.attributes, edge.attributes);
+  }
+  
+  void HyperGraph::arena_reuse(node_type& node)
+  {
+    HyperGraphArena& arena = hypergraph_arena();
+    
+    arena.reuse(arena.edges, node.edges);
+  }
   
   typedef std::string rule_parsed_type;
   typedef std::vector<rule_parsed_type> rule_parsed_set_type;
@@ -326,6 +479,10 @@ namespace cicada
     namespace standard = boost::spirit::standard;
     
     clear();
+    
+    // binary hypergraph, which is not handled by our JSON parser
+    if (hypergraph_binary_detect(iter, end))
+      return hypergraph_binary_decode(iter, end, *this);
 
     hypergraph_parser_impl::grammar_type& grammar = hypergraph_parser_impl::instance();
     
@@ -62,11 +62,11 @@ namespace cicada
       typedef cicada::Rule rule_type;
       
       Edge()
-	: head(invalid), tails(), rule(), id(invalid) {}
+	: head(invalid), tails(), features(0), rule(), id(invalid) {}
       
       template <typename Iterator>
       Edge(Iterator first, Iterator last)
-	: head(invalid), tails(first, last), rule(), id(invalid) {}
+	: head(invalid), tails(first, last), features(0), rule(), id(invalid) {}
       
       Edge(const id_type& __head,
 	   const node_set_type& __tails,
@@ -96,12 +96,15 @@ namespace cicada
 
     edge_type& add_edge(const edge_type& edge)
     {
-      const id_type edge_id = edges.size();
+      edge_type& edge_new = add_edge();
       
-      edges.push_back(edge);
-      edges.back().id = edge_id;
+      edge_new.head       = edge.head;
+      edge_new.tails      = edge.tails;
+      edge_new.features   = edge.features;
+      edge_new.attributes = edge.attributes;
+      edge_new.rule       = edge.rule;
       
-      return edges.back();
+      return edge_new;
     }
     
 
@@ -112,18 +115,19 @@ namespace cicada
       edges.push_back(edge_type());
       edges.back().id = edge_id;
       
+      arena_reuse(edges.back());
+      
       return edges.back();
     }
 
     template <typename Iterator>
     edge_type& add_edge(Iterator first, Iterator last)
     {
-      const id_type edge_id = edges.size();
+      edge_type& edge = add_edge();
       
-      edges.push_back(edge_type(first, last));
-      edges.back().id = edge_id;
-            
-      return edges.back();
+      edge.tails.assign(first, last);
+      
+      return edge;
     }
     
     node_type& add_node()
@@ -133,6 +137,8 @@ namespace cicada
       nodes.push_back(node_type());
       nodes.back().id = node_id;
       
+      arena_reuse(nodes.back());
+      
       return nodes.back();
     }
     
@@ -144,6 +150,8 @@ namespace cicada
     
     void clear()
     {
+      arena_recycle();
+      
       edges.clear();
       nodes.clear();
       
@@ -162,6 +170,21 @@ namespace cicada
       return goal != invalid;
     }
 
+  public:
+    // Per-thread arena: clear() hands the storage of feature/attribute vectors and node's edge
+    // lists to the current thread, and add_edge()/add_node() reuse them, so that a worker which
+    // clears its hypergraph for each sentence stops allocating after the first few sentences.
+    // The pooled storage is bounded by bytes (16MB per thread), not by the number of entries.
+    // Edge tails are not pooled: add_edge(first, last) still copies them.
+    // It is enabled by default, and can be turned off for each thread.
+    static void arena(const bool enabled);
+    static bool arena();
+    
+  private:
+    void arena_recycle();
+    void arena_reuse(edge_type& edge);
+    void arena_reuse(node_type& node);
+    
   public:
     // algorithms...
     
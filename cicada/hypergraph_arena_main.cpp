@@ -0,0 +1,157 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// allocation counts and throughput of building/clearing hypergraphs with and without the per-thread arena
+//
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "hypergraph.hpp"
+
+#include "utils/malloc_stats.hpp"
+#include "utils/resource.hpp"
+#include "utils/getline.hpp"
+
+typedef cicada::HyperGraph hypergraph_type;
+
+typedef std::vector<std::string, std::allocator<std::string> > line_set_type;
+typedef std::vector<hypergraph_type, std::allocator<hypergraph_type> > hypergraph_set_type;
+
+// count # of allocations
+static size_t num_allocation = 0;
+
+void* operator new(size_t size)
+{
+  ++ num_allocation;
+
+  void* p = std::malloc(size);
+  if (! p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) throw()
+{
+  std::free(p);
+}
+
+// rebuild graph as our composition algorithms do
+void build(const hypergraph_type& source, hypergraph_type& graph)
+{
+  graph.clear();
+
+  for (size_t i = 0; i != source.nodes.size(); ++ i)
+    graph.add_node();
+
+  hypergraph_type::edge_set_type::const_iterator eiter_end = source.edges.end();
+  for (hypergraph_type::edge_set_type::const_iterator eiter = source.edges.begin(); eiter != eiter_end; ++ eiter) {
+    hypergraph_type::edge_type& edge = graph.add_edge(eiter->tails.begin(), eiter->tails.end());
+
+    hypergraph_type::feature_set_type::const_iterator fiter_end = eiter->features.end();
+    for (hypergraph_type::feature_set_type::const_iterator fiter = eiter->features.begin(); fiter != fiter_end; ++ fiter)
+      edge.features[fiter->first] = fiter->second;
+
+    edge.attributes = eiter->attributes;
+    edge.rule = eiter->rule;
+
+    graph.connect_edge(edge.id, eiter->head);
+  }
+
+  graph.goal = source.goal;
+}
+
+template <typename Task>
+void benchmark(const std::string& name, Task task, const size_t num_edge)
+{
+  const size_t allocation = num_allocation;
+
+  utils::resource start;
+  task();
+  utils::resource end;
+
+  std::cout << name
+	    << " allocations/edge: " << (double(num_allocation - allocation) / num_edge)
+	    << " edges/sec: " << (num_edge / (end.thread_time() - start.thread_time()))
+	    << " malloc used: " << utils::malloc_stats::used()
+	    << std::endl;
+}
+
+struct Parse
+{
+  Parse(const line_set_type& __lines, hypergraph_type& __graph) : lines(__lines), graph(__graph) {}
+
+  void operator()()
+  {
+    for (size_t i = 0; i != lines.size(); ++ i)
+      graph.assign(lines[i]);
+  }
+
+  const line_set_type& lines;
+  hypergraph_type& graph;
+};
+
+struct Build
+{
+  Build(const hypergraph_set_type& __graphs, hypergraph_type& __graph) : graphs(__graphs), graph(__graph) {}
+
+  void operator()()
+  {
+    for (size_t i = 0; i != graphs.size(); ++ i)
+      build(graphs[i], graph);
+  }
+
+  const hypergraph_set_type& graphs;
+  hypergraph_type& graph;
+};
+
+int main(int argc, char** argv)
+{
+  try {
+    line_set_type       lines;
+    hypergraph_set_type graphs;
+
+    size_t num_edge = 0;
+
+    std::string line;
+    while (utils::getline(std::cin, line)) {
+      if (line.empty()) continue;
+
+      lines.push_back(line);
+      graphs.push_back(hypergraph_type());
+      graphs.back().assign(line);
+
+      num_edge += graphs.back().edges.size();
+    }
+
+    if (! num_edge) return 0;
+
+    for (int arena = 0; arena != 2; ++ arena) {
+      hypergraph_type::arena(arena);
+
+      hypergraph_type graph;
+
+      std::cout << (arena ? "arena" : "no arena") << std::endl;
+
+      benchmark("parse:", Parse(lines, graph), num_edge);
+      benchmark("build:", Build(graphs, graph), num_edge);
+
+      // check that the reused storage does not alter the results
+      for (size_t i = 0; i != graphs.size(); ++ i) {
+	build(graphs[i], graph);
+
+	if (graph != graphs[i])
+	  std::cerr << "different hypergraph after rebuild" << std::endl;
+      }
+    }
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,647 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+#include "hypergraph_binary.hpp"
+#include "feature_vector_codec.hpp"
+
+#include <boost/functional/hash/hash.hpp>
+
+#include "utils/config.hpp"
+#include "utils/compact_map.hpp"
+#include "utils/thread_specific_ptr.hpp"
+
+namespace cicada
+{
+  const char* HyperGraphBinary::magic = "\x7fHGB";
+
+  namespace hypergraph_binary_impl
+  {
+    typedef HyperGraph hypergraph_type;
+
+    typedef hypergraph_type::id_type            id_type;
+    typedef hypergraph_type::symbol_type        symbol_type;
+    typedef hypergraph_type::rule_type          rule_type;
+    typedef hypergraph_type::rule_ptr_type      rule_ptr_type;
+    typedef hypergraph_type::feature_set_type   feature_set_type;
+    typedef hypergraph_type::attribute_set_type attribute_set_type;
+
+    typedef feature_set_type::feature_type     feature_type;
+    typedef attribute_set_type::attribute_type attribute_type;
+
+    typedef FeatureVectorCODEC::codec_data_type codec_data_type;
+
+    enum {
+      attribute_int = 0,
+      attribute_float,
+      attribute_string
+    };
+
+    template <typename Tp>
+    struct unassigned_id
+    {
+      Tp operator()() const { return Tp(-1); }
+    };
+
+    template <typename Key>
+    struct id_map
+    {
+      typedef utils::compact_map<Key, id_type,
+				 unassigned_id<Key>, unassigned_id<Key>,
+				 boost::hash<Key>, std::equal_to<Key>,
+				 std::allocator<std::pair<const Key, id_type> > > map_type;
+      typedef std::vector<Key, std::allocator<Key> > key_set_type;
+
+      id_type insert(const Key& key)
+      {
+	std::pair<typename map_type::iterator, bool> result = maps.insert(std::make_pair(key, id_type(keys.size())));
+	if (result.second)
+	  keys.push_back(key);
+	return result.first->second;
+      }
+
+      void clear()
+      {
+	maps.clear();
+	keys.clear();
+      }
+
+      map_type     maps;
+      key_set_type keys;
+    };
+
+    typedef std::pair<const rule_type*, id_type> rule_unique_type;
+
+    struct rule_hash
+    {
+      size_t operator()(const rule_type* x) const
+      {
+	return (x ? hash_value(*x) : size_t(0));
+      }
+    };
+
+    struct rule_equal
+    {
+      bool operator()(const rule_type* x, const rule_type* y) const
+      {
+	return (x == y) || (x && y && *x == *y);
+      }
+    };
+
+    // rules are compared by value, thus the empty/deleted key must be a null pointer
+    struct unassigned_rule
+    {
+      const rule_type* operator()() const { return 0; }
+    };
+
+    typedef utils::compact_map<const rule_type*, id_type,
+			       unassigned_rule, unassigned_rule,
+			       rule_hash, rule_equal,
+			       std::allocator<std::pair<const rule_type* const, id_type> > > rule_map_type;
+    typedef std::vector<const rule_type*, std::allocator<const rule_type*> > rule_set_type;
+
+    typedef std::pair<id_type, double> feature_local_type;
+    typedef std::vector<feature_local_type, std::allocator<feature_local_type> > feature_local_set_type;
+
+    struct writer_type
+    {
+      writer_type(std::string& __buffer) : buffer(__buffer) {}
+
+      void byte(const uint8_t c)
+      {
+	if (c == 0 || c == '\n' || c == '\r' || c == HyperGraphBinary::escape) {
+	  buffer.push_back(HyperGraphBinary::escape);
+	  buffer.push_back(c + HyperGraphBinary::escape_offset);
+	} else
+	  buffer.push_back(c);
+      }
+
+      void integer(uint64_t x)
+      {
+	for (/**/; x >= 0x80; x >>= 7)
+	  byte((x & 0x7f) | 0x80);
+	byte(x);
+      }
+
+      void integer_signed(const int64_t x)
+      {
+	integer((uint64_t(x) << 1) ^ uint64_t(x >> 63));
+      }
+
+      void string(const std::string& x)
+      {
+	integer(x.size());
+	std::string::const_iterator iter_end = x.end();
+	for (std::string::const_iterator iter = x.begin(); iter != iter_end; ++ iter)
+	  byte(*iter);
+      }
+
+      void real(const double& x)
+      {
+	codec_data_type::byte_type buf[16];
+	size_t size = 0;
+
+	// codec_data_type casts integral values into int64_t, so keep large ones as raw doubles
+	if (std::fabs(x) < 9007199254740992.0)
+	  size = codec_data_type::encode(buf, x);
+	else {
+	  buf[0] = (1 << (4 + 0)) | sizeof(double);
+	  std::copy(codec_data_type::cast(x), codec_data_type::cast(x) + sizeof(double), buf + 1);
+	  size = sizeof(double) + 1;
+	}
+
+	for (size_t i = 0; i != size; ++ i)
+	  byte(buf[i]);
+      }
+
+      std::string& buffer;
+    };
+
+    struct reader_type
+    {
+      reader_type(const uint8_t* __first, const uint8_t* __last) : first(__first), last(__last) {}
+
+      uint8_t byte()
+      {
+	if (first == last)
+	  throw std::runtime_error("binary hypergraph: premature end");
+
+	const uint8_t c = *first;
+	++ first;
+
+	if (c != HyperGraphBinary::escape)
+	  return c;
+
+	if (first == last)
+	  throw std::runtime_error("binary hypergraph: premature end");
+
+	const uint8_t escaped = *first - HyperGraphBinary::escape_offset;
+	++ first;
+
+	return escaped;
+      }
+
+      uint64_t integer()
+      {
+	uint64_t x = 0;
+	for (size_t shift = 0; shift < 64; shift += 7) {
+	  const uint8_t c = byte();
+
+	  x |= uint64_t(c & 0x7f) << shift;
+	  if (! (c & 0x80))
+	    return x;
+	}
+	throw std::runtime_error("binary hypergraph: invalid integer");
+      }
+
+      int64_t integer_signed()
+      {
+	const uint64_t x = integer();
+	return int64_t(x >> 1) ^ - int64_t(x & 1);
+      }
+
+      void string(std::string& x)
+      {
+	const size_t size = integer();
+
+	x.clear();
+	x.reserve(size);
+	for (size_t i = 0; i != size; ++ i)
+	  x.push_back(byte());
+      }
+
+      double real()
+      {
+	codec_data_type::byte_type buf[16];
+
+	buf[0] = byte();
+
+	const size_t size = (buf[0] & 0x0f);
+	if (size > sizeof(double))
+	  throw std::runtime_error("binary hypergraph: invalid real");
+
+	for (size_t i = 1; i <= size; ++ i)
+	  buf[i] = byte();
+
+	double value;
+	codec_data_type::decode(buf, value);
+	return value;
+      }
+
+      const uint8_t* first;
+      const uint8_t* last;
+    };
+
+    struct encoder_type
+    {
+      typedef id_map<symbol_type::id_type>    symbol_map_type;
+      typedef id_map<feature_type::id_type>   feature_map_type;
+      typedef id_map<attribute_type::id_type> attribute_map_type;
+
+      void operator()(const hypergraph_type& graph, std::string& buffer)
+      {
+	clear();
+
+	// first, collect rules, symbols, features and attributes in the order of edge traversal
+	rule_map_type rules_unique(graph.edges.size());
+
+	hypergraph_type::node_set_type::const_iterator niter_end = graph.nodes.end();
+	for (hypergraph_type::node_set_type::const_iterator niter = graph.nodes.begin(); niter != niter_end; ++ niter) {
+	  hypergraph_type::node_type::edge_set_type::const_iterator eiter_end = niter->edges.end();
+	  for (hypergraph_type::node_type::edge_set_type::const_iterator eiter = niter->edges.begin(); eiter != eiter_end; ++ eiter) {
+	    const hypergraph_type::edge_type& edge = graph.edges[*eiter];
+
+	    if (edge.rule) {
+	      const rule_type& rule = *edge.rule;
+
+	      if (rules_unique.insert(std::make_pair(&rule, id_type(rules.size() + 1))).second) {
+		rules.push_back(&rule);
+
+		symbols.insert(rule.lhs.id());
+		rule_type::symbol_set_type::const_iterator riter_end = rule.rhs.end();
+		for (rule_type::symbol_set_type::const_iterator riter = rule.rhs.begin(); riter != riter_end; ++ riter)
+		  symbols.insert(riter->id());
+	      }
+	    }
+
+	    feature_set_type::const_iterator fiter_end = edge.features.end();
+	    for (feature_set_type::const_iterator fiter = edge.features.begin(); fiter != fiter_end; ++ fiter)
+	      features.insert(fiter->first.id());
+
+	    attribute_set_type::const_iterator aiter_end = edge.attributes.end();
+	    for (attribute_set_type::const_iterator aiter = edge.attributes.begin(); aiter != aiter_end; ++ aiter)
+	      attributes.insert(aiter->first.id());
+	  }
+	}
+
+	body.clear();
+	writer_type writer(body);
+
+	// symbol/feature/attribute tables
+	writer.integer(symbols.keys.size());
+	for (size_t i = 0; i != symbols.keys.size(); ++ i)
+	  writer.string(symbol_type(symbols.keys[i]));
+
+	writer.integer(features.keys.size());
+	for (size_t i = 0; i != features.keys.size(); ++ i)
+	  writer.string(feature_type(features.keys[i]));
+
+	writer.integer(attributes.keys.size());
+	for (size_t i = 0; i != attributes.keys.size(); ++ i)
+	  writer.string(attribute_type(attributes.keys[i]));
+
+	// rules coded by local symbol ids
+	writer.integer(rules.size());
+	rule_set_type::const_iterator riter_end = rules.end();
+	for (rule_set_type::const_iterator riter = rules.begin(); riter != riter_end; ++ riter) {
+	  const rule_type& rule = *(*riter);
+
+	  writer.integer(symbols.maps.find(rule.lhs.id())->second);
+	  writer.integer(rule.rhs.size());
+
+	  rule_type::symbol_set_type::const_iterator siter_end = rule.rhs.end();
+	  for (rule_type::symbol_set_type::const_iterator siter = rule.rhs.begin(); siter != siter_end; ++ siter)
+	    writer.integer(symbols.maps.find(siter->id())->second);
+	}
+
+	// nodes and edges
+	writer.integer(graph.nodes.size());
+	for (hypergraph_type::node_set_type::const_iterator niter = graph.nodes.begin(); niter != niter_end; ++ niter) {
+	  const hypergraph_type::node_type& node = *niter;
+
+	  writer.integer(node.edges.size());
+
+	  hypergraph_type::node_type::edge_set_type::const_iterator eiter_end = node.edges.end();
+	  for (hypergraph_type::node_type::edge_set_type::const_iterator eiter = node.edges.begin(); eiter != eiter_end; ++ eiter) {
+	    const hypergraph_type::edge_type& edge = graph.edges[*eiter];
+
+	    writer.integer(! edge.rule ? 0 : rules_unique.find(&(*edge.rule))->second);
+
+	    // tails are delta-coded, starting from the head
+	    writer.integer(edge.tails.size());
+	    int64_t tail_prev = node.id;
+	    hypergraph_type::edge_type::node_set_type::const_iterator titer_end = edge.tails.end();
+	    for (hypergraph_type::edge_type::node_set_type::const_iterator titer = edge.tails.begin(); titer != titer_end; ++ titer) {
+	      writer.integer_signed(int64_t(*titer) - tail_prev);
+	      tail_prev = *titer;
+	    }
+
+	    // features are sorted by local ids and delta-coded
+	    features_local.clear();
+	    feature_set_type::const_iterator fiter_end = edge.features.end();
+	    for (feature_set_type::const_iterator fiter = edge.features.begin(); fiter != fiter_end; ++ fiter)
+	      features_local.push_back(std::make_pair(features.maps.find(fiter->first.id())->second, fiter->second));
+	    std::sort(features_local.begin(), features_local.end());
+
+	    writer.integer(features_local.size());
+	    id_type feature_prev = 0;
+	    feature_local_set_type::const_iterator liter_end = features_local.end();
+	    for (feature_local_set_type::const_iterator liter = features_local.begin(); liter != liter_end; ++ liter) {
+	      writer.integer(liter->first - feature_prev);
+	      writer.real(liter->second);
+	      feature_prev = liter->first;
+	    }
+
+	    // attributes
+	    writer.integer(edge.attributes.size());
+	    attribute_set_type::const_iterator aiter_end = edge.attributes.end();
+	    for (attribute_set_type::const_iterator aiter = edge.attributes.begin(); aiter != aiter_end; ++ aiter) {
+	      writer.integer(attributes.maps.find(aiter->first.id())->second);
+
+	      if (const attribute_set_type::int_type* value = boost::get<attribute_set_type::int_type>(&aiter->second)) {
+		writer.byte(attribute_int);
+		writer.integer_signed(*value);
+	      } else if (const attribute_set_type::float_type* value = boost::get<attribute_set_type::float_type>(&aiter->second)) {
+		writer.byte(attribute_float);
+		writer.real(*value);
+	      } else if (const attribute_set_type::string_type* value = boost::get<attribute_set_type::string_type>(&aiter->second)) {
+		writer.byte(attribute_string);
+		writer.string(*value);
+	      } else
+		throw std::runtime_error("binary hypergraph: unsupported attribute");
+	    }
+	  }
+	}
+
+	writer.integer(graph.is_valid() ? uint64_t(graph.goal) + 1 : uint64_t(0));
+
+	// header: magic, version and the size of the (escaped) body
+	buffer.clear();
+	buffer.append(HyperGraphBinary::magic, HyperGraphBinary::magic_size);
+	buffer.push_back(HyperGraphBinary::version);
+
+	writer_type writer_header(buffer);
+	writer_header.integer(body.size());
+
+	buffer.append(body);
+      }
+
+      void clear()
+      {
+	symbols.clear();
+	features.clear();
+	attributes.clear();
+	rules.clear();
+      }
+
+      symbol_map_type    symbols;
+      feature_map_type   features;
+      attribute_map_type attributes;
+      rule_set_type      rules;
+
+      feature_local_set_type features_local;
+
+      std::string body;
+    };
+
+    struct decoder_type
+    {
+      typedef std::vector<symbol_type, std::allocator<symbol_type> >       symbol_set_type;
+      typedef std::vector<feature_type, std::allocator<feature_type> >     feature_set_type;
+      typedef std::vector<attribute_type, std::allocator<attribute_type> > attribute_set_type;
+      typedef std::vector<rule_ptr_type, std::allocator<rule_ptr_type> >   rule_ptr_set_type;
+
+      typedef std::vector<symbol_type, std::allocator<symbol_type> >       rhs_type;
+      typedef std::vector<id_type, std::allocator<id_type> >               tail_set_type;
+
+      void operator()(reader_type& reader, hypergraph_type& graph)
+      {
+	symbols.clear();
+	features.clear();
+	attributes.clear();
+	rules.clear();
+
+	const size_t symbols_size = reader.integer();
+	symbols.reserve(symbols_size);
+	for (size_t i = 0; i != symbols_size; ++ i) {
+	  reader.string(token);
+	  symbols.push_back(symbol_type(token));
+	}
+
+	const size_t features_size = reader.integer();
+	features.reserve(features_size);
+	for (size_t i = 0; i != features_size; ++ i) {
+	  reader.string(token);
+	  features.push_back(feature_type(token));
+	}
+
+	const size_t attributes_size = reader.integer();
+	attributes.reserve(attributes_size);
+	for (size_t i = 0; i != attributes_size; ++ i) {
+	  reader.string(token);
+	  attributes.push_back(attribute_type(token));
+	}
+
+	const size_t rules_size = reader.integer();
+	rules.reserve(rules_size + 1);
+	rules.push_back(rule_ptr_type());
+	for (size_t i = 0; i != rules_size; ++ i) {
+	  const symbol_type& lhs = symbol(reader.integer());
+
+	  rhs.clear();
+	  const size_t rhs_size = reader.integer();
+	  for (size_t j = 0; j != rhs_size; ++ j)
+	    rhs.push_back(symbol(reader.integer()));
+
+	  rules.push_back(rule_type::create(rule_type(lhs, rhs.begin(), rhs.end())));
+	}
+
+	const size_t nodes_size = reader.integer();
+	for (size_t i = 0; i != nodes_size; ++ i) {
+	  const id_type head = graph.add_node().id;
+
+	  const size_t edges_size = reader.integer();
+	  for (size_t j = 0; j != edges_size; ++ j) {
+	    const size_t rule_id = reader.integer();
+	    if (rule_id >= rules.size())
+	      throw std::runtime_error("binary hypergraph: invalid rule id");
+
+	    tails.clear();
+	    const size_t tails_size = reader.integer();
+	    int64_t tail = head;
+	    for (size_t k = 0; k != tails_size; ++ k) {
+	      tail += reader.integer_signed();
+	      if (tail < 0 || tail >= int64_t(nodes_size))
+		throw std::runtime_error("binary hypergraph: invalid tail");
+	      tails.push_back(tail);
+	    }
+
+	    hypergraph_type::edge_type& edge = graph.add_edge(tails.begin(), tails.end());
+	    edge.rule = rules[rule_id];
+
+	    const size_t edge_features_size = reader.integer();
+	    if (edge_features_size)
+	      edge.features.rehash(edge_features_size);
+	    id_type feature_id = 0;
+	    for (size_t k = 0; k != edge_features_size; ++ k) {
+	      feature_id += reader.integer();
+	      if (feature_id >= features.size())
+		throw std::runtime_error("binary hypergraph: invalid feature id");
+
+	      edge.features[features[feature_id]] = reader.real();
+	    }
+
+	    const size_t edge_attributes_size = reader.integer();
+	    for (size_t k = 0; k != edge_attributes_size; ++ k) {
+	      const size_t attribute_id = reader.integer();
+	      if (attribute_id >= attributes.size())
+		throw std::runtime_error("binary hypergraph: invalid attribute id");
+
+	      const attribute_type& attr = attributes[attribute_id];
+
+	      switch (reader.byte()) {
+	      case attribute_int:
+		edge.attributes[attr] = hypergraph_type::attribute_set_type::int_type(reader.integer_signed());
+		break;
+	      case attribute_float:
+		edge.attributes[attr] = hypergraph_type::attribute_set_type::float_type(reader.real());
+		break;
+	      case attribute_string:
+		reader.string(token);
+		edge.attributes[attr] = token;
+		break;
+	      default:
+		throw std::runtime_error("binary hypergraph: invalid attribute");
+	      }
+	    }
+
+	    graph.connect_edge(edge.id, head);
+	  }
+	}
+
+	const uint64_t goal = reader.integer();
+	if (goal > nodes_size)
+	  throw std::runtime_error("binary hypergraph: invalid goal");
+
+	graph.goal = (goal ? id_type(goal - 1) : hypergraph_type::invalid);
+      }
+
+      const symbol_type& symbol(const size_t id) const
+      {
+	if (id >= symbols.size())
+	  throw std::runtime_error("binary hypergraph: invalid symbol id");
+	return symbols[id];
+      }
+
+      symbol_set_type    symbols;
+      feature_set_type   features;
+      attribute_set_type attributes;
+      rule_ptr_set_type  rules;
+
+      rhs_type      rhs;
+      tail_set_type tails;
+
+      std::string token;
+    };
+
+#ifdef HAVE_TLS
+    static __thread encoder_type* __encoder_tls = 0;
+    static __thread decoder_type* __decoder_tls = 0;
+#endif
+    static utils::thread_specific_ptr<encoder_type> __encoder;
+    static utils::thread_specific_ptr<decoder_type> __decoder;
+
+    static encoder_type& encoder_instance()
+    {
+#ifdef HAVE_TLS
+      if (! __encoder_tls) {
+	__encoder.reset(new encoder_type());
+	__encoder_tls = __encoder.get();
+      }
+      
+      return *__encoder_tls;
+#else
+      if (! __encoder.get())
+	__encoder.reset(new encoder_type());
+      
+      return *__encoder;
+#endif
+    }
+
+    static decoder_type& decoder_instance()
+    {
+#ifdef HAVE_TLS
+      if (! __decoder_tls) {
+	__decoder.reset(new decoder_type());
+	__decoder_tls = __decoder.get();
+      }
+      
+      return *__decoder_tls;
+#else
+      if (! __decoder.get())
+	__decoder.reset(new decoder_type());
+      
+      return *__decoder;
+#endif
+    }
+  };
+
+  bool hypergraph_binary_detect(utils::piece::const_iterator first, utils::piece::const_iterator last)
+  {
+    for (/**/; first != last && (*first == ' ' || *first == '\t'); ++ first) ;
+
+    return (last - first >= std::ptrdiff_t(HyperGraphBinary::magic_size)
+	    && std::equal(HyperGraphBinary::magic, HyperGraphBinary::magic + HyperGraphBinary::magic_size, first));
+  }
+
+  void hypergraph_binary_encode(const HyperGraph& graph, std::string& buffer)
+  {
+    hypergraph_binary_impl::encoder_instance()(graph, buffer);
+  }
+
+  std::ostream& hypergraph_binary_encode(std::ostream& os, const HyperGraph& graph)
+  {
+    std::string buffer;
+
+    hypergraph_binary_encode(graph, buffer);
+
+    os.write(buffer.c_str(), buffer.size());
+
+    return os;
+  }
+
+  bool hypergraph_binary_decode(utils::piece::const_iterator& iter, utils::piece::const_iterator end, HyperGraph& graph)
+  {
+    graph.clear();
+
+    utils::piece::const_iterator first = iter;
+    for (/**/; first != end && (*first == ' ' || *first == '\t'); ++ first) ;
+
+    if (! hypergraph_binary_detect(first, end)) return false;
+
+    first += HyperGraphBinary::magic_size;
+
+    if (first == end || uint8_t(*first) > HyperGraphBinary::version) return false;
+    ++ first;
+
+    try {
+      hypergraph_binary_impl::reader_type reader_header(reinterpret_cast<const uint8_t*>(first),
+							reinterpret_cast<const uint8_t*>(end));
+
+      const uint64_t body_size = reader_header.integer();
+      if (body_size > uint64_t(reinterpret_cast<const uint8_t*>(end) - reader_header.first))
+	return false;
+
+      hypergraph_binary_impl::reader_type reader(reader_header.first, reader_header.first + body_size);
+      hypergraph_binary_impl::decoder_instance()(reader, graph);
+
+      if (reader.first != reader.last) {
+	graph.clear();
+	return false;
+      }
+
+      iter = reinterpret_cast<utils::piece::const_iterator>(reader.last);
+    }
+    catch (std::exception& err) {
+      graph.clear();
+      return false;
+    }
+
+    return true;
+  }
+};
@@ -0,0 +1,52 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__HYPERGRAPH_BINARY__HPP__
+#define __CICADA__HYPERGRAPH_BINARY__HPP__ 1
+
+//
+// a compact binary hypergraph format
+//
+// Each hypergraph is encoded as a magic "\x7fHGB", a version byte and a
+// length-prefixed body. The body keeps per-hypergraph symbol/feature/attribute
+// tables, so that rules are coded by (local) symbol ids, tails are delta-coded
+// relative to their head and features are packed as in feature_vector_codec.hpp.
+// Bytes which would break line-oriented processing, i.e. '\0', '\n' and '\r',
+// are escaped, thus the binary form can be placed wherever the JSON form is used,
+// e.g. "id ||| hypergraph" lines. Decoding is not zero-copy: escaped bytes are
+// undone, local symbols/features are re-interned and the result is copied into
+// a HyperGraph, much as in the JSON reader, only with less parsing.
+//
+// HyperGraph::assign automatically detects the binary format.
+//
+
+#include <iostream>
+#include <string>
+
+#include <cicada/hypergraph.hpp>
+
+#include <utils/piece.hpp>
+
+namespace cicada
+{
+  struct HyperGraphBinary
+  {
+    static const char* magic;
+    static const size_t magic_size = 4;
+    static const uint8_t version = 1;
+
+    static const uint8_t escape = 0x1b;
+    static const uint8_t escape_offset = 0x40;
+  };
+
+  bool hypergraph_binary_detect(utils::piece::const_iterator first, utils::piece::const_iterator last);
+
+  void hypergraph_binary_encode(const HyperGraph& graph, std::string& buffer);
+  std::ostream& hypergraph_binary_encode(std::ostream& os, const HyperGraph& graph);
+
+  bool hypergraph_binary_decode(utils::piece::const_iterator& iter, utils::piece::const_iterator end, HyperGraph& graph);
+};
+
+#endif
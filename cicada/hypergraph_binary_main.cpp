@@ -0,0 +1,131 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// round-trip test and parse/serialize throughput of the JSON and binary hypergraph formats
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hypergraph.hpp"
+#include "hypergraph_binary.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/getline.hpp"
+
+typedef cicada::HyperGraph hypergraph_type;
+
+typedef std::vector<std::string, std::allocator<std::string> > line_set_type;
+
+int main(int argc, char** argv)
+{
+  try {
+    line_set_type lines_json;
+    line_set_type lines_binary;
+
+    std::string line;
+    hypergraph_type graph;
+    hypergraph_type graph_binary;
+
+    size_t num_node = 0;
+    size_t num_edge = 0;
+
+    while (utils::getline(std::cin, line)) {
+      if (line.empty()) continue;
+
+      graph.assign(line);
+
+      std::ostringstream os_json;
+      os_json << graph;
+
+      lines_json.push_back(os_json.str());
+      lines_binary.push_back(std::string());
+
+      cicada::hypergraph_binary_encode(graph, lines_binary.back());
+
+      if (lines_binary.back().find('\n') != std::string::npos || lines_binary.back().find('\0') != std::string::npos)
+	std::cerr << "binary form is not line-safe" << std::endl;
+
+      graph_binary.assign(lines_binary.back());
+
+      if (graph_binary != graph)
+	std::cerr << "different hypergraph after binary round-trip" << std::endl;
+
+      num_node += graph.nodes.size();
+      num_edge += graph.edges.size();
+    }
+
+    size_t bytes_json = 0;
+    size_t bytes_binary = 0;
+    for (size_t i = 0; i != lines_json.size(); ++ i) {
+      bytes_json   += lines_json[i].size();
+      bytes_binary += lines_binary[i].size();
+    }
+
+    std::cout << "# of hypergraphs: " << lines_json.size()
+	      << " # of nodes: " << num_node
+	      << " # of edges: " << num_edge
+	      << std::endl;
+    std::cout << "json bytes: " << bytes_json << " binary bytes: " << bytes_binary << std::endl;
+
+    if (lines_json.empty()) return 0;
+
+    {
+      utils::resource start;
+      for (size_t i = 0; i != lines_json.size(); ++ i)
+	graph.assign(lines_json[i]);
+      utils::resource end;
+
+      std::cout << "json parse:       " << (lines_json.size() / (end.thread_time() - start.thread_time())) << " graphs/sec "
+		<< (bytes_json / (end.thread_time() - start.thread_time())) / (1024 * 1024) << " MB/sec"
+		<< std::endl;
+    }
+
+    {
+      utils::resource start;
+      for (size_t i = 0; i != lines_binary.size(); ++ i)
+	graph.assign(lines_binary[i]);
+      utils::resource end;
+
+      std::cout << "binary parse:     " << (lines_binary.size() / (end.thread_time() - start.thread_time())) << " graphs/sec "
+		<< (bytes_binary / (end.thread_time() - start.thread_time())) / (1024 * 1024) << " MB/sec"
+		<< std::endl;
+    }
+
+    {
+      std::ostringstream os;
+      utils::resource start;
+      for (size_t i = 0; i != lines_json.size(); ++ i) {
+	graph.assign(lines_json[i]);
+	os << graph << '\n';
+      }
+      utils::resource end;
+
+      std::cout << "json serialize:   " << (lines_json.size() / (end.thread_time() - start.thread_time())) << " graphs/sec"
+		<< " (including parse)"
+		<< std::endl;
+    }
+
+    {
+      std::ostringstream os;
+      utils::resource start;
+      for (size_t i = 0; i != lines_binary.size(); ++ i) {
+	graph.assign(lines_binary[i]);
+	cicada::hypergraph_binary_encode(os, graph) << '\n';
+      }
+      utils::resource end;
+
+      std::cout << "binary serialize: " << (lines_binary.size() / (end.thread_time() - start.thread_time())) << " graphs/sec"
+		<< " (including parse)"
+		<< std::endl;
+    }
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
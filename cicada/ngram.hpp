@@ -13,6 +13,7 @@
 #include <cicada/ngram_index.hpp>
 #include <cicada/ngram_state.hpp>
 #include <cicada/ngram_state_chart.hpp>
+#include <cicada/ngram_result_cache.hpp>
 
 #include <boost/array.hpp>
 
@@ -117,6 +118,8 @@ namespace cicada
       Result() : state(), prob(0), bound(0), prev(0), length(0), complete(false) {}
     };
     typedef Result result_type;
+    
+    typedef NGramResultCache<result_type> cache_type;
 
   public:
     NGram(const int _debug=0) : debug(_debug) { clear(); }
@@ -130,6 +133,58 @@ namespace cicada
     
     template <typename Word_>
     result_type ngram_score(const void* buffer_in, const Word_& word, void* buffer_out) const
+    {
+      return ngram_score(buffer_in, word_id(word), buffer_out);
+    }
+    
+    result_type ngram_score(const void* buffer_in, const word_type::id_type& word, void* buffer_out) const
+    {
+      bool cached = false;
+      return ngram_score(buffer_in, word, buffer_out, cached);
+    }
+    
+    // ngram_score with the result cache shared by all the threads, if reserved. cached is true
+    // when the result is found in the cache.
+    result_type ngram_score(const void* buffer_in, const word_type::id_type& word, void* buffer_out, bool& cached) const
+    {
+      cached = false;
+      
+      if (cache.empty())
+	return ngram_score_uncached(buffer_in, word, buffer_out);
+      
+      NGramState ngram_state(index.order());
+      
+      const word_type::id_type* context = ngram_state.context(buffer_in);
+      const size_type context_length = ngram_state.size(buffer_in);
+      const uint64_t hash = cache.hash(context, context_length, word);
+      
+      result_type result;
+      size_type   size_out = 0;
+      
+      if (cache.find(hash, context, context_length, word, result, ngram_state.backoff(buffer_out), size_out)) {
+	word_type::id_type* output = ngram_state.context(buffer_out);
+	
+	if (size_out) {
+	  *output = word;
+	  std::copy(context, context + size_out - 1, output + 1);
+	}
+	
+	ngram_state.size(buffer_out) = size_out;
+	
+	cached = true;
+	
+	return result;
+      }
+      
+      result = ngram_score_uncached(buffer_in, word, buffer_out);
+      
+      const_cast<cache_type&>(cache).insert(hash, context, context_length, word, result,
+					    ngram_state.backoff(buffer_out), ngram_state.size(buffer_out));
+      
+      return result;
+    }
+    
+    result_type ngram_score_uncached(const void* buffer_in, const word_type::id_type& word, void* buffer_out) const
     {
       NGramState ngram_state(index.order());
       
@@ -677,9 +732,21 @@ namespace cicada
     bool is_open() const { return index.is_open(); }
     bool has_bounds() const { return ! logbounds.empty(); }
 
+    // reserve the result cache of ngram_score for at least size entries. This should be called
+    // before scoring, since the cache is shared by all the threads.
+    void reserve_cache(size_type size)
+    {
+      cache.reserve(size, index.order());
+    }
+    
   public:
     static NGram& create(const path_type& path);
     
+  private:
+    template <typename Word_>
+    word_type::id_type word_id(const Word_& word) const { return index.vocab()[word]; }
+    word_type::id_type word_id(const word_type::id_type& word) const { return word; }
+    
   public:
     shard_index_type    index;
     shard_data_set_type logprobs;
@@ -688,6 +755,8 @@ namespace cicada
     
     logprob_type   smooth;
     int debug;
+    
+    cache_type cache;
   };
   
 };
@@ -8,6 +8,9 @@
 
 #include "ngram_index.hpp"
 
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/file.hpp>
+
 #include "utils/lexical_cast.hpp"
 
 namespace cicada
@@ -42,9 +45,56 @@ namespace cicada
     }
 
     off_set_type(offsets).swap(offsets);
+    
+    // optional unpacked layout
+    if (boost::filesystem::exists(rep.path("index-unpacked")) && boost::filesystem::exists(rep.path("children"))) {
+      ids_unpacked.open(rep.path("index-unpacked"));
+      children.open(rep.path("children"));
+      
+      if (ids_unpacked.size() != ids.size())
+	throw std::runtime_error("unpacked index size does not match");
+      if (children.size() != position_size())
+	throw std::runtime_error("children size does not match");
+      
+      unpacked = true;
+    }
 
     clear_cache();
   }
+
+  void NGramIndex::Shard::write_unpacked(const path_type& path) const
+  {
+    if (size() > size_type(uint32_t(-1)))
+      throw std::runtime_error("too large shard for the unpacked layout: " + path.string());
+    
+    {
+      boost::iostreams::filtering_ostream os;
+      os.push(boost::iostreams::file_sink((path / "index-unpacked").string(), std::ios_base::out | std::ios_base::trunc), 1024 * 1024);
+      
+      for (size_type pos = 0; pos != ids.size(); ++ pos) {
+	const id_type id = ids[pos];
+	
+	os.write((char*) &id, sizeof(id_type));
+      }
+    }
+    
+    {
+      boost::iostreams::filtering_ostream os;
+      os.push(boost::iostreams::file_sink((path / "children").string(), std::ios_base::out | std::ios_base::trunc), 1024 * 1024);
+      
+      for (size_type pos = 0; pos != position_size(); ++ pos) {
+	const uint32_t last = children_last(pos);
+	
+	os.write((char*) &last, sizeof(uint32_t));
+      }
+    }
+  }
+  
+  void NGramIndex::write_unpacked() const
+  {
+    for (size_t shard = 0; shard != __shards.size(); ++ shard)
+      __shards[shard].write_unpacked(__shards[shard].path());
+  }
   
   void NGramIndex::open(const path_type& path)
   {
@@ -23,13 +23,20 @@
 #include <cicada/vocab.hpp>
 
 #include <utils/array_power2.hpp>
+#include <utils/map_file.hpp>
 #include <utils/packed_vector.hpp>
-#include <utils/succinct_vector.hpp>
+#include <utils/succinct_vector_rank9.hpp>
 #include <utils/hashmurmur.hpp>
 #include <utils/hashmurmur3.hpp>
 #include <utils/bithack.hpp>
 #include <utils/atomicop.hpp>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace cicada
 {
   
@@ -108,8 +115,12 @@ namespace cicada
       
     public:
       typedef utils::packed_vector_mapped<id_type, std::allocator<id_type> >   id_set_type;
-      typedef utils::succinct_vector_mapped<std::allocator<int32_t> >          position_set_type;
+      typedef utils::succinct_vector_rank9_mapped<std::allocator<int32_t> >    position_set_type;
       typedef std::vector<size_type, std::allocator<size_type> >               off_set_type;
+      
+      // unpacked layout: ids as plain 32-bit words, and the end of the children range for each position
+      typedef utils::map_file<id_type, std::allocator<id_type> >               id_unpacked_set_type;
+      typedef utils::map_file<uint32_t, std::allocator<uint32_t> >             child_set_type;
 
     public:
       struct cache_type
@@ -152,16 +163,22 @@ namespace cicada
       typedef utils::array_power2<cache_type, 1024 * 32, std::allocator<cache_type> > cache_set_type;
       
     public:
-      Shard() {}
-      Shard(const path_type& path) { open(path); }
+      Shard() : unpacked(false) {}
+      Shard(const path_type& path) : unpacked(false) { open(path); }
       
-      Shard(const Shard& x) : ids(x.ids), positions(x.positions), offsets(x.offsets) { clear_cache(); }
+      Shard(const Shard& x)
+	: ids(x.ids), positions(x.positions), offsets(x.offsets),
+	  ids_unpacked(x.ids_unpacked), children(x.children), unpacked(x.unpacked) { clear_cache(); }
       Shard& operator=(const Shard& x)
       {
 	ids = x.ids;
 	positions = x.positions;
 	offsets = x.offsets;
 	
+	ids_unpacked = x.ids_unpacked;
+	children     = x.children;
+	unpacked     = x.unpacked;
+	
 	clear_cache();
 	
 	return *this;
@@ -175,6 +192,10 @@ namespace cicada
 	positions.clear();
 	offsets.clear();
 	
+	ids_unpacked.clear();
+	children.clear();
+	unpacked = false;
+	
 	clear_cache();
       };
       
@@ -185,15 +206,26 @@ namespace cicada
 
       void open(const path_type& path);
       
+      // write the unpacked layout, "index-unpacked" and "children", under path
+      void write_unpacked(const path_type& path) const;
+      
       void populate()
       {
 	ids.populate();
 	positions.populate();
+	
+	if (unpacked) {
+	  ids_unpacked.populate();
+	  children.populate();
+	}
       }
 
     public:
       id_type operator[](size_type pos) const { return index(pos); }
-      id_type index(size_type pos) const { return (pos < offsets[1] ? id_type(pos) : ids[pos - offsets[1]]); }
+      id_type index(size_type pos) const
+      {
+	return (pos < offsets[1] ? id_type(pos) : (unpacked ? ids_unpacked[pos - offsets[1]] : ids[pos - offsets[1]]));
+      }
       size_type position_size() const { return offsets[offsets.size() - 2]; }
       size_type size() const { return offsets.back(); }
       bool empty() const { return offsets.empty(); }
@@ -214,6 +246,8 @@ namespace cicada
 	  return offsets[1] != children_last(pos);
 	else if (pos >= position_size())
 	  return false;
+	else if (unpacked)
+	  return children[pos - 1] != children[pos];
 	else {
 	  const position_set_type::size_type last = positions.select(pos + 2 - 1, false);
 	  
@@ -239,6 +273,8 @@ namespace cicada
 	  return offset;
 	else if (pos >= position_size())
 	  return size();
+	else if (unpacked)
+	  return children[pos];
 	else {
 	  position_set_type::size_type last = positions.select(pos + 2 - 1, false);
 	  
@@ -307,7 +343,13 @@ namespace cicada
 	
 	if (last <= offset)
 	  return std::make_pair(utils::bithack::min(size_type(id), last), id); // unigram!
-	else {
+	else if (unpacked) {
+	  // do not form a pointer before the array: index by pos - offset
+	  const id_type* base = &(*ids_unpacked.begin());
+	  const size_type pos = first + lower_bound_unpacked(base + (first - offset), base + (last - offset), id);
+	  
+	  return std::make_pair(pos, pos != last ? base[pos - offset] : id_type(0));
+	} else {
 	  // otherwise...
 	  size_type length = last - first;
 	  first -= offset;
@@ -337,6 +379,50 @@ namespace cicada
 	}
       }
       
+      // branchless binary search until the range fits in a few cache lines, then
+      // count the ids less than id by SIMD compares, which is the lower bound of the sorted range.
+      static size_type lower_bound_unpacked(const id_type* first, const id_type* last, const id_type& id)
+      {
+	size_type pos = 0;
+	size_type length = last - first;
+	while (length > 64) {
+	  const size_type half = length >> 1;
+	  const bool less = first[pos + half] < id;
+	  
+	  pos    = utils::bithack::branch(less, pos + half + 1, pos);
+	  length = utils::bithack::branch(less, length - half - 1, half);
+	}
+	
+	first += pos;
+	last = first + length;
+	
+	size_type count = 0;
+	
+	// signed comparison after flipping the sign bit
+#if defined(__AVX2__)
+	const __m256i bias256 = _mm256_set1_epi32(int(0x80000000));
+	const __m256i key256  = _mm256_set1_epi32(int(id ^ 0x80000000));
+	for (/**/; last - first >= 8; first += 8) {
+	  const __m256i values = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first)), bias256);
+	  
+	  count += utils::bithack::bit_count(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(key256, values)))));
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i bias128 = _mm_set1_epi32(int(0x80000000));
+	const __m128i key128  = _mm_set1_epi32(int(id ^ 0x80000000));
+	for (/**/; last - first >= 4; first += 4) {
+	  const __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), bias128);
+	  
+	  count += utils::bithack::bit_count(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(key128, values)))));
+	}
+#endif
+	for (/**/; first != last; ++ first)
+	  count += (*first < id);
+	
+	return pos + count;
+      }
+      
       template <typename Iterator, typename _Word>
       std::pair<Iterator, size_type> __traverse_dispatch(Iterator first, Iterator last, const vocab_type& vocab, _Word) const
       {
@@ -370,6 +456,10 @@ namespace cicada
       position_set_type  positions;
       off_set_type       offsets;
       
+      id_unpacked_set_type ids_unpacked;
+      child_set_type       children;
+      bool                 unpacked;
+      
       cache_set_type     caches;
     };
     
@@ -510,6 +600,9 @@ namespace cicada
     void close() { clear(); }
     
     void open(const path_type& path);
+    
+    // augment each shard with the unpacked layout, which will be used when opened next time
+    void write_unpacked() const;
 
     void populate()
     {
@@ -0,0 +1,166 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// lookups by the packed and the unpacked layouts of the ngram index:
+// random walks over the index and decoder-like backward lookups of sentences from stdin.
+// The index should be augmented by cicada_index_ngram.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/random.hpp>
+
+#include "ngram_index.hpp"
+#include "sentence.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+#include "utils/bithack.hpp"
+
+typedef cicada::NGramIndex ngram_index_type;
+typedef ngram_index_type::state_type state_type;
+typedef ngram_index_type::id_type id_type;
+typedef ngram_index_type::size_type size_type;
+
+typedef std::vector<id_type, std::allocator<id_type> > ngram_type;
+typedef std::vector<ngram_type, std::allocator<ngram_type> > ngram_set_type;
+typedef std::vector<state_type, std::allocator<state_type> > state_set_type;
+
+// lookup ngrams, one word at a time, as the decoder does
+struct Lookup
+{
+  Lookup(const ngram_set_type& __ngrams) : ngrams(__ngrams) {}
+
+  void operator()(const ngram_index_type& index, state_set_type& states) const
+  {
+    states.clear();
+
+    ngram_set_type::const_iterator niter_end = ngrams.end();
+    for (ngram_set_type::const_iterator niter = ngrams.begin(); niter != niter_end; ++ niter) {
+      state_type state = index.root();
+
+      ngram_type::const_iterator iter_end = niter->end();
+      for (ngram_type::const_iterator iter = niter->begin(); iter != iter_end; ++ iter) {
+	const state_type state_next = index.next(state, *iter);
+	if (state_next.is_root_node()) break;
+
+	state = state_next;
+      }
+
+      states.push_back(state);
+    }
+  }
+
+  const ngram_set_type& ngrams;
+};
+
+void benchmark(const std::string& name, const ngram_index_type& index_packed, const ngram_index_type& index_unpacked, const ngram_set_type& ngrams)
+{
+  Lookup lookup(ngrams);
+
+  state_set_type states_packed;
+  state_set_type states_unpacked;
+
+  // we will clear caches, so that we will not measure the cache hits
+  for (size_type shard = 0; shard != index_packed.size(); ++ shard) {
+    const_cast<ngram_index_type&>(index_packed)[shard].caches.clear();
+    const_cast<ngram_index_type&>(index_unpacked)[shard].caches.clear();
+  }
+
+  utils::resource start_packed;
+  lookup(index_packed, states_packed);
+  utils::resource end_packed;
+
+  utils::resource start_unpacked;
+  lookup(index_unpacked, states_unpacked);
+  utils::resource end_unpacked;
+
+  std::cout << name
+	    << " packed: " << (ngrams.size() / (end_packed.thread_time() - start_packed.thread_time())) << " ngrams/sec"
+	    << " unpacked: " << (ngrams.size() / (end_unpacked.thread_time() - start_unpacked.thread_time())) << " ngrams/sec"
+	    << " different: " << (states_packed != states_unpacked)
+	    << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::cout << argv[0] << " ngram-index [# of samples]" << std::endl;
+    return 1;
+  }
+
+  try {
+    ngram_index_type index_unpacked(argv[1]);
+    ngram_index_type index_packed(index_unpacked);
+
+    if (! index_unpacked[0].unpacked)
+      throw std::runtime_error("no unpacked layout. run cicada_index_ngram first");
+
+    for (size_type shard = 0; shard != index_packed.size(); ++ shard)
+      index_packed[shard].unpacked = false;
+
+    const size_type samples = (argc > 2 ? utils::lexical_cast<size_type>(argv[2]) : size_type(1000000));
+
+    // random walk from the root, choosing a random child at each step, or a random word with a small probability
+    boost::mt19937 generator;
+    boost::random::uniform_int_distribution<size_type> uniform;
+
+    const size_type vocab_size = index_unpacked[0].offsets[1];
+
+    ngram_set_type ngrams;
+    for (size_type i = 0; i != samples; ++ i) {
+      ngrams.push_back(ngram_type());
+
+      state_type state = index_unpacked.root();
+      for (int order = 0; order != index_unpacked.order(); ++ order) {
+	id_type word = uniform(generator) % vocab_size;
+
+	if (! state.is_root_shard() && uniform(generator) % 8) {
+	  const ngram_index_type::shard_type& shard = index_unpacked[state.shard()];
+
+	  const size_type first = shard.children_first(state.node());
+	  const size_type last  = shard.children_last(state.node());
+
+	  if (first == last) break;
+
+	  word = shard[first + uniform(generator) % (last - first)];
+	}
+
+	ngrams.back().push_back(word);
+
+	const state_type state_next = index_unpacked.next(state, word);
+	if (state_next.is_root_node()) break;
+
+	state = state_next;
+      }
+    }
+
+    benchmark("random: ", index_packed, index_unpacked, ngrams);
+
+    // decoder-like lookups: for each position, lookup the context backward
+    ngrams.clear();
+
+    cicada::Sentence sentence;
+    while (std::cin >> sentence) {
+      for (size_type last = 1; last <= sentence.size(); ++ last) {
+	ngrams.push_back(ngram_type());
+
+	const size_type first = last - utils::bithack::min(last, size_type(index_unpacked.order()));
+
+	for (size_type pos = last; pos != first; -- pos)
+	  ngrams.back().push_back(index_unpacked.vocab()[sentence[pos - 1]]);
+      }
+    }
+
+    if (! ngrams.empty())
+      benchmark("trace:  ", index_packed, index_unpacked, ngrams);
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+}
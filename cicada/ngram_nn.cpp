@@ -60,12 +60,115 @@ namespace cicada
     id_eps_ = vocab_[vocab_type::EPSILON];
     id_unk_ = vocab_[vocab_type::UNK];
     
-    buffer_ = buffer_type(locks_.size(), dimension_embedding_ * (order_ - 1) + dimension_embedding_);
+    buffer_ = buffer_type(locks_.size(), dimension_hidden_ + dimension_embedding_ * (order_ - 1) + dimension_embedding_);
     
     for (size_type i = 0; i != cache_.size(); ++ i)
       cache_[i] = cache_type(order_);
   }
   
+  void NGramNN::precompute()
+  {
+    if (precompute_ || order_ <= 1) return;
+    
+    const size_type context_size = order_ - 1;
+    
+    tensor_type* precompute = new tensor_type(dimension_hidden_, embedding_size_ * context_size);
+    precompute_.reset(precompute);
+    
+    for (size_type i = 0; i != context_size; ++ i)
+      precompute->block(0, embedding_size_ * i, dimension_hidden_, embedding_size_).noalias()
+	= Wc_().block(0, dimension_embedding_ * i, dimension_hidden_, dimension_embedding_) * embedding_input_();
+  }
+  
+  NGramNN::prob_type NGramNN::logprob_batch(const id_type* first,
+					    const id_type* iter,
+					    const id_type* last,
+					    const int order,
+					    logprob_type* result) const
+  {
+    const size_type batch_size   = last - iter;
+    const size_type context_size = order_ - 1;
+    
+    // context layer for all the ngrams, either by table lookups or by a single GEMM
+    tensor_type context(dimension_hidden_, batch_size);
+    
+    if (precompute_) {
+      const tensor_type& precompute = *precompute_;
+      
+      for (size_type k = 0; k != batch_size; ++ k) {
+	const id_type* word = iter + k;
+	const id_type* context_first = std::max(first, word - (order - 1));
+	
+	context.col(k) = bc_().col(0);
+	
+	size_type i = 0;
+	for (/**/; i < context_size - (word - context_first); ++ i)
+	  context.col(k) += precompute.col(embedding_size_ * i + id_eps_);
+	
+	for (const id_type* citer = context_first; citer != word; ++ citer, ++ i)
+	  context.col(k) += precompute.col(embedding_size_ * i + *citer);
+      }
+    } else {
+      tensor_type input(dimension_embedding_ * context_size, batch_size);
+      
+      for (size_type k = 0; k != batch_size; ++ k) {
+	const id_type* word = iter + k;
+	const id_type* context_first = std::max(first, word - (order - 1));
+	
+	size_type i = 0;
+	for (/**/; i < context_size - (word - context_first); ++ i)
+	  input.block(dimension_embedding_ * i, k, dimension_embedding_, 1) = embedding_input_().col(id_eps_);
+	
+	for (const id_type* citer = context_first; citer != word; ++ citer, ++ i)
+	  input.block(dimension_embedding_ * i, k, dimension_embedding_, 1) = embedding_input_().col(*citer);
+      }
+      
+      context.noalias() = Wc_() * input;
+      context.colwise() += bc_().col(0);
+    }
+    
+    tensor_type hidden(dimension_embedding_, batch_size);
+    
+    hidden.noalias() = Wh_() * context.array().unaryExpr(hinge()).matrix();
+    hidden.colwise() += bh_().col(0);
+    hidden = hidden.array().unaryExpr(hinge()).matrix();
+    
+    prob_type logprob_sum = 0.0;
+    
+    if (normalize_) {
+      // scores for all the vocabulary by a single GEMM
+      tensor_type scores(embedding_size_, batch_size);
+      
+      scores.noalias() = embedding_output_().block(0, 0, dimension_embedding_, embedding_size_).transpose() * hidden;
+      scores.colwise() += embedding_output_().row(dimension_embedding_).transpose();
+      
+      for (size_type k = 0; k != batch_size; ++ k) {
+	double logsum = - std::numeric_limits<double>::infinity();
+	
+	for (id_type id = 0; id != embedding_size_; ++ id)
+	  if (id != id_bos_ && id != id_eps_)
+	    logsum = utils::mathop::logsum(logsum, double(scores(id, k)));
+	
+	const logprob_type logprob = scores(iter[k], k) - logsum;
+	
+	if (result)
+	  result[k] = logprob;
+	logprob_sum += logprob;
+      }
+    } else {
+      for (size_type k = 0; k != batch_size; ++ k) {
+	const logprob_type logprob = (embedding_output_().col(iter[k]).block(0, 0, dimension_embedding_, 1).transpose() * hidden.col(k)
+				      + embedding_output_().col(iter[k]).block(dimension_embedding_, 0, 1, 1))(0, 0);
+	
+	if (result)
+	  result[k] = logprob;
+	logprob_sum += logprob;
+      }
+    }
+    
+    return logprob_sum;
+  }
+
   typedef utils::unordered_map<std::string, NGramNN, boost::hash<utils::piece>, std::equal_to<std::string>,
 			       std::allocator<std::pair<const std::string, NGramNN> > >::type ngram_nn_map_type;
   
@@ -85,7 +188,7 @@ namespace cicada
   static utils::thread_specific_ptr<ngram_nn_map_type> __ngram_nns;
 #endif
   
-  NGramNN& NGramNN::create(const path_type& path)
+  NGramNN& NGramNN::create(const path_type& path, const bool precompute)
   {
 #ifdef HAVE_TLS
     if (! __ngram_nns_tls) {
@@ -110,7 +213,17 @@ namespace cicada
       if (iter_global == impl::__ngram_nn_map.end())
 	iter_global = impl::__ngram_nn_map.insert(std::make_pair(parameter, NGramNN(parameter))).first;
       
+      if (precompute)
+	iter_global->second.precompute();
+      
       iter = ngram_nns_map.insert(*iter_global).first;
+    } else if (precompute && ! iter->second.precomputed()) {
+      impl::lock_type lock(impl::__ngram_nn_mutex);
+      
+      ngram_nn_map_type::iterator iter_global = impl::__ngram_nn_map.find(parameter);
+      
+      iter_global->second.precompute();
+      iter->second.precompute_ = iter_global->second.precompute_;
     }
     
     return iter->second;
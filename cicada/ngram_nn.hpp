@@ -12,8 +12,10 @@
 
 #include <stdexcept>
 #include <vector>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <cicada/symbol.hpp>
 #include <cicada/vocab.hpp>
@@ -109,6 +111,8 @@ namespace cicada
     };
     typedef utils::array_power2<spinlock_type, 16, std::allocator<spinlock_type> > spinlock_set_type;
     
+    typedef boost::shared_ptr<const tensor_type> precompute_type;
+    
     typedef utils::vector2<parameter_type, std::allocator<parameter_type> > buffer_type;
     typedef cicada::NGramCache<id_type, logprob_type>                       cache_type;
     typedef utils::array_power2<cache_type, 16, std::allocator<cache_type> > cache_set_type;
@@ -120,7 +124,7 @@ namespace cicada
       : normalize_(normalize) { open(path, normalize); }
     
   public:
-   static NGramNN& create(const path_type& path);
+   static NGramNN& create(const path_type& path, const bool precompute=false);
 
   public:
     const vocab_type& vocab() const { return vocab_; }
@@ -135,6 +139,12 @@ namespace cicada
     void open(const path_type& path, const bool normalize=false);
     void close() { clear(); }
 
+    // precompute the product of Wc and each word embedding for each context position, so that
+    // the context layer is computed by table lookups and additions.
+    // This requires (order - 1) * hidden * vocabulary parameters.
+    void precompute();
+    bool precomputed() const { return precompute_.get(); }
+
     void populate()
     {
       embedding_input_.populate();
@@ -174,6 +184,8 @@ namespace cicada
       
       path_ = path_type();
 
+      precompute_.reset();
+      
       buffer_.clear();
       cache_.clear();
     }
@@ -190,6 +202,38 @@ namespace cicada
       
       return logprob_dispatch(first, last, value_type());
     }
+
+    // batched version: score all the ngrams ending at [iter, last) by a single matrix-matrix product.
+    // Each ngram is truncated to "order" words (or our order, if smaller), and [first, iter) is used as the
+    // initial context. Returns the sum of logprobs, and stores each logprob in result, if non-zero.
+    template <typename Iterator>
+    prob_type operator()(Iterator first, Iterator iter, Iterator last, const int order, logprob_type* result=0) const
+    {
+      typedef std::vector<id_type, std::allocator<id_type> > buffer_type;
+      
+      if (iter == last) return 0;
+      
+      buffer_type buffer(last - first);
+      
+      std::transform(first, last, buffer.begin(), vocab_id(vocab_));
+      
+      return logprob_batch(&(*buffer.begin()), &(*buffer.begin()) + (iter - first), &(*buffer.begin()) + buffer.size(),
+			   utils::bithack::min(order, order_),
+			   result);
+    }
+    
+  private:
+    struct vocab_id
+    {
+      vocab_id(const vocab_type& vocab) : vocab_(vocab) {}
+      
+      id_type operator()(const id_type& x) const { return x; }
+      id_type operator()(const word_type& x) const { return vocab_[x]; }
+      
+      const vocab_type& vocab_;
+    };
+
+    prob_type logprob_batch(const id_type* first, const id_type* iter, const id_type* last, const int order, logprob_type* result) const;
     
   private:
     template <typename Iterator, typename __Word>
@@ -238,28 +282,37 @@ namespace cicada
     template <typename Iterator>
     logprob_type logprob_buffer(Iterator first, Iterator last, void* buffer) const
     {
-      matrix_type input(reinterpret_cast<parameter_type*>(buffer), dimension_embedding_ * (order_ - 1), 1);
+      parameter_type* pbuffer = reinterpret_cast<parameter_type*>(buffer);
+      
+      matrix_type context(pbuffer, dimension_hidden_, 1);
+      matrix_type input(pbuffer + dimension_hidden_, dimension_embedding_ * (order_ - 1), 1);
+      matrix_type hidden(pbuffer + dimension_hidden_ + dimension_embedding_ * (order_ - 1), dimension_embedding_, 1);
       
-      if (last - first < order_) {
+      if (precompute_) {
+	const tensor_type& precompute = *precompute_;
+	
+	context = bc_();
+	
 	size_type i = 0;
 	for (/**/; i < order_ - (last - first); ++ i)
-	  input.block(dimension_embedding_ * i, 0, dimension_embedding_, 1) = embedding_input_().col(id_eps_);
+	  context += precompute.col(embedding_size_ * i + id_eps_);
 	
 	for (/**/; first != last - 1; ++ first, ++ i)
-	  input.block(dimension_embedding_ * i, 0, dimension_embedding_, 1) = embedding_input_().col(*first);
+	  context += precompute.col(embedding_size_ * i + *first);
       } else {
 	size_type i = 0;
+	for (/**/; i < order_ - (last - first); ++ i)
+	  input.block(dimension_embedding_ * i, 0, dimension_embedding_, 1) = embedding_input_().col(id_eps_);
+	
 	for (/**/; first != last - 1; ++ first, ++ i)
 	  input.block(dimension_embedding_ * i, 0, dimension_embedding_, 1) = embedding_input_().col(*first);
+	
+	context = Wc_() * input + bc_();
       }
-
+      
+      hidden = (Wh_() * context.array().unaryExpr(hinge()).matrix() + bh_()).array().unaryExpr(hinge());
+      
       if (normalize_) {
-	matrix_type hidden(reinterpret_cast<parameter_type*>(buffer) + dimension_embedding_ * (order_ - 1),
-			   dimension_embedding_,
-			   1);	
-	
-	hidden = (Wh_() * (Wc_() * input + bc_()).array().unaryExpr(hinge()).matrix() + bh_()).array().unaryExpr(hinge());
-
 	double logsum = - std::numeric_limits<double>::infinity();
 	double logprob = 0.0;
 	
@@ -277,10 +330,7 @@ namespace cicada
 	
 	return logprob - logsum;
       } else 
-	return (embedding_output_().col(*(last - 1)).block(0, 0, dimension_embedding_, 1).transpose()
-		* (Wh_() * (Wc_() * input
-			    + bc_()).array().unaryExpr(hinge()).matrix()
-		   + bh_()).array().unaryExpr(hinge()).matrix()
+	return (embedding_output_().col(*(last - 1)).block(0, 0, dimension_embedding_, 1).transpose() * hidden
 		+ embedding_output_().col(*(last - 1)).block(dimension_embedding_, 0, 1, 1))(0, 0);
     }
 
@@ -314,6 +364,9 @@ namespace cicada
     // path to the directory...
     path_type path_;
     
+    // precomputed Wc * embedding, shared among copies
+    precompute_type precompute_;
+    
     buffer_type       buffer_;
     cache_set_type    cache_;
     spinlock_set_type locks_;
@@ -1,12 +1,63 @@
+#include <cmath>
+#include <vector>
+
 #include "ngram_nn.hpp"
 #include "sentence.hpp"
 #include "vocab.hpp"
 
 #include "utils/mathop.hpp"
+#include "utils/resource.hpp"
 
 typedef cicada::Sentence sentence_type;
 typedef cicada::Vocab    vocab_type;
 
+typedef std::vector<sentence_type, std::allocator<sentence_type> > sentence_set_type;
+typedef std::vector<cicada::NGramNN::logprob_type, std::allocator<cicada::NGramNN::logprob_type> > logprob_set_type;
+
+// score each sentence, one ngram at a time
+void score_single(const cicada::NGramNN& lm, const sentence_set_type& sentences, logprob_set_type& logprobs)
+{
+  logprobs.clear();
+  
+  sentence_set_type::const_iterator siter_end = sentences.end();
+  for (sentence_set_type::const_iterator siter = sentences.begin(); siter != siter_end; ++ siter)
+    for (sentence_type::const_iterator iter = siter->begin() + 1; iter != siter->end(); ++ iter)
+      logprobs.push_back(lm(std::max(siter->begin(), iter + 1 - lm.order()), iter + 1));
+}
+
+// score each sentence by a single batch
+void score_batch(const cicada::NGramNN& lm, const sentence_set_type& sentences, logprob_set_type& logprobs)
+{
+  logprobs.clear();
+  
+  sentence_set_type::const_iterator siter_end = sentences.end();
+  for (sentence_set_type::const_iterator siter = sentences.begin(); siter != siter_end; ++ siter) {
+    const size_t pos = logprobs.size();
+    
+    logprobs.resize(pos + siter->size() - 1);
+    
+    lm(siter->begin(), siter->begin() + 1, siter->end(), lm.order(), &(*logprobs.begin()) + pos);
+  }
+}
+
+template <typename Scorer>
+void benchmark(const std::string& name, const cicada::NGramNN& lm, const sentence_set_type& sentences, logprob_set_type& logprobs, Scorer scorer)
+{
+  utils::resource start;
+  scorer(lm, sentences, logprobs);
+  utils::resource end;
+  
+  std::cout << name << (logprobs.size() / (end.thread_time() - start.thread_time())) << " ngrams/sec" << std::endl;
+}
+
+double max_difference(const logprob_set_type& x, const logprob_set_type& y)
+{
+  double diff = 0.0;
+  for (size_t i = 0; i != x.size(); ++ i)
+    diff = std::max(diff, std::fabs(double(x[i]) - double(y[i])));
+  return diff;
+}
+
 int main(int argc, char** argv)
 {
   if (argc < 2) {
@@ -24,6 +75,8 @@ int main(int argc, char** argv)
   size_t num_word = 0;
   size_t num_oov = 0;
   size_t num_sentence = 0;
+
+  sentence_set_type sentences;
   
   while (std::cin >> sentence) {
     ngram.resize(1);
@@ -59,6 +112,8 @@ int main(int argc, char** argv)
     
     num_word += sentence.size();
     ++ num_sentence;
+    
+    sentences.push_back(ngram);
   }
   
   std::cout << "# of sentences: " << num_sentence
@@ -73,4 +128,25 @@ int main(int argc, char** argv)
   std::cout << "ppl1          = " << utils::mathop::exp(- logprob_total / (num_word - num_oov)) << std::endl;
   std::cerr << "ppl(+oov)     = " << utils::mathop::exp(- logprob / (num_word + num_sentence)) << std::endl;
   std::cerr << "ppl1(+oov)    = " << utils::mathop::exp(- logprob / (num_word)) << std::endl;
+
+  // single query vs. batch, both starting from an empty cache, with and without normalization
+  for (int normalize = 1; normalize >= 0; -- normalize) {
+    logprob_set_type logprobs_single;
+    logprob_set_type logprobs_batch;
+    logprob_set_type logprobs_precompute;
+    
+    std::cout << (normalize ? "normalized" : "unnormalized") << std::endl;
+    
+    benchmark("single:           ", cicada::NGramNN(argv[1], normalize), sentences, logprobs_single, score_single);
+    benchmark("batch:            ", cicada::NGramNN(argv[1], normalize), sentences, logprobs_batch, score_batch);
+    
+    cicada::NGramNN lm_precompute(argv[1], normalize);
+    lm_precompute.precompute();
+    
+    benchmark("batch+precompute: ", lm_precompute, sentences, logprobs_precompute, score_batch);
+    
+    std::cout << "max difference: batch = " << max_difference(logprobs_single, logprobs_batch)
+	      << " batch+precompute = " << max_difference(logprobs_single, logprobs_precompute)
+	      << std::endl;
+  }
 }
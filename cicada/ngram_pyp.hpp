@@ -19,7 +19,7 @@
 #include <cicada/vocab.hpp>
 
 #include <utils/packed_vector.hpp>
-#include <utils/succinct_vector.hpp>
+#include <utils/succinct_vector_rank9.hpp>
 #include <utils/hashmurmur3.hpp>
 #include <utils/array_power2.hpp>
 #include <utils/spinlock.hpp>
@@ -80,7 +80,7 @@ namespace cicada
     
     typedef utils::packed_vector_mapped<id_type, std::allocator<id_type> >       id_set_type;
     typedef utils::packed_vector_mapped<count_type, std::allocator<count_type> > count_set_type;
-    typedef utils::succinct_vector_mapped<std::allocator<int32_t> >              position_set_type;
+    typedef utils::succinct_vector_rank9_mapped<std::allocator<int32_t> >        position_set_type;
     typedef std::vector<size_type, std::allocator<size_type> >                   offset_set_type;
     typedef std::vector<double, std::allocator<double> >                         parameter_set_type;
     
@@ -0,0 +1,255 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__NGRAM_RESULT_CACHE__HPP__
+#define __CICADA__NGRAM_RESULT_CACHE__HPP__ 1
+
+//
+// a set-associative cache of ngram scoring results, (context, word) -> (result, state), which is
+// shared by all the decoder threads without locks.
+//
+// Each entry is protected by a sequence lock: a writer acquires an entry by compare-and-swap of
+// an even version into an odd one, and releases by the next even version. A reader copies an
+// entry and validates the copy by the version before and after. A writer never waits, but gives
+// up when an entry is being written, and a reader treats a concurrent write as a miss.
+//
+// A set of four entries starts by a cache line of their versions and hashes, followed by their
+// values, thus, a miss touches a single cache line. A value keeps the context words and the
+// resulting backoffs of the ngram state, and its size depends on the order of the ngram. The words
+// of a resulting state are the scored word followed by the prefix of the context, and are not stored.
+//
+
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <cicada/symbol.hpp>
+
+#include <utils/hashmurmur3.hpp>
+#include <utils/atomicop.hpp>
+#include <utils/bithack.hpp>
+
+namespace cicada
+{
+  template <typename Result>
+  class NGramResultCache : public utils::hashmurmur3<uint64_t>
+  {
+  public:
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef Symbol             word_type;
+    typedef word_type::id_type id_type;
+
+    typedef Result                        result_type;
+    typedef typename Result::logprob_type logprob_type;
+
+    typedef utils::hashmurmur3<uint64_t> hasher_type;
+
+    static const size_type associativity = 4;
+
+  private:
+    typedef uint64_t version_type;
+
+    struct tag_type
+    {
+      volatile version_type version;
+      uint64_t              hash;
+    };
+
+    struct value_type
+    {
+      result_type result;
+      id_type     word;
+      uint16_t    size_in;
+      uint16_t    size_out;
+
+      // followed by the context words and the output backoffs
+      id_type*       context() { return reinterpret_cast<id_type*>(this + 1); }
+      const id_type* context() const { return reinterpret_cast<const id_type*>(this + 1); }
+    };
+
+    typedef std::vector<uint64_t, std::allocator<uint64_t> > entry_set_type;
+
+    static const size_type line_size = 64 / sizeof(uint64_t);
+
+  public:
+    NGramResultCache() : entries(), offset(0), stride(0), stride_set(0), buckets(0), order(0) {}
+    NGramResultCache(const NGramResultCache& x)
+      : entries(x.entries), offset(0), stride(x.stride), stride_set(x.stride_set), buckets(x.buckets), order(x.order) { align(); }
+
+    NGramResultCache& operator=(const NGramResultCache& x)
+    {
+      entries    = x.entries;
+      stride     = x.stride;
+      stride_set = x.stride_set;
+      buckets    = x.buckets;
+      order      = x.order;
+
+      align();
+
+      return *this;
+    }
+
+  public:
+    // reserve for at least size entries. Not thread safe, and should be called before scoring.
+    void reserve(size_type size, const int __order)
+    {
+      if (size == 0 || (__order == order && size <= buckets * associativity)) return;
+
+      const size_type sets = (size + associativity - 1) / associativity;
+
+      order   = __order;
+      buckets = (utils::bithack::is_power2(sets) ? sets : size_type(utils::bithack::next_largest_power2(sets)));
+
+      // values are aligned by 64 bits, and a set by a cache line
+      stride     = (sizeof(value_type) + (sizeof(id_type) + sizeof(logprob_type)) * (order - 1) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+      stride_set = ((line_size + stride * associativity + line_size - 1) / line_size) * line_size;
+
+      entries.clear();
+      entries.resize(stride_set * buckets + line_size, 0);
+
+      align();
+    }
+
+    void clear()
+    {
+      std::fill(entries.begin(), entries.end(), 0);
+    }
+
+    size_type size() const { return buckets * associativity; }
+    bool empty() const { return entries.empty(); }
+
+    uint64_t hash(const id_type* context, const size_type size_in, const id_type& word) const
+    {
+      // zero is reserved for empty entries
+      return hasher_type::operator()(context, context + size_in, word) | 1;
+    }
+
+    // find the cached result for the context of size_in words and word. The output backoffs are
+    // copied into backoffs, and the size of the output state into size_out.
+    bool find(const uint64_t hash,
+	      const id_type* context,
+	      const size_type size_in,
+	      const id_type& word,
+	      result_type& result,
+	      logprob_type* backoffs,
+	      size_type& size_out) const
+    {
+      if (entries.empty()) return false;
+
+      const uint64_t* set  = &(*entries.begin()) + offset + stride_set * (hash & (buckets - 1));
+      const tag_type* tags = reinterpret_cast<const tag_type*>(set);
+
+      for (size_type way = 0; way != associativity; ++ way) {
+	const version_type version = tags[way].version;
+
+	if (version & 1) continue;
+
+	read_barrier();
+
+	if (tags[way].hash != hash) continue;
+
+	const value_type* value = reinterpret_cast<const value_type*>(set + line_size + stride * way);
+
+	if (value->word != word || value->size_in != size_in) continue;
+	if (! std::equal(context, context + size_in, value->context())) continue;
+
+	const logprob_type* cached = reinterpret_cast<const logprob_type*>(value->context() + (order - 1));
+	const size_type cached_size = utils::bithack::min(size_type(value->size_out), size_type(order - 1));
+
+	result = value->result;
+	std::copy(cached, cached + cached_size, backoffs);
+	size_out = cached_size;
+
+	read_barrier();
+
+	if (tags[way].version == version)
+	  return true;
+      }
+
+      return false;
+    }
+
+    // insert the result. Give up when the entry is being written by others.
+    void insert(const uint64_t hash,
+		const id_type* context,
+		const size_type size_in,
+		const id_type& word,
+		const result_type& result,
+		const logprob_type* backoffs,
+		const size_type size_out)
+    {
+      if (entries.empty() || size_in > size_type(order - 1) || size_out > size_type(order - 1)) return;
+
+      uint64_t* set  = &(*entries.begin()) + offset + stride_set * (hash & (buckets - 1));
+      tag_type* tags = reinterpret_cast<tag_type*>(set);
+
+      // prefer an empty entry, or the entry is selected by the hash
+      size_type way = (hash >> 32) & (associativity - 1);
+      for (size_type i = 0; i != associativity; ++ i)
+	if (tags[i].hash == 0) {
+	  way = i;
+	  break;
+	}
+
+      const version_type version = tags[way].version;
+
+      if (version & 1) return;
+      if (! utils::atomicop::compare_and_swap(tags[way].version, version, version + 1)) return;
+
+      value_type* value = reinterpret_cast<value_type*>(set + line_size + stride * way);
+
+      tags[way].hash  = hash;
+      value->result   = result;
+      value->word     = word;
+      value->size_in  = size_in;
+      value->size_out = size_out;
+
+      std::copy(context, context + size_in, value->context());
+      std::copy(backoffs, backoffs + size_out, reinterpret_cast<logprob_type*>(value->context() + (order - 1)));
+
+      write_barrier();
+
+      tags[way].version = version + 2;
+    }
+
+  private:
+    // the first set starts at a cache line
+    void align()
+    {
+      offset = 0;
+      if (! entries.empty())
+	offset = (line_size - ((reinterpret_cast<uintptr_t>(&(*entries.begin())) / sizeof(uint64_t)) & (line_size - 1))) & (line_size - 1);
+    }
+
+    // loads are not reordered with other loads, and stores with other stores on x86, thus, we need
+    // to prevent only the compiler reordering
+    static void read_barrier()
+    {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __asm__ __volatile__("" ::: "memory");
+#else
+      utils::atomicop::memory_barrier();
+#endif
+    }
+
+    static void write_barrier()
+    {
+      read_barrier();
+    }
+
+  private:
+    entry_set_type entries;
+    size_type      offset;
+    size_type      stride;
+    size_type      stride_set;
+    size_type      buckets;
+    int            order;
+  };
+};
+
+#endif
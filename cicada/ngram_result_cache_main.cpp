@@ -0,0 +1,161 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [ngram] [cache size] [# of threads] [# of passes] < sentences
+//
+// score sentences from stdin, one word at a time as the decoder does, by threads sharing the ngram
+// result cache, and report the hit rate and the time. The sentences are scored [# of passes] times
+// to mimic the repeated scoring of the same ngrams by the hypotheses of a decoder. The scores
+// should agree with those without the cache.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "ngram.hpp"
+#include "sentence.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+#include <boost/thread.hpp>
+
+typedef cicada::NGram ngram_type;
+typedef cicada::Sentence sentence_type;
+typedef cicada::Symbol::id_type id_type;
+
+typedef std::vector<sentence_type, std::allocator<sentence_type> > sentence_set_type;
+typedef std::vector<double, std::allocator<double> > score_set_type;
+
+struct Task
+{
+  Task(const ngram_type& __ngram,
+       const sentence_set_type& __sentences,
+       score_set_type& __scores,
+       const int __shard,
+       const int __shards,
+       const int __passes)
+    : ngram(__ngram), sentences(__sentences), scores(__scores),
+      shard(__shard), shards(__shards), passes(__passes), queries(0), hits(0) {}
+
+  void operator()()
+  {
+    const cicada::NGramState ngram_state(ngram.index.order());
+
+    std::vector<char, std::allocator<char> > buffer1(ngram_state.buffer_size());
+    std::vector<char, std::allocator<char> > buffer2(ngram_state.buffer_size());
+
+    const id_type id_bos = ngram.index.vocab()[cicada::Vocab::BOS];
+    const id_type id_eos = ngram.index.vocab()[cicada::Vocab::EOS];
+
+    for (int pass = 0; pass != passes; ++ pass)
+      for (size_t i = shard; i < sentences.size(); i += shards) {
+	void* state_curr = &(*buffer1.begin());
+	void* state_next = &(*buffer2.begin());
+
+	ngram.lookup_context(&id_bos, (&id_bos) + 1, state_curr);
+
+	double score = 0.0;
+	for (size_t j = 0; j <= sentences[i].size(); ++ j) {
+	  const id_type id = (j == sentences[i].size() ? id_eos : ngram.index.vocab()[sentences[i][j]]);
+
+	  bool cached = false;
+	  score += ngram.ngram_score(state_curr, id, state_next, cached).prob;
+
+	  ++ queries;
+	  hits += cached;
+
+	  std::swap(state_curr, state_next);
+	}
+
+	scores[i] = score;
+      }
+  }
+
+  const ngram_type&        ngram;
+  const sentence_set_type& sentences;
+  score_set_type&          scores;
+
+  int shard;
+  int shards;
+  int passes;
+
+  size_t queries;
+  size_t hits;
+};
+
+int main(int argc, char** argv)
+{
+  try {
+    if (argc < 2)
+      throw std::runtime_error(std::string(argv[0]) + " ngram [cache size] [# of threads] [# of passes] < sentences");
+
+    const size_t cache_size = (argc > 2 ? utils::lexical_cast<size_t>(argv[2]) : size_t(1024 * 1024));
+    const int    threads    = (argc > 3 ? utils::lexical_cast<int>(argv[3]) : 1);
+    const int    passes     = (argc > 4 ? utils::lexical_cast<int>(argv[4]) : 2);
+
+    sentence_set_type sentences;
+    sentence_type sentence;
+    while (std::cin >> sentence)
+      sentences.push_back(sentence);
+
+    // without the cache, then, with the cache
+    score_set_type scores_uncached(sentences.size());
+    score_set_type scores_cached(sentences.size());
+
+    for (int cached = 0; cached != 2; ++ cached) {
+      ngram_type ngram(argv[1]);
+
+      if (cached)
+	ngram.reserve_cache(cache_size);
+
+      std::vector<Task, std::allocator<Task> > tasks;
+      for (int i = 0; i != threads; ++ i)
+	tasks.push_back(Task(ngram, sentences, cached ? scores_cached : scores_uncached, i, threads, passes));
+
+      utils::resource start;
+
+      boost::thread_group workers;
+      for (int i = 0; i != threads; ++ i)
+	workers.add_thread(new boost::thread(boost::ref(tasks[i])));
+      workers.join_all();
+
+      utils::resource end;
+
+      size_t queries = 0;
+      size_t hits = 0;
+      for (int i = 0; i != threads; ++ i) {
+	queries += tasks[i].queries;
+	hits    += tasks[i].hits;
+      }
+
+      std::cout << (cached ? "cached: " : "uncached: ")
+		<< "threads: " << threads
+		<< " cache size: " << ngram.cache.size()
+		<< " queries: " << queries
+		<< " hit rate: " << (queries ? double(hits) / queries : 0.0)
+		<< " cpu time: " << (end.cpu_time() - start.cpu_time())
+		<< " user time: " << (end.user_time() - start.user_time())
+		<< std::endl;
+    }
+
+    double diff = 0.0;
+    for (size_t i = 0; i != sentences.size(); ++ i)
+      diff = std::max(diff, std::fabs(scores_uncached[i] - scores_cached[i]));
+
+    std::cout << "score difference: " << diff << std::endl;
+
+    if (diff != 0.0)
+      throw std::runtime_error("uncached and cached scores differ");
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
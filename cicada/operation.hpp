@@ -97,6 +97,7 @@ namespace cicada
       ngram_count_set_type ngram_counts;
       statistics_type      statistics;
 
+      // hypergraph.clear() returns its storage to this worker's arena, which is reused by the next sentence
       void clear()
       {
 	hypergraph.clear();
@@ -29,7 +29,7 @@ namespace cicada
 		 const int __debug)
       : model(__model), weights(0), weights_assigned(0), size(200), diversity(0.0),
 	weights_one(false), weights_fixed(false), weights_extra(),
-	rejection(false), exact(false), prune(false), grow(false), grow_coarse(false), incremental(false), forced(false), sparse(false), dense(false), state_less(false), state_full(false), prune_bin(false), debug(__debug)
+	rejection(false), exact(false), prune(false), grow(false), grow_coarse(false), incremental(false), forced(false), sparse(false), dense(false), state_less(false), state_full(false), prune_bin(false), threads(1), debug(__debug)
     {
       typedef cicada::Parameter param_type;
 
@@ -66,6 +66,8 @@ namespace cicada
 	  state_less = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "prune-bin")
 	  prune_bin = utils::lexical_cast<bool>(piter->second);
+	else if (utils::ipiece(piter->first) == "threads")
+	  threads = utils::lexical_cast<int>(piter->second);
 	else if (utils::ipiece(piter->first) == "weights")
 	  weights = &base_type::weights(piter->second);
 	else if (utils::ipiece(piter->first) == "weights-one")
@@ -119,6 +121,13 @@ namespace cicada
       if (rejection || diversity != 0.0)
 	if (! prune)
 	  throw std::runtime_error("rejection or diversified can be only combined with cube-pruning");
+
+      if (threads <= 0)
+	throw std::runtime_error("invalid # of threads: " + utils::lexical_cast<std::string>(threads));
+      
+      if (threads > 1)
+	if (! prune || rejection || diversity != 0.0)
+	  throw std::runtime_error("threads can be only combined with cube-pruning");
       
       // construct sparse or dense
       if (sparse) {
@@ -189,6 +198,14 @@ namespace cicada
       
       if (weights || weights_one)
 	weights_fixed = true;
+
+      // one model, thus one state allocator, for each thread
+      if (threads > 1) {
+	const model_type& __model = (! model_local.empty() ? model_local : model);
+	
+	for (int i = 0; i != threads; ++ i)
+	  models_thread.push_back(__model.clone());
+      }
       
       if (! weights)
 	weights = &base_type::weights();
@@ -227,6 +244,15 @@ namespace cicada
       
       if (forced)
 	__model.apply_feature(true);
+
+      model_set_type& __models = const_cast<model_set_type&>(models_thread);
+      
+      for (model_set_type::iterator miter = __models.begin(); miter != __models.end(); ++ miter) {
+	miter->assign(data.id, data.hypergraph, data.lattice, data.spans, data.targets, data.ngram_counts);
+	
+	if (forced)
+	  miter->apply_feature(true);
+      }
       
       const weight_set_type* weights_apply = (weights_assigned ? weights_assigned : &(weights->weights));
       
@@ -275,6 +301,13 @@ namespace cicada
 	  else
 	    cicada::apply_cube_prune_rejection(__model, hypergraph, applied, weight_function<weight_type>(*weights_apply), const_cast<sampler_type&>(sampler), size, prune_bin);
 	  
+	} else if (! __models.empty()) {
+	  if (weights_one)
+	    cicada::apply_cube_prune(__models, hypergraph, applied, weight_function_one<weight_type>(), size, prune_bin);
+	  else if (! weights_extra.empty())
+	    cicada::apply_cube_prune(__models, hypergraph, applied, weight_function_extra<weight_type>(*weights_apply, weights_extra.begin(), weights_extra.end()), size, prune_bin);
+	  else
+	    cicada::apply_cube_prune(__models, hypergraph, applied, weight_function<weight_type>(*weights_apply), size, prune_bin);
 	} else {
 	  if (weights_one)
 	    cicada::apply_cube_prune(__model, hypergraph, applied, weight_function_one<weight_type>(), size, prune_bin);
@@ -288,6 +321,9 @@ namespace cicada
       utils::resource end;
     
       __model.apply_feature(false);
+      
+      for (model_set_type::iterator miter = __models.begin(); miter != __models.end(); ++ miter)
+	miter->apply_feature(false);
     
       if (debug)
 	std::cerr << name << ": " << data.id
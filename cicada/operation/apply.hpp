@@ -8,6 +8,8 @@
 
 #include <cicada/operation.hpp>
 
+#include <vector>
+
 #include <utils/sampler.hpp>
 
 namespace cicada
@@ -19,6 +21,7 @@ namespace cicada
     {
     private:
       typedef utils::sampler<boost::mt19937> sampler_type;
+      typedef std::vector<model_type, std::allocator<model_type> > model_set_type;
 
     public:
       Apply(const std::string& parameter,
@@ -58,6 +61,10 @@ namespace cicada
 
       bool prune_bin;
 
+      // per-thread models for parallel cube-pruning
+      int threads;
+      model_set_type models_thread;
+
       sampler_type sampler;
   
       int debug;
@@ -4,10 +4,15 @@
 
 #include <iostream>
 
+#include <boost/spirit/include/qi.hpp>
+
 #include <cicada/operation.hpp>
 #include <cicada/parameter.hpp>
 #include <cicada/compose.hpp>
+#include <cicada/compose_phrase_stack.hpp>
+#include <cicada/semiring.hpp>
 
+#include <cicada/operation/functional.hpp>
 #include <cicada/operation/compose.hpp>
 
 #include <utils/lexical_cast.hpp>
@@ -92,6 +97,8 @@ namespace cicada
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
       const tree_grammar_type& tree_grammar_compose = (tree_grammar_local.empty() ? tree_grammar : tree_grammar_local);
 	
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(lattice);
@@ -100,6 +107,8 @@ namespace cicada
       cicada::compose_tree_cky(goal, tree_grammar_compose, grammar_compose, lattice, composed, yield_source, frontier, unique_goal);
 	
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -123,6 +132,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
       
       hypergraph.swap(composed);
     }
@@ -194,6 +205,8 @@ namespace cicada
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
       const tree_grammar_type& tree_grammar_compose = (tree_grammar_local.empty() ? tree_grammar : tree_grammar_local);
 	
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(hypergraph);
@@ -202,6 +215,8 @@ namespace cicada
       cicada::compose_tree(goal, tree_grammar_compose, grammar_compose, hypergraph, composed, yield_source, frontier);
 	
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -225,6 +240,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
 	
       hypergraph.swap(composed);
     }
@@ -283,6 +300,8 @@ namespace cicada
 
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(hypergraph);
@@ -290,6 +309,8 @@ namespace cicada
       cicada::compose_earley(grammar_compose, hypergraph, composed, yield_source, frontier);
     
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -313,6 +334,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(composed);
     }
@@ -387,6 +410,8 @@ namespace cicada
 
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(lattice);
@@ -394,6 +419,8 @@ namespace cicada
       cicada::compose_cky(goal, grammar_compose, lattice, composed, yield_source, treebank, pos_mode, ordered, frontier, unique_goal);
     
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -417,6 +444,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(composed);
     }
@@ -476,6 +505,8 @@ namespace cicada
 
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(hypergraph);
@@ -483,6 +514,8 @@ namespace cicada
       cicada::compose_grammar(grammar_compose, hypergraph, composed, yield_source, frontier);
     
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -506,6 +539,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(composed);
     }
@@ -513,11 +548,21 @@ namespace cicada
     
     ComposePhrase::ComposePhrase(const std::string& parameter,
 				 const grammar_type& __grammar,
+				 const model_type& __model,
 				 const std::string& __goal,
 				 const int __debug)
       : base_type("compose-phrase"),
 	grammar(__grammar),
 	goal(__goal),
+	model(__model),
+	weights(0),
+	weights_assigned(0),
+	size(200),
+	threshold(0.0),
+	weights_one(false),
+	weights_fixed(false),
+	weights_extra(),
+	stack(false),
 	distortion(0),
 	yield_source(false),
 	frontier(false),
@@ -548,7 +593,36 @@ namespace cicada
 	  grammar_local.push_back(piter->second);
 	else if (utils::ipiece(piter->first) == "frontier")
 	  frontier = utils::lexical_cast<bool>(piter->second);
-	else
+	else if (utils::ipiece(piter->first) == "stack")
+	  stack = utils::lexical_cast<bool>(piter->second);
+	else if (utils::ipiece(piter->first) == "size")
+	  size = utils::lexical_cast<int>(piter->second);
+	else if (utils::ipiece(piter->first) == "threshold")
+	  threshold = utils::lexical_cast<double>(piter->second);
+	else if (utils::ipiece(piter->first) == "weights")
+	  weights = &base_type::weights(piter->second);
+	else if (utils::ipiece(piter->first) == "weights-one")
+	  weights_one = utils::lexical_cast<bool>(piter->second);
+	else if (utils::ipiece(piter->first) == "weight") {
+	  namespace qi = boost::spirit::qi;
+	  namespace standard = boost::spirit::standard;
+
+	  std::string::const_iterator iter = piter->second.begin();
+	  std::string::const_iterator iter_end = piter->second.end();
+
+	  std::string name;
+	  double      value;
+	  
+	  if (! qi::phrase_parse(iter, iter_end,
+				 qi::lexeme[+(!(qi::lit('=') >> qi::double_ >> (standard::space | qi::eoi))
+					      >> (standard::char_ - standard::space))]
+				 >> '='
+				 >> qi::double_,
+				 standard::blank, name, value) || iter != iter_end)
+	    throw std::runtime_error("weight parameter parsing failed");
+	  
+	  weights_extra[name] = value;
+	} else
 	  std::cerr << "WARNING: unsupported parameter for composer: " << piter->first << "=" << piter->second << std::endl;
       }
 	
@@ -556,6 +630,30 @@ namespace cicada
 	throw std::runtime_error("Phrase composer can work either source or target yield");
 	
       yield_source = source;
+
+      if (threshold < 0.0 || threshold > 1.0)
+	throw std::runtime_error("threshold should be within [0, 1]");
+
+      if (weights && weights_one)
+	throw std::runtime_error("you have weights, but specified all-one parameter");
+
+      if (weights_one && ! weights_extra.empty())
+	throw std::runtime_error("you have extra weights, but specified all-one parameter");
+      
+      if (weights || weights_one)
+	weights_fixed = true;
+      
+      if (! weights)
+	weights = &base_type::weights();
+
+      if (stack)
+	name = "compose-phrase-stack";
+    }
+
+    void ComposePhrase::assign(const weight_set_type& __weights)
+    {
+      if (! weights_fixed)
+	weights_assigned = &__weights;
     }
 
     void ComposePhrase::operator()(data_type& data) const
@@ -572,13 +670,33 @@ namespace cicada
       
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
 
       grammar_compose.assign(lattice);
       
-      cicada::compose_phrase(goal, grammar_compose, distortion, lattice, composed, yield_source, frontier);
+      if (stack) {
+	typedef cicada::semiring::Logprob<double> weight_type;
+	
+	model_type& __model = const_cast<model_type&>(model);
+	
+	__model.assign(data.id, data.hypergraph, data.lattice, data.spans, data.targets, data.ngram_counts);
+	
+	const weight_set_type* weights_compose = (weights_assigned ? weights_assigned : &(weights->weights));
+	
+	if (weights_one)
+	  cicada::compose_phrase_stack(goal, grammar_compose, __model, weight_function_one<weight_type>(), size, threshold, distortion, lattice, composed, yield_source, frontier);
+	else if (! weights_extra.empty())
+	  cicada::compose_phrase_stack(goal, grammar_compose, __model, weight_function_extra<weight_type>(*weights_compose, weights_extra.begin(), weights_extra.end()), size, threshold, distortion, lattice, composed, yield_source, frontier);
+	else
+	  cicada::compose_phrase_stack(goal, grammar_compose, __model, weight_function<weight_type>(*weights_compose), size, threshold, distortion, lattice, composed, yield_source, frontier);
+      } else
+	cicada::compose_phrase(goal, grammar_compose, distortion, lattice, composed, yield_source, frontier);
     
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -602,6 +720,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(composed);
     }
@@ -671,6 +791,8 @@ namespace cicada
       
       const grammar_type& grammar_compose = (grammar_local.empty() ? grammar : grammar_local);
 	
+      const grammar_type::cache_stat_type cache_start = grammar_compose.cache_statistics();
+      
       utils::resource start;
       
       if (lattice_mode)
@@ -684,6 +806,8 @@ namespace cicada
 	cicada::compose_alignment(goal, grammar_compose, hypergraph, target, composed);
     
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_compose.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -707,6 +831,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(composed);
     }
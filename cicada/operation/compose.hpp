@@ -131,14 +131,30 @@ namespace cicada
     public:
       ComposePhrase(const std::string& parameter,
 		    const grammar_type& __grammar,
+		    const model_type& __model,
 		    const std::string& __goal,
 		    const int __debug);
   
       void operator()(data_type& data) const;
+
+      void assign(const weight_set_type& __weights);
   
       const grammar_type& grammar;
       grammar_type grammar_local;
       std::string goal;
+
+      // stack decoding with the model
+      const model_type& model;
+      const weights_path_type* weights;
+      const weight_set_type*   weights_assigned;
+      int size;
+      double threshold;
+      bool weights_one;
+      bool weights_fixed;
+
+      feature_set_type weights_extra;
+      
+      bool stack;
   
       int distortion;
       
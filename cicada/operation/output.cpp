@@ -28,6 +28,7 @@
 #include <cicada/span_node.hpp>
 #include <cicada/span_vector.hpp>
 #include <cicada/debinarize.hpp>
+#include <cicada/hypergraph_binary.hpp>
 
 #include <cicada/operation/output.hpp>
 #include <cicada/operation/functional.hpp>
@@ -407,6 +408,7 @@ namespace cicada
 	
 	debinarize(false),
 	graphviz(false),
+	binary(false),
 	statistics(false),
 	lattice_mode(false),
 	forest_mode(false),
@@ -442,6 +444,8 @@ namespace cicada
 	  debinarize = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "graphviz")
 	  graphviz = utils::lexical_cast<bool>(piter->second);
+	else if (utils::ipiece(piter->first) == "binary")
+	  binary = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "statistics")
 	  statistics = utils::lexical_cast<bool>(piter->second);
 	else if (utils::ipiece(piter->first) == "lattice")
@@ -543,6 +547,9 @@ namespace cicada
       if (graphviz && statistics)
 	throw std::runtime_error("only one of graphviz or statistics can be specified...");
 
+      if (binary && (graphviz || statistics))
+	throw std::runtime_error("binary forest cannot be dumped with graphviz or statistics");
+
       if (graphviz || yield_graphviz)
 	no_id = true;
       
@@ -699,13 +706,20 @@ namespace cicada
 	  os << id << " ||| ";
 	
 	if (lattice_mode && forest_mode) {
-	  os << data.lattice << " ||| " << hypergraph;
+	  os << data.lattice << " ||| ";
+	  if (binary)
+	    cicada::hypergraph_binary_encode(os, hypergraph);
+	  else
+	    os << hypergraph;
 	  need_separator = true;
 	} else if (lattice_mode) {
 	  os << data.lattice;
 	  need_separator = true;
 	} else {
-	  os << hypergraph;
+	  if (binary)
+	    cicada::hypergraph_binary_encode(os, hypergraph);
+	  else
+	    os << hypergraph;
 	  need_separator = true;
 	}
 	
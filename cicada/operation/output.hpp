@@ -65,6 +65,7 @@ namespace cicada
 
       bool debinarize;
       bool graphviz;
+      bool binary;
       bool statistics;
       bool lattice_mode;
       bool forest_mode;
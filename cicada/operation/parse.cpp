@@ -152,6 +152,8 @@ namespace cicada
       const grammar_type& grammar_parse = (grammar_local.empty() ? grammar : grammar_local);
       const tree_grammar_type& tree_grammar_parse = (tree_grammar_local.empty() ? tree_grammar : tree_grammar_local);
 	
+      const grammar_type::cache_stat_type cache_start = grammar_parse.cache_statistics();
+      
       utils::resource start;
 
       grammar_parse.assign(lattice);
@@ -165,6 +167,8 @@ namespace cicada
 	cicada::parse_tree_cky(goal, tree_grammar_parse, grammar_parse, weight_function<weight_type>(*weights_parse), lattice, parsed, size, yield_source, frontier, unique_goal);
 	
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_parse.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -188,6 +192,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
 	
       hypergraph.swap(parsed);
     }
@@ -313,6 +319,8 @@ namespace cicada
       const grammar_type& grammar_parse = (grammar_local.empty() ? grammar : grammar_local);
       const tree_grammar_type& tree_grammar_parse = (tree_grammar_local.empty() ? tree_grammar : tree_grammar_local);
 	
+      const grammar_type::cache_stat_type cache_start = grammar_parse.cache_statistics();
+      
       utils::resource start;
 
       grammar_parse.assign(hypergraph);
@@ -326,6 +334,8 @@ namespace cicada
 	cicada::parse_tree(goal, tree_grammar_parse, grammar_parse, weight_function<weight_type>(*weights_parse), hypergraph, parsed, size, yield_source, frontier);
 	
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_parse.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -349,6 +359,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
 	
       hypergraph.swap(parsed);
     }
@@ -476,6 +488,8 @@ namespace cicada
       
       const grammar_type& grammar_parse = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_parse.cache_statistics();
+      
       utils::resource start;
       
       grammar_parse.assign(lattice);
@@ -488,6 +502,8 @@ namespace cicada
 	cicada::parse_cky(goal, grammar_parse, weight_function<weight_type>(*weights_parse), lattice, parsed, size, yield_source, treebank, pos_mode, ordered, frontier, unique_goal);
       
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_parse.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -511,6 +527,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(parsed);
     }
@@ -635,6 +653,8 @@ namespace cicada
 
       const grammar_type& grammar_parse = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_parse.cache_statistics();
+      
       utils::resource start;
 
       grammar_parse.assign(lattice);
@@ -647,6 +667,8 @@ namespace cicada
 	cicada::parse_agenda(goal, grammar_parse, weight_function<weight_type>(*weights_parse), lattice, parsed, size, yield_source, treebank, pos_mode, ordered, frontier);
       
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_parse.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -670,6 +692,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(parsed);
     }
@@ -856,6 +880,34 @@ namespace cicada
 	weights_assigned = &__weights;
     }
 
+    template <typename Function>
+    void ParseCoarse::parse(const Function& function, const lattice_type& lattice, hypergraph_type& graph, data_type& data) const
+    {
+      typedef cicada::ParseCoarse<typename Function::value_type, Function> parser_type;
+      
+      parser_type parser(goal, grammars, thresholds, function, size, yield_source, treebank, pos_mode, ordered, frontier);
+      
+      parser(lattice, graph);
+      
+      // prune statistics for each coarse level, i.e. name-level0, name-level1 etc.
+      for (size_t level = 0; level != parser.statistics().size(); ++ level) {
+	const typename parser_type::level_stat_type& level_stat = parser.statistics()[level];
+	
+	if (debug)
+	  std::cerr << name << ": " << data.id
+		    << " level: " << level
+		    << " pruned: " << level_stat.pruned
+		    << " unpruned: " << level_stat.unpruned
+		    << std::endl;
+	
+	statistics_type::statistic_type& stat = data.statistics[name.attribute() + "-level" + utils::lexical_cast<std::string>(level)];
+	
+	stat.count    += level_stat.count;
+	stat.pruned   += level_stat.pruned;
+	stat.unpruned += level_stat.unpruned;
+      }
+    }
+
     void ParseCoarse::operator()(data_type& data) const
     {
       typedef cicada::semiring::Logprob<double> weight_type;
@@ -879,20 +931,11 @@ namespace cicada
 	giter->assign(lattice);
       
       if (weights_one)
-	cicada::parse_coarse(goal,
-			     grammars.begin(), grammars.end(),
-			     thresholds.begin(), thresholds.end(),
-			     weight_function_one<weight_type>(), lattice, parsed, size, yield_source, treebank, pos_mode, ordered, frontier);
+	parse(weight_function_one<weight_type>(), lattice, parsed, data);
       else if (! weights_extra.empty())
-	cicada::parse_coarse(goal,
-			     grammars.begin(), grammars.end(),
-			     thresholds.begin(), thresholds.end(),
-			     weight_function_extra<weight_type>(*weights_parse, weights_extra.begin(), weights_extra.end()), lattice, parsed, size, yield_source, treebank, pos_mode, ordered, frontier);
+	parse(weight_function_extra<weight_type>(*weights_parse, weights_extra.begin(), weights_extra.end()), lattice, parsed, data);
       else
-	cicada::parse_coarse(goal,
-			     grammars.begin(), grammars.end(),
-			     thresholds.begin(), thresholds.end(),
-			     weight_function<weight_type>(*weights_parse), lattice, parsed, size, yield_source, treebank, pos_mode, ordered, frontier);
+	parse(weight_function<weight_type>(*weights_parse), lattice, parsed, data);
       
       utils::resource end;
     
@@ -1036,6 +1079,8 @@ namespace cicada
       
       const grammar_type& grammar_parse = (grammar_local.empty() ? grammar : grammar_local);
 
+      const grammar_type::cache_stat_type cache_start = grammar_parse.cache_statistics();
+      
       utils::resource start;
       
       grammar_parse.assign(lattice);
@@ -1053,6 +1098,8 @@ namespace cicada
 #endif
       
       utils::resource end;
+      
+      const grammar_type::cache_stat_type cache_end = grammar_parse.cache_statistics();
     
       if (debug)
 	std::cerr << name << ": " << data.id
@@ -1076,6 +1123,8 @@ namespace cicada
       stat.user_time += (end.user_time() - start.user_time());
       stat.cpu_time  += (end.cpu_time() - start.cpu_time());
       stat.thread_time  += (end.thread_time() - start.thread_time());
+      stat.cache_hit    += cache_end.first  - cache_start.first;
+      stat.cache_miss   += cache_end.second - cache_start.second;
     
       hypergraph.swap(parsed);
     }
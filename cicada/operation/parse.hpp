@@ -163,7 +163,12 @@ namespace cicada
       void operator()(data_type& data) const;
       
       void assign(const weight_set_type& __weights);
+
+    private:
+      template <typename Function>
+      void parse(const Function& function, const lattice_type& lattice, hypergraph_type& graph, data_type& data) const;
       
+    public:
       grammar_set_type   grammars;
       threshold_set_type thresholds;
       
@@ -54,6 +54,8 @@
 #include "utils/lexical_cast.hpp"
 
 #include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 
 namespace cicada
 {
@@ -74,6 +76,7 @@ apply: feature application\n\
 \tstate-full=[true|false] apply state-full features only\n\
 \tstate-less=[true|false] apply state-less features only\n\
 \tprune-bin=[true|false] preserve pruning bin information\n\
+\tthreads=<# of threads> parallel cube-pruning over the nodes of each sentence\n\
 \tweights=weight file for feature\n\
 \tweights-one=[true|false] one initialized weight\n\
 \tfeature=feature function\n\
@@ -115,6 +118,12 @@ compose-phrase: composition from lattice (or sentence) with phrase-based grammar
 \tfrontier=[true|false] keep source/target frontier\n\
 \tgoal=[goal symbol]\n\
 \tgrammar=[grammar spec] grammar\n\
+\tstack=[true|false] stack decoding with the model (apply is not required)\n\
+\tsize=<stack size> default: 200\n\
+\tthreshold=<threshold> prune hypotheses worse than best * threshold (0 for no threshold pruning)\n\
+\tweights=weight file for feature\n\
+\tweights-one=[true|false] one initialized weight\n\
+\tweight=\"weight=value\" additional weight to the weight vector\n\
 compose-alignment: composition from lattice (or forest) with target\n\
 \tlattice=[true|false] lattice composition\n\
 \tforest=[true|false] forest composition\n\
@@ -169,6 +178,7 @@ output: kbest or hypergraph output\n\
 \tweight=\"weight=value\" additional weight to the weight vector\n\
 \tyield=[sentence|string|terminal-pos|derivation|tree|treebank|graphviz|alignment|span] yield for kbest\n\
 \tgraphviz=[true|false] dump in graphviz format\n\
+\tbinary=[true|false] dump forest in compact binary format\n\
 \tdebinarize=[true|false] debinarize k-best trees\n\
 \tstatistics=[true|false] dump various statistics (size etc.)\n\
 \tlattice=[true|false] dump lattice\n\
@@ -354,6 +364,8 @@ viterbi: compute viterbi tree\n\
     data.id = operation_type::id_type(-1);
     output_data.use_buffer = false;
     
+    trace_mode = false;
+    
     bool output_initial = true;
     
     parameter_set_type::const_iterator piter_end = parameters.end();
@@ -378,7 +390,7 @@ viterbi: compute viterbi tree\n\
       else if (param_name == "compose-grammar")
 	operations.push_back(operation_ptr_type(new operation::ComposeGrammar(*piter, grammar, goal, debug)));
       else if (param_name == "compose-phrase")
-	operations.push_back(operation_ptr_type(new operation::ComposePhrase(*piter, grammar, goal, debug)));
+	operations.push_back(operation_ptr_type(new operation::ComposePhrase(*piter, grammar, model, goal, debug)));
       else if (param_name == "compose-alignment")
 	operations.push_back(operation_ptr_type(new operation::ComposeAlignment(*piter, grammar, goal, debug)));
       else if (param_name == "compose-dependency")
@@ -496,6 +508,7 @@ viterbi: compute viterbi tree\n\
     std::string::const_iterator end = line.end();
     
     data.clear();
+    trace.clear();
     
     if (input_id) {
       qi::uint_parser<operation_type::id_type> id_parser;
@@ -695,6 +708,34 @@ viterbi: compute viterbi tree\n\
     for (operation_ptr_set_type::const_iterator oiter = operations.begin(); oiter != oiter_end; ++ oiter)
       (*oiter)->operator()(data);
     
-    statistics += data.statistics;
+    statistics.sample(data.statistics);
+    
+    if (trace_mode) {
+      boost::iostreams::filtering_ostream os;
+      os.push(boost::iostreams::back_inserter(trace));
+      os.precision(10);
+      
+      statistics_type::const_iterator siter_end = data.statistics.end();
+      for (statistics_type::const_iterator siter = data.statistics.begin(); siter != siter_end; ++ siter) {
+	os << "{\"id\": " << data.id << ", \"operation\": \"";
+	
+	// escape as a JSON string
+	attribute_type::const_iterator citer_end = siter->first.end();
+	for (attribute_type::const_iterator citer = siter->first.begin(); citer != citer_end; ++ citer) {
+	  if (*citer == '"' || *citer == '\\')
+	    os << '\\';
+	  os << *citer;
+	}
+	
+	os << "\""
+	   << ", \"count\": " << siter->second.count
+	   << ", \"wall-time\": " << siter->second.user_time
+	   << ", \"cpu-time\": " << siter->second.cpu_time
+	   << ", \"thread-time\": " << siter->second.thread_time
+	   << ", \"nodes\": " << siter->second.node
+	   << ", \"edges\": " << siter->second.edge
+	   << "}\n";
+      }
+    }
   }
 };
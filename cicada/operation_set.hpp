@@ -106,6 +106,10 @@ namespace cicada
     const data_type& get_data() const { return data; }
 
     const statistics_type& get_statistics() const { return statistics; }
+    
+    // per-sentence trace of each operation in JSON lines, filled only when enabled by set_trace()
+    const std::string& get_trace() const { return trace; }
+    void set_trace(const bool __trace_mode) { trace_mode = __trace_mode; }
 
     size_type size() const { return operations.size(); }
     bool empty() const { return operations.empty(); }
@@ -155,6 +159,9 @@ namespace cicada
     
     operation_ptr_set_type operations;
     statistics_type        statistics;
+    
+    bool        trace_mode;
+    std::string trace;
 
     int debug;
   };
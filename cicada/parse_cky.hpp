@@ -19,6 +19,7 @@
 #include <cicada/transducer.hpp>
 #include <cicada/hypergraph.hpp>
 #include <cicada/semiring.hpp>
+#include <cicada/cky_chart.hpp>
 
 #include <utils/chunk_vector.hpp>
 #include <utils/chart.hpp>
@@ -102,46 +103,20 @@ namespace cicada
       goal_rule = rule_type::create(rule_type(vocab_type::GOAL, rule_type::symbol_set_type(1, goal.non_terminal())));
     }
     
-    typedef utils::mulvector2<hypergraph_type::id_type, std::allocator<hypergraph_type::id_type> > tails_map_type;
+    // tails of active items are positions of passive items in the passive chart, but tails of
+    // unary items are nodes in the hypergraph
+    typedef hypergraph_type::id_type passive_type;
+    
+    typedef utils::mulvector2<passive_type, std::allocator<passive_type> > tails_map_type;
+    typedef typename tails_map_type::const_reference tails_mapped_type;
     typedef size_type tails_id_type;
+    typedef std::vector<passive_type, std::allocator<passive_type> > tails_type;
     
-    struct Active
-    {
-      Active(const transducer_type::id_type& __node,
-	     const hypergraph_type::edge_type::node_set_type& __tails,
-	     const feature_set_type& __features,
-	     const attribute_set_type& __attributes)
-	: node(__node),
-	  tails(__tails),
-	  features(__features),
-	  attributes(__attributes) {}
-      Active(const transducer_type::id_type& __node,
-	     const feature_set_type& __features,
-	     const attribute_set_type& __attributes)
-	: node(__node),
-	  tails(),
-	  features(__features),
-	  attributes(__attributes) {}
-      Active(const transducer_type::id_type& __node)
-	: node(__node),
-	  tails(),
-	  features(),
-	  attributes() {}
-      
-      Active()
-	: node(),
-	  tails(),
-	  features(),
-	  attributes() {}
-      
-      transducer_type::id_type                  node;
-      hypergraph_type::edge_type::node_set_type tails;
-      feature_set_type                          features;
-      attribute_set_type                        attributes;
-    };
+    // features of active items, which are introduced by lattice arcs. The zero-th features are empty.
+    typedef std::vector<feature_set_type, std::allocator<feature_set_type> > feature_map_type;
+    typedef size_type feature_id_type;
     
-    typedef Active active_type;
-    typedef utils::chunk_vector<active_type, 4096 / sizeof(active_type), std::allocator<active_type> > active_set_type;
+    typedef CKYActiveSet active_set_type;
 
     typedef utils::chart<active_set_type, std::allocator<active_set_type> > active_chart_type;
     typedef std::vector<active_chart_type, std::allocator<active_chart_type> > active_chart_set_type;
@@ -216,9 +191,10 @@ namespace cicada
     
     struct Candidate
     {
-      Candidate() : active(), j(), first(), iter(), last(), score(), level(0) {}
+      Candidate() : tails(0), features(0), j(), first(), iter(), last(), score(), level(0) {}
       
-      const active_type* active;
+      tails_id_type   tails;
+      feature_id_type features;
       
       index_set_type j;
       
@@ -254,12 +230,9 @@ namespace cicada
     typedef std::vector<const candidate_type*, std::allocator<const candidate_type*> > candidate_heap_base_type;
     typedef utils::std_heap<const candidate_type*,  candidate_heap_base_type, compare_heap_type> candidate_heap_type;
     
-    typedef hypergraph_type::id_type passive_type;
-    //typedef std::vector<passive_type, std::allocator<passive_type> > passive_set_type;
-    typedef utils::chart<passive_type, std::allocator<passive_type> > passive_chart_type;
-    
-    typedef utils::mulvector2<passive_type, std::allocator<passive_type> > passive_map_type;
-    typedef typename passive_map_type::const_reference passive_set_type;
+    // passive items with their best scores, pointing to the derivations
+    typedef CKYScoreChart<passive_type, score_type> passive_chart_type;
+    typedef typename passive_chart_type::range_type passive_set_type;
     
     typedef std::vector<symbol_type, std::allocator<symbol_type> > non_terminal_set_type;
     typedef std::vector<score_type,  std::allocator<score_type> >  score_set_type;
@@ -343,14 +316,17 @@ namespace cicada
       scores.clear();
       
       derivation_map.clear();
-      passive_map.clear();
-      passive_map.reserve((lattice.size() + 1) * (((lattice.size() + 1) >> 1) + 1), utils::bithack::max(beam_size >> 1, 1));
       
       actives.reserve(grammar.size());
-      passives.reserve(lattice.size() + 1);
-      
       actives.resize(grammar.size(), active_chart_type(lattice.size() + 1));
-      passives.resize(lattice.size() + 1, passive_map.push_back());
+      
+      passives.initialize(lattice.size());
+      
+      tails_map.clear();
+      tails_map.push_back();
+      
+      features_map.clear();
+      features_map.push_back(feature_set_type());
 
       rule_tables.clear();
       rule_tables.reserve(grammar.size());
@@ -360,7 +336,6 @@ namespace cicada
       frontiers_target.clear();
 
       derivation_set_type derivations;
-      derivation_set_type passive_arcs;
     
       // initialize active chart
       for (size_t table = 0; table != grammar.size(); ++ table) {
@@ -368,7 +343,7 @@ namespace cicada
 	
 	for (size_t pos = 0; pos != lattice.size(); ++ pos)
 	  if (grammar[table].valid_span(pos, pos, 0))
-	    actives[table](pos, pos).push_back(active_type(root));
+	    actives[table](pos, pos).push_back(root, 0, 0);
       }
       
       for (size_t length = 1; length <= lattice.size(); ++ length)
@@ -376,7 +351,7 @@ namespace cicada
 	  const size_t last = first + length;
 
 	  if (pruner(first, last)) continue;
-	  	  
+		    
 	  //std::cerr << "span: " << first << ".." << last << " distance: " << lattice.shortest_distance(first, last) << std::endl;
 	  
 	  for (size_t table = 0; table != grammar.size(); ++ table) {
@@ -389,8 +364,8 @@ namespace cicada
 	      // first, extend active items...
 	      active_set_type& cell = actives[table](first, last);
 	      for (size_t middle = first + 1; middle < last; ++ middle) {
-		const active_set_type&  active_arcs  = actives[table](first, middle);
-		const passive_set_type passive_arcs = passive_map[passives(middle, last)];
+		const active_set_type& active_arcs  = actives[table](first, middle);
+		const passive_set_type passive_arcs = passives(middle, last);
 		
 		extend_actives(transducer, active_arcs, passive_arcs, cell);
 	      }
@@ -399,49 +374,24 @@ namespace cicada
 		// then, advance by terminal(s) at lattice[last - 1];
 		const active_set_type&  active_arcs  = actives[table](first, last - 1);
 		const lattice_type::arc_set_type& passive_arcs = lattice[last - 1];
-	      
-		typename active_set_type::const_iterator aiter_begin = active_arcs.begin();
-		typename active_set_type::const_iterator aiter_end = active_arcs.end();
-	      
-		if (aiter_begin != aiter_end) {
-		  if (pos_mode) {
-		    lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
-		    for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
-		      const symbol_type terminal = piter->label.terminal();
-		      
-		      active_set_type& cell = actives[table](first, last - 1 + piter->distance);
-		      
-		      // handling of EPSILON rule...
-		      if (terminal == vocab_type::EPSILON) {
-			for (typename active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-			  cell.push_back(active_type(aiter->node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-		      } else {
-			for (typename active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter) {
-			  const transducer_type::id_type node = transducer.next(aiter->node, terminal);
-			  if (node == transducer.root()) continue;
-			  
-			  cell.push_back(active_type(node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-			}
-		      }
-		    }
-		  } else {
-		    lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
-		    for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
-		      const symbol_type& terminal = piter->label;
-		      
-		      active_set_type& cell = actives[table](first, last - 1 + piter->distance);
-		      
-		      // handling of EPSILON rule...
-		      if (terminal == vocab_type::EPSILON) {
-			for (typename active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-			  cell.push_back(active_type(aiter->node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-		      } else {
-			for (typename active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter) {
-			  const transducer_type::id_type node = transducer.next(aiter->node, terminal);
-			  if (node == transducer.root()) continue;
-			  
-			  cell.push_back(active_type(node, aiter->tails, aiter->features + piter->features, aiter->attributes));
-			}
+		
+		if (! active_arcs.empty()) {
+		  lattice_type::arc_set_type::const_iterator piter_end = passive_arcs.end();
+		  for (lattice_type::arc_set_type::const_iterator piter = passive_arcs.begin(); piter != piter_end; ++ piter) {
+		    const symbol_type terminal = (pos_mode ? piter->label.terminal() : piter->label);
+		    
+		    active_set_type& cell = actives[table](first, last - 1 + piter->distance);
+		    
+		    // handling of EPSILON rule...
+		    if (terminal == vocab_type::EPSILON) {
+		      for (size_type a = 0; a != active_arcs.size(); ++ a)
+			cell.push_back(active_arcs.states[a], active_arcs.tails[a], extend_features(active_arcs.features[a], piter->features));
+		    } else {
+		      for (size_type a = 0; a != active_arcs.size(); ++ a) {
+			const transducer_type::id_type node = transducer.next(active_arcs.states[a], terminal);
+			if (node == transducer.root()) continue;
+			
+			cell.push_back(node, active_arcs.tails[a], extend_features(active_arcs.features[a], piter->features));
 		      }
 		    }
 		  }
@@ -461,32 +411,33 @@ namespace cicada
 	  // create new candidate with unary rule, but if it is already created, ignore!
 	  // 
 	  
-	  actives_unary.clear();
 	  unary_map.clear();
 	  node_map.clear();
 	  candidates.clear();
 	  heap.clear();
 	  
 	  for (size_t table = 0; table != grammar.size(); ++ table) {
-	    active_set_type&  cell = actives[table](first, last);
+	    const active_set_type& cell = actives[table](first, last);
 	    
-	    typename active_set_type::const_iterator citer_end = cell.end();
-	    for (typename active_set_type::const_iterator citer = cell.begin(); citer != citer_end; ++ citer) {
-	      const rule_candidate_set_type& rules = cands(table, citer->node);
+	    for (size_type a = 0; a != cell.size(); ++ a) {
+	      const rule_candidate_set_type& rules = cands(table, cell.states[a]);
 	      
 	      if (rules.empty()) continue;
 	      
-	      score_type score_antecedent = function(citer->features);
+	      score_type score_antecedent = function(features_map[cell.features[a]]);
+	      
+	      const tails_mapped_type tails = tails_map[cell.tails[a]];
 	      
-	      hypergraph_type::edge_type::node_set_type::const_iterator titer_end = citer->tails.end();
-	      for (hypergraph_type::edge_type::node_set_type::const_iterator titer = citer->tails.begin(); titer != titer_end; ++ titer)
-		score_antecedent *= scores[derivation_map[*titer].front()];
+	      typename tails_mapped_type::const_iterator titer_end = tails.end();
+	      for (typename tails_mapped_type::const_iterator titer = tails.begin(); titer != titer_end; ++ titer)
+		score_antecedent *= passives.score(*titer);
 	      
 	      candidates.push_back(candidate_type());
 	      candidate_type& cand = candidates.back();
 	      
-	      cand.active = &(*citer);
-	      cand.j = index_set_type(citer->tails.size(), 0);
+	      cand.tails    = cell.tails[a];
+	      cand.features = cell.features[a];
+	      cand.j = index_set_type(tails.size(), 0);
 	      
 	      cand.first = rules.begin();
 	      cand.iter  = rules.begin();
@@ -514,7 +465,6 @@ namespace cicada
 	    
 	    // check unary rule, and see if this edge is already inserted!
 	    
-	    const active_type& active = *(item->active);
 	    const rule_candidate_type& rule = *(item->iter);
 	    const score_type score = item->score;
 	    
@@ -527,6 +477,9 @@ namespace cicada
 	    // we will increment here!
 	    ++ num_pop;
 	    
+	    const tails_mapped_type tails = tails_map[item->tails];
+	    const feature_set_type& features = features_map[item->features];
+	    
 	    std::pair<hypergraph_type::id_type, bool> node_passive(hypergraph_type::invalid, false);
 	    
 	    if (item->level > 0) {
@@ -540,7 +493,7 @@ namespace cicada
 	      // if already inserted, check node-map and update scores!
 	      
 	      // for level > 0, we do not use j!
-	      const symbol_type label_prev = non_terminals[active.tails.front()];
+	      const symbol_type label_prev = non_terminals[tails.front()];
 	      const symbol_type label_next = rule.rule->lhs;
 	      
 	      unary_rule_set_type& unaries = unary_map[std::make_pair(std::make_pair(label_prev, item->level - 1), std::make_pair(label_next, item->level))];
@@ -555,24 +508,24 @@ namespace cicada
 		
 		scores[niter->second] = std::max(scores[niter->second], score);
 	      } else
-		node_passive = apply_rule(score, rule.rule, active.features + rule.features, active.attributes + rule.attributes,
-					  active.tails.begin(), active.tails.end(), derivations, graph,
+		node_passive = apply_rule(score, rule.rule, features + rule.features, rule.attributes,
+					  tails.begin(), tails.end(), derivations, graph,
 					  first, last, utils::bithack::branch(unique_goal && rule.rule->lhs == goal, 0, item->level));
 	    } else {
-	      // transform acive.tails into tails! if j is not empty!
-
+	      // transform passive items into nodes, if j is not empty!
+	      
 	      if (item->j.empty())
-		node_passive = apply_rule(score, rule.rule, active.features + rule.features, active.attributes + rule.attributes,
-					  active.tails.begin(), active.tails.end(), derivations, graph,
+		node_passive = apply_rule(score, rule.rule, features + rule.features, rule.attributes,
+					  tails.begin(), tails.end(), derivations, graph,
 					  first, last, item->level);
 	      else {
-		// transform active.tails into actual tails
-		hypergraph_type::edge_type::node_set_type tails(active.tails);
+		// transform passive items into actual tails
+		tails_nodes.resize(tails.size());
 		for (size_t i = 0; i != tails.size(); ++ i)
-		  tails[i] = derivation_map[active.tails[i]][item->j[i]];
+		  tails_nodes[i] = derivation_map[passives.pointer(tails[i])][item->j[i]];
 		
-		node_passive = apply_rule(score, rule.rule, active.features + rule.features, active.attributes + rule.attributes,
-					  tails.begin(), tails.end(), derivations, graph,
+		node_passive = apply_rule(score, rule.rule, features + rule.features, rule.attributes,
+					  tails_nodes.begin(), tails_nodes.end(), derivations, graph,
 					  first, last, item->level);
 	      }
 	    }
@@ -590,6 +543,8 @@ namespace cicada
 	    const symbol_type& non_terminal = non_terminals[node_passive.first];
 	    const score_type score_antecedent = scores[node_passive.first];
 	    
+	    tails_id_type tails_unary = 0;
+	    
 	    for (size_t table = 0; table != grammar.size(); ++ table) {
 	      const transducer_type& transducer = grammar[table];
 	      
@@ -604,13 +559,13 @@ namespace cicada
 	      
 	      //std::cerr << "unary rule: " << non_terminal << " size: " << rules.size() << std::endl;
 	      
-	      actives_unary.push_back(active_type());
-	      actives_unary.back().tails = hypergraph_type::edge_type::node_set_type(1, node_passive.first);
+	      if (! tails_unary)
+		tails_unary = tails_map.push_back(&node_passive.first, (&node_passive.first) + 1);
 	      
 	      candidates.push_back(candidate_type());
 	      candidate_type& cand = candidates.back();
 	      
-	      cand.active = &(actives_unary.back());
+	      cand.tails = tails_unary;
 	      // cand.j is empty!
 	      cand.first = rules.begin();
 	      cand.iter  = rules.begin();
@@ -623,32 +578,33 @@ namespace cicada
 	    }
 	  }
 	  
-	  passive_arcs.clear();
-	  
 	  if (! derivations.empty()) {
+	    const size_type position = passives.size();
+	    
 	    if (derivations.size() == 1)
-	      passive_arcs.push_back(derivation_map.push_back(derivations.begin(), derivations.end()));
+	      passives.push_back(non_terminals[derivations.front()],
+				 scores[derivations.front()],
+				 derivation_map.push_back(derivations.begin(), derivations.end()));
 	    else {
 	      std::sort(derivations.begin(), derivations.end(), less_non_terminal(non_terminals, scores));
 	      
 	      size_t i_first = 0;
 	      for (size_t i = 1; i != derivations.size(); ++ i)
 		if (non_terminals[derivations[i_first]] != non_terminals[derivations[i]]) {
-		  passive_arcs.push_back(derivation_map.push_back(derivations.begin() + i_first, derivations.begin() + i));
-
-		  //std::cerr << "\trange: [" << i_first << ", " << i << ")" << std::endl;
+		  passives.push_back(non_terminals[derivations[i_first]],
+				     scores[derivations[i_first]],
+				     derivation_map.push_back(derivations.begin() + i_first, derivations.begin() + i));
 		  
 		  i_first = i;
 		}
 	      
-	      if (i_first != derivations.size()) {
-		passive_arcs.push_back(derivation_map.push_back(derivations.begin() + i_first, derivations.end()));
-		
-		//std::cerr << "\trange: [" << i_first << ", " << derivations.size() << ")" << std::endl;
-	      }
+	      if (i_first != derivations.size())
+		passives.push_back(non_terminals[derivations[i_first]],
+				   scores[derivations[i_first]],
+				   derivation_map.push_back(derivations.begin() + i_first, derivations.end()));
 	    }
 
-	    passives(first, last) = passive_map.push_back(passive_arcs.begin(), passive_arcs.end());
+	    passives.close(first, last, position);
 	    
 	    // extend root with passive items at [first, last)
 	    for (size_t table = 0; table != grammar.size(); ++ table) {
@@ -656,8 +612,8 @@ namespace cicada
 	      
 	      if (! transducer.valid_span(first, last, lattice.shortest_distance(first, last))) continue;
 	      
-	      const active_set_type&  active_arcs  = actives[table](first, first);
-	      const passive_set_type passive_arcs = passive_map[passives(first, last)];
+	      const active_set_type& active_arcs  = actives[table](first, first);
+	      const passive_set_type passive_arcs = passives(first, last);
 	      
 	      active_set_type& cell = actives[table](first, last);
 	      
@@ -674,24 +630,24 @@ namespace cicada
       // revise this!
       
       if (unique_goal) {
-	const passive_set_type passive_arcs = passive_map[passives(0, lattice.size())];
-	for (size_t p = 0; p != passive_arcs.size(); ++ p)
-	  if (non_terminals[derivation_map[passive_arcs[p]].front()] == goal) {
+	const passive_set_type passive_arcs = passives(0, lattice.size());
+	for (size_t p = passive_arcs.first; p != passive_arcs.last; ++ p)
+	  if (passives.label(p) == goal) {
 	    if (graph.is_valid())
-	      throw std::runtime_error("multiple goal? " + boost::lexical_cast<std::string>(graph.goal) + " " + boost::lexical_cast<std::string>(derivation_map[passive_arcs[p]].front()));
+	      throw std::runtime_error("multiple goal? " + boost::lexical_cast<std::string>(graph.goal) + " " + boost::lexical_cast<std::string>(derivation_map[passives.pointer(p)].front()));
 	    
-	    if (derivation_map[passive_arcs[p]].size() > 1)
+	    if (derivation_map[passives.pointer(p)].size() > 1)
 	      throw std::runtime_error("multiple goal???");
 	    
-	    graph.goal = derivation_map[passive_arcs[p]].front();
+	    graph.goal = derivation_map[passives.pointer(p)].front();
 	  }
       } else {
-	const passive_set_type passive_arcs = passive_map[passives(0, lattice.size())];
-	for (size_t p = 0; p != passive_arcs.size(); ++ p)
-	  if (non_terminals[derivation_map[passive_arcs[p]].front()] == goal) {
-	    //std::cerr << "goal node: " << passive_arcs[p] << std::endl;
+	const passive_set_type passive_arcs = passives(0, lattice.size());
+	for (size_t p = passive_arcs.first; p != passive_arcs.last; ++ p)
+	  if (passives.label(p) == goal) {
+	    //std::cerr << "goal node: " << passives.pointer(p) << std::endl;
 	    
-	    derivation_mapped_type ref = derivation_map[passive_arcs[p]];
+	    derivation_mapped_type ref = derivation_map[passives.pointer(p)];
 	    
 	    for (size_t i = 0; i != ref.size(); ++ i) {
 	      const passive_type& id = ref[i];
@@ -722,6 +678,8 @@ namespace cicada
       non_terminals.clear();
       scores.clear();
       rule_tables.clear();
+      tails_map.clear();
+      features_map.clear();
     }
 
   private:
@@ -746,8 +704,10 @@ namespace cicada
 	  heap.push(&cand);
 	}
 	
+	const tails_mapped_type tails = tails_map[item->tails];
+	
 	for (size_type i = 0; i != item->j.size(); ++ i) {
-	  derivation_mapped_type ref = derivation_map[item->active->tails[i]];
+	  derivation_mapped_type ref = derivation_map[passives.pointer(tails[i])];
 	  
 	  if (item->j[i] + 1 < static_cast<int>(ref.size())) {
 	    // make new candidate
@@ -839,39 +799,38 @@ namespace cicada
       return std::make_pair(result.first->second, unary_next);
     }
     
+    feature_id_type extend_features(const feature_id_type& id, const feature_set_type& features)
+    {
+      if (features.empty()) return id;
+      
+      features_map.push_back(features_map[id] + features);
+      
+      return features_map.size() - 1;
+    }
+    
+    // extend active items by passive items. The passive items are contiguous in the passive chart,
+    // and new active items refer to them by positions.
     bool extend_actives(const transducer_type& transducer,
-			const active_set_type& actives, 
-			const passive_set_type& passives,
+			const active_set_type& active_arcs,
+			const passive_set_type& passive_arcs,
 			active_set_type& cell)
     {
-      typename active_set_type::const_iterator aiter_begin = actives.begin();
-      typename active_set_type::const_iterator aiter_end   = actives.end();
-      
-      typename passive_set_type::const_iterator piter_begin = passives.begin();
-      typename passive_set_type::const_iterator piter_end   = passives.end();
-
       bool found = false;
       
-      if (piter_begin != piter_end)
-	for (typename active_set_type::const_iterator aiter = aiter_begin; aiter != aiter_end; ++ aiter)
-	  if (transducer.has_next(aiter->node)) {
-	    symbol_type label;
-	    transducer_type::id_type node = transducer.root();
+      if (! passive_arcs.empty())
+	for (size_type a = 0; a != active_arcs.size(); ++ a)
+	  if (transducer.has_next(active_arcs.states[a])) {
+	    const tails_mapped_type tails_prev = tails_map[active_arcs.tails[a]];
 	    
-	    hypergraph_type::edge_type::node_set_type tails(aiter->tails.size() + 1);
-	    std::copy(aiter->tails.begin(), aiter->tails.end(), tails.begin());
+	    tails_extended.resize(tails_prev.size() + 1);
+	    std::copy(tails_prev.begin(), tails_prev.end(), tails_extended.begin());
 	    
-	    for (typename passive_set_type::const_iterator piter = piter_begin; piter != piter_end; ++ piter) {
-	      const symbol_type& non_terminal = non_terminals[derivation_map[*piter].front()];
-	      
-	      if (label != non_terminal) {
-		node = transducer.next(aiter->node, non_terminal);
-		label = non_terminal;
-	      }
+	    for (size_type p = passive_arcs.first; p != passive_arcs.last; ++ p) {
+	      const transducer_type::id_type node = transducer.next(active_arcs.states[a], passives.label(p));
 	      if (node == transducer.root()) continue;
 	      
-	      tails.back() = *piter;
-	      cell.push_back(active_type(node, tails, aiter->features, aiter->attributes));
+	      tails_extended.back() = p;
+	      cell.push_back(node, tails_map.push_back(tails_extended.begin(), tails_extended.end()), active_arcs.features[a]);
 	      
 	      found = true;
 	    }
@@ -972,10 +931,13 @@ namespace cicada
 
     active_chart_set_type  actives;
     passive_chart_type     passives;
-    active_set_type        actives_unary;
+    
+    tails_map_type         tails_map;
+    tails_type             tails_extended;
+    tails_type             tails_nodes;
+    feature_map_type       features_map;
     
     derivation_map_type    derivation_map;
-    passive_map_type       passive_map;
 
     unary_rule_map_type   unary_map;
     node_map_type         node_map;
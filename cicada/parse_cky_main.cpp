@@ -0,0 +1,158 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of categories] [# of latent annotations] [sentence length] [# of sentences] [beam size]
+//
+// parse random sentences by parse-cky and compose-cky with a random latent-annotated binary grammar,
+// and report the parsing time per sentence and the size of the parsed forests.
+//
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "grammar.hpp"
+#include "grammar_mutable.hpp"
+#include "lattice.hpp"
+#include "sentence.hpp"
+#include "hypergraph.hpp"
+#include "parse_cky.hpp"
+#include "compose_cky.hpp"
+#include "semiring.hpp"
+#include "weight_vector.hpp"
+
+#include "operation/functional.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::Symbol      symbol_type;
+typedef cicada::Grammar     grammar_type;
+typedef cicada::Lattice     lattice_type;
+typedef cicada::Sentence    sentence_type;
+typedef cicada::HyperGraph  hypergraph_type;
+
+typedef cicada::semiring::Logprob<double> weight_type;
+typedef cicada::operation::weight_function<weight_type> function_type;
+
+typedef boost::mt19937 generator_type;
+
+std::string non_terminal(const int category, const int latent)
+{
+  return "[C" + utils::lexical_cast<std::string>(category) + '@' + utils::lexical_cast<std::string>(latent) + ']';
+}
+
+std::string terminal(const int word)
+{
+  return 'w' + utils::lexical_cast<std::string>(word);
+}
+
+void insert_rule(cicada::GrammarMutable& grammar, const std::string& lhs, const std::string& rhs, const double logprob)
+{
+  grammar.insert(lhs + " ||| " + rhs + " ||| " + rhs + " ||| logprob=" + utils::lexical_cast<std::string>(logprob));
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const int num_category = (argc > 1 ? utils::lexical_cast<int>(argv[1]) : 10);
+    const int num_latent   = (argc > 2 ? utils::lexical_cast<int>(argv[2]) : 2);
+    const int length       = (argc > 3 ? utils::lexical_cast<int>(argv[3]) : 10);
+    const int num_sentence = (argc > 4 ? utils::lexical_cast<int>(argv[4]) : 3);
+    const int beam_size    = (argc > 5 ? utils::lexical_cast<int>(argv[5]) : 200);
+    const int num_word     = 300;
+
+    generator_type generator;
+    boost::random::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    boost::shared_ptr<cicada::GrammarMutable> grammar_mutable(new cicada::GrammarMutable());
+
+    // binary rules: 10% of the category triples, fully annotated by latent symbols
+    for (int a = 0; a != num_category; ++ a)
+      for (int b = 0; b != num_category; ++ b)
+	for (int c = 0; c != num_category; ++ c)
+	  if (uniform(generator) < 0.1)
+	    for (int la = 0; la != num_latent; ++ la)
+	      for (int lb = 0; lb != num_latent; ++ lb)
+		for (int lc = 0; lc != num_latent; ++ lc)
+		  insert_rule(*grammar_mutable, non_terminal(a, la), non_terminal(b, lb) + ' ' + non_terminal(c, lc), - 3.0 * uniform(generator));
+
+    // unary rules, acyclic
+    for (int a = 0; a != num_category; ++ a)
+      for (int b = a + 1; b < num_category; ++ b)
+	if (uniform(generator) < 0.05)
+	  for (int la = 0; la != num_latent; ++ la)
+	    for (int lb = 0; lb != num_latent; ++ lb)
+	      insert_rule(*grammar_mutable, non_terminal(a, la), non_terminal(b, lb), - 3.0 * uniform(generator));
+
+    // lexical rules: three categories per word
+    for (int w = 0; w != num_word; ++ w)
+      for (int k = 0; k != 3; ++ k)
+	for (int l = 0; l != num_latent; ++ l)
+	  insert_rule(*grammar_mutable, non_terminal((w * 7 + k * 13) % num_category, l), terminal(w), - 3.0 * uniform(generator));
+
+    for (int a = 0; a < num_category; a += 3)
+      for (int l = 0; l != num_latent; ++ l)
+	insert_rule(*grammar_mutable, "[ROOT]", non_terminal(a, l), - uniform(generator));
+
+    grammar_type grammar;
+    grammar.push_back(grammar_mutable);
+
+    cicada::WeightVector<double> weights;
+    weights[cicada::Feature("logprob")] = 1.0;
+
+    const symbol_type goal("[ROOT]");
+
+    double time_parse = 0.0;
+    double time_compose = 0.0;
+    size_t edges_parse = 0;
+    size_t edges_compose = 0;
+
+    for (int i = 0; i != num_sentence; ++ i) {
+      sentence_type sentence;
+      for (int j = 0; j != length; ++ j)
+	sentence.push_back(terminal(int(uniform(generator) * num_word)));
+
+      const lattice_type lattice(sentence);
+
+      hypergraph_type graph_parse;
+      hypergraph_type graph_compose;
+
+      {
+	utils::resource start;
+	cicada::parse_cky(goal, grammar, function_type(weights), lattice, graph_parse, beam_size);
+	utils::resource end;
+
+	time_parse += end.user_time() - start.user_time();
+      }
+
+      {
+	utils::resource start;
+	cicada::compose_cky(goal, grammar, lattice, graph_compose);
+	utils::resource end;
+
+	time_compose += end.user_time() - start.user_time();
+      }
+
+      if (! graph_parse.is_valid() || ! graph_compose.is_valid())
+	throw std::runtime_error("no parse for sentence " + utils::lexical_cast<std::string>(i));
+
+      edges_parse += graph_parse.edges.size();
+      edges_compose += graph_compose.edges.size();
+    }
+
+    std::cout << "parse-cky:   " << (time_parse / num_sentence) << " sec/sentence edges: " << edges_parse << std::endl;
+    std::cout << "compose-cky: " << (time_compose / num_sentence) << " sec/sentence edges: " << edges_compose << std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -18,6 +18,7 @@
 #include <cicada/semiring.hpp>
 #include <cicada/compose_cky.hpp>
 #include <cicada/parse_cky.hpp>
+#include <cicada/cky_chart.hpp>
 
 #include <utils/chunk_vector.hpp>
 #include <utils/chart.hpp>
@@ -33,14 +34,16 @@
 namespace cicada
 {
   // coarse-to-fine parsing
-  // input is a set of grammars, or use iterators
-  // 
-  // vector<grammar_type> grammar_set_type;
   //
-  // Actually, we need different implementation....
-  // How to handle this in the same framework.... separate this into different project...?
+  // input is a hierarchy of grammars, from the coarsest to the finest one, such as those learned by
+  // cicada_grammar_learn and projected by cicada_grammar_coarse: the coarsest grammar consists of [x]
+  // and [x^], the k-th grammar (k >= 1) is annotated by (k - 1)-bits of latent annotations, and the
+  // last one is the fine grammar. Each coarse grammar is parsed by a tabular CKY parser, which
+  // computes the posteriors of the labels in each span by inside/outside, and the items whose
+  // posteriors, projected onto the coarser grammar, are below the threshold are pruned from the next level.
+  // The fine grammar is parsed by ParseCKY, which constructs a hypergraph.
   //
-  
+
   template <typename Semiring, typename Function>
   struct ParseCoarse
   {
@@ -71,13 +74,51 @@ namespace cicada
     typedef std::vector<grammar_type, std::allocator<grammar_type> > grammar_set_type;
     typedef std::vector<double, std::allocator<double> > threshold_set_type;
 
-    typedef utils::compact_map<symbol_type, score_type,
-			       utils::unassigned<symbol_type>, utils::unassigned<symbol_type>,
-			       boost::hash<symbol_type>, std::equal_to<symbol_type>,
-			       std::allocator<std::pair<const symbol_type, score_type> > > label_score_set_type;
-
-    typedef utils::chart<label_score_set_type, std::allocator<label_score_set_type > > label_score_chart_type;
-
+    // posteriors of the labels in each span, kept in flat arrays and sorted by labels in each span
+    struct PosteriorChart : public CKYChart<score_type>
+    {
+      typedef CKYChart<score_type> base_type;
+      
+      typedef typename base_type::size_type  size_type;
+      typedef typename base_type::range_type range_type;
+      
+      // the position of label at [first, last), or size() if not found
+      size_type find(size_type first, size_type last, const symbol_type& label) const
+      {
+	const range_type& range = base_type::operator()(first, last);
+	
+	size_type lo = range.first;
+	size_type hi = range.last;
+	while (lo < hi) {
+	  const size_type mid = (lo + hi) >> 1;
+	  
+	  if (base_type::label(mid) < label)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+	
+	return (lo != range.last && base_type::label(lo) == label ? lo : base_type::size());
+      }
+      
+      const score_type& posterior(size_type pos) const { return base_type::pointer(pos); }
+    };
+    
+    typedef PosteriorChart posterior_chart_type;
+    
+    // # of chart items at each coarse level which survived or pruned by the threshold
+    struct LevelStat
+    {
+      size_type count;
+      size_type pruned;
+      size_type unpruned;
+      
+      LevelStat() : count(0), pruned(0), unpruned(0) {}
+    };
+    
+    typedef LevelStat level_stat_type;
+    typedef std::vector<level_stat_type, std::allocator<level_stat_type> > level_stat_set_type;
+    
     struct CoarseSymbol
     {
       CoarseSymbol(const int __bits) : bits(__bits) {}
@@ -107,7 +148,7 @@ namespace cicada
     template <typename Coarser>
     struct PruneCoarse
     {
-      PruneCoarse(const label_score_chart_type& __prunes,
+      PruneCoarse(const posterior_chart_type& __prunes,
 		  const score_type& __cutoff,
 		  Coarser __coarser)
 	: prunes(__prunes),
@@ -116,33 +157,27 @@ namespace cicada
 
       bool operator()(const int first, const int last) const
       {
-	const label_score_set_type& labels = prunes(first, last);
-
-	if (labels.empty()) return true;
+	const typename posterior_chart_type::range_type& range = prunes(first, last);
 	
-	bool no_prune = false;
-	typename label_score_set_type::const_iterator liter_end = labels.end();
-	for (typename label_score_set_type::const_iterator liter = labels.begin(); liter != liter_end; ++ liter)
-	  no_prune |= liter->second >= cutoff;
+	for (size_type pos = range.first; pos != range.last; ++ pos)
+	  if (prunes.posterior(pos) >= cutoff)
+	    return false;
 	
-	return ! no_prune;
+	return true;
       }
       
       bool operator()(const int first, const int last, const symbol_type& label) const
       {
-	const label_score_set_type& labels = prunes(first, last);
-	
-	if (labels.empty()) return true;
+	if (prunes(first, last).empty()) return true;
 	
-	typename label_score_set_type::const_iterator liter = labels.find(label);
-	if (liter != labels.end())
-	  return liter->second < cutoff;
+	size_type pos = prunes.find(first, last, label);
+	if (pos == prunes.size())
+	  pos = prunes.find(first, last, coarser(label));
 	
-	typename label_score_set_type::const_iterator citer = labels.find(coarser(label));
-	return (citer == labels.end() || citer->second < cutoff);
+	return (pos == prunes.size() || prunes.posterior(pos) < cutoff);
       }
       
-      const label_score_chart_type& prunes;
+      const posterior_chart_type& prunes;
       const score_type cutoff;
       Coarser coarser;
     };
@@ -304,6 +339,33 @@ namespace cicada
       typedef std::vector<score_pair_type, std::allocator<score_pair_type> > score_pair_set_type;
       typedef utils::chart<score_pair_set_type, std::allocator<score_pair_set_type> > score_pair_chart_type;
       
+      typedef std::pair<symbol_type, score_type> label_score_type;
+      typedef std::vector<label_score_type, std::allocator<label_score_type> > label_score_set_type;
+      
+      struct less_label
+      {
+	bool operator()(const label_score_type& x, const label_score_type& y) const
+	{
+	  return x.first < y.first;
+	}
+      };
+      
+      // lhs and score of the rules at each transducer node, computed once in each sentence
+      struct RuleScore
+      {
+	id_type    lhs;
+	score_type score;
+	
+	RuleScore() : lhs(), score() {}
+	RuleScore(const id_type& __lhs, const score_type& __score) : lhs(__lhs), score(__score) {}
+      };
+      
+      typedef RuleScore rule_score_type;
+      typedef utils::simple_vector<rule_score_type, std::allocator<rule_score_type> > rule_score_set_type;
+      typedef typename utils::unordered_map<transducer_type::id_type, rule_score_set_type, boost::hash<transducer_type::id_type>, std::equal_to<transducer_type::id_type>,
+					    std::allocator<std::pair<const transducer_type::id_type, rule_score_set_type> > >::type rule_score_map_type;
+      typedef std::vector<rule_score_map_type, std::allocator<rule_score_map_type> > rule_score_table_type;
+      
     public:
       ParseCKY(const symbol_type& __goal,
 	       const grammar_type& __grammar,
@@ -313,7 +375,8 @@ namespace cicada
 	       const bool __pos_mode=false,
 	       const bool __ordered=false,
 	       const bool __frontier=false)
-	: goal(__goal), grammar(__grammar), function(__function), yield_source(__yield_source), treebank(__treebank), pos_mode(__pos_mode), ordered(__ordered), frontier(__frontier)
+	: goal(__goal), grammar(__grammar), function(__function), yield_source(__yield_source), treebank(__treebank), pos_mode(__pos_mode), ordered(__ordered), frontier(__frontier),
+	  rule_tables(__grammar.size())
       {
 	//closure.set_empty_key(id_type(-1));
 	//closure_next.set_empty_key(id_type(-1));
@@ -322,16 +385,13 @@ namespace cicada
     public:      
       
       template <typename Pruner>
-      bool operator()(const lattice_type& lattice, label_score_chart_type& scores, const Pruner& pruner)
+      bool operator()(const lattice_type& lattice, posterior_chart_type& scores, const Pruner& pruner)
       {
 	inside_outside.clear();
-	scores.clear();
-	
 	inside_outside.reserve(lattice.size() + 1);
-	scores.reserve(lattice.size() + 1);
-	
 	inside_outside.resize(lattice.size() + 1);
-	scores.resize(lattice.size() + 1);
+	
+	scores.initialize(lattice.size());
 	
 	actives.clear();
 	passives.clear();
@@ -386,7 +446,7 @@ namespace cicada
       }
       
     private:
-      void compute_inside_outside(const lattice_type& lattice, label_score_chart_type& scores)
+      void compute_inside_outside(const lattice_type& lattice, posterior_chart_type& scores)
       {
 	const score_type score_sum = inside_outside(0, lattice.size())[goal_id].final_inside;
 	
@@ -397,21 +457,26 @@ namespace cicada
 	    
 	    if (inside_outside(first, last).empty()) continue;
 	    
-	    label_score_set_type& labels_scores = scores(first, last);
-	    const score_pair_set_type& inside_outside_scores   = inside_outside(first, last);
-
-	    //std::cerr << "span: " << first << ".." << last << std::endl;
+	    const score_pair_set_type& inside_outside_scores = inside_outside(first, last);
 	    
+	    labels_scores.clear();
 	    for (id_type id = 0; id != static_cast<id_type>(inside_outside_scores.size()); ++ id) {
-	      //const score_type score = std::max(inside_outside_scores[id].final_inside * inside_outside_scores[id].final_outside,
-	      //                                  inside_outside_scores[id].inside * inside_outside_scores[id].outside);
 	      const score_type& score = inside_outside_scores[id].score;
 	      
-	      //std::cerr << "\tid: " << id << " score: " << score << std::endl;
-	      
 	      if (score != cicada::semiring::traits<score_type>::zero())
-		labels_scores[symbol_map[id]] = score / score_sum;
+		labels_scores.push_back(std::make_pair(symbol_map[id], score / score_sum));
 	    }
+	    
+	    // keep them sorted by labels for binary search
+	    std::sort(labels_scores.begin(), labels_scores.end(), less_label());
+	    
+	    const size_type position = scores.size();
+	    
+	    typename label_score_set_type::const_iterator liter_end = labels_scores.end();
+	    for (typename label_score_set_type::const_iterator liter = labels_scores.begin(); liter != liter_end; ++ liter)
+	      scores.push_back(liter->first, liter->second);
+	    
+	    scores.close(first, last, position);
 	  }
       }
       
@@ -600,9 +665,9 @@ namespace cicada
 	      
 	      typename active_set_type::const_iterator citer_end = cell.end();
 	      for (typename active_set_type::const_iterator citer = cell.begin(); citer != citer_end; ++ citer) {
-		const transducer_type::rule_pair_set_type& rules = transducer.rules(citer->node);
+		if (transducer.rules(citer->node).empty()) continue;
 		
-		if (rules.empty()) continue;
+		const rule_score_set_type& rules = rule_scores(table, citer->node);
 		
 		score_type score_tails = cicada::semiring::traits<score_type>::one();
 		const tails_mapped_type tails = tails_map[citer->edge.tails];
@@ -611,17 +676,13 @@ namespace cicada
 		for (typename tails_mapped_type::const_iterator titer = tails.begin(); titer != titer_end; ++ titer)
 		  score_tails *= inside_outside(titer->first, titer->last)[titer->id].final_inside;
 		
-		transducer_type::rule_pair_set_type::const_iterator riter_begin = rules.begin();
-		transducer_type::rule_pair_set_type::const_iterator riter_end   = rules.end();
-		
-		for (transducer_type::rule_pair_set_type::const_iterator riter = riter_begin; riter != riter_end; ++ riter) {
-		  const rule_ptr_type rule = (yield_source ? riter->source : riter->target);
-		  
-		  if (pruner(first, last, rule->lhs)) continue;
+		typename rule_score_set_type::const_iterator riter_end = rules.end();
+		for (typename rule_score_set_type::const_iterator riter = rules.begin(); riter != riter_end; ++ riter) {
+		  const id_type lhs = riter->lhs;
 		  
-		  const id_type lhs = id_map(rule->lhs);
+		  if (pruner(first, last, symbol_map[lhs])) continue;
 		  
-		  const score_type score_edge = citer->edge.score * function(riter->features);
+		  const score_type score_edge = citer->edge.score * riter->score;
 		  
 		  if (lhs >= static_cast<id_type>(passive_arcs.size()))
 		    passive_arcs.resize(lhs + 1);
@@ -852,6 +913,23 @@ namespace cicada
 	return found;
       }
       
+      const rule_score_set_type& rule_scores(const size_type& table, const transducer_type::id_type& node)
+      {
+	typename rule_score_map_type::iterator riter = rule_tables[table].find(node);
+	if (riter == rule_tables[table].end()) {
+	  const transducer_type::rule_pair_set_type& rules = grammar[table].rules(node);
+	  
+	  riter = rule_tables[table].insert(std::make_pair(node, rule_score_set_type(rules.size()))).first;
+	  
+	  typename rule_score_set_type::iterator citer = riter->second.begin();
+	  transducer_type::rule_pair_set_type::const_iterator iter_end = rules.end();
+	  for (transducer_type::rule_pair_set_type::const_iterator iter = rules.begin(); iter != iter_end; ++ iter, ++ citer)
+	    *citer = rule_score_type(id_map((yield_source ? iter->source : iter->target)->lhs), function(iter->features));
+	}
+	
+	return riter->second;
+      }
+      
       id_type id_map(const symbol_type& symbol)
       {
 	symbol_map_type::iterator iter = symbol_map.insert(symbol).first;
@@ -882,6 +960,10 @@ namespace cicada
       tails_map_type   tails_map;
       closure_map_type closure_map;
       
+      rule_score_table_type rule_tables;
+      
+      label_score_set_type labels_scores;
+      
       unary_map_type      unaries;
       unary_computed_type unaries_computed;
       closure_set_type closure;
@@ -914,6 +996,8 @@ namespace cicada
 	throw std::runtime_error("no grammar?");
       if (thresholds.size() + 1 != grammars.size())
 	throw std::runtime_error("do we have enough threshold parameters for grammars?");
+      
+      stats.resize(thresholds.size());
     }
 
     template <typename Grammars, typename Thresholds>
@@ -942,6 +1026,8 @@ namespace cicada
 	throw std::runtime_error("no grammar?");
       if (thresholds.size() + 1 != grammars.size())
 	throw std::runtime_error("do we have enough threshold parameters for grammars?");
+      
+      stats.resize(thresholds.size());
     }
     
     void operator()(const lattice_type& lattice,
@@ -955,9 +1041,9 @@ namespace cicada
       
       if (lattice.empty()) return;
 
-      label_score_chart_type scores_init;
-      label_score_chart_type scores;
-      label_score_chart_type scores_prev;
+      posterior_chart_type scores_init;
+      posterior_chart_type scores;
+      posterior_chart_type scores_prev;
       parser_ptr_set_type parsers(grammars.size() - 1);
       
       parsers.front().reset(new ParseCKY(goal, grammars.front(), function, yield_source, treebank, pos_mode, ordered, frontier));
@@ -970,7 +1056,7 @@ namespace cicada
       std::vector<double, std::allocator<double> > factors(thresholds.size(), 1.0);
       
       // up to 4 iterations...
-      for (size_t i = 0; i != 4; ++ i) {
+      for (size_t iter = 0; iter != 4; ++ iter) {
 	scores = scores_init;
 	
 	bool succeed = true;
@@ -981,18 +1067,17 @@ namespace cicada
 	  if (! parsers[level])
 	    parsers[level].reset(new ParseCKY(goal, grammars[level], function, yield_source, treebank, pos_mode, ordered, frontier));
 
-	  //std::cerr << "level: " << level << std::endl;
-	  
 	  scores_prev.swap(scores);
 	  
+	  const score_type cutoff(thresholds[level - 1] * factors[level - 1]);
+	  
+	  prune_statistics(scores_prev, cutoff, stats[level - 1]);
+	  
+	  // the labels at the level are projected onto the previous level, i.e. the level - 1 grammar annotated by level - 2 bits
 	  if (level == 1)
-	    succeed = parsers[level]->operator()(lattice, scores, PruneCoarse<CoarseSimple>(scores_prev,
-											    thresholds[level - 1] * factors[level - 1],
-											    CoarseSimple()));
+	    succeed = parsers[level]->operator()(lattice, scores, PruneCoarse<CoarseSimple>(scores_prev, cutoff, CoarseSimple()));
 	  else
-	    succeed = parsers[level]->operator()(lattice, scores, PruneCoarse<CoarseSymbol>(scores_prev,
-											    thresholds[level - 1] * factors[level - 1],
-											    CoarseSymbol(level - 2)));
+	    succeed = parsers[level]->operator()(lattice, scores, PruneCoarse<CoarseSymbol>(scores_prev, cutoff, CoarseSymbol(level - 2)));
 	  
 	  if (! succeed) break;
 	}
@@ -1004,15 +1089,16 @@ namespace cicada
 	  continue;
 	}
 	
+	const score_type cutoff(thresholds.back() * factors.back());
+	
+	prune_statistics(scores, cutoff, stats.back());
+	
 	// we will fallback to simple tag!
 	if (grammars.size() == 2)
-	  composer(lattice, graph, PruneCoarse<CoarseSimple>(scores,
-							     thresholds.back() * factors.back(),
-							     CoarseSimple()));
+	  composer(lattice, graph, PruneCoarse<CoarseSimple>(scores, cutoff, CoarseSimple()));
 	else
-	  composer(lattice, graph, PruneCoarse<CoarseSymbol>(scores,
-							     thresholds.back() * factors.back(),
-							     CoarseSymbol(grammars.size() - 2)));
+	  composer(lattice, graph, PruneCoarse<CoarseSymbol>(scores, cutoff, CoarseSymbol(grammars.size() - 3)));
+	
 	if (graph.is_valid()) break;
 	
 	// multiply all the factors
@@ -1021,6 +1107,22 @@ namespace cicada
       }
     }
     
+    // prune statistics for each coarse level
+    const level_stat_set_type& statistics() const { return stats; }
+    
+  private:
+    void prune_statistics(const posterior_chart_type& scores, const score_type& cutoff, level_stat_type& stat)
+    {
+      ++ stat.count;
+      
+      for (size_type pos = 0; pos != scores.size(); ++ pos) {
+	if (scores.posterior(pos) < cutoff)
+	  ++ stat.pruned;
+	else
+	  ++ stat.unpruned;
+      }
+    }
+    
   private:
     const symbol_type goal;
     grammar_set_type   grammars;
@@ -1034,6 +1136,8 @@ namespace cicada
     const bool pos_mode;
     const bool ordered;
     const bool frontier;
+    
+    level_stat_set_type stats;
   };
   
   
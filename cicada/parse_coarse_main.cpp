@@ -0,0 +1,300 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of categories] [# of latent bits] [sentence length] [# of sentences] [threshold] [beam size]
+//
+// parse random sentences by parse-coarse and by a single parse-cky run with a random latent-annotated
+// grammar, and report the parsing time per sentence, the number of search errors, i.e. the Viterbi
+// derivations lost by coarse-to-fine pruning, and the prune ratios at each coarse level. The coarse
+// grammars are projected from the fine grammar by erasing the latent bits, as in cicada_grammar_coarse,
+// taking the max of the merged rules.
+//
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "grammar.hpp"
+#include "grammar_mutable.hpp"
+#include "lattice.hpp"
+#include "sentence.hpp"
+#include "hypergraph.hpp"
+#include "parse_cky.hpp"
+#include "parse_coarse.hpp"
+#include "inside_outside.hpp"
+#include "semiring.hpp"
+#include "weight_vector.hpp"
+
+#include "operation/functional.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::Symbol      symbol_type;
+typedef cicada::Grammar     grammar_type;
+typedef cicada::Lattice     lattice_type;
+typedef cicada::Sentence    sentence_type;
+typedef cicada::HyperGraph  hypergraph_type;
+
+typedef cicada::semiring::Logprob<double> weight_type;
+typedef cicada::operation::weight_function<weight_type> function_type;
+
+typedef cicada::semiring::Tropical<double> viterbi_type;
+typedef cicada::operation::weight_function<viterbi_type> function_viterbi_type;
+
+typedef cicada::ParseCoarse<weight_type, function_type> parser_coarse_type;
+
+typedef std::vector<grammar_type, std::allocator<grammar_type> > grammar_set_type;
+typedef std::vector<double, std::allocator<double> > threshold_set_type;
+
+typedef boost::mt19937 generator_type;
+
+// a rule over latent annotated categories, category -1 for a terminal word
+struct Rule
+{
+  typedef std::pair<int, int> symbol_type;
+  typedef std::vector<symbol_type, std::allocator<symbol_type> > symbol_set_type;
+
+  symbol_type     lhs;
+  symbol_set_type rhs;
+  double          logprob;
+};
+
+typedef std::vector<Rule, std::allocator<Rule> > rule_set_type;
+typedef std::map<std::string, double, std::less<std::string>, std::allocator<std::pair<const std::string, double> > > rule_map_type;
+
+// project a symbol at level: level 0 for [x], and level k for k - 1 bits. negative level for the fine grammar
+std::string project(const Rule::symbol_type& symbol, const int level)
+{
+  if (symbol.first < 0)
+    return 'w' + utils::lexical_cast<std::string>(symbol.second);
+  if (symbol.first == 0)
+    return "[ROOT]";
+  if (level == 0)
+    return "[x]";
+
+  const int latent = (level < 0 ? symbol.second : symbol.second & ((1 << (level - 1)) - 1));
+
+  return "[C" + utils::lexical_cast<std::string>(symbol.first) + '@' + utils::lexical_cast<std::string>(latent) + ']';
+}
+
+grammar_type project(const rule_set_type& rules, const int level)
+{
+  rule_map_type projected;
+
+  rule_set_type::const_iterator riter_end = rules.end();
+  for (rule_set_type::const_iterator riter = rules.begin(); riter != riter_end; ++ riter) {
+    std::string rhs;
+    for (size_t i = 0; i != riter->rhs.size(); ++ i)
+      rhs += (i ? " " : "") + project(riter->rhs[i], level);
+
+    const std::string rule = project(riter->lhs, level) + " ||| " + rhs + " ||| " + rhs;
+
+    std::pair<rule_map_type::iterator, bool> result = projected.insert(std::make_pair(rule, riter->logprob));
+    if (! result.second)
+      result.first->second = std::max(result.first->second, riter->logprob);
+  }
+
+  boost::shared_ptr<cicada::GrammarMutable> grammar_mutable(new cicada::GrammarMutable());
+
+  rule_map_type::const_iterator piter_end = projected.end();
+  for (rule_map_type::const_iterator piter = projected.begin(); piter != piter_end; ++ piter)
+    grammar_mutable->insert(piter->first + " ||| logprob=" + utils::lexical_cast<std::string>(piter->second));
+
+  grammar_type grammar;
+  grammar.push_back(grammar_mutable);
+
+  return grammar;
+}
+
+double viterbi(const hypergraph_type& graph, const cicada::WeightVector<double>& weights)
+{
+  if (! graph.is_valid()) return - std::numeric_limits<double>::infinity();
+
+  std::vector<viterbi_type, std::allocator<viterbi_type> > scores(graph.nodes.size());
+
+  cicada::inside(graph, scores, function_viterbi_type(weights));
+
+  return cicada::semiring::log(scores[graph.goal]);
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const int num_category = (argc > 1 ? utils::lexical_cast<int>(argv[1]) : 10);
+    const int num_bits     = (argc > 2 ? utils::lexical_cast<int>(argv[2]) : 2);
+    const int length       = (argc > 3 ? utils::lexical_cast<int>(argv[3]) : 20);
+    const int num_sentence = (argc > 4 ? utils::lexical_cast<int>(argv[4]) : 3);
+    const double threshold = (argc > 5 ? utils::lexical_cast<double>(argv[5]) : 1e-5);
+    const int beam_size    = (argc > 6 ? utils::lexical_cast<int>(argv[6]) : 200);
+    const int num_latent   = 1 << num_bits;
+    const int num_word     = 300;
+
+    generator_type generator;
+    boost::random::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    // category 0 is the goal, [ROOT]
+    rule_set_type rules;
+    Rule rule;
+
+    // binary rules: 20% of the category triples, fully annotated by latent symbols. The scores are
+    // mostly determined by the categories, and slightly differ by the latent annotations.
+    rule.rhs.resize(2);
+    for (int a = 1; a < num_category; ++ a)
+      for (int b = 1; b < num_category; ++ b)
+	for (int c = 1; c < num_category; ++ c)
+	  if (uniform(generator) < 0.2) {
+	    const double logprob = - 10.0 * uniform(generator);
+
+	    for (int la = 0; la != num_latent; ++ la)
+	      for (int lb = 0; lb != num_latent; ++ lb)
+		for (int lc = 0; lc != num_latent; ++ lc) {
+		  rule.lhs    = std::make_pair(a, la);
+		  rule.rhs[0] = std::make_pair(b, lb);
+		  rule.rhs[1] = std::make_pair(c, lc);
+		  rule.logprob = logprob - 2.0 * uniform(generator);
+
+		  rules.push_back(rule);
+		}
+	  }
+
+    // unary rules, acyclic
+    rule.rhs.resize(1);
+    for (int a = 1; a < num_category; ++ a)
+      for (int b = a + 1; b < num_category; ++ b)
+	if (uniform(generator) < 0.05) {
+	  const double logprob = - 10.0 * uniform(generator);
+
+	  for (int la = 0; la != num_latent; ++ la)
+	    for (int lb = 0; lb != num_latent; ++ lb) {
+	      rule.lhs    = std::make_pair(a, la);
+	      rule.rhs[0] = std::make_pair(b, lb);
+	      rule.logprob = logprob - 2.0 * uniform(generator);
+
+	      rules.push_back(rule);
+	    }
+	}
+
+    // lexical rules: three categories per word
+    for (int w = 0; w != num_word; ++ w)
+      for (int k = 0; k != 3; ++ k) {
+	const double logprob = - 10.0 * uniform(generator);
+
+	for (int l = 0; l != num_latent; ++ l) {
+	  rule.lhs    = std::make_pair(1 + (w * 7 + k * 13) % (num_category - 1), l);
+	  rule.rhs[0] = std::make_pair(-1, w);
+	  rule.logprob = logprob - 2.0 * uniform(generator);
+
+	  rules.push_back(rule);
+	}
+      }
+
+    for (int a = 1; a < num_category; a += 3)
+      for (int l = 0; l != num_latent; ++ l) {
+	rule.lhs    = std::make_pair(0, 0);
+	rule.rhs[0] = std::make_pair(a, l);
+	rule.logprob = - uniform(generator);
+
+	rules.push_back(rule);
+      }
+
+    // coarse grammars from [x] to num_bits - 1 bits, then, the fine grammar
+    grammar_set_type grammars;
+    for (int level = 0; level <= num_bits; ++ level)
+      grammars.push_back(project(rules, level));
+    grammars.push_back(project(rules, -1));
+
+    const threshold_set_type thresholds(num_bits + 1, threshold);
+
+    cicada::WeightVector<double> weights;
+    weights[cicada::Feature("logprob")] = 1.0;
+
+    const function_type function(weights);
+    const symbol_type goal("[ROOT]");
+
+    double time_fine = 0.0;
+    double time_coarse = 0.0;
+    size_t parsed = 0;
+    size_t errors = 0;
+    size_t edges_fine = 0;
+    size_t edges_coarse = 0;
+
+    parser_coarse_type::level_stat_set_type stats(thresholds.size());
+
+    for (int i = 0; i != num_sentence; ++ i) {
+      sentence_type sentence;
+      for (int j = 0; j != length; ++ j)
+	sentence.push_back('w' + utils::lexical_cast<std::string>(int(uniform(generator) * num_word)));
+
+      const lattice_type lattice(sentence);
+
+      hypergraph_type graph_fine;
+      hypergraph_type graph_coarse;
+
+      {
+	utils::resource start;
+	cicada::parse_cky(goal, grammars.back(), function, lattice, graph_fine, beam_size);
+	utils::resource end;
+
+	time_fine += end.user_time() - start.user_time();
+      }
+
+      {
+	parser_coarse_type parser(goal, grammars, thresholds, function, beam_size);
+
+	utils::resource start;
+	parser(lattice, graph_coarse);
+	utils::resource end;
+
+	time_coarse += end.user_time() - start.user_time();
+
+	for (size_t level = 0; level != stats.size(); ++ level) {
+	  stats[level].count    += parser.statistics()[level].count;
+	  stats[level].pruned   += parser.statistics()[level].pruned;
+	  stats[level].unpruned += parser.statistics()[level].unpruned;
+	}
+      }
+
+      edges_fine += graph_fine.edges.size();
+      edges_coarse += graph_coarse.edges.size();
+
+      // search errors are measured only for the sentences parsed by the fine grammar
+      if (! graph_fine.is_valid()) continue;
+
+      ++ parsed;
+
+      const double viterbi_fine   = viterbi(graph_fine, weights);
+      const double viterbi_coarse = viterbi(graph_coarse, weights);
+
+      errors += (viterbi_coarse < viterbi_fine - 1e-5);
+    }
+
+    std::cout << "parse-cky:    " << (time_fine / num_sentence) << " sec/sentence"
+	      << " edges: " << edges_fine
+	      << " parsed: " << parsed << std::endl;
+    std::cout << "parse-coarse: " << (time_coarse / num_sentence) << " sec/sentence"
+	      << " edges: " << edges_coarse
+	      << " search-errors: " << errors << std::endl;
+
+    for (size_t level = 0; level != stats.size(); ++ level)
+      std::cout << "level: " << level
+		<< " count: " << stats[level].count
+		<< " pruned: " << stats[level].pruned
+		<< " unpruned: " << stats[level].unpruned
+		<< " prune-ratio: " << (double(stats[level].pruned) / std::max(stats[level].pruned + stats[level].unpruned, size_t(1)))
+		<< std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
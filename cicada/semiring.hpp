@@ -10,6 +10,7 @@
 #include <cicada/semiring/traits.hpp>
 
 #include <cicada/semiring/envelope.hpp>
+#include <cicada/semiring/envelope_arena.hpp>
 #include <cicada/semiring/expectation.hpp>
 #include <cicada/semiring/logprob.hpp>
 #include <cicada/semiring/log.hpp>
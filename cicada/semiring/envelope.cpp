@@ -62,7 +62,7 @@ namespace cicada
 	  const line_type& line = *(*liter);
 	  
 	  // no update to x...
-	  const double& x = line_edge.x;
+	  const double& x = line.x;
 	  const double y  = line_edge.y + line.y;
 	  const double m  = line_edge.m + line.m;
 	  
@@ -0,0 +1,184 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#include <algorithm>
+
+#include "cicada/semiring/envelope_arena.hpp"
+
+namespace cicada
+{
+  namespace semiring
+  {
+
+    const EnvelopeArena::index_type EnvelopeArena::one_index;
+
+    const EnvelopeArena& EnvelopeArena::operator+=(const EnvelopeArena& x)
+    {
+      // Max operation... we will simply perform concatenation, and sort later
+
+      if (! x.is_sorted) const_cast<EnvelopeArena&>(x).sort();
+
+      if (! arena)
+	arena = x.arena;
+
+      if (lines.empty()) {
+	lines = x.lines;
+	is_sorted = true;
+	return *this;
+      }
+
+      is_sorted = false;
+
+      lines.insert(lines.end(), x.lines.begin(), x.lines.end());
+
+      return *this;
+    }
+
+    const EnvelopeArena& EnvelopeArena::operator*=(const EnvelopeArena& x)
+    {
+      // Minkowski Sum operation...
+
+      if (x.is_one())
+	return *this;
+      if (is_one()) {
+	*this = x;
+	return *this;
+      }
+
+      if (x.lines.empty() || lines.empty()) {
+	lines.clear();
+	is_sorted = true;
+	return *this;
+      }
+
+      if (! arena)
+	arena = x.arena;
+
+      if (! is_sorted)   const_cast<EnvelopeArena&>(*this).sort();
+      if (! x.is_sorted) const_cast<EnvelopeArena&>(x).sort();
+
+      arena_type& lines_arena = *arena;
+
+      // we have an object created by weight function...
+      if (lines.size() == 1 && lines_arena[lines.front()].edge) {
+	const index_type index_edge = lines.front();
+
+	lines.clear();
+	index_set_type::const_iterator liter_end = x.lines.end();
+	for (index_set_type::const_iterator liter = x.lines.begin(); liter != liter_end; ++ liter) {
+	  // we will copy, since the arena may grow
+	  const line_type line_edge = lines_arena[index_edge];
+	  const line_type line      = lines_arena[*liter];
+
+	  // no update to x...
+	  lines.push_back(lines_arena.push(line_type(line.x, line_edge.m + line.m, line_edge.y + line.y, index_edge, *liter)));
+	}
+
+      } else {
+	static const double infinity = std::numeric_limits<double>::infinity();
+
+	index_set_type L;
+
+	index_set_type::const_iterator iter1 = lines.begin();
+	index_set_type::const_iterator iter1_end = lines.end();
+
+	index_set_type::const_iterator iter2 = x.lines.begin();
+	index_set_type::const_iterator iter2_end = x.lines.end();
+
+	double x_curr  = - infinity;
+	double x_next1 = (iter1 + 1 < iter1_end ? lines_arena[*(iter1 + 1)].x : infinity);
+	double x_next2 = (iter2 + 1 < iter2_end ? lines_arena[*(iter2 + 1)].x : infinity);
+
+	while (iter1 != iter1_end && iter2 != iter2_end) {
+	  const double y = lines_arena[*iter1].y + lines_arena[*iter2].y;
+	  const double m = lines_arena[*iter1].m + lines_arena[*iter2].m;
+
+	  L.push_back(lines_arena.push(line_type(x_curr, m, y, *iter1, *iter2)));
+
+	  if (x_next1 < x_next2) {
+	    ++ iter1;
+	    x_curr  = x_next1;
+	    x_next1 = (iter1 + 1 < iter1_end ? lines_arena[*(iter1 + 1)].x : infinity);
+	  } else if (x_next2 < x_next1) {
+	    ++ iter2;
+	    x_curr  = x_next2;
+	    x_next2 = (iter2 + 1 < iter2_end ? lines_arena[*(iter2 + 1)].x : infinity);
+	  } else {
+	    ++ iter1;
+	    ++ iter2;
+
+	    x_curr = x_next1;
+
+	    x_next1 = (iter1 + 1 < iter1_end ? lines_arena[*(iter1 + 1)].x : infinity);
+	    x_next2 = (iter2 + 1 < iter2_end ? lines_arena[*(iter2 + 1)].x : infinity);
+	  }
+	}
+
+	lines.swap(L);
+      }
+
+      return *this;
+    }
+
+    struct envelope_arena_compare_slope
+    {
+      envelope_arena_compare_slope(const EnvelopeArena::arena_type& __arena) : arena(__arena) {}
+
+      bool operator()(const EnvelopeArena::index_type& x, const EnvelopeArena::index_type& y) const
+      {
+	return arena[x].m < arena[y].m;
+      }
+
+      const EnvelopeArena::arena_type& arena;
+    };
+
+    void EnvelopeArena::sort()
+    {
+      if (is_sorted) return;
+
+      // no arena: we are either zero or one
+      if (! arena) {
+	is_sorted = true;
+	return;
+      }
+
+      arena_type& lines_arena = *arena;
+
+      std::sort(lines.begin(), lines.end(), envelope_arena_compare_slope(lines_arena));
+
+      int j = 0;
+      int K = lines.size();
+
+      // lines in an unsorted envelope are not yet referenced by others, thus, we can safely update x
+      for (int i = 0; i < K; ++ i) {
+	line_type& line = lines_arena[lines[i]];
+	double x = - std::numeric_limits<double>::infinity();
+
+	if (0 < j) {
+	  if (lines_arena[lines[j - 1]].m == line.m) { // parallel line...
+	    if (line.y <= lines_arena[lines[j - 1]].y) continue;
+	    -- j;
+	  }
+	  while (0 < j) {
+	    const line_type& line_prev = lines_arena[lines[j - 1]];
+
+	    x = (line.y - line_prev.y) / (line_prev.m - line.m);
+	    if (line_prev.x < x) break;
+	    -- j;
+	  }
+
+	  if (0 == j)
+	    x = - std::numeric_limits<double>::infinity();
+	}
+
+	line.x = x;
+	lines[j ++] = lines[i];
+      }
+
+      lines.resize(j);
+
+      is_sorted = true;
+    }
+  };
+};
@@ -0,0 +1,181 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__SEMIRING__ENVELOPE_ARENA__HPP__
+#define __CICADA__SEMIRING__ENVELOPE_ARENA__HPP__ 1
+
+//
+// The same upper envelope semiring as Envelope (see envelope.hpp), but lines are stored in an arena,
+// which is owned by the caller and shared by all the envelopes of a forest (or a segment).
+// Envelopes keep only the indices into the arena, and derivations are recovered by walking
+// parent/antecedent indices. No reference counting, and no allocation per line: clear the arena
+// between segments, and its storage is reused.
+//
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include <cicada/semiring/traits.hpp>
+
+#include <cicada/hypergraph.hpp>
+#include <cicada/dot_product.hpp>
+
+namespace cicada
+{
+  namespace semiring
+  {
+
+    class EnvelopeArena
+    {
+    public:
+      typedef cicada::HyperGraph hypergraph_type;
+      typedef hypergraph_type::edge_type edge_type;
+
+      typedef uint32_t index_type;
+      typedef size_t   size_type;
+
+      // the line of the semiring-one, which is never stored in an arena
+      static const index_type one_index = index_type(-1);
+
+    public:
+      struct Line
+      {
+	Line()
+	  : x(0.0), m(0.0), y(0.0), edge(0), parent(one_index), antecedent(one_index) {}
+	Line(const double& __m, const double& __y, const edge_type& __edge)
+	  : x(- std::numeric_limits<double>::infinity()), m(__m), y(__y), edge(&__edge), parent(one_index), antecedent(one_index) {}
+	Line(const double& __x, const double& __m, const double& __y, const index_type& __parent, const index_type& __antecedent)
+	  : x(__x), m(__m), y(__y), edge(0), parent(__parent), antecedent(__antecedent) {}
+
+	double x;
+	double m;
+	double y;
+
+	// D part...
+	const edge_type* edge;
+
+	index_type parent;
+	index_type antecedent;
+      };
+
+      typedef Line line_type;
+
+      struct Arena
+      {
+	typedef std::vector<line_type, std::allocator<line_type> > line_set_type;
+
+	index_type push(const line_type& line)
+	{
+	  lines.push_back(line);
+	  return lines.size() - 1;
+	}
+
+	const line_type& operator[](const index_type& pos) const { return lines[pos]; }
+	line_type& operator[](const index_type& pos) { return lines[pos]; }
+
+	size_type size() const { return lines.size(); }
+	bool empty() const { return lines.empty(); }
+
+	void clear() { lines.clear(); }
+
+	template <typename Traversal>
+	typename Traversal::value_type yield(const index_type& pos, const Traversal traversal) const
+	{
+	  typedef typename Traversal::value_type yield_type;
+	  typedef std::vector<yield_type, std::allocator<yield_type> > yield_set_type;
+
+	  yield_set_type yields;
+
+	  index_type curr = pos;
+	  while (! lines[curr].edge) {
+	    yields.push_back(yield(lines[curr].antecedent, traversal));
+
+	    curr = lines[curr].parent;
+	  }
+
+	  yield_type __yield;
+
+	  traversal(*(lines[curr].edge), __yield, yields.rbegin(), yields.rend());
+
+	  return __yield;
+	}
+
+	line_set_type lines;
+      };
+
+      typedef Arena arena_type;
+
+      typedef std::vector<index_type, std::allocator<index_type> > index_set_type;
+
+      typedef index_set_type::const_iterator const_iterator;
+
+    public:
+      EnvelopeArena() : arena(0), lines(), is_sorted(true) {}
+      EnvelopeArena(arena_type* __arena, const index_type& line) : arena(__arena), lines(1, line), is_sorted(true) {}
+
+    public:
+      const EnvelopeArena& operator+=(const EnvelopeArena& x);
+      const EnvelopeArena& operator*=(const EnvelopeArena& x);
+
+    public:
+      const_iterator begin() const { return lines.begin(); }
+      const_iterator end()   const { return lines.end(); }
+
+      size_type size() const { return lines.size(); }
+      bool empty() const { return lines.empty(); }
+
+      void sort();
+
+    private:
+      bool is_one() const { return lines.size() == 1 && lines.front() == one_index; }
+
+    private:
+      arena_type*    arena;
+      index_set_type lines;
+      bool           is_sorted;
+    };
+
+    template <typename FeatureVector>
+    struct EnvelopeArenaFunction
+    {
+      typedef FeatureVector feature_set_type;
+
+      typedef EnvelopeArena envelope_type;
+      typedef envelope_type::line_type  line_type;
+      typedef envelope_type::arena_type arena_type;
+
+      EnvelopeArenaFunction(arena_type& __arena,
+			    const feature_set_type& __origin,
+			    const feature_set_type& __direction)
+	: arena(__arena), origin(__origin), direction(__direction) {}
+
+      template <typename Edge>
+      EnvelopeArena operator()(const Edge& edge) const
+      {
+	const double m = cicada::dot_product(edge.features, direction);
+	const double y = cicada::dot_product(edge.features, origin);
+
+	return EnvelopeArena(&arena, arena.push(line_type(m, y, edge)));
+      }
+
+      arena_type& arena;
+
+      const feature_set_type& origin;
+      const feature_set_type& direction;
+    };
+
+    template <>
+    struct traits<EnvelopeArena>
+    {
+      static inline EnvelopeArena zero() { return EnvelopeArena(); }
+      static inline EnvelopeArena one()  { return EnvelopeArena(0, EnvelopeArena::one_index); }
+    };
+
+  };
+};
+
+#endif
@@ -11,7 +11,24 @@ namespace cicada
        << " edge: " << stat.edge
        << " user-time: " << stat.user_time
        << " cpu-time: "  << stat.cpu_time
-       << " thread-time: " << stat.thread_time;
+       << " thread-time: " << stat.thread_time
+       << " node-max: " << stat.node_max
+       << " edge-max: " << stat.edge_max;
+    
+    if (! stat.latency.empty())
+      os << " latency-p50: " << stat.percentile(0.5)
+	 << " latency-p90: " << stat.percentile(0.9)
+	 << " latency-p99: " << stat.percentile(0.99)
+	 << " latency-max: " << stat.latency_max;
+    
+    if (stat.cache_hit || stat.cache_miss)
+      os << " cache-hit: " << stat.cache_hit
+	 << " cache-miss: " << stat.cache_miss;
+    
+    if (stat.pruned || stat.unpruned)
+      os << " pruned: " << stat.pruned
+	 << " unpruned: " << stat.unpruned
+	 << " prune-ratio: " << (double(stat.pruned) / (stat.pruned + stat.unpruned));
     
     return os;
   }
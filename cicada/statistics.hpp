@@ -8,14 +8,19 @@
 
 #include <cstddef>
 #include <stdint.h>
+#include <cmath>
+
+#include <algorithm>
 
 #include <iostream>
+#include <vector>
 
 #include <cicada/attribute.hpp>
 
 #include <boost/functional/hash/hash.hpp>
 
 #include <utils/compact_map.hpp>
+#include <utils/bithack.hpp>
 
 namespace cicada
 {
@@ -32,6 +37,9 @@ namespace cicada
     
     struct Stat
     {
+      // latency histogram: the i-th bucket counts the samples in [2^(i/4), 2^((i+1)/4)) micro seconds
+      typedef std::vector<count_type, std::allocator<count_type> > histogram_type;
+      
       count_type count;
       
       count_type node;
@@ -41,14 +49,29 @@ namespace cicada
       second_type cpu_time;
       second_type thread_time;
       
-      Stat() : count(0), node(0), edge(0), user_time(0), cpu_time(0), thread_time(0) {}
+      count_type node_max;
+      count_type edge_max;
+      
+      second_type    latency_max;
+      histogram_type latency;
+      
+      // rule sets found in the grammar caches, and decoded
+      count_type cache_hit;
+      count_type cache_miss;
+      
+      // chart items pruned, or survived, by coarse-to-fine parsing
+      count_type pruned;
+      count_type unpruned;
+      
+      Stat() : count(0), node(0), edge(0), user_time(0), cpu_time(0), thread_time(0), node_max(0), edge_max(0), latency_max(0), latency(), cache_hit(0), cache_miss(0), pruned(0), unpruned(0) {}
       Stat(const count_type& __count,
 	   const count_type& __node,
 	   const count_type& __edge,
 	   const second_type& __user_time,
 	   const second_type& __cpu_time)
 	: count(__count), node(__node), edge(__edge),
-	  user_time(__user_time), cpu_time(__cpu_time), thread_time(0.0) {}
+	  user_time(__user_time), cpu_time(__cpu_time), thread_time(0.0),
+	  node_max(0), edge_max(0), latency_max(0), latency(), cache_hit(0), cache_miss(0), pruned(0), unpruned(0) {}
       Stat(const count_type& __count,
 	   const count_type& __node,
 	   const count_type& __edge,
@@ -56,7 +79,8 @@ namespace cicada
 	   const second_type& __cpu_time,
 	   const second_type& __thread_time)
 	: count(__count), node(__node), edge(__edge),
-	  user_time(__user_time), cpu_time(__cpu_time), thread_time(__thread_time) {}
+	  user_time(__user_time), cpu_time(__cpu_time), thread_time(__thread_time),
+	  node_max(0), edge_max(0), latency_max(0), latency(), cache_hit(0), cache_miss(0), pruned(0), unpruned(0) {}
       
       void clear()
       {
@@ -66,6 +90,64 @@ namespace cicada
 	user_time   = 0;
 	cpu_time    = 0;
 	thread_time = 0;
+	node_max = 0;
+	edge_max = 0;
+	latency_max = 0;
+	latency.clear();
+	cache_hit = 0;
+	cache_miss = 0;
+	pruned = 0;
+	unpruned = 0;
+      }
+      
+      // accumulate x as a single sample, i.e. the statistics of a single sentence,
+      // and record its (wall-clock) latency and forest size
+      void sample(const Stat& x)
+      {
+	operator+=(x);
+	
+	node_max = utils::bithack::max(node_max, x.node);
+	edge_max = utils::bithack::max(edge_max, x.edge);
+	latency_max = std::max(latency_max, x.user_time);
+	
+	const size_type pos = bucket(x.user_time);
+	if (pos >= latency.size())
+	  latency.resize(pos + 1, 0);
+	++ latency[pos];
+      }
+      
+      // approximate latency at p (0.0 <= p <= 1.0), bounded by the upper bound of the bucket
+      second_type percentile(const double p) const
+      {
+	count_type total = 0;
+	for (size_type pos = 0; pos != latency.size(); ++ pos)
+	  total += latency[pos];
+	
+	if (! total) return 0.0;
+	
+	const double threshold = p * total;
+	
+	count_type accumulated = 0;
+	for (size_type pos = 0; pos != latency.size(); ++ pos) {
+	  accumulated += latency[pos];
+	  
+	  if (accumulated && accumulated >= threshold)
+	    return std::min(bound(pos), latency_max);
+	}
+	
+	return latency_max;
+      }
+      
+      static size_type bucket(const second_type& seconds)
+      {
+	if (seconds <= 1e-6) return 0;
+	
+	return utils::bithack::min(size_type(std::log(seconds * 1e6) / std::log(2.0) * 4), size_type(127));
+      }
+      
+      static second_type bound(const size_type& pos)
+      {
+	return 1e-6 * std::pow(2.0, double(pos + 1) / 4);
       }
       
       Stat operator+() const
@@ -80,6 +162,7 @@ namespace cicada
 	return stat;
       }
       
+      // histograms are summed, and peaks are maximized
       Stat& operator+=(const Stat& x)
       {
 	count += x.count;
@@ -88,9 +171,26 @@ namespace cicada
 	user_time   += x.user_time;
 	cpu_time    += x.cpu_time;
 	thread_time += x.thread_time;
+	
+	node_max = utils::bithack::max(node_max, x.node_max);
+	edge_max = utils::bithack::max(edge_max, x.edge_max);
+	latency_max = std::max(latency_max, x.latency_max);
+	
+	if (x.latency.size() > latency.size())
+	  latency.resize(x.latency.size(), 0);
+	for (size_type pos = 0; pos != x.latency.size(); ++ pos)
+	  latency[pos] += x.latency[pos];
+	
+	cache_hit  += x.cache_hit;
+	cache_miss += x.cache_miss;
+	
+	pruned   += x.pruned;
+	unpruned += x.unpruned;
+	
 	return *this;
       }
       
+      // we cannot subtract peaks, and keep them as is
       Stat& operator-=(const Stat& x)
       {
 	count -= x.count;
@@ -99,6 +199,18 @@ namespace cicada
 	user_time   -= x.user_time;
 	cpu_time    -= x.cpu_time;
 	thread_time -= x.thread_time;
+	
+	if (x.latency.size() > latency.size())
+	  latency.resize(x.latency.size(), 0);
+	for (size_type pos = 0; pos != x.latency.size(); ++ pos)
+	  latency[pos] -= x.latency[pos];
+	
+	cache_hit  -= x.cache_hit;
+	cache_miss -= x.cache_miss;
+	
+	pruned   -= x.pruned;
+	unpruned -= x.unpruned;
+	
 	return *this;
       }
 
@@ -152,6 +264,16 @@ namespace cicada
       return *this;
     }
     
+    // accumulate per-sentence statistics, each operation as a single sample
+    Statistics& sample(const Statistics& x)
+    {
+      const_iterator iter_end = x.end();
+      for (const_iterator iter = x.begin(); iter != iter_end; ++ iter)
+	operator[](iter->first).sample(iter->second);
+      
+      return *this;
+    }
+    
     Statistics& operator-=(const Statistics& x)
     {
       const_iterator iter_end = x.end();
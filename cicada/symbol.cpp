@@ -45,6 +45,16 @@ namespace cicada
       value_set_type caches;
     };
 
+    // per-thread string-to-id cache in front of the interning table, indexed by the hash value
+    struct intern_cache_type
+    {
+      typedef utils::array_power2<id_type, 1024 * 4, std::allocator<id_type> > id_set_type;
+
+      intern_cache_type() { std::fill(ids.begin(), ids.end(), id_type(-1)); }
+
+      id_set_type ids;
+    };
+
     typedef std::vector<int, std::allocator<int> >   index_map_type;
     typedef std::vector<bool, std::allocator<bool> > non_terminal_map_type;
     typedef std::vector<id_type, std::allocator<id_type> > non_terminal_id_map_type;
@@ -90,6 +100,27 @@ namespace cicada
 	impl.reset(new SymbolImpl());
       
       return *impl;
+#endif
+    }
+
+    // function-local, since symbols are interned during the static initialization
+    static SymbolImpl::intern_cache_type& intern_cache()
+    {
+      static utils::thread_specific_ptr<SymbolImpl::intern_cache_type> caches;
+#ifdef HAVE_TLS
+      static __thread SymbolImpl::intern_cache_type* caches_tls = 0;
+
+      if (! caches_tls) {
+	caches.reset(new SymbolImpl::intern_cache_type());
+	caches_tls = caches.get();
+      }
+
+      return *caches_tls;
+#else
+      if (! caches.get())
+	caches.reset(new SymbolImpl::intern_cache_type());
+
+      return *caches;
 #endif
     }
   };
@@ -101,6 +132,30 @@ namespace cicada
     return symbol_impl::instance().symbol_maps;
   }
 
+  Symbol::id_type Symbol::__allocate(const piece_type& x)
+  {
+    symbol_set_type& symbols = __symbols();
+
+    const symbol_set_type::hash_type hash = symbol_set_type::hash(x);
+
+    SymbolImpl::intern_cache_type& caches = symbol_impl::intern_cache();
+
+    id_type& cache = caches.ids[hash & (caches.ids.size() - 1)];
+
+    if (cache != id_type(-1) && symbols[cache] == x)
+      return cache;
+
+    cache = symbols.find(x, hash);
+
+    if (cache == symbol_set_type::npos) {
+      ticket_type::scoped_writer_lock lock(__mutex);
+
+      cache = symbols.insert(x, hash).first;
+    }
+
+    return cache;
+  }
+
   Symbol::piece_type Symbol::sgml_tag() const
   {
     if (! is_sgml_tag())
@@ -539,10 +594,11 @@ namespace cicada
   {
     ticket_type::scoped_reader_lock lock(__mutex);
     
-    Vocab vocab(path, std::max(size_type(__symbols().size() / 2), size_type(1024)));
-    symbol_set_type::const_iterator siter_end = __symbols().end();
-    for (symbol_set_type::const_iterator siter = __symbols().begin(); siter != siter_end; ++ siter)
-      vocab.insert(*siter);
+    const symbol_set_type& symbols = __symbols();
+
+    Vocab vocab(path, std::max(size_type(symbols.size() / 2), size_type(1024)));
+    for (id_type id = 0; id != symbols.size(); ++ id)
+      vocab.insert(symbols[id]);
   }
   
 };
@@ -17,6 +17,7 @@
 #include <boost/thread.hpp>
 
 #include <utils/indexed_set.hpp>
+#include <utils/intern_set.hpp>
 #include <utils/spinlock.hpp>
 #include <utils/rwticket.hpp>
 #include <utils/piece.hpp>
@@ -88,11 +89,8 @@ namespace cicada
 	maps.resize(power2, 0);
       }
       
-      if (! maps[__id]) {
-	ticket_type::scoped_reader_lock lock(__mutex);
-	
+      if (! maps[__id])
 	maps[__id] = &(__symbols()[__id]);
-      }
       
       return *maps[__id];
     }
@@ -165,23 +163,17 @@ namespace cicada
     
     
   private:
-    typedef utils::indexed_set<piece_type, boost::hash<piece_type>, std::equal_to<piece_type>, std::allocator<piece_type> > symbol_index_type;
-    typedef utils::chunk_vector<symbol_type, 4096 / sizeof(symbol_type), std::allocator<symbol_type> > symbol_set_type;
+    typedef utils::intern_set symbol_set_type;
     typedef std::vector<const symbol_type*, std::allocator<const symbol_type*> > symbol_map_type;
     
   public:
+    // lookups are lock-free. Only the insertion of a new symbol takes the writer lock.
     static bool exists(const piece_type& x)
     {
-      ticket_type::scoped_reader_lock lock(__mutex);
-      
-      const symbol_index_type& index = __index();
-      
-      return index.find(x) != index.end();
+      return __symbols().find(x) != symbol_set_type::npos;
     }
     static size_t allocated()
     {
-      ticket_type::scoped_reader_lock lock(__mutex);
-      
       return __symbols().size();
     }
     static void write(const path_type& path);
@@ -197,34 +189,13 @@ namespace cicada
       return syms;
     }
     
-    static symbol_index_type& __index()
-    {
-      static symbol_index_type index;
-      return index;
-    }
-    
     static const id_type& __allocate_empty()
     {
       static const id_type __id = __allocate("");
       return __id;
     }
     
-    static id_type __allocate(const piece_type& x)
-    {
-      ticket_type::scoped_writer_lock lock(__mutex);
-
-      symbol_index_type& index = __index();
-      
-      std::pair<symbol_index_type::iterator, bool> result = index.insert(x);
-      
-      if (result.second) {
-	symbol_set_type& symbols = __symbols();
-	symbols.push_back(x);
-	const_cast<piece_type&>(*result.first) = symbols.back();
-      }
-      
-      return result.first - index.begin();
-    }
+    static id_type __allocate(const piece_type& x);
     
   private:
     id_type __id;
@@ -11,9 +11,17 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/type_traits.hpp>
 
+#include <boost/thread.hpp>
+#include <boost/functional/hash/hash.hpp>
+
 #include "utils/random_seed.hpp"
+#include "utils/resource.hpp"
+#include "utils/rwticket.hpp"
+#include "utils/indexed_set.hpp"
+#include "utils/chunk_vector.hpp"
 
 #include "symbol.hpp"
+#include "feature.hpp"
 
 #include <cicada/msgpack/symbol.hpp>
 
@@ -40,6 +48,93 @@ void process(const cicada::Symbol& x, int index)
   msgpack_test(x);
 }
 
+typedef std::vector<std::string, std::allocator<std::string> > word_set_type;
+
+// interning by a single, writer-locked index, as we did before the lock-free interning table
+struct InternLocked
+{
+  typedef utils::piece piece_type;
+  typedef utils::indexed_set<piece_type, boost::hash<piece_type>, std::equal_to<piece_type>, std::allocator<piece_type> > index_type;
+  typedef utils::chunk_vector<std::string, 4096 / sizeof(std::string), std::allocator<std::string> > string_set_type;
+
+  size_t operator()(const piece_type& x)
+  {
+    utils::rwticket::scoped_writer_lock lock(mutex);
+
+    std::pair<index_type::iterator, bool> result = index.insert(x);
+
+    if (result.second) {
+      strings.push_back(x);
+      const_cast<piece_type&>(*result.first) = strings.back();
+    }
+
+    return result.first - index.begin();
+  }
+
+  utils::rwticket mutex;
+  index_type      index;
+  string_set_type strings;
+};
+
+// each thread interns words taken from the shared vocabulary, and words unique to the thread
+template <typename Interner>
+struct Intern
+{
+  Intern(Interner& __interner, const word_set_type& __words, const int __id, const int __iteration)
+    : interner(__interner), words(__words), id(__id), iteration(__iteration), sum(0) {}
+
+  void operator()()
+  {
+    const std::string prefix = boost::lexical_cast<std::string>(id) + ':';
+
+    for (int iter = 0; iter != iteration; ++ iter)
+      for (size_t i = 0; i != words.size(); ++ i) {
+	sum += interner(words[i]);
+
+	if (i % 16 == 0)
+	  sum += interner(prefix + words[(i + iter) % words.size()]);
+      }
+  }
+
+  Interner&            interner;
+  const word_set_type& words;
+  int                  id;
+  int                  iteration;
+  size_t               sum;
+};
+
+struct InternSymbol
+{
+  size_t operator()(const utils::piece& x) const { return cicada::Symbol(x).id(); }
+};
+
+struct InternFeature
+{
+  size_t operator()(const utils::piece& x) const { return cicada::Feature(x).id(); }
+};
+
+template <typename Interner>
+double intern(Interner& interner, const word_set_type& words, const int threads, const int iteration)
+{
+  typedef Intern<Interner> task_type;
+  typedef std::vector<task_type, std::allocator<task_type> > task_set_type;
+
+  task_set_type tasks;
+  for (int i = 0; i != threads; ++ i)
+    tasks.push_back(task_type(interner, words, i, iteration));
+
+  utils::resource start;
+
+  boost::thread_group workers;
+  for (int i = 0; i != threads; ++ i)
+    workers.add_thread(new boost::thread(boost::ref(tasks[i])));
+  workers.join_all();
+
+  utils::resource end;
+
+  return double(words.size()) * (1.0 + 1.0 / 16) * iteration * threads / (end.user_time() - start.user_time());
+}
+
 int main(int argc, char** argv)
 {
   typedef cicada::Symbol symbol_type;
@@ -92,4 +187,21 @@ int main(int argc, char** argv)
     
     symbol_type symbol(rnd);
   }
+
+  // multi-threaded interning
+  word_set_type words;
+  for (int i = 0; i != 1024 * 64; ++ i)
+    words.push_back(boost::lexical_cast<std::string>(random()));
+
+  for (int threads = 1; threads <= 32; threads *= 2) {
+    InternLocked  locked;
+    InternSymbol  symbol;
+    InternFeature feature;
+
+    std::cout << "threads: " << threads
+	      << " locked: " << intern(locked, words, threads, 8) << " words/sec"
+	      << " symbol: " << intern(symbol, words, threads, 8) << " words/sec"
+	      << " feature: " << intern(feature, words, threads, 8) << " words/sec"
+	      << std::endl;
+  }
 }
@@ -34,6 +34,9 @@ file-name: indexed grammar or plain text grammar\n\
 \tmax-span=[int] maximum span (<=0 for no-constraint)\n\
 \tkey-value=[true|false] store key-value format of features/attributes\n\
 \tpopulate=[true|false] \"populate\" by pre-fetching\n\
+\tcache-size=[int] # of decoded rule sets shared by threads (indexed grammar only)\n\
+\tfilter=[file-name] keep only the rules matching the input sentences, then populate\n\
+\tfilter-lattice=[true|false] the filter input is lattices\n\
 \tfeature-prefix=[prefix for feature name] add prefix to the default feature name: rule-table\n\
 \tattribute-prefix=[prefix for attribute name] add prefix to the default attribute name: rule-table\n\
 \tfeature0=[feature-name]\n\
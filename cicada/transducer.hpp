@@ -91,6 +91,9 @@ namespace cicada
     
     virtual void assign(const lattice_type& lattice, const lattice_type& lattice2) {}
     virtual void assign(const hypergraph_type& hypergraph, const lattice_type& lattice) {}
+    
+    // accumulate the # of rule sets found in a cache (hit) and decoded (miss), if cached
+    virtual void cache_statistics(size_type& hit, size_type& miss) const {}
 
   public:
     static const char* lists();
@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <unistd.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include "cicada_impl.hpp"
 #include "cicada_output_impl.hpp"
@@ -30,6 +31,7 @@
 
 #include <boost/program_options.hpp>
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
 
 typedef std::string op_type;
 typedef std::vector<op_type, std::allocator<op_type> > op_set_type;
@@ -57,6 +59,7 @@ bool tree_grammar_list = false;
 feature_parameter_set_type feature_parameters;
 bool feature_list = false;
 path_type output_feature;
+path_type output_trace;
 
 op_set_type ops;
 bool op_list = false;
@@ -69,6 +72,7 @@ bool tokenizer_list = false;
 bool matcher_list = false;
 
 int threads = 1;
+int schedule = 0;
 
 int debug = 0;
 
@@ -204,6 +208,134 @@ int main(int argc, char ** argv)
   return 0;
 }
 
+// per-sentence traces are written as soon as each sentence is finished, so that we do not keep
+// the traces of the whole run in memory, nor lose them when interrupted.
+struct TraceStream
+{
+  TraceStream(const path_type& path)
+    : os(path.empty() ? 0 : new utils::compress_ostream(path, 1024 * 1024)) {}
+  
+  void write(const std::string& trace)
+  {
+    if (! os || trace.empty()) return;
+    
+    boost::mutex::scoped_lock lock(mutex);
+    
+    *os << trace;
+  }
+  
+  boost::mutex                    mutex;
+  boost::shared_ptr<std::ostream> os;
+};
+
+// # of outputs written by the reducer, which the scheduler waits on
+struct Progress
+{
+  Progress() : reduced(0) {}
+  
+  void update(const size_t __reduced)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      
+      reduced = __reduced;
+    }
+    
+    cond.notify_all();
+  }
+  
+  // wait until no more than window inputs are waiting to be written
+  void wait(const size_t dispatched, const size_t window)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    
+    while (dispatched > reduced + window)
+      cond.wait(lock);
+  }
+  
+  size_t reduced;
+  
+  boost::mutex              mutex;
+  boost::condition_variable cond;
+};
+
+// look-ahead scheduling: a window of inputs is dispatched longest-first, so that a long input
+// found late in the input will not keep the other threads waiting at the end.
+// When progress is given, we will not dispatch a new window until the reducer catches up,
+// so that its reordering buffer is bounded by twice the window.
+template <typename Queue>
+struct Scheduler
+{
+  typedef std::pair<size_t, std::string> input_type;
+  typedef std::vector<input_type, std::allocator<input_type> > input_set_type;
+
+  struct greater_length
+  {
+    bool operator()(const input_type& x, const input_type& y) const
+    {
+      return x.first > y.first;
+    }
+  };
+  
+  Scheduler(Queue& __queue, const int __window, Progress* __progress=0)
+    : queue(__queue), window(__window), progress(__progress), dispatched(0) {}
+  
+  ~Scheduler() { flush(); }
+  
+  void push(const std::string& input, const size_t length)
+  {
+    if (window <= 0) {
+      queue.push(input);
+      return;
+    }
+    
+    inputs.push_back(input_type(length, input));
+    
+    if (inputs.size() >= size_t(window))
+      flush();
+  }
+  
+  void flush()
+  {
+    if (inputs.empty()) return;
+    
+    if (progress)
+      progress->wait(dispatched, window);
+    
+    std::stable_sort(inputs.begin(), inputs.end(), greater_length());
+    
+    typename input_set_type::iterator iter_end = inputs.end();
+    for (typename input_set_type::iterator iter = inputs.begin(); iter != iter_end; ++ iter)
+      queue.push_swap(iter->second);
+    
+    dispatched += inputs.size();
+    inputs.clear();
+  }
+  
+  // # of tokens, as an estimate of the cost of decoding
+  static size_t length(const std::string& line)
+  {
+    size_t tokens = 0;
+    bool space = true;
+    
+    std::string::const_iterator iter_end = line.end();
+    for (std::string::const_iterator iter = line.begin(); iter != iter_end; ++ iter) {
+      const bool space_curr = (*iter == ' ' || *iter == '\t');
+      
+      tokens += (space && ! space_curr);
+      space = space_curr;
+    }
+    
+    return tokens;
+  }
+  
+  Queue&            queue;
+  int               window;
+  Progress*         progress;
+  size_t            dispatched;
+  input_set_type    inputs;
+};
+
 struct MapReduceFile
 {
   typedef operation_set_type::operation_type::id_type id_type;
@@ -243,11 +375,13 @@ struct TaskFile : public MapReduceFile
 {
   TaskFile(queue_is_type&   __queue_is,
 	   queue_os_type&   __queue_os,
+	   TraceStream&     __trace,
 	   const model_type& __model,
 	   const grammar_type& __grammar,
 	   const tree_grammar_type& __tree_grammar)
     : queue_is(__queue_is),
       queue_os(__queue_os),
+      trace(__trace),
       _model(__model),
       _grammar(__grammar),
       _tree_grammar(__tree_grammar) {}
@@ -274,6 +408,8 @@ struct TaskFile : public MapReduceFile
 				  input_bitext_mode,
 				  true,
 				  debug);
+    
+    operations.set_trace(! output_trace.empty());
 
     if (input_directory_mode) {
       std::string file;
@@ -296,6 +432,8 @@ struct TaskFile : public MapReduceFile
 	id_buffer.id     = operations.get_data().id;
 	id_buffer.buffer = operations.get_output_data().buffer;
 	
+	trace.write(operations.get_trace());
+	
 	queue_os.push_swap(id_buffer);
       }
     } else {
@@ -313,6 +451,8 @@ struct TaskFile : public MapReduceFile
 	id_buffer.id     = operations.get_data().id;
 	id_buffer.buffer = operations.get_output_data().buffer;
 	
+	trace.write(operations.get_trace());
+	
 	queue_os.push_swap(id_buffer);
       }
     }
@@ -325,6 +465,7 @@ struct TaskFile : public MapReduceFile
   
   queue_is_type&   queue_is;
   queue_os_type&   queue_os;
+  TraceStream&     trace;
   const model_type& _model;
   const grammar_type& _grammar;
   const tree_grammar_type& _tree_grammar;  
@@ -334,8 +475,8 @@ struct TaskFile : public MapReduceFile
 
 struct ReduceFile : public MapReduceFile
 {
-  ReduceFile(queue_os_type& __queue, const path_type& __path)
-    : queue(__queue), path(__path) {}
+  ReduceFile(queue_os_type& __queue, const path_type& __path, Progress& __progress)
+    : queue(__queue), path(__path), progress(__progress) {}
   
   void operator()()
   {
@@ -378,6 +519,9 @@ struct ReduceFile : public MapReduceFile
       
       if (dump && flush_output)
 	os << std::flush;
+      
+      if (dump)
+	progress.update(id);
     }
     
     for (buffer_map_type::iterator iter = maps.find(id); iter != maps.end() && iter->first == id; /**/) {
@@ -405,6 +549,8 @@ struct ReduceFile : public MapReduceFile
   
   queue_os_type& queue;
   path_type      path;
+  
+  Progress& progress;
 };
 
 struct TaskDirectory
@@ -412,10 +558,12 @@ struct TaskDirectory
   typedef utils::lockfree_list_queue<std::string, std::allocator<std::string> > queue_type;
   
   TaskDirectory(queue_type&   __queue,
+		TraceStream&  __trace,
 		const model_type& __model,
 		const grammar_type& __grammar,
 		const tree_grammar_type& __tree_grammar)
     : queue(__queue),
+      trace(__trace),
       _model(__model),
       _grammar(__grammar),
       _tree_grammar(__tree_grammar) {}
@@ -443,6 +591,8 @@ struct TaskDirectory
 				  true,
 				  debug);
     
+    operations.set_trace(! output_trace.empty());
+    
     if (input_directory_mode) {
       std::string file;
       std::string line;
@@ -458,6 +608,8 @@ struct TaskDirectory
 	  operations(line);
 	else
 	  throw std::runtime_error("invalid file? " + file);
+	
+	trace.write(operations.get_trace());
       }
     } else {
       std::string line;
@@ -468,6 +620,8 @@ struct TaskDirectory
 	if (line.empty()) break;
 	
 	operations(line);
+	
+	trace.write(operations.get_trace());
       }
     }
     
@@ -478,6 +632,7 @@ struct TaskDirectory
   }
   
   queue_type&   queue;
+  TraceStream&  trace;
   const model_type& _model;
   const grammar_type& _grammar;
   const tree_grammar_type& _tree_grammar;
@@ -496,44 +651,55 @@ void cicada_file(const operation_set_type& operations,
   typedef TaskFile      task_type;
   typedef ReduceFile    reducer_type;
   
+  typedef Scheduler<map_reduce_type::queue_is_type> scheduler_type;
+  
   map_reduce_type::queue_is_type queue_is(threads);
   map_reduce_type::queue_os_type queue_os;
   
+  Progress progress;
+  
+  TraceStream trace(output_trace);
+  
   boost::thread_group reducer;
-  reducer.add_thread(new boost::thread(reducer_type(queue_os, operations.get_output_data().file)));
+  reducer.add_thread(new boost::thread(reducer_type(queue_os, operations.get_output_data().file, progress)));
   
   boost::thread_group mapper;
-  std::vector<task_type, std::allocator<task_type> > tasks(threads, task_type(queue_is, queue_os, model, grammar, tree_grammar));
+  std::vector<task_type, std::allocator<task_type> > tasks(threads, task_type(queue_is, queue_os, trace, model, grammar, tree_grammar));
   
   for (int i = 0; i != threads; ++ i)
     mapper.add_thread(new boost::thread(boost::ref(tasks[i])));
   
-  if (input_directory_mode) {
-    for (size_t i = 0; /**/; ++ i) {
-      const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
-      
-      const path_type path_input = input_file / file_name;
-      
-      if (! boost::filesystem::exists(path_input)) break;
-      
-      queue_is.push(path_input.string());
-    }
-  } else {
-    utils::compress_istream is(input_file, 1024 * 1024);
-    
-    operation_set_type::operation_type::id_type id = 0;
-    std::string line;
+  {
+    // the ids may not be consecutive with id-prefixed input, thus, we cannot bound by the reduced ones
+    scheduler_type scheduler(queue_is, schedule, input_id_mode || input_directory_mode ? 0 : &progress);
     
-    while (utils::getline(is, line)) {
-      if (input_id_mode) {
-	if (line.empty())
-	  throw std::runtime_error("invalid empty input!");
+    if (input_directory_mode) {
+      for (size_t i = 0; /**/; ++ i) {
+	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
 	
-	queue_is.push_swap(line);
-      } else
-	queue_is.push(utils::lexical_cast<std::string>(id) + " ||| " + line);
+	const path_type path_input = input_file / file_name;
+	
+	if (! boost::filesystem::exists(path_input)) break;
+	
+	scheduler.push(path_input.string(), schedule > 0 ? size_t(boost::filesystem::file_size(path_input)) : size_t(0));
+      }
+    } else {
+      utils::compress_istream is(input_file, 1024 * 1024);
       
-      ++ id;
+      operation_set_type::operation_type::id_type id = 0;
+      std::string line;
+      
+      while (utils::getline(is, line)) {
+	if (input_id_mode) {
+	  if (line.empty())
+	    throw std::runtime_error("invalid empty input!");
+	  
+	  scheduler.push(line, scheduler.length(line));
+	} else
+	  scheduler.push(utils::lexical_cast<std::string>(id) + " ||| " + line, scheduler.length(line));
+	
+	++ id;
+      }
     }
   }
   
@@ -557,39 +723,47 @@ void cicada_directory(const operation_set_type& operations,
 		      operation_set_type::statistics_type& stats)
 {
   typedef TaskDirectory task_type;
+  typedef Scheduler<task_type::queue_type> scheduler_type;
   
   task_type::queue_type queue(threads);
   
+  TraceStream trace(output_trace);
+  
   boost::thread_group mapper;
-  std::vector<task_type, std::allocator<task_type> > tasks(threads, task_type(queue, model, grammar, tree_grammar));
+  std::vector<task_type, std::allocator<task_type> > tasks(threads, task_type(queue, trace, model, grammar, tree_grammar));
   
   for (int i = 0; i != threads; ++ i)
     mapper.add_thread(new boost::thread(boost::ref(tasks[i])));
   
-  if (input_directory_mode) {
-    boost::filesystem::directory_iterator iter_end;
-    for (boost::filesystem::directory_iterator iter(input_file); iter != iter_end; ++ iter) {
-      const std::string file = path_type(*iter).string();
-      
-      if (! file.empty())
-	queue.push(file);
-    }
-  } else {
-    utils::compress_istream is(input_file, 1024 * 1024);
+  {
+    // no reordering for directory output
+    scheduler_type scheduler(queue, schedule);
     
-    operation_set_type::operation_type::id_type id = 0;
-    std::string line;
-
-    while (utils::getline(is, line)) {
-      if (input_id_mode) {
-	if (line.empty())
-	  throw std::runtime_error("invalid empty input!");
+    if (input_directory_mode) {
+      boost::filesystem::directory_iterator iter_end;
+      for (boost::filesystem::directory_iterator iter(input_file); iter != iter_end; ++ iter) {
+	const std::string file = path_type(*iter).string();
 	
-	queue.push_swap(line);
-      } else
-	queue.push(utils::lexical_cast<std::string>(id) + " ||| " + line);
+	if (! file.empty())
+	  scheduler.push(file, schedule > 0 ? size_t(boost::filesystem::file_size(*iter)) : size_t(0));
+      }
+    } else {
+      utils::compress_istream is(input_file, 1024 * 1024);
       
-      ++ id;
+      operation_set_type::operation_type::id_type id = 0;
+      std::string line;
+      
+      while (utils::getline(is, line)) {
+	if (input_id_mode) {
+	  if (line.empty())
+	    throw std::runtime_error("invalid empty input!");
+	  
+	  scheduler.push(line, scheduler.length(line));
+	} else
+	  scheduler.push(utils::lexical_cast<std::string>(id) + " ||| " + line, scheduler.length(line));
+	
+	++ id;
+      }
     }
   }
   
@@ -647,6 +821,7 @@ void options(int argc, char** argv)
     ("feature-function",        po::value<feature_parameter_set_type >(&feature_parameters)->composing(), "feature function(s)")
     ("feature-function-list",   po::bool_switch(&feature_list),                                           "list of available feature function(s)")
     ("output-feature-function", po::value<path_type>(&output_feature),                                    "output feature function(s)")
+    ("output-trace",            po::value<path_type>(&output_trace),                                      "output per-sentence trace of operations (JSON lines)")
 
     //operatins...
     ("operation",      po::value<op_set_type>(&ops)->composing(), "operations")
@@ -664,6 +839,7 @@ void options(int argc, char** argv)
   opts_command.add_options()
     ("config",  po::value<path_type>(),                    "configuration file")
     ("threads", po::value<int>(&threads),                  "# of threads")
+    ("schedule", po::value<int>(&schedule),                "look-ahead window of inputs dispatched longest-first (zero for input order)")
     ("debug",   po::value<int>(&debug)->implicit_value(1), "debug level")
     ("help", "help message");
 
@@ -9,6 +9,7 @@
 #include <set>
 
 #include "cicada_alignment_impl.hpp"
+#include "cicada_alignment_hmm_kernel.hpp"
 
 #include "utils/vector2_aligned.hpp"
 #include "utils/vector3_aligned.hpp"
@@ -36,6 +37,7 @@ struct LearnHMM : public LearnBase
     typedef utils::vector3_aligned<prob_type, utils::aligned_allocator<prob_type> > transition_type;
     
     typedef std::vector<prob_type, utils::aligned_allocator<prob_type> > scale_type;
+    typedef std::vector<prob_type, utils::aligned_allocator<prob_type> > buffer_type;
     
     typedef utils::vector2_aligned<prob_type, utils::aligned_allocator<prob_type> > posterior_type;
 
@@ -47,8 +49,10 @@ struct LearnHMM : public LearnBase
     
     emission_type   emission;
     transition_type transition;
+    prob_type       transition_none;
     
-    scale_type scale;
+    scale_type  scale;
+    buffer_type buffer;
     
     posterior_type posterior;
     
@@ -67,6 +71,7 @@ struct LearnHMM : public LearnBase
       emission.clear();
       transition.clear();
       scale.clear();
+      buffer.clear();
       
       posterior.clear();
       
@@ -84,6 +89,7 @@ struct LearnHMM : public LearnBase
       emission_type(emission).swap(emission);
       transition_type(transition).swap(transition);
       scale_type(scale).swap(scale);
+      buffer_type(buffer).swap(buffer);
       
       posterior_type(posterior).swap(posterior);
       
@@ -162,10 +168,10 @@ struct LearnHMM : public LearnBase
       transition.clear();
       
       emission.reserve(target_size + 2, (source_size + 2) * 2);
-      transition.reserve(target_size + 2, (source_size + 2) * 2, (source_size + 2) * 2);
+      transition.reserve(target_size + 2, source_size + 2, source_size + 2);
       
       emission.resize(target_size + 2, (source_size + 2) * 2, 0.0);
-      transition.resize(target_size + 2, (source_size + 2) * 2, (source_size + 2) * 2, 0.0);
+      transition.resize(target_size + 2, source_size + 2, source_size + 2, 0.0);
       
       // compute emission table...
       emission(0, 0) = 1.0;
@@ -190,37 +196,25 @@ struct LearnHMM : public LearnBase
       }
 
       // compute transition table...
+      // the transition from a word and from its NULL copy are the same, thus we keep only the band
+      // from the previous positions. The transition into NULL is transition_none.
       // we start from 1, since there exists no previously aligned word before BOS...
       for (size_type trg = 1; trg < target_size + 2; ++ trg) {
 	
 	// alignment into non-null
 	// start from 1 to exlude transition into <s>
 	for (size_type next = 1; next != source_size + 2; ++ next) {
-	  prob_type* titer1 = &(*transition.begin(trg, next)); // from word
-	  prob_type* titer2 = titer1 + (source_size + 2);      // from EPSILON
+	  prob_type* titer = &(*transition.begin(trg, next));
 	  
 	  // - 1 to exclude previous </s>...
-	  for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ titer1, ++ titer2) {
-	    const prob_type prob = prob_align * atable(source_class[prev], target_class[trg],
-						       source_size, target_size,
-						       prev - 1, next - 1);
-	    
-	    *titer1 = prob;
-	    *titer2 = prob;
-	  }
-	}
-	
-	// null transition
-	// we will exclude EOS
-	for (size_type next = 0; next != (source_size + 2) - 1; ++ next) {
-	  const size_type next_none = next + (source_size + 2);
-	  const size_type prev1_none = next;
-	  const size_type prev2_none = next + (source_size + 2);
-	  
-	  transition(trg, next_none, prev1_none) = prob_null;
-	  transition(trg, next_none, prev2_none) = prob_null;
+	  for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ titer)
+	    *titer = prob_align * atable(source_class[prev], target_class[trg],
+					 source_size, target_size,
+					 prev - 1, next - 1);
 	}
       }
+      
+      transition_none = prob_null;
     }
 
     void prepare(const sentence_type& __source,
@@ -274,10 +268,10 @@ struct LearnHMM : public LearnBase
       transition.clear();
       
       emission.reserve(target_size + 2, (source_size + 2) * 2);
-      transition.reserve(target_size + 2, (source_size + 2) * 2, (source_size + 2) * 2);
+      transition.reserve(target_size + 2, source_size + 2, source_size + 2);
       
       emission.resize(target_size + 2, (source_size + 2) * 2, 0.0);
-      transition.resize(target_size + 2, (source_size + 2) * 2, (source_size + 2) * 2, 0.0);
+      transition.resize(target_size + 2, source_size + 2, source_size + 2, 0.0);
       
       // compute emission table...
       emission(0, 0) = 1.0;
@@ -297,37 +291,25 @@ struct LearnHMM : public LearnBase
 
       
       // compute transition table...
+      // the transition from a word and from its NULL copy are the same, thus we keep only the band
+      // from the previous positions. The transition into NULL is transition_none.
       // we start from 1, since there exists no previously aligned word before BOS...
       for (size_type trg = 1; trg != target_size + 2; ++ trg) {
 	
 	// alignment into non-null
 	// start from 1 to exlude transition into <s>
 	for (size_type next = 1; next != source_size + 2; ++ next) {
-	  prob_type* titer1 = &(*transition.begin(trg, next)); // from word
-	  prob_type* titer2 = titer1 + (source_size + 2);      // from EPSILON
+	  prob_type* titer = &(*transition.begin(trg, next));
 	  
 	  // - 1 to exclude previous </s>...
-	  for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ titer1, ++ titer2) {
-	    const prob_type prob = prob_align * atable(source_class[prev], target_class[trg],
-						       source_size, target_size,
-						       prev - 1, next - 1);
-	    
-	    *titer1 = prob;
-	    *titer2 = prob;
-	  }
-	}
-	
-	// null transition
-	// we will exclude EOS
-	for (size_type next = 0; next != (source_size + 2) - 1; ++ next) {
-	  const size_type next_none = next + (source_size + 2);
-	  const size_type prev1_none = next;
-	  const size_type prev2_none = next + (source_size + 2);
-	  
-	  transition(trg, next_none, prev1_none) = prob_null;
-	  transition(trg, next_none, prev2_none) = prob_null;
+	  for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ titer)
+	    *titer = prob_align * atable(source_class[prev], target_class[trg],
+					 source_size, target_size,
+					 prev - 1, next - 1);
 	}
       }
+      
+      transition_none = prob_null;
     }
     
     void forward_backward(const sentence_type& __source,
@@ -348,110 +330,8 @@ struct LearnHMM : public LearnBase
       backward.resize(target_size + 2, (source_size + 2) * 2, 0.0);
       scale.resize(target_size + 2, 1.0);
       
-      forward(0, 0) = 1.0;
-      for (size_type trg = 1; trg != target_size + 2; ++ trg) {
-	// +1 to exclude BOS
-	prob_type*       niter = &(*forward.begin(trg)) + 1;
-	const prob_type* eiter = &(*emission.begin(trg)) + 1;
-	
-	for (size_type next = 1; next != source_size + 2; ++ next, ++ niter, ++ eiter) {
-	  const prob_type* piter = &(*forward.begin(trg - 1));
-	  const prob_type* titer = &(*transition.begin(trg, next));
-	  
-	  const double factor = *eiter;
-	  if (factor > 0.0) {
-	    double accum[4] = {0.0, 0.0, 0.0, 0.0};
-	    const int loop_size = (source_size + 2) * 2;
-	    for (int prev = 0; prev < loop_size - 3; prev += 4) {
-	      accum[0] += piter[prev + 0] * titer[prev + 0] * factor;
-	      accum[1] += piter[prev + 1] * titer[prev + 1] * factor;
-	      accum[2] += piter[prev + 2] * titer[prev + 2] * factor;
-	      accum[3] += piter[prev + 3] * titer[prev + 3] * factor;
-	    }
-	    
-	    switch (loop_size & 0x03) {
-	    case 3: accum[4 - 3] += piter[loop_size - 3] * titer[loop_size - 3] * factor;
-	    case 2: accum[4 - 2] += piter[loop_size - 2] * titer[loop_size - 2] * factor;
-	    case 1: accum[4 - 1] += piter[loop_size - 1] * titer[loop_size - 1] * factor;
-	    }
-	    *niter += accum[0] + accum[1] + accum[2] + accum[3];
-	    
-#if 0
-	    for (int prev = 0; prev < (source_size + 2) * 2; ++ prev, ++ piter, ++ titer)
-	      *niter += (*piter) * (*titer) * factor;
-#endif
-	  }
-	}
-	
-	prob_type*       niter_none = &(*forward.begin(trg)) + (source_size + 2);
-	const prob_type* eiter_none = &(*emission.begin(trg)) + (source_size + 2);
-	const prob_type* piter_none1 = &(*forward.begin(trg - 1));
-	const prob_type* piter_none2 = piter_none1 + (source_size + 2);
-	
-	for (size_type next = 0; next != (source_size + 2) - 1; ++ next, ++ niter_none, ++ eiter_none, ++ piter_none1, ++ piter_none2) {
-	  const size_type next_none = next + source_size + 2;
-	  const size_type prev_none1 = next;
-	  const size_type prev_none2 = next + source_size + 2;
-	  
-	  *niter_none += (*piter_none1) * (*eiter_none) * transition(trg, next_none, prev_none1);
-	  *niter_none += (*piter_none2) * (*eiter_none) * transition(trg, next_none, prev_none2);
-	}
-	
-	scale[trg] = std::accumulate(forward.begin(trg), forward.end(trg), 0.0);
-	scale[trg] = (scale[trg] == 0.0 ? 1.0 : 1.0 / scale[trg]);
-	if (scale[trg] != 1.0)
-	  std::transform(forward.begin(trg), forward.end(trg), forward.begin(trg), std::bind2nd(std::multiplies<double>(), scale[trg]));
-      }
-      
-      backward(target_size + 2 - 1, source_size + 2 - 1) = 1.0;
-      
-      for (int trg = target_size + 2 - 2; trg >= 0; -- trg) {
-	const prob_type factor_scale = scale[trg];
-	
-	// +1 to exclude BOS
-	const prob_type* niter = &(*backward.begin(trg + 1)) + 1;
-	const prob_type* eiter = &(*emission.begin(trg + 1)) + 1;
-	
-	for (size_type next = 1; next != source_size + 2; ++ next, ++ niter, ++ eiter) {
-	  prob_type*       piter = &(*backward.begin(trg));
-	  const prob_type* titer = &(*transition.begin(trg + 1, next));
-	  
-	  const double factor = (*eiter) * (*niter) * factor_scale;
-	  if (factor > 0.0) {
-	    const int loop_size = (source_size + 2) * 2;
-	    for (int prev = 0; prev < loop_size - 3; prev += 4) {
-	      piter[prev + 0] += titer[prev + 0] * factor;
-	      piter[prev + 1] += titer[prev + 1] * factor;
-	      piter[prev + 2] += titer[prev + 2] * factor;
-	      piter[prev + 3] += titer[prev + 3] * factor;
-	    }
-	    switch (loop_size & 0x03) {
-	    case 3: piter[loop_size - 3] += titer[loop_size - 3] * factor;
-	    case 2: piter[loop_size - 2] += titer[loop_size - 2] * factor;
-	    case 1: piter[loop_size - 1] += titer[loop_size - 1] * factor;
-	    }
-	    
-#if 0
-	    for (int prev = 0; prev < (source_size + 2) * 2; ++ prev, ++ piter, ++ titer)
-	      *piter += (*titer) * factor;
-#endif
-	  }
-	}
-	
-	const prob_type* niter_none = &(*backward.begin(trg + 1)) + (source_size + 2);
-	const prob_type* eiter_none = &(*emission.begin(trg + 1)) + (source_size + 2);
-	prob_type*       piter_none1 = &(*backward.begin(trg));
-	prob_type*       piter_none2 = piter_none1 + (source_size + 2);
-
-	for (size_type next = 0; next != (source_size + 2) - 1; ++ next, ++ niter_none, ++ eiter_none, ++ piter_none1, ++ piter_none2) {
-	  const size_type next_none = next + source_size + 2;
-	  const size_type prev_none1 = next;
-	  const size_type prev_none2 = next + source_size + 2;
-	  
-	  *piter_none1 += (*niter_none) * (*eiter_none) * transition(trg + 1, next_none, prev_none1) * factor_scale;
-	  *piter_none2 += (*niter_none) * (*eiter_none) * transition(trg + 1, next_none, prev_none2) * factor_scale;
-	}
-      }
+      HMMKernel::forward(emission, transition, transition_none, source_size, target_size, forward, scale, buffer);
+      HMMKernel::backward(emission, transition, transition_none, source_size, target_size, scale, backward, buffer);
     }
 
     void estimate_posterior(const sentence_type& __source,
@@ -632,17 +512,12 @@ struct LearnHMM : public LearnBase
 
 	  if (factor_backward > 0.0) {
 	    const prob_type* fiter_word = &(*forward.begin(trg - 1));
-	    const prob_type* titer_word = &(*transition.begin(trg, next));
 	    const prob_type* fiter_none = &(*forward.begin(trg - 1)) + (source_size + 2);
-	    const prob_type* titer_none = &(*transition.begin(trg, next)) + (source_size + 2);
+	    const prob_type* titer      = &(*transition.begin(trg, next));
 	    
 	    // - 1 to exlude EOS
-	    for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ fiter_word, ++ titer_word, ++ fiter_none, ++ titer_none) {
-	      const double count_word = (*fiter_word) * factor_backward * (*titer_word) * factor;
-	      const double count_none = (*fiter_none) * factor_backward * (*titer_none) * factor;
-	      
-	      mapped[prev]->operator[](next - prev) += count_word + count_none;
-	    }
+	    for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev, ++ fiter_word, ++ fiter_none, ++ titer)
+	      mapped[prev]->operator[](next - prev) += ((*fiter_word) + (*fiter_none)) * factor_backward * (*titer) * factor;
 	  }
 	}
       }
@@ -1280,6 +1155,8 @@ struct ViterbiHMM : public ViterbiBase
 		  __atable_source_target, __atable_target_source,
 		  __classes_source, __classes_target) {}
   
+  typedef LearnHMM::hmm_data_type hmm_data_type;
+  
   void viterbi(const sentence_type& source,
 	       const sentence_type& target,
 	       const ttable_type& ttable,
@@ -1291,12 +1168,8 @@ struct ViterbiHMM : public ViterbiBase
     const size_type source_size = source.size();
     const size_type target_size = target.size();
     
-    const double prob_null  = p0;
-    const double prob_align = 1.0 - p0;
-    
-    forward.clear();
-    backptr.clear();
-    scale.clear();
+    // emission and transition are gathered once for this pair
+    hmm.prepare(source, target, ttable, atable, classes_source, classes_target);
     
     forward.clear();
     backptr.clear();
@@ -1310,75 +1183,50 @@ struct ViterbiHMM : public ViterbiBase
     backptr.resize(target_size + 2, (source_size + 2) * 2, -1);
     scale.resize(target_size + 2, 1.0);
     
-    source_class.reserve(source_size + 2);
-    target_class.reserve(target_size + 2);
-    source_class.resize(source_size + 2);
-    target_class.resize(target_size + 2);
-    
-    source_class[0] = vocab_type::BOS;
-    target_class[0] = vocab_type::BOS;
-    source_class[(source_size + 2) - 1] = vocab_type::EOS;
-    target_class[(target_size + 2) - 1] = vocab_type::EOS;
-
-    sentence_type::iterator csiter = source_class.begin() + 1;
-    for (sentence_type::const_iterator siter = source.begin(); siter != source.end(); ++ siter, ++ csiter)
-      *csiter = classes_source[*siter];
-    
-    sentence_type::iterator ctiter = target_class.begin() + 1;
-    for (sentence_type::const_iterator titer = target.begin(); titer != target.end(); ++ titer, ++ ctiter)
-      *ctiter = classes_target[*titer];
-    
     forward(0, 0) = 1.0;
     
-    double scale_accumulated = 0.0;
     for (size_type trg = 1; trg != target_size + 2; ++ trg) {
-      const word_type target_word = (trg == target_size + 1 ? vocab_type::EOS : target[trg - 1]);
-      const double emission_none = ttable(vocab_type::EPSILON, target_word);
+      const prob_type* piter_word = &(*forward.begin(trg - 1));
+      const prob_type* piter_none = piter_word + (source_size + 2);
       
       // + 1 to exclude BOS
-      prob_type* niter = &(*forward.begin(trg)) + 1;
-      index_type* biter = &(*backptr.begin(trg)) + 1;
+      const prob_type* eiter = &(*hmm.emission.begin(trg)) + 1;
+      prob_type*       niter = &(*forward.begin(trg)) + 1;
+      index_type*      biter = &(*backptr.begin(trg)) + 1;
       
-      for (size_type next = 1; next != source_size + 2; ++ next, ++ niter, ++ biter) {
-	const word_type source_word = (next == static_cast<int>(source_size + 1) ? vocab_type::EOS : source[next - 1]);
-	const double emission = ttable(source_word, target_word);
+      for (size_type next = 1; next != source_size + 2; ++ next, ++ niter, ++ biter, ++ eiter) {
+	const double emission = *eiter;
 	
 	if (emission > 0.0) {
-	  const prob_type* piter = &(*forward.begin(trg - 1));
+	  const prob_type* titer = &(*hmm.transition.begin(trg, next));
 	  
-	  for (size_type prev = 0; prev != (source_size + 2) - 1; ++ prev) {
-	    const prob_type transition_word = prob_align * atable(source_class[prev], target_class[trg],
-								  source_size, target_size,
-								  prev - 1, next - 1);
-	    
-	    const double prob1 = emission * transition_word * piter[prev];
-	    const double prob2 = emission * transition_word * piter[prev + source_size + 2];
+	  // - 1 to exclude previous </s>
+	  const double prob_word = HMMKernel::max_product(emission, titer, piter_word, (source_size + 2) - 1);
+	  const double prob_none = HMMKernel::max_product(emission, titer, piter_none, (source_size + 2) - 1);
+	  const double prob = std::max(prob_word, prob_none);
+	  
+	  if (prob > *niter) {
+	    // the first maximum when visiting a word followed by its NULL copy
+	    const size_type prev_word = HMMKernel::find_product(emission, titer, piter_word, (source_size + 2) - 1, prob);
+	    const size_type prev_none = HMMKernel::find_product(emission, titer, piter_none, (source_size + 2) - 1, prob);
 	    
-	    if (prob1 > *niter) {
-	      *niter = prob1;
-	      *biter = prev;
-	    }
-	    if (prob2 > *niter) {
-	      *niter = prob2;
-	      *biter = prev + source_size + 2;
-	    }
+	    *niter = prob;
+	    *biter = (prev_word <= prev_none ? prev_word : prev_none + source_size + 2);
 	  }
 	}
       }
       
-      prob_type* niter_none = &(*forward.begin(trg)) + source_size + 2;
-      index_type* biter_none = &(*backptr.begin(trg)) + source_size + 2;
+      const prob_type* eiter_none = &(*hmm.emission.begin(trg)) + source_size + 2;
+      prob_type*       niter_none = &(*forward.begin(trg)) + source_size + 2;
+      index_type*      biter_none = &(*backptr.begin(trg)) + source_size + 2;
       
-      for (size_type next = 0; next != (source_size + 2) - 1; ++ next, ++ niter_none, ++ biter_none) {
+      for (size_type next = 0; next != (source_size + 2) - 1; ++ next, ++ niter_none, ++ biter_none, ++ eiter_none) {
 	// alignment into none...
-	const int next_none = next + source_size + 2;
 	const int prev_none1 = next;
 	const int prev_none2 = next + source_size + 2;
 	
-	const prob_type transition_none = prob_null;
-	
-	const double prob1 = forward(trg - 1, prev_none1) * emission_none * transition_none;
-	const double prob2 = forward(trg - 1, prev_none2) * emission_none * transition_none;
+	const double prob1 = forward(trg - 1, prev_none1) * (*eiter_none) * hmm.transition_none;
+	const double prob2 = forward(trg - 1, prev_none2) * (*eiter_none) * hmm.transition_none;
 	
 	if (prob1 > *niter_none) {
 	  *niter_none = prob1;
@@ -1435,15 +1283,11 @@ struct ViterbiHMM : public ViterbiBase
     backptr.clear();
     scale.clear();
     
-    source_class.clear();
-    target_class.clear();
-    
     forward_type(forward).swap(forward);
     backptr_type(backptr).swap(backptr);
     scale_type(scale).swap(scale);
     
-    sentence_type(source_class).swap(source_class);
-    sentence_type(target_class).swap(target_class);
+    hmm.shrink();
 
     ViterbiBase::shrink();
   }
@@ -1457,8 +1301,7 @@ struct ViterbiHMM : public ViterbiBase
   backptr_type  backptr;
   scale_type    scale;
 
-  sentence_type source_class;
-  sentence_type target_class;
+  hmm_data_type hmm;
 };
 
 
@@ -1581,6 +1424,8 @@ struct ViterbiPosteriorHMM : public ViterbiBase
     maximum(0, 0) = 1.0;
 
     for (size_type trg = 1; trg != target_size + 2; ++ trg) {
+      const prob_type* piter_word = &(*maximum.begin(trg - 1));
+      const prob_type* piter_none = piter_word + (source_size + 2);
       
       // +1 to exclude BOS
       const prob_type* eiter = &(*hmm.emission.begin(trg)) + 1;
@@ -1591,17 +1436,19 @@ struct ViterbiPosteriorHMM : public ViterbiBase
 	const double factor = *eiter;
 	
 	if (factor > 0.0) {
-	  const prob_type* piter = &(*maximum.begin(trg - 1));
 	  const prob_type* titer = &(*hmm.transition.begin(trg, next));
 	  
-	  for (size_type prev = 0; prev != (source_size + 2) * 2; ++ prev, ++ piter, ++ titer) {
-	    const double prob = factor * (*titer) * (*piter);
-	    
-	    if (prob >= *niter) {
-	      *niter = prob;
-	      *biter = prev;
-	    }
-	  }
+	  const double prob_word = HMMKernel::max_product(factor, titer, piter_word, source_size + 2);
+	  const double prob_none = HMMKernel::max_product(factor, titer, piter_none, source_size + 2);
+	  const double prob = std::max(prob_word, prob_none);
+	  
+	  // the last maximum when visiting words followed by NULLs
+	  const size_type prev_none = HMMKernel::rfind_product(factor, titer, piter_none, source_size + 2, prob);
+	  
+	  *niter = prob;
+	  *biter = (prev_none != source_size + 2
+		    ? prev_none + source_size + 2
+		    : HMMKernel::rfind_product(factor, titer, piter_word, source_size + 2, prob));
 	}
       }
       
@@ -1613,12 +1460,11 @@ struct ViterbiPosteriorHMM : public ViterbiBase
       
       for (size_type next = 0; next != (source_size + 2) - 1; ++ next, ++ niter_none, ++ biter_none, ++ eiter_none, ++ piter_none1, ++ piter_none2) {
 	// alignment into none...
-	const size_type next_none = next + source_size + 2;
 	const size_type prev_none1 = next;
 	const size_type prev_none2 = next + source_size + 2;
 	
-	const double prob1 = (*piter_none1) * (*eiter_none) * hmm.transition(trg, next_none, prev_none1);
-	const double prob2 = (*piter_none2) * (*eiter_none) * hmm.transition(trg, next_none, prev_none2);
+	const double prob1 = (*piter_none1) * (*eiter_none) * hmm.transition_none;
+	const double prob2 = (*piter_none2) * (*eiter_none) * hmm.transition_none;
 	
 	if (prob1 > *niter_none) {
 	  *niter_none = prob1;
@@ -0,0 +1,297 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA_ALIGNMENT_HMM_KERNEL__HPP__
+#define __CICADA_ALIGNMENT_HMM_KERNEL__HPP__ 1
+
+//
+// forward-backward kernel for the HMM word alignment.
+//
+// The states of a target position are laid out as [0, source_size + 2) for the source positions,
+// including <s> and </s>, followed by their NULL copies in [source_size + 2, (source_size + 2) * 2).
+// The transition into a source position depends only on the previous source position, not on
+// whether the previous state was a NULL copy, thus, the transitions are kept as a dense band of
+// (source_size + 2) x (source_size + 2) per target position, transition(trg, next, prev), and the
+// two halves of the previous states are merged before the dot products. The transition into NULL
+// keeps the previous position with a constant probability.
+//
+// The recursions are scaled, not in log-space, and the inner loops are dot products, axpy and
+// max-products over contiguous rows which are vectorized by AVX or SSE2 when available.
+//
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct HMMKernel
+{
+  typedef size_t    size_type;
+  typedef ptrdiff_t difference_type;
+
+  // sum_i x[i] * y[i]
+  static double dot(const double* x, const double* y, const size_type size)
+  {
+    size_type i = 0;
+    double sum = 0.0;
+
+#if defined(__AVX__)
+    __m256d accum0 = _mm256_setzero_pd();
+    __m256d accum1 = _mm256_setzero_pd();
+    for (/**/; i + 8 <= size; i += 8) {
+      accum0 = _mm256_add_pd(accum0, _mm256_mul_pd(_mm256_loadu_pd(x + i),     _mm256_loadu_pd(y + i)));
+      accum1 = _mm256_add_pd(accum1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+    }
+
+    double buffer[4];
+    _mm256_storeu_pd(buffer, _mm256_add_pd(accum0, accum1));
+    sum = (buffer[0] + buffer[1]) + (buffer[2] + buffer[3]);
+#elif defined(__SSE2__)
+    __m128d accum0 = _mm_setzero_pd();
+    __m128d accum1 = _mm_setzero_pd();
+    for (/**/; i + 4 <= size; i += 4) {
+      accum0 = _mm_add_pd(accum0, _mm_mul_pd(_mm_loadu_pd(x + i),     _mm_loadu_pd(y + i)));
+      accum1 = _mm_add_pd(accum1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+
+    double buffer[2];
+    _mm_storeu_pd(buffer, _mm_add_pd(accum0, accum1));
+    sum = buffer[0] + buffer[1];
+#endif
+
+    for (/**/; i != size; ++ i)
+      sum += x[i] * y[i];
+
+    return sum;
+  }
+
+  // y[i] += a * x[i]
+  static void axpy(const double a, const double* x, double* y, const size_type size)
+  {
+    size_type i = 0;
+
+#if defined(__AVX__)
+    const __m256d a256 = _mm256_set1_pd(a);
+    for (/**/; i + 4 <= size; i += 4)
+      _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_mul_pd(a256, _mm256_loadu_pd(x + i))));
+#elif defined(__SSE2__)
+    const __m128d a128 = _mm_set1_pd(a);
+    for (/**/; i + 2 <= size; i += 2)
+      _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(a128, _mm_loadu_pd(x + i))));
+#endif
+
+    for (/**/; i != size; ++ i)
+      y[i] += a * x[i];
+  }
+
+  // z[i] = x[i] + y[i]
+  static void add(const double* x, const double* y, double* z, const size_type size)
+  {
+    size_type i = 0;
+
+#if defined(__AVX__)
+    for (/**/; i + 4 <= size; i += 4)
+      _mm256_storeu_pd(z + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+#elif defined(__SSE2__)
+    for (/**/; i + 2 <= size; i += 2)
+      _mm_storeu_pd(z + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+#endif
+
+    for (/**/; i != size; ++ i)
+      z[i] = x[i] + y[i];
+  }
+
+  // x[i] *= a
+  static void multiply(double* x, const double a, const size_type size)
+  {
+    size_type i = 0;
+
+#if defined(__AVX__)
+    const __m256d a256 = _mm256_set1_pd(a);
+    for (/**/; i + 4 <= size; i += 4)
+      _mm256_storeu_pd(x + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), a256));
+#elif defined(__SSE2__)
+    const __m128d a128 = _mm_set1_pd(a);
+    for (/**/; i + 2 <= size; i += 2)
+      _mm_storeu_pd(x + i, _mm_mul_pd(_mm_loadu_pd(x + i), a128));
+#endif
+
+    for (/**/; i != size; ++ i)
+      x[i] *= a;
+  }
+
+  // sum_i x[i]
+  static double sum(const double* x, const size_type size)
+  {
+    size_type i = 0;
+    double sum = 0.0;
+
+#if defined(__AVX__)
+    __m256d accum = _mm256_setzero_pd();
+    for (/**/; i + 4 <= size; i += 4)
+      accum = _mm256_add_pd(accum, _mm256_loadu_pd(x + i));
+
+    double buffer[4];
+    _mm256_storeu_pd(buffer, accum);
+    sum = (buffer[0] + buffer[1]) + (buffer[2] + buffer[3]);
+#elif defined(__SSE2__)
+    __m128d accum = _mm_setzero_pd();
+    for (/**/; i + 2 <= size; i += 2)
+      accum = _mm_add_pd(accum, _mm_loadu_pd(x + i));
+
+    double buffer[2];
+    _mm_storeu_pd(buffer, accum);
+    sum = buffer[0] + buffer[1];
+#endif
+
+    for (/**/; i != size; ++ i)
+      sum += x[i];
+
+    return sum;
+  }
+
+  // max_i (a * x[i]) * y[i], or zero for an empty range. All the values are assumed to be non-negative.
+  static double max_product(const double a, const double* x, const double* y, const size_type size)
+  {
+    size_type i = 0;
+    double maximum = 0.0;
+
+#if defined(__AVX__)
+    const __m256d a256 = _mm256_set1_pd(a);
+    __m256d max256 = _mm256_setzero_pd();
+    for (/**/; i + 4 <= size; i += 4)
+      max256 = _mm256_max_pd(max256, _mm256_mul_pd(_mm256_mul_pd(a256, _mm256_loadu_pd(x + i)), _mm256_loadu_pd(y + i)));
+
+    double buffer[4];
+    _mm256_storeu_pd(buffer, max256);
+    maximum = std::max(std::max(buffer[0], buffer[1]), std::max(buffer[2], buffer[3]));
+#elif defined(__SSE2__)
+    const __m128d a128 = _mm_set1_pd(a);
+    __m128d max128 = _mm_setzero_pd();
+    for (/**/; i + 2 <= size; i += 2)
+      max128 = _mm_max_pd(max128, _mm_mul_pd(_mm_mul_pd(a128, _mm_loadu_pd(x + i)), _mm_loadu_pd(y + i)));
+
+    double buffer[2];
+    _mm_storeu_pd(buffer, max128);
+    maximum = std::max(buffer[0], buffer[1]);
+#endif
+
+    for (/**/; i != size; ++ i)
+      maximum = std::max(maximum, (a * x[i]) * y[i]);
+
+    return maximum;
+  }
+
+  // the first i such that (a * x[i]) * y[i] == value, or size if not found.
+  // The product is computed as in max_product, thus, the maximum is always found.
+  static size_type find_product(const double a, const double* x, const double* y, const size_type size, const double value)
+  {
+    for (size_type i = 0; i != size; ++ i)
+      if ((a * x[i]) * y[i] == value)
+	return i;
+    return size;
+  }
+
+  // the last i such that (a * x[i]) * y[i] == value, or size if not found.
+  static size_type rfind_product(const double a, const double* x, const double* y, const size_type size, const double value)
+  {
+    for (size_type i = size; i != 0; -- i)
+      if ((a * x[i - 1]) * y[i - 1] == value)
+	return i - 1;
+    return size;
+  }
+
+  // forward recursion: forward is (target_size + 2) x (source_size + 2) * 2 cleared by zero, and
+  // scale is (target_size + 2) initialized by one. merged is a buffer of the previous states.
+  template <typename Emission, typename Transition, typename Forward, typename Scale, typename Buffer>
+  static void forward(const Emission& emission,
+		      const Transition& transition,
+		      const double prob_null,
+		      const size_type source_size,
+		      const size_type target_size,
+		      Forward& forward,
+		      Scale& scale,
+		      Buffer& merged)
+  {
+    const size_type width = source_size + 2;
+
+    merged.resize(width);
+
+    forward(0, 0) = 1.0;
+    for (size_type trg = 1; trg != target_size + 2; ++ trg) {
+      const double* piter = &(*forward.begin(trg - 1));
+      const double* eiter = &(*emission.begin(trg));
+      double*       niter = &(*forward.begin(trg));
+      double*       miter = &(*merged.begin());
+
+      // merge words and NULLs of the previous states
+      add(piter, piter + width, miter, width);
+
+      // start from 1 to exclude <s>, and - 1 to exclude the transition from </s>
+      for (size_type next = 1; next != width; ++ next)
+	if (eiter[next] > 0.0)
+	  niter[next] = eiter[next] * dot(miter, &(*transition.begin(trg, next)), width - 1);
+
+      // NULL, excluding </s>
+      for (size_type next = 0; next != width - 1; ++ next)
+	niter[width + next] = miter[next] * eiter[width + next] * prob_null;
+
+      const double total = sum(niter, width * 2);
+
+      scale[trg] = (total == 0.0 ? 1.0 : 1.0 / total);
+      if (scale[trg] != 1.0)
+	multiply(niter, scale[trg], width * 2);
+    }
+  }
+
+  // backward recursion: backward is (target_size + 2) x (source_size + 2) * 2 cleared by zero, and
+  // scale is computed by forward(). A state and its NULL copy share the same successors, thus, the
+  // two halves of a backward row are the same.
+  template <typename Emission, typename Transition, typename Backward, typename Scale, typename Buffer>
+  static void backward(const Emission& emission,
+		       const Transition& transition,
+		       const double prob_null,
+		       const size_type source_size,
+		       const size_type target_size,
+		       const Scale& scale,
+		       Backward& backward,
+		       Buffer& merged)
+  {
+    const size_type width = source_size + 2;
+
+    merged.resize(width);
+
+    backward(target_size + 2 - 1, width - 1) = 1.0;
+    for (difference_type trg = target_size + 2 - 2; trg >= 0; -- trg) {
+      const double  factor_scale = scale[trg];
+      const double* niter = &(*backward.begin(trg + 1));
+      const double* eiter = &(*emission.begin(trg + 1));
+      double*       piter = &(*backward.begin(trg));
+      double*       miter = &(*merged.begin());
+
+      std::fill(miter, miter + width, 0.0);
+
+      // start from 1 to exclude <s>, and - 1 to exclude the transition from </s>
+      for (size_type next = 1; next != width; ++ next) {
+	const double factor = eiter[next] * niter[next] * factor_scale;
+
+	if (factor > 0.0)
+	  axpy(factor, &(*transition.begin(trg + 1, next)), miter, width - 1);
+      }
+
+      // NULL, excluding </s>
+      for (size_type next = 0; next != width - 1; ++ next)
+	miter[next] += niter[width + next] * eiter[width + next] * prob_null * factor_scale;
+
+      std::copy(miter, miter + width, piter);
+      std::copy(miter, miter + width, piter + width);
+    }
+  }
+};
+
+#endif
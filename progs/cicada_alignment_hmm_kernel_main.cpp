@@ -0,0 +1,215 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of sentence pairs] [min length] [max length]
+//
+// run forward-backward over synthetic sentence pairs with random emissions and transitions by
+// the scalar recursion over the full (source_size + 2) * 2 states, and by the banded HMMKernel.
+// The two should agree.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+#include "cicada_alignment_hmm_kernel.hpp"
+
+#include "utils/vector2_aligned.hpp"
+#include "utils/vector3_aligned.hpp"
+#include "utils/aligned_allocator.hpp"
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+#include <boost/random.hpp>
+
+typedef utils::vector2_aligned<double, utils::aligned_allocator<double> > matrix_type;
+typedef utils::vector3_aligned<double, utils::aligned_allocator<double> > tensor_type;
+typedef std::vector<double, utils::aligned_allocator<double> > vector_type;
+
+// the previous recursion over the full (source_size + 2) * 2 transitions
+void forward_backward(const matrix_type& emission,
+		      const tensor_type& transition,
+		      const size_t source_size,
+		      const size_t target_size,
+		      matrix_type& forward,
+		      matrix_type& backward,
+		      vector_type& scale)
+{
+  const size_t width = source_size + 2;
+
+  forward(0, 0) = 1.0;
+  for (size_t trg = 1; trg != target_size + 2; ++ trg) {
+    for (size_t next = 1; next != width; ++ next) {
+      const double factor = emission(trg, next);
+
+      if (factor > 0.0)
+	for (size_t prev = 0; prev != width * 2; ++ prev)
+	  forward(trg, next) += forward(trg - 1, prev) * transition(trg, next, prev) * factor;
+    }
+
+    for (size_t next = 0; next != width - 1; ++ next) {
+      forward(trg, next + width) += forward(trg - 1, next) * emission(trg, next + width) * transition(trg, next + width, next);
+      forward(trg, next + width) += forward(trg - 1, next + width) * emission(trg, next + width) * transition(trg, next + width, next + width);
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i != width * 2; ++ i)
+      sum += forward(trg, i);
+
+    scale[trg] = (sum == 0.0 ? 1.0 : 1.0 / sum);
+    for (size_t i = 0; i != width * 2; ++ i)
+      forward(trg, i) *= scale[trg];
+  }
+
+  backward(target_size + 2 - 1, width - 1) = 1.0;
+  for (int trg = target_size + 2 - 2; trg >= 0; -- trg) {
+    for (size_t next = 1; next != width; ++ next) {
+      const double factor = emission(trg + 1, next) * backward(trg + 1, next) * scale[trg];
+
+      if (factor > 0.0)
+	for (size_t prev = 0; prev != width * 2; ++ prev)
+	  backward(trg, prev) += transition(trg + 1, next, prev) * factor;
+    }
+
+    for (size_t next = 0; next != width - 1; ++ next) {
+      const double factor = backward(trg + 1, next + width) * emission(trg + 1, next + width) * scale[trg];
+
+      backward(trg, next)         += factor * transition(trg + 1, next + width, next);
+      backward(trg, next + width) += factor * transition(trg + 1, next + width, next + width);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const size_t num_pair   = (argc > 1 ? utils::lexical_cast<size_t>(argv[1]) : size_t(1000));
+    const size_t length_min = (argc > 2 ? utils::lexical_cast<size_t>(argv[2]) : size_t(20));
+    const size_t length_max = (argc > 3 ? utils::lexical_cast<size_t>(argv[3]) : size_t(100));
+
+    const double prob_null = 0.01;
+
+    boost::mt19937 generator;
+    boost::random::uniform_int_distribution<size_t> length_dist(length_min, length_max);
+    boost::random::uniform_real_distribution<double> prob_dist(0.0, 1.0);
+
+    matrix_type emission;
+    tensor_type transition;
+    tensor_type transition_full;
+
+    matrix_type forward_scalar;
+    matrix_type backward_scalar;
+    vector_type scale_scalar;
+
+    matrix_type forward_kernel;
+    matrix_type backward_kernel;
+    vector_type scale_kernel;
+    vector_type buffer;
+
+    double time_scalar = 0.0;
+    double time_kernel = 0.0;
+    double diff_forward = 0.0;
+    double diff_backward = 0.0;
+    double diff_scale = 0.0;
+
+    for (size_t pair = 0; pair != num_pair; ++ pair) {
+      const size_t source_size = length_dist(generator);
+      const size_t target_size = length_dist(generator);
+      const size_t width = source_size + 2;
+
+      emission.clear();
+      emission.resize(target_size + 2, width * 2, 0.0);
+
+      emission(0, 0) = 1.0;
+      emission(target_size + 2 - 1, width - 1) = 1.0;
+      for (size_t trg = 1; trg <= target_size; ++ trg) {
+	for (size_t src = 1; src <= source_size; ++ src)
+	  emission(trg, src) = prob_dist(generator);
+
+	const double prob_epsilon = prob_dist(generator);
+	for (size_t src = 0; src != width - 1; ++ src)
+	  emission(trg, src + width) = prob_epsilon;
+      }
+
+      transition.clear();
+      transition.resize(target_size + 2, width, width, 0.0);
+      transition_full.clear();
+      transition_full.resize(target_size + 2, width * 2, width * 2, 0.0);
+
+      for (size_t trg = 1; trg != target_size + 2; ++ trg) {
+	for (size_t next = 1; next != width; ++ next)
+	  for (size_t prev = 0; prev != width - 1; ++ prev) {
+	    const double prob = (1.0 - prob_null) * prob_dist(generator);
+
+	    transition(trg, next, prev) = prob;
+	    transition_full(trg, next, prev) = prob;
+	    transition_full(trg, next, prev + width) = prob;
+	  }
+
+	for (size_t next = 0; next != width - 1; ++ next) {
+	  transition_full(trg, next + width, next) = prob_null;
+	  transition_full(trg, next + width, next + width) = prob_null;
+	}
+      }
+
+      forward_scalar.clear();
+      backward_scalar.clear();
+      scale_scalar.clear();
+      forward_scalar.resize(target_size + 2, width * 2, 0.0);
+      backward_scalar.resize(target_size + 2, width * 2, 0.0);
+      scale_scalar.resize(target_size + 2, 1.0);
+
+      forward_kernel.clear();
+      backward_kernel.clear();
+      scale_kernel.clear();
+      forward_kernel.resize(target_size + 2, width * 2, 0.0);
+      backward_kernel.resize(target_size + 2, width * 2, 0.0);
+      scale_kernel.resize(target_size + 2, 1.0);
+
+      utils::resource start_scalar;
+
+      forward_backward(emission, transition_full, source_size, target_size, forward_scalar, backward_scalar, scale_scalar);
+
+      utils::resource end_scalar;
+
+      utils::resource start_kernel;
+
+      HMMKernel::forward(emission, transition, prob_null, source_size, target_size, forward_kernel, scale_kernel, buffer);
+      HMMKernel::backward(emission, transition, prob_null, source_size, target_size, scale_kernel, backward_kernel, buffer);
+
+      utils::resource end_kernel;
+
+      time_scalar += end_scalar.user_time() - start_scalar.user_time();
+      time_kernel += end_kernel.user_time() - start_kernel.user_time();
+
+      for (size_t trg = 0; trg != target_size + 2; ++ trg) {
+	diff_scale = std::max(diff_scale, std::fabs(scale_scalar[trg] - scale_kernel[trg]) / scale_scalar[trg]);
+
+	for (size_t i = 0; i != width * 2; ++ i) {
+	  diff_forward = std::max(diff_forward, std::fabs(forward_scalar(trg, i) - forward_kernel(trg, i)));
+	  diff_backward = std::max(diff_backward, (std::fabs(backward_scalar(trg, i) - backward_kernel(trg, i))
+						   / std::max(backward_scalar(trg, i), 1.0)));
+	}
+      }
+    }
+
+    std::cout << "scalar: " << time_scalar << " user" << std::endl;
+    std::cout << "kernel: " << time_kernel << " user" << std::endl;
+    std::cout << "forward difference: " << diff_forward
+	      << " backward difference: " << diff_backward
+	      << " scale difference: " << diff_scale
+	      << std::endl;
+
+    if (diff_forward > 1e-10 || diff_backward > 1e-10 || diff_scale > 1e-10)
+      throw std::runtime_error("scalar and kernel differ");
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
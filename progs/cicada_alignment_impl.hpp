@@ -19,6 +19,7 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/range.hpp>
+#include <boost/utility.hpp>
 
 #include <cicada/sentence.hpp>
 #include <cicada/alignment.hpp>
@@ -846,6 +847,84 @@ struct aligned_type
   aligned_set_type aligned;
 };
 
+//
+// E-step counts shared by all the learning threads. Words are striped by the lower bits of their ids,
+// and a thread accumulates the counts of a word under the lock of its stripe, so that we keep a single
+// copy of the counts, not one per thread, and the M-step can partition the words by stripes.
+//
+struct ttable_counts_shared_type : private boost::noncopyable
+{
+  typedef size_t    size_type;
+  typedef ptrdiff_t difference_type;
+  
+  typedef ttable_type::count_map_type    count_map_type;
+  typedef ttable_type::count_dict_type   count_dict_type;
+  typedef aligned_type::aligned_map_type aligned_map_type;
+  typedef aligned_type::aligned_set_type aligned_set_type;
+  
+  typedef utils::spinlock         mutex_type;
+  typedef mutex_type::scoped_lock lock_type;
+  
+  static const size_type stripe_size = 256;
+  
+  static size_type stripe(const word_type::id_type& word) { return word & (stripe_size - 1); }
+  static size_type offset(const word_type::id_type& word) { return word / stripe_size; }
+  static word_type::id_type word(const size_type stripe, const size_type offset) { return offset * stripe_size + stripe; }
+  
+  // accumulate counts and aligned words of a word. They are swapped in when the word is not seen yet.
+  void insert(const word_type::id_type& word, count_map_type& __counts, aligned_map_type& __aligned)
+  {
+    if (__counts.empty() && __aligned.empty()) return;
+    
+    const size_type pos = stripe(word);
+    
+    lock_type lock(mutexes[pos]);
+    
+    if (! __counts.empty()) {
+      count_map_type& counts_word = counts[pos][offset(word)];
+      
+      if (counts_word.empty())
+	counts_word.swap(__counts);
+      else
+	counts_word += __counts;
+    }
+    
+    if (! __aligned.empty()) {
+      aligned_map_type& aligned_word = aligned[pos][offset(word)];
+      
+      if (aligned_word.empty())
+	aligned_word.swap(__aligned);
+      else
+	aligned_word += __aligned;
+    }
+  }
+  
+  // one plus the largest word id
+  size_type size() const
+  {
+    size_type size = 0;
+    for (size_type pos = 0; pos != stripe_size; ++ pos) {
+      if (! counts[pos].empty())
+	size = utils::bithack::max(size, size_type(word(pos, counts[pos].size() - 1)) + 1);
+      if (! aligned[pos].empty())
+	size = utils::bithack::max(size, size_type(word(pos, aligned[pos].size() - 1)) + 1);
+    }
+    return size;
+  }
+  
+  void clear()
+  {
+    for (size_type pos = 0; pos != stripe_size; ++ pos) {
+      counts[pos].clear();
+      aligned[pos].clear();
+    }
+  }
+  
+  count_dict_type  counts[stripe_size];
+  aligned_set_type aligned[stripe_size];
+  mutex_type       mutexes[stripe_size];
+};
+
 //
 // e-table for length modeling
 //
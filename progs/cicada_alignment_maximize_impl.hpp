@@ -7,7 +7,10 @@
 
 #include <limits>
 
+#include <boost/thread.hpp>
+
 #include "utils/mathop.hpp"
+#include "utils/lockfree_list_queue.hpp"
 
 struct Maximize
 {
@@ -280,4 +283,113 @@ struct MaximizeL0
   parameter_type mu;
 };
 
+//
+// M-step from the shared E-step counts: the stripes are distributed to the threads, and each word is
+// maximized into its own slot of the pre-sized ttable_new/aligned_new, thus, no locking is required.
+// The counts are released as we go.
+//
+
+template <typename Maximizer>
+struct MaximizeShared : public Maximizer
+{
+  typedef ttable_counts_shared_type counts_type;
+
+  typedef utils::lockfree_list_queue<int, std::allocator<int> > queue_type;
+  
+  MaximizeShared(queue_type& __queue,
+		 counts_type& __counts,
+		 const ttable_type& __ttable,
+		 ttable_type& __ttable_new,
+		 aligned_type& __aligned_new,
+		 const Maximizer& __base)
+    : Maximizer(__base),
+      queue(__queue),
+      counts(__counts),
+      ttable(__ttable),
+      ttable_new(__ttable_new),
+      aligned_new(__aligned_new) {}
+  
+  void operator()()
+  {
+    const ttable_type::count_map_type ttable_empty;
+    
+    for (;;) {
+      int stripe = 0;
+      queue.pop(stripe);
+      if (stripe < 0) break;
+      
+      counts_type::aligned_set_type& aligned = counts.aligned[stripe];
+      
+      for (size_t pos = 0; pos != aligned.size(); ++ pos)
+	if (aligned.exists(pos))
+	  aligned_new.aligned[counts_type::word(stripe, pos)].swap(aligned[pos]);
+      
+      aligned.clear();
+      
+      counts_type::count_dict_type& ttable_counts = counts.counts[stripe];
+      
+      for (size_t pos = 0; pos != ttable_counts.size(); ++ pos)
+	if (ttable_counts.exists(pos)) {
+	  const word_type::id_type word_id = counts_type::word(stripe, pos);
+	  
+	  Maximizer::operator()(ttable_counts[pos],
+				ttable.exists(word_id) ? ttable.ttable[word_id] : ttable_empty,
+				ttable_new.ttable[word_id],
+				ttable.prior,
+				ttable.smooth);
+	  
+	  ttable_counts.erase(ttable_counts.begin() + pos);
+	}
+      
+      ttable_counts.clear();
+    }
+  }
+  
+  queue_type&  queue;
+  counts_type& counts;
+  
+  const ttable_type& ttable;
+  
+  ttable_type&  ttable_new;
+  aligned_type& aligned_new;
+};
+
+template <typename Maximizer>
+inline
+void maximize_shared(ttable_counts_shared_type& counts,
+		     ttable_type& ttable,
+		     aligned_type& aligned,
+		     const Maximizer& maximizer,
+		     const int threads)
+{
+  typedef MaximizeShared<Maximizer>             mapper_type;
+  typedef typename mapper_type::queue_type      queue_type;
+  
+  const size_t size = counts.size();
+  
+  ttable_type  ttable_new(ttable.prior, ttable.smooth);
+  aligned_type aligned_new;
+  
+  // pre-size so that the threads never re-allocate the tables
+  ttable_new.resize(size);
+  aligned_new.resize(size);
+  
+  queue_type queue;
+  
+  boost::thread_group workers;
+  for (int i = 0; i != utils::bithack::max(threads, 1); ++ i)
+    workers.add_thread(new boost::thread(mapper_type(queue, counts, ttable, ttable_new, aligned_new, maximizer)));
+  
+  for (int stripe = 0; stripe != static_cast<int>(ttable_counts_shared_type::stripe_size); ++ stripe)
+    queue.push(stripe);
+  
+  for (int i = 0; i != utils::bithack::max(threads, 1); ++ i)
+    queue.push(-1);
+  
+  workers.join_all();
+  
+  ttable.swap(ttable_new);
+  aligned.swap(aligned_new);
+}
+
 #endif
@@ -293,106 +293,8 @@ struct LearnMapReduce
   
   typedef std::vector<bitext_type, std::allocator<bitext_type> > bitext_set_type;
   
-  struct ttable_counts_type
-  {
-    word_type                      word;
-    ttable_type::count_map_type    counts;
-    aligned_type::aligned_map_type aligned;
-    
-    ttable_counts_type() : word(), counts(), aligned() {}
-    
-    void swap(ttable_counts_type& x)
-    {
-      word.swap(x.word);
-      counts.swap(x.counts);
-      aligned.swap(x.aligned);
-    }
-  };
-
   
   typedef utils::lockfree_list_queue<bitext_set_type, std::allocator<bitext_set_type> >       queue_bitext_type;
-  typedef utils::lockfree_list_queue<ttable_counts_type, std::allocator<ttable_counts_type> > queue_ttable_type;
-  typedef std::vector<queue_ttable_type, std::allocator<queue_ttable_type> >                  queue_ttable_set_type;
-};
-
-namespace std
-{
-  inline
-  void swap(LearnMapReduce::ttable_counts_type& x, LearnMapReduce::ttable_counts_type& y)
-  {
-    x.swap(y);
-  }
-};
-
-template <typename Maximizer>
-struct LearnReducer : public Maximizer
-{
-  typedef size_t    size_type;
-  typedef ptrdiff_t difference_type;
-  
-  typedef LearnMapReduce map_reduce_type;
-  
-  typedef map_reduce_type::ttable_counts_type ttable_counts_type;
-  typedef map_reduce_type::queue_ttable_type  queue_ttable_type;
-  
-  LearnReducer(queue_ttable_type& __queue,
-	       const ttable_type& __ttable,
-	       const aligned_type& __aligned,
-	       ttable_type& __ttable_new,
-	       aligned_type& __aligned_new,
-	       const Maximizer& __base)
-    : Maximizer(__base),
-      queue(__queue),
-      ttable(__ttable),
-      aligned(__aligned),
-      ttable_new(__ttable_new),
-      aligned_new(__aligned_new) {}
-  
-  void operator()()
-  {
-    ttable_type  ttable_reduced;
-    aligned_type aligned_reduced;
-    
-    for (;;) {
-      ttable_counts_type counts;
-      
-      queue.pop_swap(counts);
-      
-      if (counts.counts.empty() && counts.aligned.empty()) break;
-      
-      if (! counts.counts.empty())
-	ttable_reduced[counts.word] += counts.counts;
-      if (! counts.aligned.empty())
-	aligned_reduced[counts.word] += counts.aligned;
-    }
-    
-    for (word_type::id_type word_id = 0; word_id < aligned_reduced.size(); ++ word_id)
-      if (aligned_reduced.exists(word_id)) {
-	aligned_new[word_id].swap(aligned_reduced[word_id]);
-	
-	aligned_reduced.clear(word_id);
-      }
-
-    ttable_type::count_map_type ttable_empty;
-    
-    for (word_type::id_type word_id = 0; word_id < ttable_reduced.size(); ++ word_id)
-      if (ttable_reduced.exists(word_id)) { 
-	if (ttable.exists(word_id))
-	  Maximizer::operator()(ttable_reduced[word_id], ttable[word_id], ttable_new[word_id], ttable.prior, ttable.smooth);
-	else
-	  Maximizer::operator()(ttable_reduced[word_id], ttable_empty, ttable_new[word_id], ttable.prior, ttable.smooth);
-	
-	ttable_reduced.clear(word_id);
-      }
-  }
-  
-  queue_ttable_type& queue;
-  
-  const ttable_type&  ttable;
-  const aligned_type& aligned;
-
-  ttable_type&  ttable_new;
-  aligned_type& aligned_new;
 };
 
 
@@ -401,21 +303,18 @@ struct LearnMapper : public Learner
 {
   typedef LearnMapReduce map_reduce_type;
   
-  typedef map_reduce_type::bitext_set_type    bitext_set_type;
-  typedef map_reduce_type::ttable_counts_type ttable_counts_type;
+  typedef map_reduce_type::bitext_set_type bitext_set_type;
   
-  typedef map_reduce_type::queue_bitext_type      queue_bitext_type;
-  typedef map_reduce_type::queue_ttable_type      queue_ttable_type;
-  typedef map_reduce_type::queue_ttable_set_type  queue_ttable_set_type;
+  typedef map_reduce_type::queue_bitext_type queue_bitext_type;
   
   LearnMapper(queue_bitext_type& __queue_bitext,
-	      queue_ttable_set_type& __queue_ttable_source_target,
-	      queue_ttable_set_type& __queue_ttable_target_source,
+	      ttable_counts_shared_type& __counts_source_target,
+	      ttable_counts_shared_type& __counts_target_source,
 	      const LearnBase& __base)
     : Learner(__base),
       queue_bitext(__queue_bitext),
-      queue_ttable_source_target(__queue_ttable_source_target),
-      queue_ttable_target_source(__queue_ttable_target_source) {}
+      counts_source_target(__counts_source_target),
+      counts_target_source(__counts_target_source) {}
   
   void operator()()
   {
@@ -456,35 +355,29 @@ struct LearnMapper : public Learner
 							      Learner::aligned_target_source.size());
     
     for (word_type::id_type source_id = 0; source_id != source_max; ++ source_id) {
-      ttable_counts_type counts;
-	  
+      ttable_type::count_map_type    counts;
+      aligned_type::aligned_map_type aligned;
+      
       if (Learner::ttable_counts_source_target.exists(source_id) && ! Learner::ttable_counts_source_target[source_id].empty())
-	counts.counts.swap(Learner::ttable_counts_source_target[source_id]);
-	  
+	counts.swap(Learner::ttable_counts_source_target[source_id]);
+      
       if (Learner::aligned_source_target.exists(source_id) && ! Learner::aligned_source_target[source_id].empty())
-	counts.aligned.swap(Learner::aligned_source_target[source_id]);
-	  
-      if (! counts.counts.empty() || ! counts.aligned.empty()) {
-	counts.word = word_type(source_id);
-	
-	queue_ttable_source_target[source_id % queue_ttable_source_target.size()].push_swap(counts);
-      }
+	aligned.swap(Learner::aligned_source_target[source_id]);
+      
+      counts_source_target.insert(source_id, counts, aligned);
     }
 	
     for (word_type::id_type target_id = 0; target_id != target_max; ++ target_id) {
-      ttable_counts_type counts;
-	  
+      ttable_type::count_map_type    counts;
+      aligned_type::aligned_map_type aligned;
+      
       if (Learner::ttable_counts_target_source.exists(target_id) && ! Learner::ttable_counts_target_source[target_id].empty())
-	counts.counts.swap(Learner::ttable_counts_target_source[target_id]);
-	  
+	counts.swap(Learner::ttable_counts_target_source[target_id]);
+      
       if (Learner::aligned_target_source.exists(target_id) && ! Learner::aligned_target_source[target_id].empty())
-	counts.aligned.swap(Learner::aligned_target_source[target_id]);
-	  
-      if (! counts.counts.empty() || ! counts.aligned.empty()) {
-	counts.word = word_type(target_id);
-	
-	queue_ttable_target_source[target_id % queue_ttable_target_source.size()].push_swap(counts);
-      }
+	aligned.swap(Learner::aligned_target_source[target_id]);
+      
+      counts_target_source.insert(target_id, counts, aligned);
     }
 	
     Learner::ttable_counts_source_target.clear();
@@ -494,29 +387,10 @@ struct LearnMapper : public Learner
   }
   
   queue_bitext_type& queue_bitext;
-  queue_ttable_set_type& queue_ttable_source_target;
-  queue_ttable_set_type& queue_ttable_target_source;
+  ttable_counts_shared_type& counts_source_target;
+  ttable_counts_shared_type& counts_target_source;
 };
 
-template <typename TableSet, typename Table>
-inline
-void merge_tables(TableSet& tables, Table& merged)
-{
-  merged.clear();
-
-  size_t size_max = 0;
-  for (size_t i = 0; i != tables.size(); ++ i)
-    size_max = utils::bithack::max(size_max, tables[i].size());
-  
-  merged.reserve(size_max);
-  merged.resize(size_max);
-  
-  for (size_t i = 0; i != tables.size(); ++ i)
-    for (word_type::id_type word_id = 0; word_id != tables[i].size(); ++ word_id)
-      if (tables[i].exists(word_id))
-	merged[word_type(word_id)].swap(tables[i][word_type(word_id)]);
-}
-
 template <typename Learner, typename Maximizer>
 void learn(const Maximizer& maximizer, 
 	   ttable_type& ttable_source_target,
@@ -526,24 +400,21 @@ void learn(const Maximizer& maximizer,
 {
   typedef LearnMapReduce map_reduce_type;
   typedef LearnMapper<Learner> mapper_type;
-  typedef LearnReducer<Maximizer> reducer_type;
   
   typedef map_reduce_type::bitext_type     bitext_type;
   typedef map_reduce_type::bitext_set_type bitext_set_type;
   
-  typedef map_reduce_type::queue_bitext_type      queue_bitext_type;
-  typedef map_reduce_type::queue_ttable_type      queue_ttable_type;
-  typedef map_reduce_type::queue_ttable_set_type  queue_ttable_set_type;
+  typedef map_reduce_type::queue_bitext_type queue_bitext_type;
   
   typedef std::vector<mapper_type, std::allocator<mapper_type> > mapper_set_type;
   
   queue_bitext_type queue_bitext(threads * 64);
-  queue_ttable_set_type queue_ttable_source_target(utils::bithack::max(1, threads / 2));
-  queue_ttable_set_type queue_ttable_target_source(utils::bithack::max(1, threads / 2));
+  ttable_counts_shared_type counts_source_target;
+  ttable_counts_shared_type counts_target_source;
   
   mapper_set_type  mappers(threads, mapper_type(queue_bitext,
-						queue_ttable_source_target,
-						queue_ttable_target_source,
+						counts_source_target,
+						counts_target_source,
 						LearnBase(ttable_source_target, ttable_target_source)));
   
   etable_type etable_source_target(length_source_target);
@@ -555,36 +426,11 @@ void learn(const Maximizer& maximizer,
 
     utils::resource accumulate_start;
 
-    std::vector<ttable_type, std::allocator<ttable_type> > ttable_source_target_new(threads, ttable_type(ttable_source_target.prior,
-													 ttable_source_target.smooth));
-    std::vector<ttable_type, std::allocator<ttable_type> > ttable_target_source_new(threads, ttable_type(ttable_target_source.prior,
-													 ttable_target_source.smooth));
-    
-    std::vector<aligned_type, std::allocator<aligned_type> > aligned_source_target_new(threads);
-    std::vector<aligned_type, std::allocator<aligned_type> > aligned_target_source_new(threads);
-    
     boost::thread_group workers_mapper;
-    boost::thread_group workers_reducer_source_target;
-    boost::thread_group workers_reducer_target_source;
     
     for (size_t i = 0; i != mappers.size(); ++ i)
       workers_mapper.add_thread(new boost::thread(boost::ref(mappers[i])));
     
-    for (size_t i = 0; i != queue_ttable_source_target.size(); ++ i)
-      workers_reducer_source_target.add_thread(new boost::thread(reducer_type(queue_ttable_source_target[i],
-									      ttable_source_target,
-									      aligned_source_target,
-									      ttable_source_target_new[i],
-									      aligned_source_target_new[i],
-									      maximizer)));
-    for (size_t i = 0; i != queue_ttable_target_source.size(); ++ i)
-      workers_reducer_target_source.add_thread(new boost::thread(reducer_type(queue_ttable_target_source[i],
-									      ttable_target_source,
-									      aligned_target_source,
-									      ttable_target_source_new[i],
-									      aligned_target_source_new[i],
-									      maximizer)));
-    
     utils::compress_istream is_src(source_file, 1024 * 1024);
     utils::compress_istream is_trg(target_file, 1024 * 1024);
     std::auto_ptr<std::istream> is_align(! alignment_file.empty()
@@ -651,13 +497,6 @@ void learn(const Maximizer& maximizer,
     
     workers_mapper.join_all();
     
-    // send termination to reducer by sending nulls
-    for (size_t i = 0; i != queue_ttable_source_target.size(); ++ i)
-      queue_ttable_source_target[i].push(queue_ttable_type::value_type());
-    
-    for (size_t i = 0; i != queue_ttable_target_source.size(); ++ i)
-      queue_ttable_target_source[i].push(queue_ttable_type::value_type());
-    
     objective_source_target /= num_bitext;
     objective_target_source /= num_bitext;
     
@@ -681,14 +520,9 @@ void learn(const Maximizer& maximizer,
     etable_source_target.assign(length_source_target);
     etable_target_source.assign(length_target_source);
     
-    workers_reducer_source_target.join_all();
-    workers_reducer_target_source.join_all();
-    
-    // merge ttable and aligned...
-    merge_tables(ttable_source_target_new, ttable_source_target);
-    merge_tables(ttable_target_source_new, ttable_target_source);
-    merge_tables(aligned_source_target_new, aligned_source_target);
-    merge_tables(aligned_target_source_new, aligned_target_source);
+    // M-step from the shared counts
+    maximize_shared(counts_source_target, ttable_source_target, aligned_source_target, maximizer, threads);
+    maximize_shared(counts_target_source, ttable_target_source, aligned_target_source, maximizer, threads);
 
     utils::resource accumulate_end;
     
@@ -58,6 +58,8 @@ bool score_ghkm   = false;
 
 double max_malloc = 8; // 8 GB
 int    threads = 1;
+bool   uncompressed = false;
+bool   lz4 = false;
 
 int debug = 0;
 
@@ -284,15 +286,74 @@ struct progress_mapper : public Mapper
 
 struct TaskMerge
 {
+  typedef PhrasePair       rule_pair_type;
+  typedef PhrasePairParser rule_pair_parser_type;
+
   TaskMerge(path_set_type& __files,
 	    const path_type& __prefix,
 	    const size_t& __size) : files(__files), prefix(__prefix), size(__size) {}
   
-  void operator()()
+  template <typename Tp>
+  struct greater_buffer
   {
-    typedef PhrasePair       rule_pair_type;
-    typedef PhrasePairParser rule_pair_parser_type;
+    bool operator()(const Tp* x, const Tp* y) const
+    {
+      return x->first > y->first;
+    }
+  };
 
+  // merge counts from streams into os in a single pass...
+  void merge_counts(const path_set_type& paths, std::ostream& os)
+  {
+    typedef utils::compress_istream         istream_type;
+    typedef boost::shared_ptr<istream_type> istream_ptr_type;
+    typedef std::vector<istream_ptr_type, std::allocator<istream_ptr_type> > istream_ptr_set_type;
+    
+    typedef std::pair<rule_pair_type, istream_type*> buffer_stream_type;
+    typedef std::vector<buffer_stream_type, std::allocator<buffer_stream_type> > buffer_stream_set_type;
+    typedef std::vector<buffer_stream_type*, std::allocator<buffer_stream_type*> > pqueue_base_type;
+    typedef std::priority_queue<buffer_stream_type*, pqueue_base_type, greater_buffer<buffer_stream_type> > pqueue_type;
+    
+    pqueue_type            pqueue;
+    istream_ptr_set_type   istreams(paths.size());
+    buffer_stream_set_type buffer_streams(paths.size());
+    
+    for (size_t pos = 0; pos != paths.size(); ++ pos) {
+      istreams[pos].reset(new istream_type(paths[pos], 1024 * 1024));
+      
+      buffer_stream_type* buffer_stream = &buffer_streams[pos];
+      buffer_stream->second = &(*istreams[pos]);
+      
+      if (parser(*buffer_stream->second, buffer_stream->first))
+	pqueue.push(buffer_stream);
+    }
+    
+    rule_pair_type counts;
+    
+    while (! pqueue.empty()) {
+      buffer_stream_type* buffer_stream(pqueue.top());
+      pqueue.pop();
+      
+      rule_pair_type& curr = buffer_stream->first;
+      
+      if (counts.counts.empty() || counts != curr) {
+	if (! counts.counts.empty())
+	  os << counts << '\n';
+	
+	counts.swap(curr);
+      } else
+	counts.increment(curr.counts.begin(), curr.counts.end());
+      
+      if (parser(*buffer_stream->second, buffer_stream->first))
+	pqueue.push(buffer_stream);
+    }
+    
+    if (! counts.counts.empty())
+      os << counts << '\n';
+  }
+  
+  void operator()()
+  {
     typedef utils::unordered_set<path_type, boost::hash<path_type>, std::equal_to<path_type>,
 				 std::allocator<path_type> >::type path_temporary_type;
 
@@ -305,18 +366,20 @@ struct TaskMerge
     for (path_set_type::const_iterator fiter = files.begin(); fiter != fiter_end; ++ fiter)
       size_files.push_back(size_path_type(boost::filesystem::file_size(*fiter), *fiter));
     
-    rule_pair_parser_type parser;
-    
     path_temporary_type temp;
+    path_set_type       merged;
     
     while (size_files.size() > size && size_files.size() >= 2) {
       std::sort(size_files.begin(), size_files.end(), std::greater<size_path_type>());
       
-      const path_type file1 = size_files.back().second;
-      size_files.pop_back();
+      // merge the smallest files so that the merged one and the rest fit in size, but do not open more than size at once
+      const size_t merge_size = utils::bithack::max(utils::bithack::min(size_files.size() - size + 1, size), size_t(2));
       
-      const path_type file2 = size_files.back().second;
-      size_files.pop_back();
+      merged.clear();
+      for (size_t i = 0; i != merge_size; ++ i) {
+	merged.push_back(size_files.back().second);
+	size_files.pop_back();
+      }
       
       const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.merged.XXXXXX");
       utils::tempfile::insert(counts_file_tmp);
@@ -326,57 +389,18 @@ struct TaskMerge
       temp.insert(counts_file);
 
       {
-	utils::compress_istream is1(file1, 1024 * 1024);
-	utils::compress_istream is2(file2, 1024 * 1024);
-      
 	utils::compress_ostream os(counts_file, 1024 * 1024);
 	os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
-      
-	std::string line1;
-	std::string line2;
-
-	rule_pair_type rule1;
-	rule_pair_type rule2;
-      
-	bool parsed1 = utils::getline(is1, line1) && parser(line1, rule1);
-	bool parsed2 = utils::getline(is2, line2) && parser(line2, rule2);
-      
-	while (parsed1 && parsed2) {
-	  if (rule1 < rule2) {
-	    os << rule1 << '\n';
-	    parsed1 = utils::getline(is1, line1) && parser(line1, rule1);
-	  } else if (rule2 < rule1) {
-	    os << rule2 << '\n';
-	    parsed2 = utils::getline(is2, line2) && parser(line2, rule2);
-	  } else {
-	    rule1.increment(rule2.counts.begin(), rule2.counts.end());
-	    os << rule1 << '\n';
-	    parsed1 = utils::getline(is1, line1) && parser(line1, rule1);
-	    parsed2 = utils::getline(is2, line2) && parser(line2, rule2);
-	  }
-	}
-      
-	// dump remaining...
-	while (parsed1) {
-	  os << rule1 << '\n';
-	  parsed1 = utils::getline(is1, line1) && parser(line1, rule1);
-	}
-      
-	while (parsed2) {
-	  os << rule2 << '\n';
-	  parsed2 = utils::getline(is2, line2) && parser(line2, rule2);
-	}
-      }
-      
-      if (temp.find(file1) != temp.end()) {
-	boost::filesystem::remove(file1);
-	utils::tempfile::erase(file1);
+	
+	merge_counts(merged, os);
       }
       
-      if (temp.find(file2) != temp.end()) {
-	boost::filesystem::remove(file2);
-	utils::tempfile::erase(file2);
-      }
+      path_set_type::const_iterator miter_end = merged.end();
+      for (path_set_type::const_iterator miter = merged.begin(); miter != miter_end; ++ miter)
+	if (temp.find(*miter) != temp.end()) {
+	  boost::filesystem::remove(*miter);
+	  utils::tempfile::erase(*miter);
+	}
       
       size_files.push_back(size_path_type(boost::filesystem::file_size(counts_file), counts_file));
     }
@@ -388,6 +412,8 @@ struct TaskMerge
       files.push_back(siter->second);
   }
   
+  rule_pair_parser_type parser;
+  
   path_set_type& files;
   path_type      prefix;
   size_t         size;
@@ -534,6 +560,8 @@ void target_counts(const path_map_type& reversed_files,
 						       threads,
 						       max_malloc,
 						       utils::bithack::max((max_files + threads - 1) / threads, 1),
+						       ! uncompressed,
+						       lz4,
 						       debug)));
   
   boost::thread_group mappers;
@@ -618,6 +646,8 @@ void source_counts(const path_set_type& counts_files,
 						       joint_counts[shard],
 						       source_counts[shard],
 						       max_malloc,
+						       ! uncompressed,
+						       lz4,
 						       debug)));  
   
   boost::thread_group mappers;
@@ -695,6 +725,8 @@ void reverse_counts(const path_set_type& counts_files,
 						       threads,
 						       max_malloc,
 						       utils::bithack::max((max_files + threads - 1) / threads, 1),
+						       ! uncompressed,
+						       lz4,
 						       debug)));
 
   boost::thread_group mappers;
@@ -732,6 +764,8 @@ void options(int argc, char** argv)
     
     ("max-malloc", po::value<double>(&max_malloc), "maximum malloc in GB")
     ("threads", po::value<int>(&threads), "# of threads")
+    ("uncompressed", po::bool_switch(&uncompressed), "do not compress temporary files by gzip")
+    ("lz4", po::bool_switch(&lz4), "compress temporary files by LZ4, not by gzip")
     
     ;
   
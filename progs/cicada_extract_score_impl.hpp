@@ -27,8 +27,10 @@
 
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/file.hpp>
 
 #include <string>
 #include <vector>
@@ -846,6 +848,332 @@ struct PhraseCountGenerator
   }
 };
 
+// binary records for the temporary files of the score pipeline, which are written and read only by
+// the map-reducers below: each record is prefixed by its byte length, followed by the length-prefixed
+// phrases and the counts as raw doubles, where the lengths are byte-aligned codes.
+// Only the temporary files are binary: the extractor's output is still text, which is parsed once
+// when merged. The phrases are kept as raw bytes, not as vocabulary ids, so that the records are
+// ordered by the same operator< as their parsed counterparts, and are read without the vocabulary
+// of the process which wrote them.
+// Files with the extension ".gz" are gzip compressed, as were the text temporary files, and those
+// with ".lz4" are compressed by the LZ4 block codec, which is faster but compresses less.
+struct PhraseRecord
+{
+  typedef boost::filesystem::path path_type;
+  typedef std::string             buffer_type;
+  typedef uint64_t                length_type;
+
+  static bool compressed(const path_type& path)
+  {
+    return path.extension() == ".gz" || path.extension() == ".lz4";
+  }
+
+  static const char* extension(const bool compress, const bool lz4=false)
+  {
+    return (compress ? (lz4 ? ".lz4" : ".gz") : ".bin");
+  }
+
+  // read a length-prefixed record into buffer. false if no more records
+  static bool read(std::istream& is, buffer_type& buffer)
+  {
+    typedef std::istream::traits_type traits_type;
+
+    std::streambuf* sbuf = is.rdbuf();
+
+    length_type length = 0;
+    for (int shift = 0; /**/; shift += 7) {
+      const traits_type::int_type c = sbuf->sbumpc();
+
+      if (traits_type::eq_int_type(c, traits_type::eof())) {
+	if (shift)
+	  throw std::runtime_error("truncated record length");
+	return false;
+      }
+
+      length |= length_type(c & 0x7f) << shift;
+
+      if (! (c & 0x80)) break;
+
+      if (shift > 63)
+	throw std::runtime_error("invalid record length");
+    }
+
+    buffer.resize(length);
+    if (length && sbuf->sgetn(&(*buffer.begin()), length) != static_cast<std::streamsize>(length))
+      throw std::runtime_error("truncated record");
+
+    return true;
+  }
+
+  static void write(std::ostream& os, const buffer_type& buffer)
+  {
+    char code[16];
+
+    os.write(code, utils::byte_aligned_encode(length_type(buffer.size()), code));
+    os.write(buffer.data(), buffer.size());
+  }
+
+  static void encode(buffer_type& buffer, const length_type& length)
+  {
+    char code[16];
+
+    buffer.append(code, utils::byte_aligned_encode(length, code));
+  }
+
+  static void encode(buffer_type& buffer, const std::string& phrase)
+  {
+    encode(buffer, length_type(phrase.size()));
+    buffer.append(phrase);
+  }
+
+  template <typename Counts>
+  static void encode_counts(buffer_type& buffer, const Counts& counts)
+  {
+    encode(buffer, length_type(counts.size()));
+    if (! counts.empty())
+      buffer.append(reinterpret_cast<const char*>(&(*counts.begin())), sizeof(double) * counts.size());
+  }
+
+  static const char* decode(const char* first, const char* last, length_type& length)
+  {
+    if (first == last)
+      throw std::runtime_error("truncated record");
+
+    first += utils::byte_aligned_decode(length, first);
+
+    if (first > last)
+      throw std::runtime_error("truncated record");
+
+    return first;
+  }
+
+  static const char* decode(const char* first, const char* last, std::string& phrase)
+  {
+    length_type length = 0;
+    first = decode(first, last, length);
+
+    if (length > length_type(last - first))
+      throw std::runtime_error("truncated record");
+
+    phrase.assign(first, first + length);
+    return first + length;
+  }
+
+  template <typename Counts>
+  static const char* decode_counts(const char* first, const char* last, Counts& counts)
+  {
+    length_type length = 0;
+    first = decode(first, last, length);
+
+    if (length * sizeof(double) > length_type(last - first))
+      throw std::runtime_error("truncated record");
+
+    counts.resize(length);
+    if (length)
+      std::memcpy(&(*counts.begin()), first, sizeof(double) * length);
+    return first + sizeof(double) * length;
+  }
+};
+
+class PhraseRecordOstream : public boost::iostreams::filtering_ostream
+{
+public:
+  typedef boost::filesystem::path path_type;
+
+public:
+  PhraseRecordOstream(const path_type& path, size_t buffer_size = 4096)
+  {
+    if (path.extension() == ".lz4")
+      push(codec::lz4_compressor());
+    else if (path.extension() == ".gz")
+      push(boost::iostreams::gzip_compressor());
+    push(boost::iostreams::file_sink(path.string(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary), buffer_size);
+  }
+};
+
+class PhraseRecordIstream : public boost::iostreams::filtering_istream
+{
+public:
+  typedef boost::filesystem::path path_type;
+
+public:
+  PhraseRecordIstream(const path_type& path, size_t buffer_size = 4096)
+  {
+    if (path.extension() == ".lz4")
+      push(codec::lz4_decompressor());
+    else if (path.extension() == ".gz")
+      push(boost::iostreams::gzip_decompressor());
+    push(boost::iostreams::file_source(path.string(), std::ios_base::in | std::ios_base::binary), buffer_size);
+  }
+};
+
+struct PhrasePairSimpleRecordParser
+{
+  typedef PhrasePairSimple phrase_pair_type;
+
+  bool operator()(std::istream& is, phrase_pair_type& phrase_pair)
+  {
+    phrase_pair.clear();
+
+    if (! PhraseRecord::read(is, buffer)) return false;
+
+    const char* first = buffer.data();
+    const char* last  = first + buffer.size();
+
+    first = PhraseRecord::decode(first, last, phrase_pair.source);
+    first = PhraseRecord::decode(first, last, phrase_pair.target);
+    first = PhraseRecord::decode_counts(first, last, phrase_pair.counts);
+
+    if (first != last)
+      throw std::runtime_error("invalid phrase pair record");
+
+    return true;
+  }
+
+  PhraseRecord::buffer_type buffer;
+};
+
+struct PhrasePairSimpleRecordGenerator
+{
+  typedef PhrasePairSimple phrase_pair_type;
+
+  std::ostream& operator()(std::ostream& os, const phrase_pair_type& phrase_pair)
+  {
+    buffer.clear();
+
+    PhraseRecord::encode(buffer, phrase_pair.source);
+    PhraseRecord::encode(buffer, phrase_pair.target);
+    PhraseRecord::encode_counts(buffer, phrase_pair.counts);
+
+    PhraseRecord::write(os, buffer);
+
+    return os;
+  }
+
+  PhraseRecord::buffer_type buffer;
+};
+
+struct PhraseCountRecordParser
+{
+  typedef PhraseCount phrase_count_type;
+
+  bool operator()(std::istream& is, phrase_count_type& phrase_count)
+  {
+    phrase_count.clear();
+
+    if (! PhraseRecord::read(is, buffer)) return false;
+
+    const char* first = buffer.data();
+    const char* last  = first + buffer.size();
+
+    first = PhraseRecord::decode(first, last, phrase_count.phrase);
+    first = PhraseRecord::decode_counts(first, last, phrase_count.counts);
+
+    if (first != last)
+      throw std::runtime_error("invalid phrase count record");
+
+    return true;
+  }
+
+  PhraseRecord::buffer_type buffer;
+};
+
+struct PhraseCountRecordGenerator
+{
+  typedef PhraseCount phrase_count_type;
+
+  std::ostream& operator()(std::ostream& os, const phrase_count_type& phrase_count)
+  {
+    buffer.clear();
+
+    PhraseRecord::encode(buffer, phrase_count.phrase);
+    PhraseRecord::encode_counts(buffer, phrase_count.counts);
+
+    PhraseRecord::write(os, buffer);
+
+    return os;
+  }
+
+  PhraseRecord::buffer_type buffer;
+};
+
+// merge sorted runs of phrase pair records in a single pass by a heap over the runs, and the counts of
+// the same phrase pair are summed.
+struct PhrasePairSimpleMerger
+{
+  typedef boost::filesystem::path                            path_type;
+  typedef std::vector<path_type, std::allocator<path_type> > path_set_type;
+
+  typedef PhrasePairSimple simple_type;
+
+  typedef PhrasePairSimpleRecordParser    parser_type;
+  typedef PhrasePairSimpleRecordGenerator generator_type;
+
+  template <typename Tp>
+  struct greater_buffer
+  {
+    bool operator()(const Tp* x, const Tp* y) const
+    {
+      return x->first > y->first;
+    }
+  };
+
+  void operator()(const path_set_type& paths, const path_type& path)
+  {
+    typedef PhraseRecordIstream             istream_type;
+    typedef boost::shared_ptr<istream_type> istream_ptr_type;
+    typedef std::vector<istream_ptr_type, std::allocator<istream_ptr_type> > istream_ptr_set_type;
+
+    typedef std::pair<simple_type, istream_type*> buffer_stream_type;
+    typedef std::vector<buffer_stream_type, std::allocator<buffer_stream_type> > buffer_stream_set_type;
+    typedef std::vector<buffer_stream_type*, std::allocator<buffer_stream_type*> > pqueue_base_type;
+    typedef std::priority_queue<buffer_stream_type*, pqueue_base_type, greater_buffer<buffer_stream_type> > pqueue_type;
+
+    pqueue_type            pqueue;
+    istream_ptr_set_type   istreams(paths.size());
+    buffer_stream_set_type buffer_streams(paths.size());
+
+    for (size_t pos = 0; pos != paths.size(); ++ pos) {
+      istreams[pos].reset(new istream_type(paths[pos], 1024 * 1024));
+
+      buffer_stream_type* buffer_stream = &buffer_streams[pos];
+      buffer_stream->second = &(*istreams[pos]);
+
+      if (parser(*buffer_stream->second, buffer_stream->first))
+	pqueue.push(buffer_stream);
+    }
+
+    PhraseRecordOstream os(path, 1024 * 1024);
+    os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
+
+    simple_type counts;
+
+    while (! pqueue.empty()) {
+      buffer_stream_type* buffer_stream(pqueue.top());
+      pqueue.pop();
+
+      simple_type& curr = buffer_stream->first;
+
+      if (counts.counts.empty() || counts != curr) {
+	if (! counts.counts.empty())
+	  generator(os, counts);
+
+	counts.swap(curr);
+      } else
+	counts.increment(curr.counts.begin(), curr.counts.end());
+
+      if (parser(*buffer_stream->second, buffer_stream->first))
+	pqueue.push(buffer_stream);
+    }
+
+    if (! counts.counts.empty())
+      generator(os, counts);
+  }
+
+  parser_type    parser;
+  generator_type generator;
+};
+
 struct PhrasePairExtractor
 {
   typedef uint64_t                            hash_value_type;
@@ -1171,12 +1499,10 @@ struct PhrasePairSourceReducer
   typedef map_reduce_type::queue_ptr_type     queue_ptr_type;
   typedef map_reduce_type::queue_ptr_set_type queue_ptr_set_type;
   
-  typedef PhraseCountParser    phrase_count_parser_type;
-  typedef PhraseCountGenerator phrase_count_generator_type;
+  typedef PhraseCountRecordGenerator phrase_count_generator_type;
   
   typedef ExtractRoot extract_root_type;
   
-  phrase_count_parser_type    parser;
   phrase_count_generator_type generator;
 
   queue_ptr_set_type& queues;
@@ -1190,6 +1516,8 @@ struct PhrasePairSourceReducer
   extract_root_type extract_root;
   
   double              max_malloc;
+  bool                compress;
+  bool                lz4;
   int                 debug;
   
   PhrasePairSourceReducer(queue_ptr_set_type&  __queues,
@@ -1198,6 +1526,8 @@ struct PhrasePairSourceReducer
 			  root_count_set_type& __joint_counts,
 			  root_count_set_type& __root_counts,
 			  const double __max_malloc,
+			  const bool   __compress,
+			  const bool   __lz4,
 			  const int    __debug)
     : queues(__queues),
       prefix(__prefix),
@@ -1205,6 +1535,8 @@ struct PhrasePairSourceReducer
       joint_counts(__joint_counts),
       root_counts(__root_counts),
       max_malloc(__max_malloc),
+      compress(__compress),
+      lz4(__lz4),
       debug(__debug) {}
   
   template <typename Tp>
@@ -1266,13 +1598,13 @@ struct PhrasePairSourceReducer
     {
       const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.source.XXXXXX");
       utils::tempfile::insert(counts_file_tmp);
-      const path_type counts_file = counts_file_tmp.string() + ".gz";
+      const path_type counts_file = counts_file_tmp.string() + PhraseRecord::extension(compress, lz4);
       utils::tempfile::insert(counts_file);
       
       path = counts_file;
     }
     
-    utils::compress_ostream os(path, 1024 * 1024);
+    PhraseRecordOstream os(path, 1024 * 1024);
     os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
     
     simple_type counts;
@@ -1292,7 +1624,7 @@ struct PhrasePairSourceReducer
 	if (observed) {
 	  counts.counts.push_back(observed);
 	  
-	  generator(os, phrase_count_type(counts.source, counts.counts)) << '\n';
+	  generator(os, phrase_count_type(counts.source, counts.counts));
 	}
 
 	root_source = extract_root(curr.source);
@@ -1341,7 +1673,7 @@ struct PhrasePairSourceReducer
     if (observed) {
       counts.counts.push_back(observed);
       
-      generator(os, phrase_count_type(counts.source, counts.counts)) << '\n';
+      generator(os, phrase_count_type(counts.source, counts.counts));
     }
     
     progress.final();
@@ -1602,8 +1934,8 @@ struct PhrasePairReverseReducer
   typedef map_reduce_type::queue_ptr_type     queue_ptr_type;
   typedef map_reduce_type::queue_ptr_set_type queue_ptr_set_type;
   
-  typedef PhrasePairSimpleParser    simple_parser_type;
-  typedef PhrasePairSimpleGenerator simple_generator_type;
+  typedef PhrasePairSimpleRecordGenerator simple_generator_type;
+  typedef PhrasePairSimpleMerger          simple_merger_type;
 
   typedef utils::unordered_set<simple_type, boost::hash<simple_type>, std::equal_to<simple_type>,
 			       std::allocator<simple_type> >::type simple_unique_type;
@@ -1635,8 +1967,8 @@ struct PhrasePairReverseReducer
 			     string_hash, std::equal_to<std::string>,
 			     std::allocator<std::string> > unique_set_type;
   
-  simple_parser_type    parser;
   simple_generator_type generator;
+  simple_merger_type    merger;
 
   queue_type&    queue;
   path_type      prefix;
@@ -1645,6 +1977,8 @@ struct PhrasePairReverseReducer
   int            shard_size;
   double         max_malloc;
   size_t         max_files;
+  bool           compress;
+  bool           lz4;
   int            debug;
   
   PhrasePairReverseReducer(queue_type&    __queue,
@@ -1653,6 +1987,8 @@ struct PhrasePairReverseReducer
 			   const int      __shard_size,
 			   const double   __max_malloc,
 			   const int      __max_files,
+			   const bool     __compress,
+			   const bool     __lz4,
 			   const int      __debug)
     : queue(__queue),
       prefix(__prefix),
@@ -1660,6 +1996,8 @@ struct PhrasePairReverseReducer
       shard_size(__shard_size),
       max_malloc(__max_malloc),
       max_files(__max_files),
+      compress(__compress),
+      lz4(__lz4),
       debug(__debug)
   {
     if (__max_files <= 0)
@@ -1675,47 +2013,7 @@ struct PhrasePairReverseReducer
   };
 
 
-  // merge counts from two streams into os..
-  void merge_counts(std::istream& is1, std::istream& is2, std::ostream& os)
-  {
-    std::string line1;
-    std::string line2;
-    simple_type simple1;
-    simple_type simple2;
-    
-    bool parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-    bool parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-    
-    while (parsed1 && parsed2) {
-      if (simple1 < simple2) {
-	generator(os, simple1) << '\n';
-	parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-      } else if (simple2 < simple1) {
-	generator(os, simple2) << '\n';
-	parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-      } else {
-	simple1.increment(simple2.counts.begin(), simple2.counts.end());
-	generator(os, simple1) << '\n';
-	
-	parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-	parsed2 = utils::getline(is2, line2) && parser(line2, simple2);	
-      }
-    }
-    
-    // dump remaining...
-    while (parsed1) {
-      generator(os, simple1) << '\n';
-      parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-    }
-    
-    while (parsed2) {
-      generator(os, simple2) << '\n';
-      parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-    }
-  }
-  
-  
-  // merge from smallest files...
+  // merge the smallest runs by a single-pass k-way merge until we have at most max_files runs
   void merge_counts(path_set_type& paths)
   {
     typedef std::pair<size_t, path_type> size_path_type;
@@ -1728,38 +2026,35 @@ struct PhrasePairReverseReducer
     path_set_type::const_iterator piter_end = paths.end();
     for (path_set_type::const_iterator piter = paths.begin(); piter != piter_end; ++ piter)
       size_paths.push_back(size_path_type(boost::filesystem::file_size(*piter), *piter));
-
+    
+    path_set_type merged;
+    
     while (size_paths.size() > max_files) {
       
       // sort according to the file-size...
       std::sort(size_paths.begin(), size_paths.end(), std::greater<size_path_type>());
       
-      const path_type file1 = size_paths.back().second;
-      size_paths.pop_back();
+      // the merged run and the rest fit in max_files, but we will not open more than max_files at once
+      const size_t merge_size = utils::bithack::max(utils::bithack::min(size_paths.size() - max_files + 1, max_files), size_t(2));
       
-      const path_type file2 = size_paths.back().second;
-      size_paths.pop_back();
+      merged.clear();
+      for (size_t i = 0; i != merge_size; ++ i) {
+	merged.push_back(size_paths.back().second);
+	size_paths.pop_back();
+      }
       
       const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.reversed.XXXXXX");
       utils::tempfile::insert(counts_file_tmp);
-      const path_type counts_file = counts_file_tmp.string() + ".gz";
+      const path_type counts_file = counts_file_tmp.string() + PhraseRecord::extension(compress, lz4);
       utils::tempfile::insert(counts_file);
       
-      {
-	utils::compress_istream is1(file1, 1024 * 1024);
-	utils::compress_istream is2(file2, 1024 * 1024);
-	
-	utils::compress_ostream os(counts_file, 1024 * 1024);
-	os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
-	
-	merge_counts(is1, is2, os);
-      }
-      
-      boost::filesystem::remove(file1);
-      boost::filesystem::remove(file2);
+      merger(merged, counts_file);
       
-      utils::tempfile::erase(file1);
-      utils::tempfile::erase(file2);
+      path_set_type::const_iterator miter_end = merged.end();
+      for (path_set_type::const_iterator miter = merged.begin(); miter != miter_end; ++ miter) {
+	boost::filesystem::remove(*miter);
+	utils::tempfile::erase(*miter);
+      }
       
       size_paths.push_back(size_path_type(boost::filesystem::file_size(counts_file), counts_file));
     }
@@ -1799,18 +2094,18 @@ struct PhrasePairReverseReducer
     // tempfile...
     const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.reversed.XXXXXX");
     utils::tempfile::insert(counts_file_tmp);
-    const path_type counts_file = counts_file_tmp.string() + ".gz";
+    const path_type counts_file = counts_file_tmp.string() + PhraseRecord::extension(compress, lz4);
     utils::tempfile::insert(counts_file);
     
     paths.push_back(counts_file);
 
     // final dump!
-    utils::compress_ostream os(counts_file, 1024 * 1024);
+    PhraseRecordOstream os(counts_file, 1024 * 1024);
     os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
     
     sorted_type::const_iterator siter_end = sorted.end();
     for (sorted_type::const_iterator siter = sorted.begin(); siter != siter_end; ++ siter)
-      generator(os, *(*siter)) << '\n';
+      generator(os, *(*siter));
   }
 
   struct EmptyProgress
@@ -2070,8 +2365,7 @@ struct PhrasePairTargetMapper
   
   typedef PhraseSet phrase_set_type;
 
-  typedef PhrasePairSimpleParser    simple_parser_type;
-  typedef PhrasePairSimpleGenerator simple_generator_type;
+  typedef PhrasePairSimpleRecordParser simple_parser_type;
   
   typedef ExtractRoot extract_root_type;
   
@@ -2112,18 +2406,13 @@ struct PhrasePairTargetMapper
     }
   };
 
-  simple_parser_type    parser;
-  simple_generator_type generator;
-
-  std::string line;
-  simple_type phrase_pair;
+  simple_parser_type parser;
+  simple_type        phrase_pair;
 
   template <typename Counts>
   void read_phrase_pair(std::istream& is, Counts& counts)
   {    
-    while (counts.size() < 256 && utils::getline(is, line)) {
-      if (! parser(line, phrase_pair)) continue;
-      
+    while (counts.size() < 256 && parser(is, phrase_pair)) {
       if (counts.empty() || counts.back().source != phrase_pair.source)
 	counts.push_back(phrase_pair);
       else if (counts.back().target != phrase_pair.target) {
@@ -2152,7 +2441,7 @@ struct PhrasePairTargetMapper
   template <typename Progress>
   void operator()(const Progress& progress)
   {
-    typedef utils::compress_istream         istream_type;
+    typedef PhraseRecordIstream             istream_type;
     typedef boost::shared_ptr<istream_type> istream_ptr_type;
     typedef std::vector<istream_ptr_type, std::allocator<istream_ptr_type> > istream_ptr_set_type;
     
@@ -2377,11 +2666,11 @@ struct PhrasePairTargetReducer
 			     string_hash, std::equal_to<std::string>,
 			     std::allocator<std::string> > unique_set_type;
 
-  typedef PhrasePairSimpleParser    simple_parser_type;
-  typedef PhrasePairSimpleGenerator simple_generator_type;
+  typedef PhrasePairSimpleRecordGenerator simple_generator_type;
+  typedef PhrasePairSimpleMerger          simple_merger_type;
 
-  simple_parser_type    parser;
   simple_generator_type generator;
+  simple_merger_type    merger;
   
   queue_type&    queue;
   path_type      prefix;
@@ -2390,6 +2679,8 @@ struct PhrasePairTargetReducer
   int            shard_size;
   double         max_malloc;
   size_t         max_files;
+  bool           compress;
+  bool           lz4;
   int            debug;
   
   PhrasePairTargetReducer(queue_type&    __queue,
@@ -2398,6 +2689,8 @@ struct PhrasePairTargetReducer
 			  const int      __shard_size,
 			  const double   __max_malloc,
 			  const int      __max_files,
+			  const bool     __compress,
+			  const bool     __lz4,
 			  const int      __debug)
     : queue(__queue),
       prefix(__prefix),
@@ -2405,6 +2698,8 @@ struct PhrasePairTargetReducer
       shard_size(__shard_size),
       max_malloc(__max_malloc),
       max_files(__max_files),
+      compress(__compress),
+      lz4(__lz4),
       debug(__debug)
   {
     if (__max_files <= 0)
@@ -2419,52 +2714,12 @@ struct PhrasePairTargetReducer
     }
   };
   
-  // merge counts from two streams into os..
-  void merge_counts(std::istream& is1, std::istream& is2, std::ostream& os)
-  {
-    std::string line1;
-    std::string line2;
-    
-    simple_type simple1;
-    simple_type simple2;
-    
-    bool parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-    bool parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-    
-    while (parsed1 && parsed2) {
-      if (simple1 < simple2) {
-	generator(os, simple1) << '\n';
-	parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-      } else if (simple2 < simple1) {
-	generator(os, simple2) << '\n';
-	parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-      } else {
-	simple1.increment(simple2.counts.begin(), simple2.counts.end());
-	generator(os, simple1) << '\n';
-	
-	parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-	parsed2 = utils::getline(is2, line2) && parser(line2, simple2);	
-      }
-    }
-    
-    // dump remaining...
-    while (parsed1) {
-      generator(os, simple1) << '\n';
-      parsed1 = utils::getline(is1, line1) && parser(line1, simple1);
-    }
-    
-    while (parsed2) {
-      generator(os, simple2) << '\n';
-      parsed2 = utils::getline(is2, line2) && parser(line2, simple2);
-    }
-  }
-  
-  // merge from smallest files...
+  // merge the smallest runs by a single-pass k-way merge until we have at most max_files runs
   void merge_counts(path_set_type& paths)
   {
     typedef std::pair<size_t, path_type> size_path_type;
     typedef std::vector<size_path_type, std::allocator<size_path_type> > size_path_set_type;
-    
+
     if (paths.size() <= max_files) return;
     
     size_path_set_type size_paths;
@@ -2473,41 +2728,38 @@ struct PhrasePairTargetReducer
     for (path_set_type::const_iterator piter = paths.begin(); piter != piter_end; ++ piter)
       size_paths.push_back(size_path_type(boost::filesystem::file_size(*piter), *piter));
     
+    path_set_type merged;
+    
     while (size_paths.size() > max_files) {
       
       // sort according to the file-size...
       std::sort(size_paths.begin(), size_paths.end(), std::greater<size_path_type>());
       
-      const path_type file1 = size_paths.back().second;
-      size_paths.pop_back();
+      // the merged run and the rest fit in max_files, but we will not open more than max_files at once
+      const size_t merge_size = utils::bithack::max(utils::bithack::min(size_paths.size() - max_files + 1, max_files), size_t(2));
       
-      const path_type file2 = size_paths.back().second;
-      size_paths.pop_back();
+      merged.clear();
+      for (size_t i = 0; i != merge_size; ++ i) {
+	merged.push_back(size_paths.back().second);
+	size_paths.pop_back();
+      }
       
       const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.target.XXXXXX");
       utils::tempfile::insert(counts_file_tmp);
-      const path_type counts_file = counts_file_tmp.string() + ".gz";
+      const path_type counts_file = counts_file_tmp.string() + PhraseRecord::extension(compress, lz4);
       utils::tempfile::insert(counts_file);
       
-      {
-	utils::compress_istream is1(file1, 1024 * 1024);
-	utils::compress_istream is2(file2, 1024 * 1024);
-	
-	utils::compress_ostream os(counts_file, 1024 * 1024);
-	os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
-	
-	merge_counts(is1, is2, os);
-      }
-      
-      boost::filesystem::remove(file1);
-      boost::filesystem::remove(file2);
+      merger(merged, counts_file);
       
-      utils::tempfile::erase(file1);
-      utils::tempfile::erase(file2);
+      path_set_type::const_iterator miter_end = merged.end();
+      for (path_set_type::const_iterator miter = merged.begin(); miter != miter_end; ++ miter) {
+	boost::filesystem::remove(*miter);
+	utils::tempfile::erase(*miter);
+      }
       
       size_paths.push_back(size_path_type(boost::filesystem::file_size(counts_file), counts_file));
     }
-
+    
     paths.clear();
     
     size_path_set_type::const_iterator siter_end = size_paths.end();
@@ -2543,18 +2795,18 @@ struct PhrasePairTargetReducer
     // tempfile...
     const path_type counts_file_tmp = utils::tempfile::file_name(prefix / "cicada.extract.target.XXXXXX");
     utils::tempfile::insert(counts_file_tmp);
-    const path_type counts_file = counts_file_tmp.string() + ".gz";
+    const path_type counts_file = counts_file_tmp.string() + PhraseRecord::extension(compress, lz4);
     utils::tempfile::insert(counts_file);
     
     paths.push_back(counts_file);
 
     // final dump!
-    utils::compress_ostream os(counts_file, 1024 * 1024);
+    PhraseRecordOstream os(counts_file, 1024 * 1024);
     os.exceptions(std::ostream::eofbit | std::ostream::failbit | std::ostream::badbit);
     
     sorted_type::const_iterator siter_end = sorted.end();
     for (sorted_type::const_iterator siter = sorted.begin(); siter != siter_end; ++ siter)
-      generator(os, *(*siter)) << '\n';
+      generator(os, *(*siter));
   }
 
   struct EmptyProgress
@@ -2972,8 +3224,8 @@ struct PhrasePairScoreReducer
   typedef map_reduce_type::queue_ptr_type     queue_ptr_type;
   typedef map_reduce_type::queue_ptr_set_type queue_ptr_set_type;  
 
-  typedef PhrasePairSimpleParser    simple_parser_type;
-  typedef PhraseCountParser         phrase_parser_type;
+  typedef PhrasePairSimpleRecordParser simple_parser_type;
+  typedef PhraseCountRecordParser      phrase_parser_type;
   
   const path_type&     path_source;
   const path_set_type& path_targets;
@@ -3085,15 +3337,13 @@ struct PhrasePairScoreReducer
   simple_parser_type simple_parser;
   phrase_parser_type phrase_parser;
 
-  std::string line;
-  simple_type phrase_pair;
+  simple_type       phrase_pair;
+  phrase_count_type phrase;
 
   template <typename Counts>
   void read_phrase_pair(std::istream& is, Counts& counts)
   {
-    while (counts.size() < 256 && utils::getline(is, line)) {
-      if (! simple_parser(line, phrase_pair)) continue;
-      
+    while (counts.size() < 256 && simple_parser(is, phrase_pair)) {
       if (counts.empty() || counts.back().source != phrase_pair.source)
 	counts.push_back(phrase_pair);
       else if (counts.back().target != phrase_pair.target) {
@@ -3107,12 +3357,7 @@ struct PhrasePairScoreReducer
   template <typename Counts>
   void read_phrase(std::istream& is, Counts& counts)
   {
-    std::string line;
-    phrase_count_type phrase;
-    
-    while (counts.size() < 256 && utils::getline(is, line)) {
-      if (! phrase_parser(line, phrase)) continue;
-      
+    while (counts.size() < 256 && phrase_parser(is, phrase)) {
       if (counts.empty() || counts.back().phrase != phrase.phrase)
 	counts.push_back(phrase);
       else
@@ -3142,7 +3387,7 @@ struct PhrasePairScoreReducer
     typedef std::vector<buffer_queue_type*, std::allocator<buffer_queue_type*> > pqueue_base_type;
     typedef std::priority_queue<buffer_queue_type*, pqueue_base_type, greater_buffer<buffer_queue_type> > pqueue_type;
     
-    typedef utils::compress_istream         istream_type;
+    typedef PhraseRecordIstream             istream_type;
     typedef boost::shared_ptr<istream_type> istream_ptr_type;
     typedef std::vector<istream_ptr_type, std::allocator<istream_ptr_type> > istream_ptr_set_type;
     
@@ -3197,7 +3442,7 @@ struct PhrasePairScoreReducer
       }
     }
 
-    utils::compress_istream is_source(path_source, 1024 * 1024);
+    PhraseRecordIstream is_source(path_source, 1024 * 1024);
     phrase_buffer_type buffer_source;
     
     read_phrase(is_source, buffer_source);
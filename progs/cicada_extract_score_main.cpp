@@ -41,4 +41,14 @@ int main(int argc, char** argv)
     std::cout << "parsing failed" << std::endl;
   
   PhrasePairGenerator()(std::cout, phrase_pair) << std::endl;
+
+  std::stringstream stream;
+  PhrasePairSimpleRecordGenerator()(stream, PhrasePairSimple(phrase_pair.source, phrase_pair.target, phrase_pair.counts));
+  PhrasePairSimpleRecordGenerator()(stream, PhrasePairSimple("", "good", phrase_pair.counts));
+  
+  PhrasePairSimpleRecordParser simple_parser;
+  PhrasePairSimple simple;
+  
+  while (simple_parser(stream, simple))
+    PhrasePairSimpleGenerator()(std::cout, simple) << std::endl;
 }
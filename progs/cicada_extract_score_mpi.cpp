@@ -70,6 +70,8 @@ bool score_scfg   = false;
 bool score_ghkm   = false;
 
 double max_malloc = 8; // 8 GB
+bool   uncompressed = false;
+bool   lz4 = false;
 path_type prog_name;
 std::string host;
 std::string hostfile;
@@ -1074,6 +1076,8 @@ void source_counts_reducer(utils::mpi_intercomm& mapper,
 				     root_joint,
 				     root_source,
 				     max_malloc,
+				     ! uncompressed,
+				     lz4,
 				     debug));
   
   simple_type        source;
@@ -1293,7 +1297,7 @@ void target_counts_reducer(utils::mpi_intercomm& mapper,
   const int max_files = number_descriptors() >> 2;
   
   queue_type queue(queue_size);
-  boost::thread reducer(reducer_type(queue, utils::tempfile::tmp_dir(), target_files, 1, max_malloc, max_files, debug));
+  boost::thread reducer(reducer_type(queue, utils::tempfile::tmp_dir(), target_files, 1, max_malloc, max_files, ! uncompressed, lz4, debug));
   
   simple_type target;
   simple_parser_type parser;
@@ -1547,7 +1551,7 @@ void reverse_counts_reducer(utils::mpi_intercomm& mapper,
   const int max_files = number_descriptors() >> 2;
   
   queue_type queue(queue_size);
-  boost::thread reducer(reducer_type(queue, output_file, reversed_files, 1, max_malloc, max_files, debug));
+  boost::thread reducer(reducer_type(queue, output_file, reversed_files, 1, max_malloc, max_files, ! uncompressed, lz4, debug));
   
   simple_type reversed;
   simple_parser_type parser;
@@ -1628,6 +1632,8 @@ void options(int argc, char** argv)
     ("score-ghkm",   po::bool_switch(&score_ghkm),   "score ghkm fragment counts")
     
     ("max-malloc", po::value<double>(&max_malloc),    "maximum malloc in GB")
+    ("uncompressed", po::bool_switch(&uncompressed),  "do not compress temporary files by gzip")
+    ("lz4",          po::bool_switch(&lz4),           "compress temporary files by LZ4, not by gzip")
     ("prog",       po::value<path_type>(&prog_name),  "this binary")
     ("host",       po::value<std::string>(&host),     "host name")
     ("hostfile",   po::value<std::string>(&hostfile), "hostfile name")
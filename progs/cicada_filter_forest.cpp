@@ -0,0 +1,167 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// convert hypergraphs between the JSON and the compact binary format
+//
+// We accept one hypergraph per line, optionally prefixed by "id ||| " and followed by
+// other " ||| " separated fields, which are copied verbatim.
+// An uncompressed input file is memory-mapped so that lines are not buffered, but
+// each hypergraph is still decoded into (copied to) a HyperGraph.
+//
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cicada/hypergraph.hpp"
+#include "cicada/hypergraph_binary.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "utils/program_options.hpp"
+#include "utils/compress_stream.hpp"
+#include "utils/map_file.hpp"
+#include "utils/piece.hpp"
+#include "utils/getline.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef cicada::HyperGraph hypergraph_type;
+
+typedef boost::filesystem::path path_type;
+
+path_type input_file = "-";
+path_type output_file = "-";
+
+bool binary_mode = false;
+bool json_mode = false;
+
+int debug = 0;
+
+void options(int argc, char** argv);
+
+struct Convert
+{
+  Convert(const bool __binary) : binary(__binary), num(0) {}
+
+  void operator()(const utils::piece& line, std::ostream& os)
+  {
+    utils::piece::const_iterator first = line.begin();
+    utils::piece::const_iterator last  = line.end();
+
+    // skip "id ||| " prefix, if any
+    utils::piece::const_iterator iter = first;
+    for (/**/; iter != last && (*iter == ' ' || *iter == '\t'); ++ iter) ;
+
+    if (iter != last && *iter != '{' && ! cicada::hypergraph_binary_detect(iter, last)) {
+      const char* separator = " ||| ";
+
+      iter = std::search(first, last, separator, separator + 5);
+      if (iter == last)
+	throw std::runtime_error("invalid hypergraph line: " + std::string(first, std::min(last, first + 64)));
+      iter += 5;
+    }
+
+    os.write(first, iter - first);
+
+    if (! graph.assign(iter, last))
+      throw std::runtime_error("invalid hypergraph at line: " + utils::lexical_cast<std::string>(num));
+
+    if (binary)
+      cicada::hypergraph_binary_encode(os, graph);
+    else
+      os << graph;
+
+    // remaining fields
+    os.write(iter, last - iter);
+    os << '\n';
+
+    ++ num;
+  }
+
+  const bool binary;
+  size_t num;
+  hypergraph_type graph;
+};
+
+int main(int argc, char** argv)
+{
+  try {
+    options(argc, argv);
+
+    if (binary_mode && json_mode)
+      throw std::runtime_error("either one of --binary or --json");
+    if (! binary_mode && ! json_mode)
+      binary_mode = true;
+
+    Convert convert(binary_mode);
+
+    utils::compress_ostream os(output_file, 1024 * 1024);
+
+    if (input_file != "-"
+	&& boost::filesystem::is_regular_file(input_file)
+	&& utils::impl::compress_iformat(input_file) == utils::impl::COMPRESS_STREAM_UNKNOWN) {
+      // split lines directly from the mapped file, without line buffering
+      utils::map_file<char> mapped(input_file);
+
+      utils::map_file<char>::const_iterator iter = mapped.begin();
+      utils::map_file<char>::const_iterator end  = mapped.end();
+
+      while (iter != end) {
+	utils::map_file<char>::const_iterator next = static_cast<const char*>(std::memchr(iter, '\n', end - iter));
+	if (! next)
+	  next = end;
+
+	if (next != iter)
+	  convert(utils::piece(iter, next), os);
+
+	iter = (next == end ? end : next + 1);
+      }
+    } else {
+      utils::compress_istream is(input_file, 1024 * 1024);
+
+      std::string line;
+      while (utils::getline(is, line))
+	if (! line.empty())
+	  convert(line, os);
+    }
+
+    if (debug)
+      std::cerr << "# of hypergraphs: " << convert.num << std::endl;
+  }
+  catch (std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void options(int argc, char** argv)
+{
+  namespace po = boost::program_options;
+
+  po::options_description desc("options");
+  desc.add_options()
+    ("input",  po::value<path_type>(&input_file)->default_value(input_file),   "input file")
+    ("output", po::value<path_type>(&output_file)->default_value(output_file), "output")
+
+    ("binary", po::bool_switch(&binary_mode), "convert into the binary hypergraph format (default)")
+    ("json",   po::bool_switch(&json_mode),   "convert into the JSON hypergraph format")
+
+    ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
+
+    ("help", "help message");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << argv[0] << " [options]" << '\n' << desc << '\n';
+    exit(0);
+  }
+}
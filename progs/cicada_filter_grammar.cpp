@@ -0,0 +1,106 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+// filter an indexed grammar by a test set, and write the sub-grammar in the same binary format
+
+#include <cstdlib>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "cicada/grammar_static.hpp"
+
+#include "utils/program_options.hpp"
+#include "utils/resource.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+
+typedef boost::program_options::variables_map variable_set_type;
+
+int debug = 0;
+
+void options(int argc, char** argv, variable_set_type& variables);
+
+int main(int argc, char** argv)
+{
+  try {
+    variable_set_type variables;
+    options(argc, argv, variables);
+
+    if (variables.count("temporary") && ! variables["temporary"].as<std::string>().empty())
+      ::setenv("TMPDIR_SPEC", variables["temporary"].as<std::string>().data(), 1);
+    
+    if (! variables.count("grammar"))
+      throw std::runtime_error("no grammar");
+    if (! variables.count("output"))
+      throw std::runtime_error("no output file");
+    
+    const std::string grammar_path = variables["grammar"].as<std::string>();
+    const std::string input_path   = variables["input"].as<std::string>();
+    const std::string output_path  = variables["output"].as<std::string>();
+    
+    const bool input_lattice = variables.count("input-lattice") && variables["input-lattice"].as<bool>();
+    
+    utils::resource start;
+    
+    cicada::GrammarStatic grammar(grammar_path);
+    
+    utils::resource loaded;
+    
+    grammar.filter(input_path, input_lattice);
+    
+    utils::resource filtered;
+    
+    if (variables.count("quantize") && variables["quantize"].as<bool>())
+      grammar.quantize();
+    
+    grammar.write(output_path);
+    
+    utils::resource end;
+    
+    if (debug)
+      std::cerr << "load cpu time: " << (loaded.cpu_time() - start.cpu_time())
+		<< " user time: " << (loaded.user_time() - start.user_time()) << std::endl
+		<< "filter cpu time: " << (filtered.cpu_time() - loaded.cpu_time())
+		<< " user time: " << (filtered.user_time() - loaded.user_time()) << std::endl
+		<< "write cpu time: " << (end.cpu_time() - filtered.cpu_time())
+		<< " user time: " << (end.user_time() - filtered.user_time()) << std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void options(int argc, char** argv, variable_set_type& variables)
+{
+  namespace po = boost::program_options;
+  
+  po::options_description desc("options");
+  desc.add_options()
+    ("grammar",       po::value<std::string>(),                     "indexed (or text) grammar")
+    ("input",         po::value<std::string>()->default_value("-"), "input sentences (or lattices)")
+    ("output",        po::value<std::string>(),                     "filtered grammar in binary format")
+    ("temporary",     po::value<std::string>(),                     "temporary directory")
+    ("input-lattice", utils::true_false_switch(),                   "input is lattices")
+    ("quantize",      utils::true_false_switch(),                   "perform quantization")
+    
+    ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
+    
+    ("help", "help message");
+
+  po::store(po::parse_command_line(argc, argv, desc, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), variables);
+  
+  po::notify(variables);
+  
+  if (variables.count("help")) {
+    std::cout << argv[0] << " [options]\n"
+	      << desc << std::endl;
+    exit(0);
+  }
+}
@@ -0,0 +1,212 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// append k-best directories to a binary k-best store, each as a block:
+// hypotheses of each <i>.gz are made unique, and, when a refset is given,
+// the sufficient statistics of the scorer are precomputed.
+//
+
+#include <cstdlib>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cicada_kbest_impl.hpp"
+#include "cicada_kbest_store.hpp"
+#include "cicada_text_impl.hpp"
+
+#include "utils/program_options.hpp"
+#include "utils/compress_stream.hpp"
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+#include "utils/unordered_set.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+
+typedef boost::filesystem::path path_type;
+typedef std::vector<path_type, std::allocator<path_type> > path_set_type;
+
+path_set_type kbest_path;
+path_set_type refset_files;
+path_type     output_path;
+
+std::string scorer_name = "bleu:order=4";
+
+int debug = 0;
+
+void read_refset(const path_set_type& files, scorer_document_type& scorers);
+void options(int argc, char** argv);
+
+int main(int argc, char** argv)
+{
+  try {
+    options(argc, argv);
+
+    if (kbest_path.empty())
+      throw std::runtime_error("no kbest?");
+    if (output_path.empty())
+      throw std::runtime_error("no output?");
+
+    scorer_document_type scorers(scorer_name);
+
+    if (! refset_files.empty())
+      read_refset(refset_files, scorers);
+
+    typedef boost::spirit::istream_iterator iter_type;
+    typedef kbest_feature_parser<iter_type> parser_type;
+
+    typedef utils::unordered_set<hypothesis_type, boost::hash<hypothesis_type>, std::equal_to<hypothesis_type>,
+				 std::allocator<hypothesis_type> >::type hypothesis_unique_type;
+
+    parser_type parser;
+    kbest_feature_type kbest_feature;
+
+    hypothesis_unique_type uniques;
+
+    for (path_set_type::const_iterator piter = kbest_path.begin(); piter != kbest_path.end(); ++ piter) {
+      if (! boost::filesystem::is_directory(*piter))
+	throw std::runtime_error("no kbest directory? " + piter->string());
+
+      if (debug)
+	std::cerr << "indexing kbest: " << piter->string() << std::endl;
+
+      utils::resource start;
+
+      KBestStoreWriter writer(output_path, scorers.empty() ? std::string() : scorer_name, KBestStore::refset(refset_files));
+
+      size_t num_segment = 0;
+      size_t num_hypothesis = 0;
+
+      for (size_t i = 0; /**/; ++ i) {
+	const path_type path = (*piter) / (utils::lexical_cast<std::string>(i) + ".gz");
+
+	if (! boost::filesystem::exists(path)) break;
+
+	utils::compress_istream is(path, 1024 * 1024);
+	is.unsetf(std::ios::skipws);
+
+	iter_type iter(is);
+	iter_type iter_end;
+
+	uniques.clear();
+
+	while (iter != iter_end) {
+	  boost::fusion::get<1>(kbest_feature).clear();
+	  boost::fusion::get<2>(kbest_feature).clear();
+
+	  if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, kbest_feature))
+	    if (iter != iter_end)
+	      throw std::runtime_error("kbest parsing failed");
+
+	  const size_t& id = boost::fusion::get<0>(kbest_feature);
+
+	  hypothesis_type hyp(kbest_feature);
+
+	  if (! uniques.insert(hyp).second) continue;
+
+	  if (! scorers.empty()) {
+	    if (id >= scorers.size() || ! scorers[id])
+	      throw std::runtime_error("no reference for id: " + utils::lexical_cast<std::string>(id));
+
+	    hyp.score = scorers[id]->score(sentence_type(hyp.sentence.begin(), hyp.sentence.end()));
+	  }
+
+	  writer.insert(id, hyp);
+
+	  ++ num_hypothesis;
+	}
+
+	writer.segment();
+
+	++ num_segment;
+      }
+
+      writer.close();
+
+      utils::resource end;
+
+      if (debug)
+	std::cerr << "# of segments: " << num_segment
+		  << " # of hypotheses: " << num_hypothesis
+		  << " cpu time: " << (end.cpu_time() - start.cpu_time())
+		  << " user time: " << (end.user_time() - start.user_time())
+		  << std::endl;
+    }
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void read_refset(const path_set_type& files, scorer_document_type& scorers)
+{
+  typedef boost::spirit::istream_iterator iter_type;
+  typedef cicada_sentence_parser<iter_type> parser_type;
+
+  scorers.clear();
+
+  parser_type parser;
+  id_sentence_type id_sentence;
+
+  for (path_set_type::const_iterator fiter = files.begin(); fiter != files.end(); ++ fiter) {
+
+    if (! boost::filesystem::exists(*fiter) && *fiter != "-")
+      throw std::runtime_error("no reference file: " + fiter->string());
+
+    utils::compress_istream is(*fiter, 1024 * 1024);
+    is.unsetf(std::ios::skipws);
+
+    iter_type iter(is);
+    iter_type iter_end;
+
+    while (iter != iter_end) {
+      id_sentence.second.clear();
+      if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, id_sentence))
+	if (iter != iter_end)
+	  throw std::runtime_error("refset parsing failed");
+
+      const int& id = id_sentence.first;
+
+      if (id >= static_cast<int>(scorers.size()))
+	scorers.resize(id + 1);
+      if (! scorers[id])
+	scorers[id] = scorers.create();
+
+      scorers[id]->insert(id_sentence.second);
+    }
+  }
+}
+
+void options(int argc, char** argv)
+{
+  namespace po = boost::program_options;
+
+  po::options_description desc("options");
+  desc.add_options()
+    ("kbest",  po::value<path_set_type>(&kbest_path)->multitoken(),   "kbest path(s), each appended as a block")
+    ("refset", po::value<path_set_type>(&refset_files)->multitoken(), "reference set file(s) for precomputing scores")
+    ("output", po::value<path_type>(&output_path),                    "k-best store (created or appended)")
+
+    ("scorer", po::value<std::string>(&scorer_name)->default_value(scorer_name), "error metric")
+
+    ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
+
+    ("help", "help message");
+
+  po::variables_map variables;
+  po::store(po::parse_command_line(argc, argv, desc, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), variables);
+  po::notify(variables);
+
+  if (variables.count("help")) {
+    std::cout << argv[0] << " [options]\n"
+	      << desc << std::endl;
+    exit(0);
+  }
+}
@@ -0,0 +1,91 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// augment an ngram index with the unpacked layout:
+// child ids are stored as plain 32-bit words, searched by SIMD compares, and
+// the children range of each node is stored explicitly, not computed by select.
+//
+
+#include <cstdlib>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+
+#include "cicada/ngram_index.hpp"
+
+#include "utils/program_options.hpp"
+#include "utils/resource.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+typedef boost::filesystem::path path_type;
+
+path_type ngram_file;
+
+int debug = 0;
+
+void options(int argc, char** argv);
+
+int main(int argc, char** argv)
+{
+  try {
+    options(argc, argv);
+
+    if (ngram_file.empty())
+      throw std::runtime_error("no ngram?");
+    if (! boost::filesystem::exists(ngram_file))
+      throw std::runtime_error("no ngram? " + ngram_file.string());
+
+    // we accept either the ngram directory, or the index directory under it
+    const path_type index_file = (boost::filesystem::exists(ngram_file / "index" / "ngram-000000")
+				  ? ngram_file / "index"
+				  : ngram_file);
+
+    utils::resource start;
+
+    cicada::NGramIndex index(index_file);
+
+    index.write_unpacked();
+
+    utils::resource end;
+
+    if (debug)
+      std::cerr << "index: " << index_file.string()
+		<< " # of shards: " << index.size()
+		<< " order: " << index.order()
+		<< " cpu time: " << (end.cpu_time() - start.cpu_time())
+		<< " user time: " << (end.user_time() - start.user_time())
+		<< std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void options(int argc, char** argv)
+{
+  namespace po = boost::program_options;
+
+  po::options_description desc("options");
+  desc.add_options()
+    ("ngram", po::value<path_type>(&ngram_file), "ngram language model (or its index) in binary format")
+
+    ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
+
+    ("help", "help message");
+
+  po::variables_map variables;
+  po::store(po::parse_command_line(argc, argv, desc, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), variables);
+  po::notify(variables);
+
+  if (variables.count("help")) {
+    std::cout << argv[0] << " [options]\n"
+	      << desc << std::endl;
+    exit(0);
+  }
+}
@@ -0,0 +1,207 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__KBEST_MATRIX__HPP__
+#define __CICADA__KBEST_MATRIX__HPP__ 1
+
+//
+// a block of hypotheses' features in CSR form: feature ids and values are kept in separate
+// arrays, and offsets[i], offsets[i + 1] delimit the i-th row.
+//
+// margins() scores a range of rows against a dense weight array, and accumulate() adds
+// coefficient-scaled rows into a dense gradient array, so that the objectives can avoid the
+// sparse lookups and the per-element semiring arithmetic of WeightVector.
+// margins() gathers the weights by AVX2 (or by pairs of loads with SSE2), and the interleaved
+// accumulate() updates contiguous gradients by AVX or SSE2, with scalar tails, as in
+// cicada_alignment_hmm_kernel.hpp. The AVX products are fused by FMA when available, which
+// rounds once per multiply-add, thus may differ from the scalar sums in the last bits. The single gradient accumulate() is a scatter, which is left
+// scalar.
+//
+
+#include <stdint.h>
+#include <cstddef>
+
+#include <vector>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cicada
+{
+  struct KBestMatrix
+  {
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef uint32_t index_type;
+    typedef double   value_type;
+
+    typedef std::vector<index_type, std::allocator<index_type> > index_set_type;
+    typedef std::vector<value_type, std::allocator<value_type> > value_set_type;
+    typedef std::vector<size_type, std::allocator<size_type> >   offset_set_type;
+
+    KBestMatrix() : indices(), values(), offsets(), index_max(0) { offsets.push_back(0); }
+
+    void clear()
+    {
+      indices.clear();
+      values.clear();
+      offsets.clear();
+      offsets.push_back(0);
+      index_max = 0;
+    }
+
+    // insert a row from a range of (feature, value)
+    template <typename Iterator>
+    void insert(Iterator first, Iterator last)
+    {
+      for (/**/; first != last; ++ first) {
+	const index_type index = first->first.id();
+
+	indices.push_back(index);
+	values.push_back(first->second);
+
+	index_max = std::max(index_max, size_type(index) + 1);
+      }
+
+      offsets.push_back(indices.size());
+    }
+
+    size_type size() const { return offsets.size() - 1; }
+    bool empty() const { return offsets.size() == 1; }
+
+    // the dense size required to cover all the features in this block
+    size_type dimension() const { return index_max; }
+
+    void shrink()
+    {
+      index_set_type(indices).swap(indices);
+      value_set_type(values).swap(values);
+      offset_set_type(offsets).swap(offsets);
+    }
+
+    // margins[i - first] = sum_j weights[indices[j]] * values[j] for the rows in [first, last).
+    // features beyond weights_size have zero weights.
+    void margins(const value_type* weights, const size_type weights_size,
+		 const size_type first, const size_type last,
+		 value_type* margins) const
+    {
+      // no features at all, thus we cannot take the address of the first element
+      if (indices.empty()) {
+	std::fill(margins, margins + (last - first), value_type(0.0));
+	return;
+      }
+
+      if (weights_size >= index_max) {
+	for (size_type i = first; i != last; ++ i) {
+	  const index_type* iiter     = &(*indices.begin()) + offsets[i];
+	  const index_type* iiter_end = &(*indices.begin()) + offsets[i + 1];
+	  const value_type* viter     = &(*values.begin()) + offsets[i];
+
+	  value_type sum = 0.0;
+
+#if defined(__AVX2__)
+	  __m256d accum = _mm256_setzero_pd();
+	  for (/**/; iiter_end - iiter >= 4; iiter += 4, viter += 4) {
+	    const __m256d gathered = _mm256_i32gather_pd(weights, _mm_loadu_si128(reinterpret_cast<const __m128i*>(iiter)), 8);
+
+#if defined(__FMA__)
+	    accum = _mm256_fmadd_pd(gathered, _mm256_loadu_pd(viter), accum);
+#else
+	    accum = _mm256_add_pd(accum, _mm256_mul_pd(gathered, _mm256_loadu_pd(viter)));
+#endif
+	  }
+
+	  double buffer[4];
+	  _mm256_storeu_pd(buffer, accum);
+	  sum = (buffer[0] + buffer[1]) + (buffer[2] + buffer[3]);
+#elif defined(__SSE2__)
+	  __m128d accum0 = _mm_setzero_pd();
+	  __m128d accum1 = _mm_setzero_pd();
+	  for (/**/; iiter_end - iiter >= 4; iiter += 4, viter += 4) {
+	    accum0 = _mm_add_pd(accum0, _mm_mul_pd(_mm_set_pd(weights[iiter[1]], weights[iiter[0]]), _mm_loadu_pd(viter)));
+	    accum1 = _mm_add_pd(accum1, _mm_mul_pd(_mm_set_pd(weights[iiter[3]], weights[iiter[2]]), _mm_loadu_pd(viter + 2)));
+	  }
+
+	  double buffer[2];
+	  _mm_storeu_pd(buffer, _mm_add_pd(accum0, accum1));
+	  sum = buffer[0] + buffer[1];
+#endif
+
+	  for (/**/; iiter != iiter_end; ++ iiter, ++ viter)
+	    sum += weights[*iiter] * (*viter);
+
+	  margins[i - first] = sum;
+	}
+      } else {
+	for (size_type i = first; i != last; ++ i) {
+	  value_type sum = 0.0;
+	  for (size_type j = offsets[i]; j != offsets[i + 1]; ++ j)
+	    sum += (indices[j] < weights_size ? weights[indices[j]] * values[j] : value_type(0.0));
+
+	  margins[i - first] = sum;
+	}
+      }
+    }
+
+    // gradients[indices[j] * stride + c] += coefficients[(i - first) * stride + c] * values[j]
+    // for the rows in [first, last) and c in [0, stride), i.e. stride gradients interleaved in
+    // a single dense array of at least dimension() * stride.
+    void accumulate(const size_type first, const size_type last,
+		    const value_type* coefficients, const size_type stride,
+		    value_type* gradients) const
+    {
+      if (stride == 1) {
+	for (size_type i = first; i != last; ++ i) {
+	  const value_type coefficient = coefficients[i - first];
+
+	  if (coefficient == 0.0) continue;
+
+	  for (size_type j = offsets[i]; j != offsets[i + 1]; ++ j)
+	    gradients[indices[j]] += coefficient * values[j];
+	}
+      } else {
+	for (size_type i = first; i != last; ++ i) {
+	  const value_type* citer = coefficients + (i - first) * stride;
+
+	  for (size_type j = offsets[i]; j != offsets[i + 1]; ++ j) {
+	    value_type* giter = gradients + size_type(indices[j]) * stride;
+	    const value_type value = values[j];
+
+	    size_type c = 0;
+
+#if defined(__AVX__)
+	    const __m256d value256 = _mm256_set1_pd(value);
+	    for (/**/; c + 4 <= stride; c += 4)
+#if defined(__FMA__)
+	      _mm256_storeu_pd(giter + c, _mm256_fmadd_pd(_mm256_loadu_pd(citer + c), value256, _mm256_loadu_pd(giter + c)));
+#else
+	      _mm256_storeu_pd(giter + c, _mm256_add_pd(_mm256_loadu_pd(giter + c), _mm256_mul_pd(_mm256_loadu_pd(citer + c), value256)));
+#endif
+#elif defined(__SSE2__)
+	    const __m128d value128 = _mm_set1_pd(value);
+	    for (/**/; c + 2 <= stride; c += 2)
+	      _mm_storeu_pd(giter + c, _mm_add_pd(_mm_loadu_pd(giter + c), _mm_mul_pd(_mm_loadu_pd(citer + c), value128)));
+#endif
+
+	    for (/**/; c != stride; ++ c)
+	      giter[c] += citer[c] * value;
+	  }
+	}
+      }
+    }
+
+    index_set_type  indices;
+    value_set_type  values;
+    offset_set_type offsets;
+    size_type       index_max;
+  };
+};
+
+#endif
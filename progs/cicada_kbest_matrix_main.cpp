@@ -0,0 +1,115 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of hypotheses] [# of features] [# of features per hypothesis]
+//
+// score random hypotheses by the sparse dot product with WeightVector, and by the batched
+// KBestMatrix kernel, then, accumulate the gradient by both. The two should agree.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "cicada_kbest_matrix.hpp"
+
+#include "cicada/feature.hpp"
+#include "cicada/weight_vector.hpp"
+#include "cicada/dot_product.hpp"
+
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+#include <boost/random.hpp>
+
+typedef cicada::Feature feature_type;
+typedef cicada::WeightVector<double, std::allocator<double> > weight_set_type;
+typedef std::pair<feature_type, double> feature_value_type;
+typedef std::vector<feature_value_type, std::allocator<feature_value_type> > feature_set_type;
+typedef std::vector<feature_set_type, std::allocator<feature_set_type> > feature_map_type;
+
+int main(int argc, char** argv)
+{
+  try {
+    const size_t num_hypothesis = (argc > 1 ? utils::lexical_cast<size_t>(argv[1]) : size_t(100000));
+    const size_t num_feature    = (argc > 2 ? utils::lexical_cast<size_t>(argv[2]) : size_t(10000));
+    const size_t num_active     = (argc > 3 ? utils::lexical_cast<size_t>(argv[3]) : size_t(30));
+
+    boost::mt19937 generator;
+    boost::random::uniform_int_distribution<size_t> feature_dist(1, num_feature);
+    boost::random::uniform_real_distribution<double> value_dist(-1.0, 1.0);
+
+    // features are created by the order of id
+    for (size_t i = 0; i <= num_feature; ++ i)
+      feature_type("feature" + utils::lexical_cast<std::string>(i));
+
+    weight_set_type weights;
+    for (size_t i = 1; i <= num_feature; ++ i)
+      weights[feature_type("feature" + utils::lexical_cast<std::string>(i))] = value_dist(generator);
+
+    feature_map_type features(num_hypothesis);
+    cicada::KBestMatrix matrix;
+
+    for (size_t k = 0; k != num_hypothesis; ++ k) {
+      for (size_t j = 0; j != num_active; ++ j)
+	features[k].push_back(feature_value_type(feature_type::id_type(feature_dist(generator)), value_dist(generator)));
+
+      std::sort(features[k].begin(), features[k].end());
+
+      matrix.insert(features[k].begin(), features[k].end());
+    }
+
+    std::vector<double, std::allocator<double> > margins_sparse(num_hypothesis);
+    std::vector<double, std::allocator<double> > margins_dense(num_hypothesis);
+
+    utils::resource start_sparse;
+
+    for (size_t k = 0; k != num_hypothesis; ++ k)
+      margins_sparse[k] = cicada::dot_product(weights, features[k].begin(), features[k].end(), 0.0);
+
+    weight_set_type gradient_sparse;
+    for (size_t k = 0; k != num_hypothesis; ++ k)
+      for (feature_set_type::const_iterator fiter = features[k].begin(); fiter != features[k].end(); ++ fiter)
+	gradient_sparse[fiter->first] += margins_sparse[k] * fiter->second;
+
+    utils::resource end_sparse;
+
+    utils::resource start_dense;
+
+    matrix.margins(&(*weights.begin()), weights.size(), 0, matrix.size(), &(*margins_dense.begin()));
+
+    std::vector<double, std::allocator<double> > gradient_dense(matrix.dimension(), 0.0);
+    matrix.accumulate(0, matrix.size(), &(*margins_dense.begin()), 1, &(*gradient_dense.begin()));
+
+    utils::resource end_dense;
+
+    double diff_margin = 0.0;
+    for (size_t k = 0; k != num_hypothesis; ++ k)
+      diff_margin = std::max(diff_margin, std::fabs(margins_sparse[k] - margins_dense[k]));
+
+    double diff_gradient = 0.0;
+    for (size_t i = 0; i != gradient_dense.size(); ++ i)
+      diff_gradient = std::max(diff_gradient, std::fabs(gradient_sparse[feature_type(feature_type::id_type(i))] - gradient_dense[i]));
+
+    std::cout << "sparse: " << (end_sparse.cpu_time() - start_sparse.cpu_time()) << " cpu "
+	      << (end_sparse.user_time() - start_sparse.user_time()) << " user"
+	      << std::endl;
+    std::cout << "dense: " << (end_dense.cpu_time() - start_dense.cpu_time()) << " cpu "
+	      << (end_dense.user_time() - start_dense.user_time()) << " user"
+	      << std::endl;
+    std::cout << "margin difference: " << diff_margin
+	      << " gradient difference: " << diff_gradient
+	      << std::endl;
+
+    if (diff_margin > 1e-10 || diff_gradient > 1e-8)
+      throw std::runtime_error("sparse and dense differ");
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,581 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __CICADA__KBEST_STORE__HPP__
+#define __CICADA__KBEST_STORE__HPP__ 1
+
+//
+// binary k-best store: a repository of columns, which are memory-mapped for reading.
+//
+//   prop.list       type = kbest-store, and scorer = <scorer spec> and refset = <fingerprint of
+//                   the reference set> when scores are stored
+//   vocab           words, one per line, indexed by the line number
+//   feature         feature names, one per line, indexed by the line number
+//   block           end offset into segment for each block, i.e. an appended k-best directory
+//   segment         end offset into hypotheses for each segment, i.e. <i>.gz of a k-best directory
+//   id              id of each hypothesis
+//   sentence        end offset into word for each hypothesis
+//   word            word ids
+//   feature-offset  end offset into feature-id/feature-value for each hypothesis (CSR)
+//   feature-id      feature ids
+//   feature-value   feature values
+//   score-offset    end offset into score for each hypothesis (only when scores are stored)
+//   score           encoded scores, the statistics of the scorer in prop.list
+//
+// Stored scores are used only when both the scorer spec and the refset fingerprint match, i.e.
+// a different or updated reference set recomputes the scores.
+// Hypotheses are unique in each segment. Appending a block simply appends to the columns, and
+// the vocab/feature, then, the block is written at last, so that readers see only complete blocks.
+//
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "cicada_kbest_impl.hpp"
+
+#include "utils/map_file.hpp"
+#include "utils/repository.hpp"
+#include "utils/piece.hpp"
+#include "utils/getline.hpp"
+#include "utils/compress_stream.hpp"
+#include "utils/lexical_cast.hpp"
+#include "utils/hashmurmur3.hpp"
+
+class KBestStore
+{
+public:
+  typedef size_t   size_type;
+  typedef uint64_t off_type;
+  typedef uint32_t id_type;
+
+  typedef boost::filesystem::path path_type;
+
+  typedef hypothesis_type::word_type          word_type;
+  typedef hypothesis_type::feature_type       feature_type;
+  typedef hypothesis_type::feature_value_type feature_value_type;
+
+  typedef cicada::eval::Score score_type;
+
+private:
+  typedef utils::map_file<off_type, std::allocator<off_type> > off_set_type;
+  typedef utils::map_file<id_type, std::allocator<id_type> >   id_set_type;
+  typedef utils::map_file<double, std::allocator<double> >     value_set_type;
+  typedef utils::map_file<char, std::allocator<char> >         byte_set_type;
+
+  typedef std::vector<word_type, std::allocator<word_type> >                   word_map_type;
+  typedef std::vector<feature_type, std::allocator<feature_type> >             feature_map_type;
+  typedef std::vector<feature_value_type, std::allocator<feature_value_type> > feature_set_type;
+
+public:
+  KBestStore() {}
+  KBestStore(const path_type& path, const std::string& scorer=std::string(), const std::string& refset=std::string()) { open(path, scorer, refset); }
+
+public:
+  static bool exists(const path_type& path)
+  {
+    if (! utils::repository::exists(path)) return false;
+
+    utils::repository rep(path, utils::repository::read);
+    utils::repository::const_iterator iter = rep.find("type");
+
+    return iter != rep.end() && iter->second == "kbest-store";
+  }
+
+  // fingerprint of the (decompressed) contents of the reference set files, in the given order
+  template <typename PathSet>
+  static std::string refset(const PathSet& files)
+  {
+    utils::hashmurmur3<uint64_t> hasher;
+
+    uint64_t hash = files.size();
+
+    std::string line;
+    typename PathSet::const_iterator fiter_end = files.end();
+    for (typename PathSet::const_iterator fiter = files.begin(); fiter != fiter_end; ++ fiter) {
+      utils::compress_istream is(*fiter, 1024 * 1024);
+
+      while (utils::getline(is, line))
+	hash = hasher((void*) line.c_str(), line.size(), hash + 1);
+
+      hash = hasher(hash, 0xfffffffffffffffful);
+    }
+
+    char buffer[17];
+    for (int i = 15; i >= 0; -- i, hash >>= 4)
+      buffer[i] = "0123456789abcdef"[hash & 0x0f];
+    buffer[16] = '\0';
+
+    return files.empty() ? std::string() : std::string(buffer);
+  }
+
+  // scores are decoded only when they were computed by the same scorer spec over the same refset
+  void open(const path_type& path, const std::string& scorer=std::string(), const std::string& refset=std::string())
+  {
+    typedef utils::repository repository_type;
+
+    close();
+
+    repository_type rep(path, repository_type::read);
+
+    repository_type::const_iterator iter = rep.find("type");
+    if (iter == rep.end() || iter->second != "kbest-store")
+      throw std::runtime_error("not a k-best store: " + path.string());
+
+    block_offsets.open(rep.path("block"));
+    segment_offsets.open(rep.path("segment"));
+    ids.open(rep.path("id"));
+    sentence_offsets.open(rep.path("sentence"));
+    words.open(rep.path("word"));
+    feature_offsets.open(rep.path("feature-offset"));
+    feature_ids.open(rep.path("feature-id"));
+    feature_values.open(rep.path("feature-value"));
+
+    repository_type::const_iterator siter = rep.find("scorer");
+    repository_type::const_iterator riter = rep.find("refset");
+    if (siter != rep.end() && ! scorer.empty() && siter->second == scorer
+	&& riter != rep.end() && ! refset.empty() && riter->second == refset) {
+      score_offsets.open(rep.path("score-offset"));
+      scores.open(rep.path("score"));
+    }
+
+    // words and features are mapped into our ids once...
+    read_names(rep.path("vocab"), word_map);
+    read_names(rep.path("feature"), feature_map);
+  }
+
+  void close()
+  {
+    block_offsets.clear();
+    segment_offsets.clear();
+    ids.clear();
+    sentence_offsets.clear();
+    words.clear();
+    feature_offsets.clear();
+    feature_ids.clear();
+    feature_values.clear();
+    score_offsets.clear();
+    scores.clear();
+
+    word_map.clear();
+    feature_map.clear();
+  }
+
+  // # of blocks, and # of segments in a block
+  size_type blocks() const { return block_offsets.empty() ? size_type(0) : block_offsets.size(); }
+  size_type segments(const size_type block) const { return segment_last(block) - segment_first(block); }
+
+  // range of hypotheses of a segment in a block
+  off_type first(const size_type block, const size_type segment) const
+  {
+    const off_type pos = segment_first(block) + segment;
+    return pos == 0 ? off_type(0) : segment_offsets[pos - 1];
+  }
+  off_type last(const size_type block, const size_type segment) const
+  {
+    return segment_offsets[segment_first(block) + segment];
+  }
+
+  size_type id(const off_type pos) const { return ids[pos]; }
+
+  bool has_score() const { return ! score_offsets.empty(); }
+
+  // append hypotheses in [first, last)
+  void read(const off_type first, const off_type last, hypothesis_set_type& hypotheses) const
+  {
+    word_set_type    sentence;
+    feature_set_type features;
+
+    for (off_type pos = first; pos != last; ++ pos) {
+      sentence.clear();
+      features.clear();
+
+      const off_type word_last = sentence_offsets[pos];
+      for (off_type i = (pos == 0 ? off_type(0) : sentence_offsets[pos - 1]); i != word_last; ++ i)
+	sentence.push_back(word_map[words[i]]);
+
+      const off_type feature_last = feature_offsets[pos];
+      for (off_type i = (pos == 0 ? off_type(0) : feature_offsets[pos - 1]); i != feature_last; ++ i)
+	features.push_back(feature_value_type(feature_map[feature_ids[i]], feature_values[i]));
+
+      hypotheses.push_back(hypothesis_type(sentence.begin(), sentence.end(), features.begin(), features.end()));
+
+      if (has_score()) {
+	const off_type score_first = (pos == 0 ? off_type(0) : score_offsets[pos - 1]);
+
+	hypotheses.back().score = score_type::decode(utils::piece(scores.begin() + score_first,
+								  scores.begin() + score_offsets[pos]));
+	hypotheses.back().loss  = hypotheses.back().score->loss();
+      }
+    }
+  }
+
+private:
+  typedef std::vector<word_type, std::allocator<word_type> > word_set_type;
+
+  size_type segment_first(const size_type block) const { return block == 0 ? size_type(0) : size_type(block_offsets[block - 1]); }
+  size_type segment_last(const size_type block) const { return block_offsets[block]; }
+
+  template <typename Map>
+  static void read_names(const path_type& path, Map& map)
+  {
+    map.clear();
+
+    utils::compress_istream is(path, 1024 * 1024);
+
+    std::string line;
+    while (utils::getline(is, line))
+      map.push_back(typename Map::value_type(line));
+  }
+
+private:
+  off_set_type   block_offsets;
+  off_set_type   segment_offsets;
+  id_set_type    ids;
+  off_set_type   sentence_offsets;
+  id_set_type    words;
+  off_set_type   feature_offsets;
+  id_set_type    feature_ids;
+  value_set_type feature_values;
+  off_set_type   score_offsets;
+  byte_set_type  scores;
+
+  word_map_type    word_map;
+  feature_map_type feature_map;
+};
+
+class KBestStoreWriter
+{
+public:
+  typedef KBestStore::size_type size_type;
+  typedef KBestStore::off_type  off_type;
+  typedef KBestStore::id_type   id_type;
+  typedef KBestStore::path_type path_type;
+
+  typedef hypothesis_type::word_type    word_type;
+  typedef hypothesis_type::feature_type feature_type;
+
+private:
+  typedef boost::iostreams::filtering_ostream ostream_type;
+  typedef boost::shared_ptr<ostream_type>     ostream_ptr_type;
+
+  typedef std::vector<id_type, std::allocator<id_type> > id_map_type;
+
+public:
+  // create a store, or open an existing one for appending a block. The scorer spec and the refset
+  // fingerprint should be the same as the store, or empty when no scores are stored.
+  KBestStoreWriter(const path_type& path, const std::string& scorer, const std::string& refset=std::string()) { open(path, scorer, refset); }
+  ~KBestStoreWriter() { close(); }
+
+public:
+  void open(const path_type& path, const std::string& scorer, const std::string& refset=std::string())
+  {
+    typedef utils::repository repository_type;
+
+    if (! KBestStore::exists(path)) {
+      if (boost::filesystem::exists(path) && ! boost::filesystem::is_directory(path))
+	throw std::runtime_error("not a directory: " + path.string());
+      if (boost::filesystem::exists(path) && ! boost::filesystem::is_empty(path))
+	throw std::runtime_error("not a k-best store: " + path.string());
+
+      repository_type rep(path, repository_type::write);
+      rep["type"] = "kbest-store";
+      if (! scorer.empty()) {
+	rep["scorer"] = scorer;
+	rep["refset"] = refset;
+      }
+    }
+
+    repository_type rep(path, repository_type::read);
+
+    repository_type::const_iterator siter = rep.find("scorer");
+    if ((siter == rep.end() ? std::string() : siter->second) != scorer)
+      throw std::runtime_error("scorer does not match with the store: " + path.string());
+
+    repository_type::const_iterator riter = rep.find("refset");
+    if (! scorer.empty() && (riter == rep.end() ? std::string() : riter->second) != refset)
+      throw std::runtime_error("refset does not match with the store: " + path.string());
+
+    with_score = ! scorer.empty();
+
+    // current sizes of the columns
+    num_segment     = file_size(rep.path("segment"))    / sizeof(off_type);
+    size_hypothesis = file_size(rep.path("id"))         / sizeof(id_type);
+    size_word       = file_size(rep.path("word"))       / sizeof(id_type);
+    size_feature    = file_size(rep.path("feature-id")) / sizeof(id_type);
+    size_score      = file_size(rep.path("score"));
+
+    // columns longer than the last block are left by a failed append, which we do not recover
+    if (num_segment != read_last(rep.path("block")))
+      throw std::runtime_error("corrupted k-best store: " + path.string());
+
+    size_vocab   = read_names(rep.path("vocab"),   vocab_map,   &word_type::id);
+    size_feature_name = read_names(rep.path("feature"), feature_map, &feature_type::id);
+
+    vocab_os          = open_append(rep.path("vocab"));
+    feature_os        = open_append(rep.path("feature"));
+    block_os          = open_append(rep.path("block"));
+    segment_os        = open_append(rep.path("segment"));
+    id_os             = open_append(rep.path("id"));
+    sentence_os       = open_append(rep.path("sentence"));
+    word_os           = open_append(rep.path("word"));
+    feature_offset_os = open_append(rep.path("feature-offset"));
+    feature_id_os     = open_append(rep.path("feature-id"));
+    feature_value_os  = open_append(rep.path("feature-value"));
+
+    if (with_score) {
+      score_offset_os = open_append(rep.path("score-offset"));
+      score_os        = open_append(rep.path("score"));
+    }
+
+    num_segment_block = 0;
+  }
+
+  // push a hypothesis of the current segment
+  void insert(const size_type id, const hypothesis_type& hyp)
+  {
+    write(*id_os, id_type(id));
+
+    hypothesis_type::sentence_type::const_iterator siter_end = hyp.sentence.end();
+    for (hypothesis_type::sentence_type::const_iterator siter = hyp.sentence.begin(); siter != siter_end; ++ siter)
+      write(*word_os, word(*siter));
+    size_word += hyp.sentence.size();
+    write(*sentence_os, off_type(size_word));
+
+    hypothesis_type::feature_set_type::const_iterator fiter_end = hyp.features.end();
+    for (hypothesis_type::feature_set_type::const_iterator fiter = hyp.features.begin(); fiter != fiter_end; ++ fiter) {
+      write(*feature_id_os, feature(fiter->first));
+      write(*feature_value_os, double(fiter->second));
+    }
+    size_feature += hyp.features.size();
+    write(*feature_offset_os, off_type(size_feature));
+
+    if (with_score) {
+      if (! hyp.score)
+	throw std::runtime_error("no score for a hypothesis");
+
+      const std::string encoded = hyp.score->encode();
+
+      score_os->write(encoded.c_str(), encoded.size());
+      size_score += encoded.size();
+      write(*score_offset_os, off_type(size_score));
+    }
+
+    ++ size_hypothesis;
+  }
+
+  // finish the current segment
+  void segment()
+  {
+    write(*segment_os, off_type(size_hypothesis));
+
+    ++ num_segment;
+    ++ num_segment_block;
+  }
+
+  // finish the current block, and close all the columns
+  void close()
+  {
+    if (! block_os) return;
+
+    // flush all the columns before writing the block
+    vocab_os.reset();
+    feature_os.reset();
+    segment_os.reset();
+    id_os.reset();
+    sentence_os.reset();
+    word_os.reset();
+    feature_offset_os.reset();
+    feature_id_os.reset();
+    feature_value_os.reset();
+    score_offset_os.reset();
+    score_os.reset();
+
+    if (num_segment_block)
+      write(*block_os, off_type(num_segment));
+
+    block_os.reset();
+  }
+
+private:
+  template <typename Tp>
+  static void write(ostream_type& os, const Tp& x)
+  {
+    os.write((char*) &x, sizeof(Tp));
+  }
+
+  id_type word(const word_type& x)
+  {
+    return index(x, x.id(), vocab_map, size_vocab, *vocab_os);
+  }
+
+  id_type feature(const feature_type& x)
+  {
+    return index(x, x.id(), feature_map, size_feature_name, *feature_os);
+  }
+
+  template <typename Tp>
+  static id_type index(const Tp& x, const size_type id, id_map_type& map, size_type& size, ostream_type& os)
+  {
+    if (id >= map.size())
+      map.resize(id + 1, id_type(-1));
+
+    if (map[id] == id_type(-1)) {
+      os << static_cast<const std::string&>(x) << '\n';
+
+      map[id] = size;
+      ++ size;
+    }
+
+    return map[id];
+  }
+
+  template <typename Tp>
+  static size_type read_names(const path_type& path, id_map_type& map, typename Tp::id_type (Tp::*id)() const)
+  {
+    map.clear();
+
+    if (! boost::filesystem::exists(path)) return 0;
+
+    utils::compress_istream is(path, 1024 * 1024);
+
+    size_type size = 0;
+    std::string line;
+    while (utils::getline(is, line)) {
+      const size_type pos = (Tp(line).*id)();
+
+      if (pos >= map.size())
+	map.resize(pos + 1, id_type(-1));
+
+      map[pos] = size;
+      ++ size;
+    }
+
+    return size;
+  }
+
+  static off_type file_size(const path_type& path)
+  {
+    return boost::filesystem::exists(path) ? off_type(boost::filesystem::file_size(path)) : off_type(0);
+  }
+
+  static off_type read_last(const path_type& path)
+  {
+    if (! file_size(path)) return 0;
+
+    utils::map_file<off_type, std::allocator<off_type> > offsets(path);
+
+    return offsets.empty() ? off_type(0) : offsets[offsets.size() - 1];
+  }
+
+  static ostream_ptr_type open_append(const path_type& path)
+  {
+    ostream_ptr_type os(new ostream_type());
+    os->push(boost::iostreams::file_sink(path.string(), std::ios_base::out | std::ios_base::app | std::ios_base::binary), 1024 * 1024);
+
+    return os;
+  }
+
+private:
+  bool with_score;
+
+  size_type num_segment;
+  size_type num_segment_block;
+
+  size_type size_hypothesis;
+  size_type size_word;
+  size_type size_feature;
+  size_type size_score;
+
+  size_type size_vocab;
+  size_type size_feature_name;
+
+  id_map_type vocab_map;
+  id_map_type feature_map;
+
+  ostream_ptr_type vocab_os;
+  ostream_ptr_type feature_os;
+  ostream_ptr_type block_os;
+  ostream_ptr_type segment_os;
+  ostream_ptr_type id_os;
+  ostream_ptr_type sentence_os;
+  ostream_ptr_type word_os;
+  ostream_ptr_type feature_offset_os;
+  ostream_ptr_type feature_id_os;
+  ostream_ptr_type feature_value_os;
+  ostream_ptr_type score_offset_os;
+  ostream_ptr_type score_os;
+};
+
+// a k-best file <i>.gz, or a segment of a block in a k-best store
+struct KBestFile
+{
+  typedef KBestStore::path_type path_type;
+
+  KBestFile() : path(), store(0), block(0), segment(0) {}
+  KBestFile(const path_type& __path) : path(__path), store(0), block(0), segment(0) {}
+  KBestFile(const KBestStore& __store, const size_t __block, const size_t __segment)
+    : path(), store(&__store), block(__block), segment(__segment) {}
+
+  bool empty() const { return path.empty() && ! store; }
+
+  path_type         path;
+  const KBestStore* store;
+  size_t            block;
+  size_t            segment;
+};
+
+// a k-best directory, or a block of a k-best store
+struct KBestSet
+{
+  typedef KBestStore::path_type path_type;
+
+  KBestSet(const path_type& __path) : path(__path), store(0), block(0) {}
+  KBestSet(const path_type& __path, const KBestStore& __store, const size_t __block) : path(__path), store(&__store), block(__block) {}
+
+  bool exists(const size_t i) const
+  {
+    return (store ? i < store->segments(block) : boost::filesystem::exists(file(i).path));
+  }
+
+  KBestFile file(const size_t i) const
+  {
+    return (store ? KBestFile(*store, block, i) : KBestFile(path / (utils::lexical_cast<std::string>(i) + ".gz")));
+  }
+
+  path_type         path;
+  const KBestStore* store;
+  size_t            block;
+};
+
+typedef std::deque<KBestStore, std::allocator<KBestStore> > kbest_store_set_type;
+typedef std::vector<KBestSet, std::allocator<KBestSet> >    kbest_set_set_type;
+
+// each k-best directory is a set, and each block of a k-best store is a set
+template <typename PathSet>
+inline
+void read_kbest_sets(const PathSet& paths, kbest_store_set_type& stores, kbest_set_set_type& sets, const std::string& scorer, const std::string& refset)
+{
+  typename PathSet::const_iterator piter_end = paths.end();
+  for (typename PathSet::const_iterator piter = paths.begin(); piter != piter_end; ++ piter) {
+    if (KBestStore::exists(*piter)) {
+      stores.push_back(KBestStore(*piter, scorer, refset));
+
+      for (size_t block = 0; block != stores.back().blocks(); ++ block)
+	sets.push_back(KBestSet(*piter, stores.back(), block));
+    } else
+      sets.push_back(KBestSet(*piter));
+  }
+}
+
+#endif
@@ -0,0 +1,139 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// kbest-directory store-directory
+//
+// read the k-best directory by parsing the text, append it to the k-best store as a block,
+// then, read the last block of the store. The two should hold the same hypotheses.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "cicada_kbest_impl.hpp"
+#include "cicada_kbest_store.hpp"
+
+#include "utils/compress_stream.hpp"
+#include "utils/resource.hpp"
+#include "utils/unordered_set.hpp"
+
+#include <boost/functional/hash.hpp>
+
+typedef boost::filesystem::path path_type;
+
+int main(int argc, char** argv)
+{
+  try {
+    if (argc != 3) {
+      std::cout << argv[0] << " kbest-directory store-directory" << std::endl;
+      return 1;
+    }
+
+    typedef boost::spirit::istream_iterator iter_type;
+    typedef kbest_feature_parser<iter_type> parser_type;
+
+    typedef utils::unordered_set<hypothesis_type, boost::hash<hypothesis_type>, std::equal_to<hypothesis_type>,
+				 std::allocator<hypothesis_type> >::type hypothesis_unique_type;
+
+    const path_type kbest_path(argv[1]);
+    const path_type store_path(argv[2]);
+
+    parser_type parser;
+    kbest_feature_type kbest_feature;
+
+    hypothesis_map_type kbests;
+    std::vector<size_t, std::allocator<size_t> > ids;
+
+    utils::resource start_parse;
+
+    for (size_t i = 0; /**/; ++ i) {
+      const path_type path = kbest_path / (utils::lexical_cast<std::string>(i) + ".gz");
+
+      if (! boost::filesystem::exists(path)) break;
+
+      utils::compress_istream is(path, 1024 * 1024);
+      is.unsetf(std::ios::skipws);
+
+      iter_type iter(is);
+      iter_type iter_end;
+
+      kbests.push_back(hypothesis_set_type());
+      ids.push_back(0);
+
+      hypothesis_unique_type uniques;
+
+      while (iter != iter_end) {
+	boost::fusion::get<1>(kbest_feature).clear();
+	boost::fusion::get<2>(kbest_feature).clear();
+
+	if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, kbest_feature))
+	  if (iter != iter_end)
+	    throw std::runtime_error("kbest parsing failed");
+
+	ids.back() = boost::fusion::get<0>(kbest_feature);
+
+	hypothesis_type hyp(kbest_feature);
+
+	if (uniques.insert(hyp).second)
+	  kbests.back().push_back(hyp);
+      }
+    }
+
+    utils::resource end_parse;
+
+    {
+      KBestStoreWriter writer(store_path, std::string());
+
+      for (size_t seg = 0; seg != kbests.size(); ++ seg) {
+	hypothesis_set_type::const_iterator kiter_end = kbests[seg].end();
+	for (hypothesis_set_type::const_iterator kiter = kbests[seg].begin(); kiter != kiter_end; ++ kiter)
+	  writer.insert(ids[seg], *kiter);
+
+	writer.segment();
+      }
+    }
+
+    utils::resource start_store;
+
+    KBestStore store(store_path);
+
+    hypothesis_map_type kbests_store(kbests.size());
+
+    const size_t block = store.blocks() - 1;
+
+    if (store.segments(block) != kbests.size())
+      throw std::runtime_error("# of segments does not match");
+
+    for (size_t seg = 0; seg != kbests.size(); ++ seg)
+      store.read(store.first(block, seg), store.last(block, seg), kbests_store[seg]);
+
+    utils::resource end_store;
+
+    size_t num_hypothesis = 0;
+    size_t num_different = 0;
+    for (size_t seg = 0; seg != kbests.size(); ++ seg) {
+      num_hypothesis += kbests[seg].size();
+      num_different  += (kbests[seg] != kbests_store[seg]);
+    }
+
+    std::cout << "segments: " << kbests.size()
+	      << " hypotheses: " << num_hypothesis
+	      << " blocks: " << store.blocks()
+	      << std::endl;
+    std::cout << "parse: " << (end_parse.cpu_time() - start_parse.cpu_time()) << " cpu "
+	      << (end_parse.user_time() - start_parse.user_time()) << " user"
+	      << std::endl;
+    std::cout << "store: " << (end_store.cpu_time() - start_store.cpu_time()) << " cpu "
+	      << (end_store.user_time() - start_store.user_time()) << " user"
+	      << " different: " << num_different
+	      << std::endl;
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -15,6 +15,8 @@
 
 #include "cicada_impl.hpp"
 #include "cicada_kbest_impl.hpp"
+#include "cicada_kbest_store.hpp"
+#include "cicada_kbest_matrix.hpp"
 #include "cicada_text_impl.hpp"
 #include "cicada_mert_kbest_impl.hpp"
 
@@ -134,12 +136,12 @@ int debug = 0;
 void options(int argc, char** argv);
 
 void read_kbest(const scorer_document_type& scorers,
-		const path_set_type& kbest_path,
+		const kbest_set_set_type& kbest_sets,
 		hypothesis_map_type& kbests,
 		kbest_map_type& kbest_map);
 void read_kbest(const scorer_document_type& scorers,
-		const path_set_type& kbest_path,
-		const path_set_type& oracle_path,
+		const kbest_set_set_type& kbest_sets,
+		const kbest_set_set_type& oracle_sets,
 		hypothesis_map_type& kbests,
 		hypothesis_map_type& oracles,
 		kbest_map_type& kbest_map);
@@ -238,16 +240,26 @@ int main(int argc, char ** argv)
     
     threads = utils::bithack::max(1, threads);
 
+    // k-best stores are expanded into their blocks, and hold scores when the scorer matches
+    kbest_store_set_type kbest_stores;
+    kbest_set_set_type   kbest_sets;
+    kbest_set_set_type   oracle_sets;
+    
+    const std::string refset = KBestStore::refset(refset_files);
+
+    read_kbest_sets(kbest_path,  kbest_stores, kbest_sets,  refset_files.empty() ? std::string() : scorer_name, refset);
+    read_kbest_sets(oracle_path, kbest_stores, oracle_sets, refset_files.empty() ? std::string() : scorer_name, refset);
+
     scorer_document_type scorers(scorer_name);
 
     if (! refset_files.empty()) {
       read_refset(refset_files, scorers);
       
-      if (! unite_kbest && kbest_path.size() > 1) {
+      if (! unite_kbest && kbest_sets.size() > 1) {
 	scorer_document_type scorers_iterative(scorer_name);
-	scorers_iterative.resize(scorers.size() * kbest_path.size());
+	scorers_iterative.resize(scorers.size() * kbest_sets.size());
 	
-	for (size_t i = 0; i != kbest_path.size(); ++ i)
+	for (size_t i = 0; i != kbest_sets.size(); ++ i)
 	  std::copy(scorers.begin(), scorers.end(), scorers_iterative.begin() + scorers.size() * i);
 	
 	scorers.swap(scorers_iterative);
@@ -264,9 +276,9 @@ int main(int argc, char ** argv)
     kbest_map_type      kbest_map;
     
     if (! learn_xbleu)
-      read_kbest(scorers, kbest_path, oracle_path, kbests, oracles, kbest_map);
+      read_kbest(scorers, kbest_sets, oracle_sets, kbests, oracles, kbest_map);
     else
-      read_kbest(scorers, kbest_path, kbests, kbest_map);
+      read_kbest(scorers, kbest_sets, kbests, kbest_map);
     
     if (debug)
       std::cerr << "# of features: " << feature_type::allocated() << std::endl;
@@ -1411,9 +1423,22 @@ struct OptimizeSVM
       grad_pos = 0.0;
       grad_neg = 0.0;
       
+      // score all the samples at once
+      cicada::KBestMatrix matrix;
+      for (size_t id = 0; id != encoder.losses.size(); ++ id)
+	matrix.insert(encoder.features[id].begin(), encoder.features[id].end());
+      
+      std::vector<double, std::allocator<double> > margins(encoder.losses.size());
+      std::vector<double, std::allocator<double> > margins_prev(encoder.losses.size());
+      
+      if (! margins.empty()) {
+	matrix.margins(&(*weights.begin()),      weights.size(),      0, matrix.size(), &(*margins.begin()));
+	matrix.margins(&(*weights_prev.begin()), weights_prev.size(), 0, matrix.size(), &(*margins_prev.begin()));
+      }
+      
       for (size_t id = 0; id != encoder.losses.size(); ++ id) {
-	const double margin      = cicada::dot_product(weights,      encoder.features[id].begin(), encoder.features[id].end(), 0.0);
-	const double margin_prev = cicada::dot_product(weights_prev, encoder.features[id].begin(), encoder.features[id].end(), 0.0);
+	const double& margin      = margins[id];
+	const double& margin_prev = margins_prev[id];
 	
 	const double bi_pos = margin_prev - margin;
 	const double ci_pos = encoder.losses[id]  - margin_prev;
@@ -1644,7 +1669,7 @@ struct ObjectiveXBLEU
   typedef ptrdiff_t difference_type;
   
   typedef hypothesis_type::feature_value_type feature_value_type;
-  typedef utils::mulvector2<feature_value_type, std::allocator<feature_value_type> > sample_set_type;
+  typedef cicada::KBestMatrix sample_set_type;
   typedef std::vector<sample_set_type, std::allocator<sample_set_type> > sample_map_type;
   
   ObjectiveXBLEU(const hypothesis_map_type& __kbests,
@@ -1656,7 +1681,8 @@ struct ObjectiveXBLEU
       scorers(__scorers),
       weights(__weights),
       lambda(__lambda),
-      feature_scale(__feature_scale)
+      feature_scale(__feature_scale),
+      dimension(0)
   {
     features_kbest.clear();
     features_kbest.reserve(kbests.size());
@@ -1666,9 +1692,13 @@ struct ObjectiveXBLEU
       if (! kbests[id].empty()) {
 	
 	for (size_t k = 0; k != kbests[id].size(); ++ k)
-	  features_kbest[id].push_back(kbests[id][k].features.begin(), kbests[id][k].features.end());
+	  features_kbest[id].insert(kbests[id][k].features.begin(), kbests[id][k].features.end());
+	
+	features_kbest[id].shrink();
+	
+	dimension = utils::bithack::max(dimension, features_kbest[id].dimension());
       }
-    
+  
   }
   
   const hypothesis_map_type& kbests;
@@ -1679,6 +1709,7 @@ struct ObjectiveXBLEU
   const feature_type feature_scale;
   
   sample_map_type features_kbest;
+  size_type       dimension;
   
   struct Task
   {
@@ -1687,7 +1718,7 @@ struct ObjectiveXBLEU
     static weight_type brevity_penalty(const double x)
     {
       typedef cicada::semiring::traits<weight_type> traits_type;
-
+      
       // return (std::exp(x) - 1) / (1.0 + std::exp(1000.0 * x)) + 1.0;
       
       return ((traits_type::exp(x) - traits_type::one()) / (traits_type::one() + traits_type::exp(1000.0 * x))) + traits_type::one();
@@ -1696,7 +1727,7 @@ struct ObjectiveXBLEU
     static weight_type derivative_brevity_penalty(const double x)
     {
       typedef cicada::semiring::traits<weight_type> traits_type;
-       
+      
       const weight_type expx     = traits_type::exp(x);
       const weight_type expxm1   = expx - traits_type::one();
       const weight_type exp1000x = traits_type::exp(1000.0 * x);
@@ -1726,17 +1757,24 @@ struct ObjectiveXBLEU
       
       //return 1.0 / (1.0 + exp1000x) - (x - clip) * (1000.0 * exp1000x) / ((1.0 + exp1000x) * (1.0 + exp1000x));
     }
-
-    typedef cicada::WeightVector<weight_type > gradient_type;
-    typedef std::vector<gradient_type, std::allocator<gradient_type> > gradients_type;
-    typedef std::vector<weight_type, std::allocator<weight_type> > weights_type;
+    
+    // gradients are interleaved in a dense array, gradients[feature * stride + column], with the columns:
+    //   hypo(n)    n - 1
+    //   matched(n) order + n - 1
+    //   reference  order * 2
+    //   entropy    order * 2 + 1
+    static size_type stride() { return order * 2 + 2; }
+    static size_type column_hypo(const int n) { return n - 1; }
+    static size_type column_matched(const int n) { return order + n - 1; }
+    static size_type column_reference() { return order * 2; }
+    static size_type column_entropy() { return order * 2 + 1; }
+    
+    typedef std::vector<double, std::allocator<double> > gradients_type;
+    typedef std::vector<double, std::allocator<double> > coefficients_type;
     
     typedef std::vector<double, std::allocator<double> > ngram_counts_type;
-    typedef std::vector<weight_set_type, std::allocator<weight_set_type> > feature_counts_type;
     
     typedef std::vector<double, std::allocator<double> > margins_type;
-
-    typedef cicada::FeatureVector<weight_type, std::allocator<weight_type> > expectation_type;
     
     // queue...
     typedef utils::lockfree_list_queue<int, std::allocator<int> > queue_type;
@@ -1746,74 +1784,52 @@ struct ObjectiveXBLEU
 	 const sample_map_type& __features_kbest,
 	 const scorer_document_type& __scorers,
 	 const weight_set_type& __weights,
-	 const feature_type& __feature_scale)
+	 const feature_type& __feature_scale,
+	 const size_type& __dimension)
       : queue(__queue),
 	kbests(__kbests),
 	features_kbest(__features_kbest),
 	scorers(__scorers),
 	weights(__weights),
 	feature_scale(__feature_scale),
+	dimension(__dimension),
 	c_matched(order + 1),
 	c_hypo(order + 1),
-	g_matched(order + 1),
-	g_hypo(order + 1),
-	g_reference(),
-	g_entropy(),
+	gradients(),
+	gradient_scale(),
 	r(0),
 	e(0)
     { }
     
     queue_type& queue;
-
+    
     const hypothesis_map_type& kbests;
     const sample_map_type& features_kbest;
     const scorer_document_type& scorers;
     const weight_set_type& weights;
     const feature_type feature_scale;
+    const size_type dimension;
     
-    ngram_counts_type   c_matched;
-    ngram_counts_type   c_hypo;
-    feature_counts_type g_matched;
-    feature_counts_type g_hypo;
-    weight_set_type     g_reference;
-    weight_set_type     g_entropy;
+    ngram_counts_type c_matched;
+    ngram_counts_type c_hypo;
+    gradients_type    gradients;
+    gradients_type    gradient_scale;
     double r;
     double e;
     
     void operator()()
     {
-      weights_type    matched(order + 1);
-      weights_type    hypo(order + 1);
-      expectation_type expectation;
-      
-      weights_type    counts_matched(order + 1);
-      weights_type    counts_hypo(order + 1);
+      ngram_counts_type matched(order + 1);
+      ngram_counts_type hypo(order + 1);
       
-      gradients_type gradients_matched(order + 1);
-      gradients_type gradients_hypo(order + 1);
-      
-      weight_type    reference;
-      weight_type    entropy;
-      gradient_type  gradient_reference;
-      gradient_type  gradient_entropy;
-      
-      margins_type  margins;
-
-      for (size_t n = 1; n != g_matched.size(); ++ n) {
-	gradients_matched[n].allocate();
-	gradients_hypo[n].allocate();
-	
-	g_matched[n].clear();
-	g_hypo[n].clear();
-      }
+      margins_type      margins;
+      coefficients_type coefficients;
       
-      gradient_reference.allocate();
-      gradient_entropy.allocate();
-      g_reference.clear();
-      g_entropy.clear();
+      gradients.clear();
+      gradients.resize(dimension * stride(), 0.0);
+      gradient_scale.clear();
+      gradient_scale.resize(stride(), 0.0);
       
-      std::fill(counts_matched.begin(), counts_matched.end(), weight_type());
-      std::fill(counts_hypo.begin(), counts_hypo.end(), weight_type());
       std::fill(c_matched.begin(), c_matched.end(), 0.0);
       std::fill(c_hypo.begin(), c_hypo.end(), 0.0);
       r = 0.0;
@@ -1826,38 +1842,40 @@ struct ObjectiveXBLEU
 	queue.pop(id);
 	if (id < 0) break;
 	
-	margins.clear();
-	  
-	std::fill(matched.begin(), matched.end(), weight_type());
-	std::fill(hypo.begin(), hypo.end(), weight_type());
-	expectation.clear();
-	  
-	weight_type Z;
-	weight_type Z_reference;
-	weight_type Z_entropy;
-	weight_type dR;
-	  
+	const size_type kbest_size = kbests[id].size();
+	
 	// first pass... compute margin and Z
-	for (size_type k = 0; k != kbests[id].size(); ++ k) {
-	  //const hypothesis_type& kbest = kbests[id][k];
-	  
-	  const double margin  = cicada::dot_product(weights, features_kbest[id][k].begin(), features_kbest[id][k].end(), 0.0);
-	    
-	  margins.push_back(margin);
-	  Z += cicada::semiring::traits<weight_type>::exp(margin * scale);
-	}
-
+	margins.resize(kbest_size);
+	features_kbest[id].margins(&(*weights.begin()), weights.size(), 0, kbest_size, &(*margins.begin()));
+	
+	double margin_max = - std::numeric_limits<double>::infinity();
+	for (size_type k = 0; k != kbest_size; ++ k)
+	  margin_max = std::max(margin_max, margins[k] * scale);
+	
+	double sum = 0.0;
+	for (size_type k = 0; k != kbest_size; ++ k)
+	  sum += std::exp(margins[k] * scale - margin_max);
+	
+	const double logZ = margin_max + std::log(sum);
+	
 	// second pass... compute sums (counts, etc.)
-	for (size_type k = 0; k != kbests[id].size(); ++ k) {
+	std::fill(matched.begin(), matched.end(), 0.0);
+	std::fill(hypo.begin(), hypo.end(), 0.0);
+	
+	double Z_reference = 0.0;
+	double Z_entropy = 0.0;
+	double dR = 0.0;
+	
+	for (size_type k = 0; k != kbest_size; ++ k) {
 	  const hypothesis_type& kbest = kbests[id][k];
-	    
-	  const double& margin = margins[k];
-	  const weight_type prob = cicada::semiring::traits<weight_type>::exp(margin * scale) / Z;
-	    
+	  
+	  const double logprob = margins[k] * scale - logZ;
+	  const double prob    = std::exp(logprob);
+	  
 	  const cicada::eval::Bleu* bleu = dynamic_cast<const cicada::eval::Bleu*>(kbest.score.get());
 	  if (! bleu)
 	    throw std::runtime_error("no bleu statistics?");
-	    
+	  
 	  // collect scaled bleu stats
 	  for (size_t n = 1; n <= static_cast<size_t>(order); ++ n) {
 	    if (n - 1 < bleu->ngrams_hypothesis.size())
@@ -1865,111 +1883,66 @@ struct ObjectiveXBLEU
 	    if (n - 1 < bleu->ngrams_matched.size())
 	      matched[n] += prob * bleu->ngrams_matched[n - 1];
 	  }
-	    
+	  
 	  // collect reference length
 	  Z_reference += prob * bleu->length_reference;
-	    
+	  
 	  // collect entropy...
-	  Z_entropy -= prob * cicada::semiring::log(prob);
-	    
-	  // collect expectation
-	  sample_set_type::const_reference::const_iterator fiter_end = features_kbest[id][k].end();
-	  for (sample_set_type::const_reference::const_iterator fiter = features_kbest[id][k].begin(); fiter != fiter_end; ++ fiter)
-	    expectation[fiter->first] += prob * weight_type(fiter->second * scale);
+	  Z_entropy -= prob * logprob;
 	  
-	  expectation[feature_scale] += prob * weight_type(margin);
-	    
-	  dR += weight_type(1.0 + cicada::semiring::log(prob)) * prob;
+	  dR += (1.0 + logprob) * prob;
 	}
+	
+	// third pass, the coefficient of each hypothesis for each gradient. The gradient is the
+	// expectation of value * stat minus the expectation of value times the expectation of
+	// stat, thus, we subtract the expected stat from each stat, and need only a single
+	// accumulation of the features.
+	coefficients.resize(kbest_size * stride());
+	
+	for (size_type k = 0; k != kbest_size; ++ k) {
+	  const hypothesis_type& kbest = kbests[id][k];
 	  
-	// accumulate
-	std::transform(hypo.begin(), hypo.end(), counts_hypo.begin(), counts_hypo.begin(), std::plus<weight_type>());
-	std::transform(matched.begin(), matched.end(), counts_matched.begin(), counts_matched.begin(), std::plus<weight_type>());
+	  const double logprob = margins[k] * scale - logZ;
+	  const double prob    = std::exp(logprob);
+	  
+	  const cicada::eval::Bleu* bleu = dynamic_cast<const cicada::eval::Bleu*>(kbest.score.get());
 	  
-	reference += Z_reference;
-	entropy += Z_entropy;
+	  double* citer = &(*coefficients.begin()) + k * stride();
 	  
-	expectation_type::const_iterator eiter_end = expectation.end();
-	for (expectation_type::const_iterator eiter = expectation.begin(); eiter != eiter_end; ++ eiter) {
-	  // collect bleus...
 	  for (int n = 1; n <= order; ++ n) {
-	    gradients_hypo[n][eiter->first] -= eiter->second * hypo[n];
-	    gradients_matched[n][eiter->first] -= eiter->second * matched[n];
-	  }
-	    
-	  // reference lengths
-	  gradient_reference[eiter->first] -= eiter->second * Z_reference;
-	    
-	  // entropy gradient...
-	  gradient_entropy[eiter->first] -= - dR * eiter->second;
-	}
-	
-	// third pass, collect gradients...
-	for (size_type k = 0; k != kbests[id].size(); ++ k) {
-	  const hypothesis_type& kbest = kbests[id][k];
-	    
-	  const double& margin = margins[k];
-	  const weight_type prob = cicada::semiring::traits<weight_type>::exp(margin * scale) / Z;
-	  const cicada::eval::Bleu* bleu = dynamic_cast<const cicada::eval::Bleu*>(kbest.score.get());
+	    const double ngrams_hypothesis = (size_t(n - 1) < bleu->ngrams_hypothesis.size() ? double(bleu->ngrams_hypothesis[n - 1]) : 0.0);
+	    const double ngrams_matched    = (size_t(n - 1) < bleu->ngrams_matched.size()    ? double(bleu->ngrams_matched[n - 1])    : 0.0);
 	    
-	  // collect feature expectations etc...
-	  sample_set_type::const_reference::const_iterator fiter_end = features_kbest[id][k].end();
-	  for (sample_set_type::const_reference::const_iterator fiter = features_kbest[id][k].begin(); fiter != fiter_end; ++ fiter) {
-	    const weight_type value(fiter->second * scale);
-	      
-	    // bleu statistics
-	    for (size_t n = 1; n <= static_cast<size_t>(order); ++ n) {
-	      if (n - 1 < bleu->ngrams_hypothesis.size())
-		gradients_hypo[n][fiter->first] += value * prob * bleu->ngrams_hypothesis[n - 1];
-		
-	      if (n - 1 < bleu->ngrams_matched.size())
-		gradients_matched[n][fiter->first] += value * prob * bleu->ngrams_matched[n - 1];
-	    }
-	      
-	    // reference lengths
-	    gradient_reference[fiter->first] += value * prob * bleu->length_reference;
-	      
-	    // entropy: we will collect minus values!
-	    gradient_entropy[fiter->first] += - weight_type(1.0 + cicada::semiring::log(prob)) * prob * value;
+	    citer[column_hypo(n)]    = prob * (ngrams_hypothesis - hypo[n]);
+	    citer[column_matched(n)] = prob * (ngrams_matched - matched[n]);
 	  }
-	    
-	  const weight_type value_scale(margin);
-	    
-	  for (size_t n = 1; n <= static_cast<size_t>(order); ++ n) {
-	    if (n - 1 < bleu->ngrams_hypothesis.size())
-	      gradients_hypo[n][feature_scale] += value_scale * prob * bleu->ngrams_hypothesis[n - 1];
-	      
-	    if (n - 1 < bleu->ngrams_matched.size())
-	      gradients_matched[n][feature_scale] += value_scale * prob * bleu->ngrams_matched[n - 1];
+	  
+	  citer[column_reference()] = prob * (bleu->length_reference - Z_reference);
+	  
+	  // entropy: we will collect minus values!
+	  citer[column_entropy()] = prob * (dR - (1.0 + logprob));
+	  
+	  // the value of the feature-scale is the margin, and the other features are scaled
+	  for (size_type c = 0; c != stride(); ++ c) {
+	    gradient_scale[c] += citer[c] * margins[k];
+	    citer[c] *= scale;
 	  }
-	    
-	  gradient_reference[feature_scale] += value_scale * prob * bleu->length_reference;
-	  gradient_entropy[feature_scale] += - weight_type(1.0 + cicada::semiring::log(prob)) * prob * value_scale;
 	}
-      }
-      
-      // copy from weight space to double space
-      std::copy(counts_matched.begin(), counts_matched.end(), c_matched.begin());
-      std::copy(counts_hypo.begin(), counts_hypo.end(), c_hypo.begin());
-      
-      for (size_t n = 1; n != g_matched.size(); ++ n) {
-	g_matched[n].allocate();
-	g_hypo[n].allocate();
 	
-	std::copy(gradients_matched[n].begin(), gradients_matched[n].end(), g_matched[n].begin());
-	std::copy(gradients_hypo[n].begin(), gradients_hypo[n].end(), g_hypo[n].begin());
+	features_kbest[id].accumulate(0, kbest_size, &(*coefficients.begin()), stride(), &(*gradients.begin()));
+	
+	// accumulate
+	for (int n = 1; n <= order; ++ n) {
+	  c_hypo[n]    += hypo[n];
+	  c_matched[n] += matched[n];
+	}
+	
+	r += Z_reference;
+	e += Z_entropy;
       }
-      
-      g_reference.allocate();
-      g_entropy.allocate();
-      std::copy(gradient_reference.begin(), gradient_reference.end(), g_reference.begin());
-      std::copy(gradient_entropy.begin(), gradient_entropy.end(), g_entropy.begin());
-
-      r = reference;
-      e = entropy;
     }
   };
-
+  
   
   double operator()(size_t size, const double* x, double* g) const
   {
@@ -1978,11 +1951,13 @@ struct ObjectiveXBLEU
     
     typedef std::vector<task_type, std::allocator<task_type> > task_set_type;
     
+    utils::resource start;
+    
     // swapping...!
     std::swap(weights[feature_type(feature_type::id_type(0))], weights[feature_scale]);
     
     queue_type queue;
-    task_set_type tasks(threads, task_type(queue, kbests, features_kbest, scorers, weights, feature_scale));
+    task_set_type tasks(threads, task_type(queue, kbests, features_kbest, scorers, weights, feature_scale, dimension));
     
     boost::thread_group workers;
     for (int i = 0; i < threads; ++ i)
@@ -2002,26 +1977,19 @@ struct ObjectiveXBLEU
     
     task_type::ngram_counts_type c_matched(order + 1, 0.0);
     task_type::ngram_counts_type c_hypo(order + 1, 0.0);
-
-    task_type::feature_counts_type g_matched(order + 1);
-    task_type::feature_counts_type g_hypo(order + 1);
-    weight_set_type g_reference;
-    weight_set_type g_entropy;
+    
+    task_type::gradients_type gradients(dimension * task_type::stride(), 0.0);
+    task_type::gradients_type gradient_scale(task_type::stride(), 0.0);
     
     double r(0.0);
     double e(0.0);
-      
+    
     for (int i = 0; i < threads; ++ i) {
       std::transform(tasks[i].c_matched.begin(), tasks[i].c_matched.end(), c_matched.begin(), c_matched.begin(), std::plus<double>());
       std::transform(tasks[i].c_hypo.begin(), tasks[i].c_hypo.end(), c_hypo.begin(), c_hypo.begin(), std::plus<double>());
       
-      for (int n = 1; n <= order; ++ n) {
-	g_matched[n] += tasks[i].g_matched[n];
-	g_hypo[n] += tasks[i].g_hypo[n];
-      }
-      
-      g_reference += tasks[i].g_reference;
-      g_entropy += tasks[i].g_entropy;
+      std::transform(tasks[i].gradients.begin(), tasks[i].gradients.end(), gradients.begin(), gradients.begin(), std::plus<double>());
+      std::transform(tasks[i].gradient_scale.begin(), tasks[i].gradient_scale.end(), gradient_scale.begin(), gradient_scale.begin(), std::plus<double>());
       
       r += tasks[i].r;
       e += tasks[i].e;
@@ -2055,30 +2023,31 @@ struct ObjectiveXBLEU
     const double objective_bleu = exp_P * B;
     const double entropy = e / instances;
     
-    if (temperature != 0.0)
-      std::transform(g_entropy.begin(), g_entropy.end(), g, std::bind2nd(std::multiplies<double>(), - temperature / instances));
-    else
-      std::fill(g, g + size, 0.0);
+    // the factors for each column of the gradients
+    task_type::gradients_type factors(task_type::stride(), 0.0);
+    
+    factors[task_type::column_entropy()] = - temperature / instances;
     
-    for (int n = 1; n <= order; ++ n) 
+    for (int n = 1; n <= order; ++ n)
       if (c_hypo[n] > 0.0) {
-	const double factor_matched = - (exp_P * B / order) / c_matched[n];
-	const double factor_hypo    = - (exp_P * B / order) / c_hypo[n];
-	
-	for (size_t i = 0; i != static_cast<size_t>(size); ++ i) {
-	  g[i] += factor_matched * g_matched[n][i];
-	  g[i] -= factor_hypo * g_hypo[n][i];
-	}
+	factors[task_type::column_matched(n)] += - (exp_P * B / order) / c_matched[n];
+	factors[task_type::column_hypo(n)]    -= - (exp_P * B / order) / c_hypo[n];
       }
     
     if (c_hypo[1] > 0.0) {
-      const double factor_ref  = - exp_P * C_dC / r;
-      const double factor_hypo = - exp_P * C_dC / c_hypo[1];
+      factors[task_type::column_reference()] -= - exp_P * C_dC / r;
+      factors[task_type::column_hypo(1)]     += - exp_P * C_dC / c_hypo[1];
+    }
+    
+    for (size_t i = 0; i != static_cast<size_t>(size); ++ i) {
+      const double* giter = (i == feature_scale.id()
+			     ? &(*gradient_scale.begin())
+			     : (i < dimension ? &(*gradients.begin()) + i * task_type::stride() : 0));
       
-      for (size_t i = 0; i != static_cast<size_t>(size); ++ i) {
-	g[i] -= factor_ref  * g_reference[i];
-	g[i] += factor_hypo * g_hypo[1][i];
-      }
+      g[i] = 0.0;
+      if (giter)
+	for (size_type c = 0; c != task_type::stride(); ++ c)
+	  g[i] += factors[c] * giter[c];
     }
     
     // we need to minimize negative bleu... + regularized by average entropy...
@@ -2097,12 +2066,16 @@ struct ObjectiveXBLEU
     if (scale_fixed)
       g[feature_scale.id()] = 0.0;
     
+    utils::resource end;
+    
     if (debug >= 2)
       std::cerr << "objective: " << objective
 		<< " xBLEU: " << objective_bleu
 		<< " BP: " << B
 		<< " entropy: " << entropy
 		<< " scale: " << weights[feature_scale]
+		<< " cpu time: " << (end.cpu_time() - start.cpu_time())
+		<< " user time: " << (end.user_time() - start.user_time())
 		<< std::endl;
     
     // swapping...!
@@ -2111,7 +2084,7 @@ struct ObjectiveXBLEU
     
     return objective;
   }
-  
+
 };
 
 struct ObjectiveSoftmax
@@ -2120,78 +2093,20 @@ struct ObjectiveSoftmax
   typedef ptrdiff_t difference_type;
   
   typedef hypothesis_type::feature_value_type feature_value_type;
-
-  
-  struct SampleSet
-  {
-    typedef std::vector<feature_value_type, std::allocator<feature_value_type> > features_type;
-    typedef std::vector<size_type, std::allocator<size_type> > offsets_type;
-    
-    struct Sample
-    {
-      typedef const feature_value_type* const_iterator;
-      
-      Sample(const_iterator __first, const_iterator __last) : first(__first), last(__last) {}
-      
-      const_iterator begin() const { return first; }
-      const_iterator end() const { return last; }
-      size_type size() const { return last - first; }
-      bool emtpy() const { return first == last; }
-      
-      const_iterator first;
-      const_iterator last;
-    };
-
-    typedef Sample sample_type;
-    typedef sample_type value_type;
-    
-    SampleSet() : features(), offsets() { offsets.push_back(0); }
-    
-    void clear()
-    {
-      features.clear();
-      offsets.clear();
-      offsets.push_back(0);
-    }
-    
-    template <typename Iterator>
-    void insert(Iterator first, Iterator last)
-    {
-      features.insert(features.end(), first, last);
-      offsets.push_back(features.size());
-    }
-    
-    sample_type operator[](size_type pos) const
-    {
-      return sample_type(&(*features.begin()) + offsets[pos], &(*features.begin()) + offsets[pos + 1]);
-    }
-    
-    size_type size() const { return offsets.size() - 1; }
-    bool empty() const { return offsets.size() == 1; }
-    
-    void shrink()
-    {
-      features_type(features).swap(features);
-      offsets_type(offsets).swap(offsets);
-    }
-    
-    features_type features;
-    offsets_type  offsets;
-  };
   
-  typedef SampleSet sample_set_type;
+  typedef cicada::KBestMatrix sample_set_type;
   
   struct sample_pair_type
   {
     typedef std::vector<double, std::allocator<double> > loss_set_type;
-
+    
     sample_pair_type() : features(), loss(),  offset(0) {}
     sample_pair_type(const hypothesis_set_type& kbests,
 		     const hypothesis_set_type& oracles)
       : features(), loss(),  offset(0)
     {
       loss.reserve(kbests.size() + oracles.size());
-
+      
       hypothesis_set_type::const_iterator oiter_end = oracles.end();
       for (hypothesis_set_type::const_iterator oiter = oracles.begin(); oiter != oiter_end; ++ oiter) {
 	features.insert(oiter->features.begin(), oiter->features.end());
@@ -2223,60 +2138,78 @@ struct ObjectiveSoftmax
   };
   
   typedef std::vector<sample_pair_type, std::allocator<sample_pair_type> > sample_pair_set_type;
-
+  
   ObjectiveSoftmax(const hypothesis_map_type& kbests,
 		   const hypothesis_map_type& oracles,
 		   weight_set_type& __weights,
 		   const double& __lambda)
     : weights(__weights),
-      lambda(__lambda)
+      lambda(__lambda),
+      dimension(0)
   {
     // transform into sample-pair-set-type
     
     const size_t id_max = utils::bithack::min(kbests.size(), oracles.size());
     
     samples.reserve(id_max);
-    for (size_t id = 0; id != id_max; ++ id) 
-      if (! kbests[id].empty() && ! oracles[id].empty())
+    for (size_t id = 0; id != id_max; ++ id)
+      if (! kbests[id].empty() && ! oracles[id].empty()) {
 	samples.push_back(sample_pair_type(kbests[id], oracles[id]));
+	
+	dimension = utils::bithack::max(dimension, samples.back().features.dimension());
+      }
   }
   
   sample_pair_set_type samples;
   
   weight_set_type& weights;
   double lambda;
+  size_type dimension;
   
   struct Task
   {
     typedef hypothesis_type::feature_value_type feature_value_type;
     
-    typedef cicada::semiring::Log<double> weight_type;
-    typedef cicada::WeightVector<weight_type > expectation_type;
-
+    typedef std::vector<double, std::allocator<double> > gradient_type;
+    
     typedef utils::lockfree_list_queue<int, std::allocator<int> > queue_type;
     
     Task(queue_type&            __queue,
 	 const weight_set_type& __weights,
 	 const sample_pair_set_type& __samples,
-	 const size_t& __instances)
+	 const size_t& __instances,
+	 const size_t& __dimension)
       : queue(__queue),
 	weights(__weights),
 	samples(__samples),
-	instances(__instances)
+	instances(__instances),
+	dimension(__dimension)
     {}
     
-
+    // normalize exp(margins) in [first, last) into probabilities, and return the log of the normalizer
+    static double normalize(double* first, double* last)
+    {
+      const double margin_max = *std::max_element(first, last);
+      
+      double sum = 0.0;
+      for (double* iter = first; iter != last; ++ iter) {
+	*iter = std::exp(*iter - margin_max);
+	sum += *iter;
+      }
+      
+      for (double* iter = first; iter != last; ++ iter)
+	*iter /= sum;
+      
+      return margin_max + std::log(sum);
+    }
+    
     void operator()()
     {
       typedef std::vector<double, std::allocator<double> > margin_set_type;
-
+      
       g.clear();
+      g.resize(dimension, 0.0);
       objective = 0.0;
-
-      expectation_type  expectations;
-      
-      expectations.allocate();
-      expectations.clear();
       
       margin_set_type margins;
       
@@ -2287,73 +2220,46 @@ struct ObjectiveSoftmax
 	queue.pop(id);
 	if (id < 0) break;
 	
-	weight_type Z_oracle;
-	weight_type Z_kbest;
+	const sample_pair_type& sample = samples[id];
 	
-	margins.clear();
-	margins.resize(samples[id].size());
+	margins.resize(sample.size());
 	
-	for (size_type i = samples[id].oracle_begin(); i != samples[id].oracle_end(); ++ i) {
-	  const sample_set_type::value_type features = samples[id].features[i];
-	  const double loss = samples[id].loss[i];
-	  
-	  margins[i] = cicada::dot_product(weights, features.begin(), features.end(), cost_factor * loss);
-	  
-	  Z_oracle += cicada::semiring::traits<weight_type>::exp(margins[i]);
-	}
+	sample.features.margins(&(*weights.begin()), weights.size(), 0, sample.size(), &(*margins.begin()));
 	
-	for (size_type i = samples[id].kbest_begin(); i != samples[id].kbest_end(); ++ i) {
-	  const sample_set_type::value_type features = samples[id].features[i];
-	  const double loss = samples[id].loss[i];
-	  
-	  margins[i] = cicada::dot_product(weights, features.begin(), features.end(), cost_factor * loss);
-	  
-	  Z_kbest += cicada::semiring::traits<weight_type>::exp(margins[i]);
-	}
+	for (size_type i = 0; i != sample.size(); ++ i)
+	  margins[i] += cost_factor * sample.loss[i];
 	
-	for (size_type i = samples[id].oracle_begin(); i != samples[id].oracle_end(); ++ i) {
-	  const sample_set_type::value_type features = samples[id].features[i];
-	  const weight_type weight = cicada::semiring::traits<weight_type>::exp(margins[i]) / Z_oracle;
-	  
-	  sample_set_type::value_type::const_iterator fiter_end = features.end();
-	  for (sample_set_type::value_type::const_iterator fiter = features.begin(); fiter != fiter_end; ++ fiter)
-	    expectations[fiter->first] -= weight_type(fiter->second) * weight;
-	}
+	// margins are turned into the posteriors, negated for the oracles, then, the expectations are
+	// accumulated in a single pass
+	const double logZ_oracle = normalize(&(*margins.begin()) + sample.oracle_begin(), &(*margins.begin()) + sample.oracle_end());
+	const double logZ_kbest  = normalize(&(*margins.begin()) + sample.kbest_begin(),  &(*margins.begin()) + sample.kbest_end());
 	
-	for (size_type i = samples[id].kbest_begin(); i != samples[id].kbest_end(); ++ i) {
-	  const sample_set_type::value_type features = samples[id].features[i];
-	  const weight_type weight = cicada::semiring::traits<weight_type>::exp(margins[i]) / Z_kbest;
-	  
-	  sample_set_type::value_type::const_iterator fiter_end = features.end();
-	  for (sample_set_type::value_type::const_iterator fiter = features.begin(); fiter != fiter_end; ++ fiter)
-	    expectations[fiter->first] += weight_type(fiter->second) * weight;
-	}
+	for (size_type i = sample.oracle_begin(); i != sample.oracle_end(); ++ i)
+	  margins[i] = - margins[i];
 	
-	const double margin = log(Z_oracle) - log(Z_kbest);
+	sample.features.accumulate(0, sample.size(), &(*margins.begin()), 1, &(*g.begin()));
+	
+	const double margin = logZ_oracle - logZ_kbest;
 	objective -= margin;
 	
 	if (debug >= 3)
 	  std::cerr << "id: " << id << " margin: " << margin << std::endl;
       }
       
-      // transform feature_expectations into g...
-      
-      g.allocate();
-      std::copy(expectations.begin(), expectations.end(), g.begin());
-      
       objective /= instances;
       std::transform(g.begin(), g.end(), g.begin(), std::bind2nd(std::multiplies<double>(), 1.0 / instances));
     }
-
+    
     queue_type&            queue;
     
     const weight_set_type& weights;
     const sample_pair_set_type& samples;
     
     size_type instances;
+    size_type dimension;
     
-    double          objective;
-    weight_set_type g;
+    double        objective;
+    gradient_type g;
   };
   
   double operator()(size_t n, const double* x, double* g) const
@@ -2363,10 +2269,12 @@ struct ObjectiveSoftmax
     
     typedef std::vector<task_type, std::allocator<task_type> > task_set_type;
     
+    utils::resource start;
+    
     const size_type instances = samples.size();
     
     queue_type queue;
-    task_set_type tasks(threads, task_type(queue, weights, samples, instances));
+    task_set_type tasks(threads, task_type(queue, weights, samples, instances, dimension));
     
     boost::thread_group workers;
     for (int i = 0; i < threads; ++ i)
@@ -2387,7 +2295,7 @@ struct ObjectiveSoftmax
     
     for (int i = 0; i < threads; ++ i) {
       objective += tasks[i].objective;
-      std::transform(tasks[i].g.begin(), tasks[i].g.end(), g, g, std::plus<double>());
+      std::transform(tasks[i].g.begin(), tasks[i].g.begin() + utils::bithack::min(n, dimension), g, g, std::plus<double>());
     }
     
     // L2...
@@ -2401,8 +2309,13 @@ struct ObjectiveSoftmax
       objective += 0.5 * lambda * norm;
     }
     
+    utils::resource end;
+    
     if (debug >= 2)
-      std::cerr << "objective: " << objective << std::endl;
+      std::cerr << "objective: " << objective
+		<< " cpu time: " << (end.cpu_time() - start.cpu_time())
+		<< " user time: " << (end.user_time() - start.user_time())
+		<< std::endl;
     
     return objective;
   }
@@ -2643,7 +2556,9 @@ struct TaskLoss
 
       hypothesis_set_type::iterator kiter_end = kbests[id].end();
       for (hypothesis_set_type::iterator kiter = kbests[id].begin(); kiter != kiter_end; ++ kiter) {
-	kiter->score = scorers[id]->score(sentence_type(sentence_type(kiter->sentence.begin(), kiter->sentence.end())));
+	// scores may be already read from a k-best store
+	if (! kiter->score)
+	  kiter->score = scorers[id]->score(sentence_type(sentence_type(kiter->sentence.begin(), kiter->sentence.end())));
 	kiter->loss = kiter->score->loss();
       }
     }
@@ -2763,7 +2678,7 @@ void unique_kbest(hypothesis_map_type& kbests)
 
 struct TaskReadUnite
 {
-  typedef std::pair<path_type, path_type> path_pair_type;
+  typedef std::pair<KBestFile, KBestFile> path_pair_type;
   typedef utils::lockfree_list_queue<path_pair_type, std::allocator<path_pair_type> > queue_type;
   
   TaskReadUnite(queue_type& __queue)
@@ -2783,10 +2698,24 @@ struct TaskReadUnite
       
       if (paths.first.empty() && paths.second.empty()) break;
       
-      const path_type& path           = (! paths.first.empty() ? paths.first : paths.second);
+      const KBestFile& file           = (! paths.first.empty() ? paths.first : paths.second);
       hypothesis_map_type& hypotheses = (! paths.first.empty() ? kbests      : oracles);
       
-      utils::compress_istream is(path, 1024 * 1024);
+      if (file.store) {
+	const KBestStore::off_type last = file.store->last(file.block, file.segment);
+	
+	for (KBestStore::off_type pos = file.store->first(file.block, file.segment); pos != last; ++ pos) {
+	  const size_t id = file.store->id(pos);
+	  
+	  if (id >= hypotheses.size())
+	    hypotheses.resize(id + 1);
+	  
+	  file.store->read(pos, pos + 1, hypotheses[id]);
+	}
+	continue;
+      }
+      
+      utils::compress_istream is(file.path, 1024 * 1024);
       is.unsetf(std::ios::skipws);
       
       iter_type iter(is);
@@ -2817,7 +2746,7 @@ struct TaskReadUnite
 
 struct TaskReadSync
 {
-  typedef boost::fusion::tuple<path_type, path_type, size_t, size_t> path_pair_type;
+  typedef boost::fusion::tuple<KBestFile, KBestFile, size_t, size_t> path_pair_type;
   typedef utils::lockfree_list_queue<path_pair_type, std::allocator<path_pair_type> > queue_type;
   
   TaskReadSync(queue_type& __queue, const scorer_document_type& __scorers)
@@ -2872,11 +2801,40 @@ struct TaskReadSync
     hypotheses.swap(merged);
   }
 
-  void operator()()
+  typedef boost::spirit::istream_iterator iter_type;
+  typedef kbest_feature_parser<iter_type> parser_type;
+  
+  void read_hypotheses(const KBestFile& file, hypothesis_set_type& hypotheses, const parser_type& parser, kbest_feature_type& kbest_feature)
   {
-    typedef boost::spirit::istream_iterator iter_type;
-    typedef kbest_feature_parser<iter_type> parser_type;
+    // hypotheses in a k-best store are already unique
+    if (file.store) {
+      file.store->read(file.store->first(file.block, file.segment), file.store->last(file.block, file.segment), hypotheses);
+      return;
+    }
+    
+    utils::compress_istream is(file.path, 1024 * 1024);
+    is.unsetf(std::ios::skipws);
+    
+    iter_type iter(is);
+    iter_type iter_end;
     
+    while (iter != iter_end) {
+      boost::fusion::get<1>(kbest_feature).clear();
+      boost::fusion::get<2>(kbest_feature).clear();
+      
+      if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, kbest_feature))
+	if (iter != iter_end)
+	  throw std::runtime_error("kbest parsing failed");
+      
+      hypotheses.push_back(hypothesis_type(kbest_feature));
+    }
+    
+    // unique
+    unique_hypotheses(hypotheses);
+  }
+
+  void operator()()
+  {
     parser_type parser;
     kbest_feature_type kbest_feature;
 
@@ -2901,30 +2859,13 @@ struct TaskReadSync
       kbest_map.push_back(mappos);
       
       if (! boost::fusion::get<0>(paths).empty()) {
-	utils::compress_istream is(boost::fusion::get<0>(paths), 1024 * 1024);
-	is.unsetf(std::ios::skipws);
-	
-	iter_type iter(is);
-	iter_type iter_end;
-	
-	while (iter != iter_end) {
-	  boost::fusion::get<1>(kbest_feature).clear();
-	  boost::fusion::get<2>(kbest_feature).clear();
-	    
-	  if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, kbest_feature))
-	    if (iter != iter_end)
-	      throw std::runtime_error("kbest parsing failed");
-	  
-	  kbests.back().push_back(hypothesis_type(kbest_feature));
-	}
-	
-	// unique
-	unique_hypotheses(kbests.back());
+	read_hypotheses(boost::fusion::get<0>(paths), kbests.back(), parser, kbest_feature);
 	
 	if (! scorers.empty()) {
 	  hypothesis_set_type::iterator kiter_end = kbests.back().end();
 	  for (hypothesis_set_type::iterator kiter = kbests.back().begin(); kiter != kiter_end; ++ kiter) {
-	    kiter->score = scorers[refpos]->score(sentence_type(kiter->sentence.begin(), kiter->sentence.end()));
+	    if (! kiter->score)
+	      kiter->score = scorers[refpos]->score(sentence_type(kiter->sentence.begin(), kiter->sentence.end()));
 	    kiter->loss  = kiter->score->loss();
 	  }
 	} else {
@@ -2935,30 +2876,13 @@ struct TaskReadSync
       }
       
       if (! boost::fusion::get<1>(paths).empty()) {
-	utils::compress_istream is(boost::fusion::get<1>(paths), 1024 * 1024);
-	is.unsetf(std::ios::skipws);
-	  
-	iter_type iter(is);
-	iter_type iter_end;
-	  
-	while (iter != iter_end) {
-	  boost::fusion::get<1>(kbest_feature).clear();
-	  boost::fusion::get<2>(kbest_feature).clear();
-	  
-	  if (! boost::spirit::qi::phrase_parse(iter, iter_end, parser, boost::spirit::standard::blank, kbest_feature))
-	    if (iter != iter_end)
-	      throw std::runtime_error("kbest parsing failed");
-	  
-	  oracles.back().push_back(hypothesis_type(kbest_feature));
-	}
-
-	// unique
-	unique_hypotheses(oracles.back());
+	read_hypotheses(boost::fusion::get<1>(paths), oracles.back(), parser, kbest_feature);
 	
 	if (! scorers.empty()) {
 	  hypothesis_set_type::iterator oiter_end = oracles.back().end();
 	  for (hypothesis_set_type::iterator oiter = oracles.back().begin(); oiter != oiter_end; ++ oiter) {
-	    oiter->score = scorers[refpos]->score(sentence_type(oiter->sentence.begin(), oiter->sentence.end()));
+	    if (! oiter->score)
+	      oiter->score = scorers[refpos]->score(sentence_type(oiter->sentence.begin(), oiter->sentence.end()));
 	    oiter->loss  = oiter->score->loss();
 	  }
 	} else {
@@ -2979,8 +2903,8 @@ struct TaskReadSync
 };
 
 void read_kbest(const scorer_document_type& scorers,
-		const path_set_type& kbest_path,
-		const path_set_type& oracle_path,
+		const kbest_set_set_type& kbest_sets,
+		const kbest_set_set_type& oracle_sets,
 		hypothesis_map_type& kbests,
 		hypothesis_map_type& oracles,
 		kbest_map_type& kbest_map)
@@ -3000,38 +2924,30 @@ void read_kbest(const scorer_document_type& scorers,
     for (int i = 0; i != threads; ++ i)
       workers.add_thread(new boost::thread(boost::ref(tasks[i])));
     
-    for (path_set_type::const_iterator piter = kbest_path.begin(); piter != kbest_path.end(); ++ piter) {
+    for (kbest_set_set_type::const_iterator siter = kbest_sets.begin(); siter != kbest_sets.end(); ++ siter) {
       if (debug)
-	std::cerr << "reading kbest: " << piter->string() << std::endl;
+	std::cerr << "reading kbest: " << siter->path.string() << std::endl;
       
       for (size_t i = 0; /**/; ++ i) {
-	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
-	
-	const path_type path_kbest = (*piter) / file_name;
-	
-	if (! boost::filesystem::exists(path_kbest)) break;
+	if (! siter->exists(i)) break;
 	
-	queue.push(std::make_pair(path_kbest, path_type()));
+	queue.push(std::make_pair(siter->file(i), KBestFile()));
       }
     }
     
-    for (path_set_type::const_iterator piter = oracle_path.begin(); piter != oracle_path.end(); ++ piter) {
+    for (kbest_set_set_type::const_iterator siter = oracle_sets.begin(); siter != oracle_sets.end(); ++ siter) {
       if (debug)
-	std::cerr << "reading oracles: " << piter->string() << std::endl;
+	std::cerr << "reading oracles: " << siter->path.string() << std::endl;
       
       for (size_t i = 0; /**/; ++ i) {
-	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
+	if (! siter->exists(i)) break;
 	
-	const path_type path_oracle = (*piter) / file_name;
-	
-	if (! boost::filesystem::exists(path_oracle)) break;
-	
-	queue.push(std::make_pair(path_type(), path_oracle));
+	queue.push(std::make_pair(KBestFile(), siter->file(i)));
       }
     }
     
     for (int i = 0; i != threads; ++ i)
-      queue.push(std::make_pair(path_type(), path_type()));
+      queue.push(std::make_pair(KBestFile(), KBestFile()));
     
     workers.join_all();
 
@@ -3108,7 +3024,7 @@ void read_kbest(const scorer_document_type& scorers,
     typedef std::vector<task_type, std::allocator<task_type> > task_set_type;
     
     // synchronous reading...
-    if (kbest_path.size() != oracle_path.size())
+    if (kbest_sets.size() != oracle_sets.size())
       throw std::runtime_error("# of kbests does not match");
     
     queue_type queue(threads);
@@ -3119,25 +3035,20 @@ void read_kbest(const scorer_document_type& scorers,
       workers.add_thread(new boost::thread(boost::ref(tasks[i])));
     
     size_t refpos = 0;
-    for (size_t pos = 0; pos != kbest_path.size(); ++ pos) {
+    for (size_t pos = 0; pos != kbest_sets.size(); ++ pos) {
       if (debug)
-	std::cerr << "reading kbest: " << kbest_path[pos].string() << " with " << oracle_path[pos].string() << std::endl;
+	std::cerr << "reading kbest: " << kbest_sets[pos].path.string() << " with " << oracle_sets[pos].path.string() << std::endl;
       
       for (size_t i = 0; /**/; ++ i) {
-	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
-	
-	const path_type path_kbest  = kbest_path[pos] / file_name;
-	const path_type path_oracle = oracle_path[pos] / file_name;
-	
-	if (! boost::filesystem::exists(path_kbest)) break;
-	if (! boost::filesystem::exists(path_oracle)) continue;
+	if (! kbest_sets[pos].exists(i)) break;
+	if (! oracle_sets[pos].exists(i)) continue;
 	
-	queue.push(path_pair_type(path_kbest, path_oracle, refpos ++, i));
+	queue.push(path_pair_type(kbest_sets[pos].file(i), oracle_sets[pos].file(i), refpos ++, i));
       }
     }
     
     for (int i = 0; i != threads; ++ i)
-      queue.push(path_pair_type(path_type(), path_type(), size_t(-1), size_t(-1)));
+      queue.push(path_pair_type(KBestFile(), KBestFile(), size_t(-1), size_t(-1)));
     
     workers.join_all();
 
@@ -3167,7 +3078,7 @@ void read_kbest(const scorer_document_type& scorers,
 }
 
 void read_kbest(const scorer_document_type& scorers,
-		const path_set_type& kbest_path,
+		const kbest_set_set_type& kbest_sets,
 		hypothesis_map_type& kbests,
 		kbest_map_type& kbest_map)
 {
@@ -3186,23 +3097,19 @@ void read_kbest(const scorer_document_type& scorers,
     for (int i = 0; i != threads; ++ i)
       workers.add_thread(new boost::thread(boost::ref(tasks[i])));
     
-    for (path_set_type::const_iterator piter = kbest_path.begin(); piter != kbest_path.end(); ++ piter) {
+    for (kbest_set_set_type::const_iterator siter = kbest_sets.begin(); siter != kbest_sets.end(); ++ siter) {
       if (debug)
-	std::cerr << "reading kbest: " << piter->string() << std::endl;
+	std::cerr << "reading kbest: " << siter->path.string() << std::endl;
       
       for (size_t i = 0; /**/; ++ i) {
-	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
+	if (! siter->exists(i)) break;
 	
-	const path_type path_kbest = (*piter) / file_name;
-	
-	if (! boost::filesystem::exists(path_kbest)) break;
-	
-	queue.push(std::make_pair(path_kbest, path_type()));
+	queue.push(std::make_pair(siter->file(i), KBestFile()));
       }
     }
     
     for (int i = 0; i != threads; ++ i)
-      queue.push(std::make_pair(path_type(), path_type()));
+      queue.push(std::make_pair(KBestFile(), KBestFile()));
     
     workers.join_all();
     
@@ -3259,23 +3166,19 @@ void read_kbest(const scorer_document_type& scorers,
       workers.add_thread(new boost::thread(boost::ref(tasks[i])));
     
     size_t refpos = 0;
-    for (size_t pos = 0; pos != kbest_path.size(); ++ pos) {
+    for (size_t pos = 0; pos != kbest_sets.size(); ++ pos) {
       if (debug)
-	std::cerr << "reading kbest: " << kbest_path[pos].string() << std::endl;
+	std::cerr << "reading kbest: " << kbest_sets[pos].path.string() << std::endl;
       
       for (size_t i = 0; /**/; ++ i) {
-	const std::string file_name = utils::lexical_cast<std::string>(i) + ".gz";
-	
-	const path_type path_kbest  = kbest_path[pos] / file_name;
-	
-	if (! boost::filesystem::exists(path_kbest)) break;
+	if (! kbest_sets[pos].exists(i)) break;
 	
-	queue.push(path_pair_type(path_kbest, path_type(), refpos ++, i));
+	queue.push(path_pair_type(kbest_sets[pos].file(i), KBestFile(), refpos ++, i));
       }
     }
     
     for (int i = 0; i != threads; ++ i)
-      queue.push(path_pair_type(path_type(), path_type(), size_t(-1), size_t(-1)));
+      queue.push(path_pair_type(KBestFile(), KBestFile(), size_t(-1), size_t(-1)));
     
     workers.join_all();
     
@@ -539,8 +539,9 @@ struct EnvelopeTask
   typedef line_search_type::segment_set_type      segment_set_type;
   typedef line_search_type::segment_document_type segment_document_type;
 
-  typedef cicada::semiring::Envelope envelope_type;
+  typedef cicada::semiring::EnvelopeArena envelope_type;
   typedef std::vector<envelope_type, std::allocator<envelope_type> >  envelope_set_type;
+  typedef envelope_type::arena_type arena_type;
 
   typedef utils::lockfree_list_queue<int, std::allocator<int> >  queue_type;
 
@@ -560,6 +561,7 @@ struct EnvelopeTask
 
   void operator()()
   {
+    arena_type        arena;
     envelope_set_type envelopes;
 
     int seg;
@@ -570,26 +572,27 @@ struct EnvelopeTask
 
       
       
+      arena.clear();
       envelopes.clear();
       envelopes.resize(graphs[seg].nodes.size());
 
-      cicada::inside(graphs[seg], envelopes, cicada::semiring::EnvelopeFunction<weight_set_type>(origin, direction));
+      cicada::inside(graphs[seg], envelopes, cicada::semiring::EnvelopeArenaFunction<weight_set_type>(arena, origin, direction));
       
       const envelope_type& envelope = envelopes[graphs[seg].goal];
       const_cast<envelope_type&>(envelope).sort();
       
       envelope_type::const_iterator eiter_end = envelope.end();
       for (envelope_type::const_iterator eiter = envelope.begin(); eiter != eiter_end; ++ eiter) {
-	const envelope_type::line_ptr_type& line = *eiter;
+	const envelope_type::line_type& line = arena[*eiter];
 	
-	const sentence_type yield = line->yield(cicada::operation::sentence_traversal());
+	const sentence_type yield = arena.yield(*eiter, cicada::operation::sentence_traversal());
 	
 	scorer_type::score_ptr_type score = scorers[seg]->score(yield);
 	
 	if (debug >= 4)
-	  std::cerr << "segment: " << seg << " x: " << line->x << std::endl;
+	  std::cerr << "segment: " << seg << " x: " << line.x << std::endl;
 	
-	segments[seg].push_back(std::make_pair(line->x, score));
+	segments[seg].push_back(std::make_pair(line.x, score));
       }
     }
   }
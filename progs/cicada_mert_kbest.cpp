@@ -53,6 +53,7 @@
 
 #include "cicada_text_impl.hpp"
 #include "cicada_kbest_impl.hpp"
+#include "cicada_kbest_store.hpp"
 #include "cicada_mert_kbest_impl.hpp"
 
 typedef boost::filesystem::path path_type;
@@ -155,7 +156,7 @@ bool valid_bounds(Iterator first, Iterator last, BoundIterator lower, BoundItera
   return true;
 }
 
-void read_tstset(const path_set_type& files, hypothesis_map_type& kbests, const size_t scorers_size);
+void read_tstset(const kbest_set_set_type& files, hypothesis_map_type& kbests, const size_t scorers_size);
 void read_refset(const path_set_type& file, scorer_document_type& scorers);
 
 void initialize_score(hypothesis_map_type& hypotheses,
@@ -247,17 +248,22 @@ int main(int argc, char ** argv)
 
     threads = utils::bithack::max(threads, 1);
     
+    // k-best stores are expanded into their blocks
+    kbest_store_set_type tstset_stores;
+    kbest_set_set_type   tstset_sets;
+    read_kbest_sets(tstset_files, tstset_stores, tstset_sets, scorer_name, KBestStore::refset(refset_files));
+
     // read reference set
     scorer_document_type scorers(scorer_name);
     read_refset(refset_files, scorers);
 
     const size_t scorers_size = scorers.size();
     
-    if (iterative && tstset_files.size() > 1) {
+    if (iterative && tstset_sets.size() > 1) {
       scorer_document_type scorers_iterative(scorer_name);
-      scorers_iterative.resize(scorers.size() * tstset_files.size());
+      scorers_iterative.resize(scorers.size() * tstset_sets.size());
       
-      for (size_t i = 0; i != tstset_files.size(); ++ i)
+      for (size_t i = 0; i != tstset_sets.size(); ++ i)
 	std::copy(scorers.begin(), scorers.end(), scorers_iterative.begin() + scorers.size() * i);
       
       scorers.swap(scorers_iterative);
@@ -272,7 +278,7 @@ int main(int argc, char ** argv)
 
     hypothesis_map_type kbests(scorers.size());
     
-    read_tstset(tstset_files, kbests, scorers_size);
+    read_tstset(tstset_sets, kbests, scorers_size);
 
     initialize_score(kbests, scorers);
 
@@ -748,7 +754,9 @@ struct TaskInit
       for (hypothesis_unique_type::const_iterator uiter = uniques.begin(); uiter != uiter_end; ++ uiter) {
 	merged.push_back(*(*uiter));
 	
-	merged.back().score = scorers[id]->score(sentence_type(merged.back().sentence.begin(), merged.back().sentence.end()));
+	// scores may be already read from a k-best store
+	if (! merged.back().score)
+	  merged.back().score = scorers[id]->score(sentence_type(merged.back().sentence.begin(), merged.back().sentence.end()));
       }
       
       uniques.clear();
@@ -783,7 +791,7 @@ void initialize_score(hypothesis_map_type& hypotheses,
   workers.join_all();
 }
 
-void read_tstset(const path_set_type& files,
+void read_tstset(const kbest_set_set_type& files,
 		 hypothesis_map_type& hypotheses,
 		 const size_t scorers_size)
 {
@@ -797,19 +805,35 @@ void read_tstset(const path_set_type& files,
   kbest_feature_type kbest_feature;
   
   size_t iter = 0;
-  for (path_set_type::const_iterator fiter = files.begin(); fiter != files.end(); ++ fiter, ++ iter) {
-    if (! boost::filesystem::exists(*fiter) && *fiter != "-")
-      throw std::runtime_error("no file: " + fiter->string());
+  for (kbest_set_set_type::const_iterator siter = files.begin(); siter != files.end(); ++ siter, ++ iter) {
+    const path_type& path = siter->path;
+    
+    if (! boost::filesystem::exists(path) && path != "-")
+      throw std::runtime_error("no file: " + path.string());
 
     const size_t id_offset = size_t(iterative) * scorers_size * iter;
 
-    if (boost::filesystem::is_directory(*fiter)) {
+    if (siter->store) {
+      for (size_t i = 0; siter->exists(i); ++ i) {
+	const KBestFile file = siter->file(i);
+	const KBestStore::off_type last = file.store->last(file.block, file.segment);
+	
+	for (KBestStore::off_type pos = file.store->first(file.block, file.segment); pos != last; ++ pos) {
+	  const size_t id = file.store->id(pos) + id_offset;
+	  
+	  if (id >= hypotheses.size())
+	    throw std::runtime_error("invalid id: " + utils::lexical_cast<std::string>(id));
+	  if (id != i + id_offset)
+	    throw std::runtime_error("invalid id: " + utils::lexical_cast<std::string>(id));
+	  
+	  file.store->read(pos, pos + 1, hypotheses[id]);
+	}
+      }
+    } else if (boost::filesystem::is_directory(path)) {
       for (size_t i = 0; /**/; ++ i) {
-	const path_type path = (*fiter) / (utils::lexical_cast<std::string>(i) + ".gz");
-
-	if (! boost::filesystem::exists(path)) break;
+	if (! siter->exists(i)) break;
 	
-	utils::compress_istream is(path, 1024 * 1024);
+	utils::compress_istream is(siter->file(i).path, 1024 * 1024);
 	is.unsetf(std::ios::skipws);
 	
 	iter_type iter(is);
@@ -834,7 +858,7 @@ void read_tstset(const path_set_type& files,
 	}
       }
     } else {
-      utils::compress_istream is(*fiter, 1024 * 1024);
+      utils::compress_istream is(path, 1024 * 1024);
       is.unsetf(std::ios::skipws);
       
       iter_type iter(is);
@@ -692,8 +692,9 @@ void EnvelopeComputer::operator()(segment_document_type& segments, const weight_
 
   typedef boost::tokenizer<utils::space_separator, utils::piece::const_iterator, utils::piece> tokenizer_type;
 
-  typedef cicada::semiring::Envelope envelope_type;
+  typedef cicada::semiring::EnvelopeArena envelope_type;
   typedef std::vector<envelope_type, std::allocator<envelope_type> >  envelope_set_type;
+  typedef envelope_type::arena_type arena_type;
   
   const int mpi_rank = MPI::COMM_WORLD.Get_rank();
   const int mpi_size = MPI::COMM_WORLD.Get_size();
@@ -728,26 +729,29 @@ void EnvelopeComputer::operator()(segment_document_type& segments, const weight_
     }
     
     // compute local envelopes
+    arena_type        arena;
     envelope_set_type envelopes;
     
     for (int mpi_id = 0; mpi_id < static_cast<int>(graphs.size()); ++ mpi_id) {
       const int id = mpi_id * mpi_size + mpi_rank;
       
+      arena.clear();
+      
       envelopes.clear();
       envelopes.resize(graphs[mpi_id].nodes.size());
       
-      cicada::inside(graphs[mpi_id], envelopes, cicada::semiring::EnvelopeFunction<weight_set_type>(origin, direction));
+      cicada::inside(graphs[mpi_id], envelopes, cicada::semiring::EnvelopeArenaFunction<weight_set_type>(arena, origin, direction));
       
       const envelope_type& envelope = envelopes[graphs[mpi_id].goal];
       const_cast<envelope_type&>(envelope).sort();
       
       envelope_type::const_iterator eiter_end = envelope.end();
       for (envelope_type::const_iterator eiter = envelope.begin(); eiter != eiter_end; ++ eiter) {
-	const envelope_type::line_ptr_type& line = *eiter;
+	const envelope_type::line_type& line = arena[*eiter];
 	
-	const sentence_type yield = line->yield(cicada::operation::sentence_traversal());
+	const sentence_type yield = arena.yield(*eiter, cicada::operation::sentence_traversal());
 	
-	segments[id].push_back(std::make_pair(line->x, scorers[id]->score(yield)));
+	segments[id].push_back(std::make_pair(line.x, scorers[id]->score(yield)));
       }
     }
     
@@ -800,6 +804,7 @@ void EnvelopeComputer::operator()(segment_document_type& segments, const weight_
     
     bcast_weights(0, direction);
 
+    arena_type        arena;
     envelope_set_type envelopes;
     
     ostream_type os;
@@ -809,22 +814,24 @@ void EnvelopeComputer::operator()(segment_document_type& segments, const weight_
     for (int mpi_id = 0; mpi_id < static_cast<int>(graphs.size()); ++ mpi_id) {
       const int id = mpi_id * mpi_size + mpi_rank;
 
+      arena.clear();
+
       envelopes.clear();
       envelopes.resize(graphs[mpi_id].nodes.size());
       
-      cicada::inside(graphs[mpi_id], envelopes, cicada::semiring::EnvelopeFunction<weight_set_type>(origin, direction));
+      cicada::inside(graphs[mpi_id], envelopes, cicada::semiring::EnvelopeArenaFunction<weight_set_type>(arena, origin, direction));
 
       const envelope_type& envelope = envelopes[graphs[mpi_id].goal];
       const_cast<envelope_type&>(envelope).sort();
       
       envelope_type::const_iterator eiter_end = envelope.end();
       for (envelope_type::const_iterator eiter = envelope.begin(); eiter != eiter_end; ++ eiter) {
-	const envelope_type::line_ptr_type& line = *eiter;
+	const envelope_type::line_type& line = arena[*eiter];
 	
-	const sentence_type yield = line->yield(cicada::operation::sentence_traversal());
+	const sentence_type yield = arena.yield(*eiter, cicada::operation::sentence_traversal());
 	
 	os << id << ' ';
-	utils::encode_base64(line->x, std::ostream_iterator<char>(os));
+	utils::encode_base64(line.x, std::ostream_iterator<char>(os));
 	os << ' ' << scorers[id]->score(yield)->encode() << '\n';
       }
     }
@@ -63,6 +63,7 @@ bool tree_grammar_list = false;
 feature_parameter_set_type feature_parameters;
 bool feature_list = false;
 path_type output_feature;
+path_type output_trace;
 
 op_set_type ops;
 bool op_list = false;
@@ -79,11 +80,12 @@ int debug = 0;
 // input mode... use of one-line lattice input or sentence input?
 void options(int argc, char** argv);
 
-void cicada_file(operation_set_type& operations);
-void cicada_directory(operation_set_type& operations);
+void cicada_file(operation_set_type& operations, std::string& trace);
+void cicada_directory(operation_set_type& operations, std::string& trace);
 void synchronize();
 void merge_features();
 void merge_statistics(const operation_set_type& operations, operation_set_type::statistics_type& statistics);
+void merge_trace(const std::string& trace);
 
 int main(int argc, char ** argv)
 {
@@ -179,6 +181,8 @@ int main(int argc, char ** argv)
     if (mpi_rank == 0 && debug)
       std::cerr << "operations: " << operations.size() << std::endl;
     
+    operations.set_trace(! output_trace.empty());
+    
     // make sure to synchronize here... otherwise, badthink may happen...
     if (mpi_rank == 0 && ! operations.get_output_data().directory.empty())
       prepare_directory(operations.get_output_data().directory);
@@ -187,10 +191,12 @@ int main(int argc, char ** argv)
     
     ::sync();
     
+    std::string trace;
+    
     if (! operations.get_output_data().file.empty())
-      cicada_file(operations);
+      cicada_file(operations, trace);
     else
-      cicada_directory(operations);
+      cicada_directory(operations, trace);
     
     synchronize();
     
@@ -203,6 +209,9 @@ int main(int argc, char ** argv)
       std::cerr << "statistics"<< '\n'
 		<< statistics;
     
+    if (! output_trace.empty())
+      merge_trace(trace);
+    
     if (! output_feature.empty()) {
       merge_features();
       
@@ -228,6 +237,7 @@ enum {
   notify_tag,
   feature_tag,
   stat_tag,
+  trace_tag,
 };
 
 inline
@@ -385,13 +395,48 @@ void merge_statistics(const operation_set_type& operations,
 	    ++ iter;
 	    if (iter == tokenizer.end()) continue;
 	    const utils::piece thread_time = *iter;
-	
-	    statistics[name] += statistics_type::statistic_type(utils::lexical_cast<statistics_type::count_type>(count),
-								utils::lexical_cast<statistics_type::count_type>(node),
-								utils::lexical_cast<statistics_type::count_type>(edge),
-								utils::decode_base64<statistics_type::second_type>(user_time),
-								utils::decode_base64<statistics_type::second_type>(cpu_time),
-								utils::decode_base64<statistics_type::second_type>(thread_time));
+	    
+	    statistics_type::statistic_type stat(utils::lexical_cast<statistics_type::count_type>(count),
+						 utils::lexical_cast<statistics_type::count_type>(node),
+						 utils::lexical_cast<statistics_type::count_type>(edge),
+						 utils::decode_base64<statistics_type::second_type>(user_time),
+						 utils::decode_base64<statistics_type::second_type>(cpu_time),
+						 utils::decode_base64<statistics_type::second_type>(thread_time));
+	    
+	    // peaks, cache hits/misses, pruned/unpruned items and the latency histogram follow
+	    ++ iter;
+	    if (iter != tokenizer.end()) {
+	      stat.node_max = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.edge_max = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.cache_hit = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.cache_miss = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.pruned = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.unpruned = utils::lexical_cast<statistics_type::count_type>(*iter);
+	      ++ iter;
+	    }
+	    if (iter != tokenizer.end()) {
+	      stat.latency_max = utils::decode_base64<statistics_type::second_type>(*iter);
+	      ++ iter;
+	    }
+	    for (/**/; iter != tokenizer.end(); ++ iter)
+	      stat.latency.push_back(utils::lexical_cast<statistics_type::count_type>(*iter));
+	    
+	    statistics[name] += stat;
 	  } else {
 	    stream[rank].reset();
 	    device[rank].reset();
@@ -422,12 +467,84 @@ void merge_statistics(const operation_set_type& operations,
       utils::encode_base64(siter->second.cpu_time, std::ostream_iterator<char>(os));
       os << ' ';
       utils::encode_base64(siter->second.thread_time, std::ostream_iterator<char>(os));
+      os << ' ' << siter->second.node_max
+	 << ' ' << siter->second.edge_max
+	 << ' ' << siter->second.cache_hit
+	 << ' ' << siter->second.cache_miss
+	 << ' ' << siter->second.pruned
+	 << ' ' << siter->second.unpruned;
+      os << ' ';
+      utils::encode_base64(siter->second.latency_max, std::ostream_iterator<char>(os));
+      for (size_t pos = 0; pos != siter->second.latency.size(); ++ pos)
+	os << ' ' << siter->second.latency[pos];
       os << '\n';
     }
     os << '\n';
   }
 }
 
+void merge_trace(const std::string& trace)
+{
+  const int mpi_rank = MPI::COMM_WORLD.Get_rank();
+  const int mpi_size = MPI::COMM_WORLD.Get_size();
+  
+  if (mpi_rank == 0) {
+    typedef utils::mpi_device_source            device_type;
+    typedef boost::iostreams::filtering_istream stream_type;
+    
+    typedef boost::shared_ptr<device_type> device_ptr_type;
+    typedef boost::shared_ptr<stream_type> stream_ptr_type;
+    
+    typedef std::vector<device_ptr_type, std::allocator<device_ptr_type> > device_ptr_set_type;
+    typedef std::vector<stream_ptr_type, std::allocator<stream_ptr_type> > stream_ptr_set_type;
+    
+    device_ptr_set_type device(mpi_size);
+    stream_ptr_set_type stream(mpi_size);
+    
+    for (int rank = 1; rank != mpi_size; ++ rank) {
+      device[rank].reset(new device_type(rank, trace_tag, 1024 * 1024));
+      stream[rank].reset(new stream_type());
+      
+      stream[rank]->push(boost::iostreams::zlib_decompressor());
+      stream[rank]->push(*device[rank]);
+    }
+    
+    utils::compress_ostream os(output_trace, 1024 * 1024);
+    os << trace;
+    
+    std::string line;
+    
+    int non_found_iter = 0;
+    while (1) {
+      bool found = false;
+      
+      for (int rank = 1; rank != mpi_size; ++ rank)
+	while (stream[rank] && device[rank] && device[rank]->test()) {
+	  if (std::getline(*stream[rank], line)) {
+	    if (! line.empty())
+	      os << line << '\n';
+	  } else {
+	    stream[rank].reset();
+	    device[rank].reset();
+	  }
+	  
+	  found = true;
+	}
+      
+      if (std::count(device.begin(), device.end(), device_ptr_type()) == mpi_size) break;
+      
+      non_found_iter = loop_sleep(found, non_found_iter);
+    }
+    
+  } else {
+    boost::iostreams::filtering_ostream os;
+    os.push(boost::iostreams::zlib_compressor());
+    os.push(utils::mpi_device_sink(0, trace_tag, 1024 * 1024));
+    
+    os << trace;
+  }
+}
+
 
 void synchronize()
 {
@@ -608,10 +725,12 @@ struct TaskFile
 
   TaskFile(queue_single_type&   __queue_is,
 	     queue_type&   __queue_os,
-	     operation_set_type& __operations)
+	     operation_set_type& __operations,
+	     std::string& __trace)
     : queue_is(__queue_is),
       queue_os(__queue_os),
-      operations(__operations) {}
+      operations(__operations),
+      trace(__trace) {}
 
   void operator()()
   {
@@ -639,6 +758,8 @@ struct TaskFile
 	queue_is.ready();
 	
 	queue_os.push(utils::lexical_cast<std::string>(operations.get_data().id) + ' ' + operations.get_output_data().buffer);
+	
+	trace += operations.get_trace();
       }
     } else {
       std::string line;
@@ -653,6 +774,8 @@ struct TaskFile
 	queue_is.ready();
 	
 	queue_os.push(utils::lexical_cast<std::string>(operations.get_data().id) + ' ' + operations.get_output_data().buffer);
+	
+	trace += operations.get_trace();
       }
     }
     
@@ -665,6 +788,7 @@ struct TaskFile
   queue_single_type& queue_is;
   queue_type&        queue_os;
   operation_set_type& operations;
+  std::string&       trace;
 };
 
 struct ReduceFile
@@ -753,7 +877,7 @@ struct ReduceFile
   path_type   path;
 };
 
-void cicada_file(operation_set_type& operations)
+void cicada_file(operation_set_type& operations, std::string& trace)
 {
   const int mpi_rank = MPI::COMM_WORLD.Get_rank();
   const int mpi_size = MPI::COMM_WORLD.Get_size();
@@ -763,7 +887,7 @@ void cicada_file(operation_set_type& operations)
   task_type::queue_single_type queue_is(1);
   task_type::queue_type        queue_os;
   
-  boost::thread thread(task_type(queue_is, queue_os, operations));
+  boost::thread thread(task_type(queue_is, queue_os, operations, trace));
   
   if (mpi_rank == 0) {
     typedef MapFile    map_type;
@@ -923,9 +1047,11 @@ struct Task
   //typedef utils::lockfree_list_queue<std::string, std::allocator<std::string> > queue_type;
 
   Task(queue_type&   __queue,
-       operation_set_type& __operations)
+       operation_set_type& __operations,
+       std::string& __trace)
     : queue(__queue),
-      operations(__operations) {}
+      operations(__operations),
+      trace(__trace) {}
 
   void operator()()
   {
@@ -946,6 +1072,8 @@ struct Task
 	  throw std::runtime_error("invalid file? " + file);
 	
 	queue.ready();
+	
+	trace += operations.get_trace();
       }
     } else {
       std::string line;
@@ -958,6 +1086,8 @@ struct Task
 	operations(line);
 	
 	queue.ready();
+	
+	trace += operations.get_trace();
       }
     }
     
@@ -967,9 +1097,10 @@ struct Task
   
   queue_type&   queue;
   operation_set_type& operations;
+  std::string&  trace;
 };
 
-void cicada_directory(operation_set_type& operations)
+void cicada_directory(operation_set_type& operations, std::string& trace)
 {
   const int mpi_rank = MPI::COMM_WORLD.Get_rank();
   const int mpi_size = MPI::COMM_WORLD.Get_size();
@@ -980,7 +1111,7 @@ void cicada_directory(operation_set_type& operations)
 
   queue_type queue(1);
   
-  boost::thread thread(task_type(queue, operations));
+  boost::thread thread(task_type(queue, operations, trace));
   
   if (mpi_rank == 0) {
     typedef utils::mpi_ostream ostream_type;
@@ -1158,6 +1289,7 @@ void options(int argc, char** argv)
     ("feature-function",        po::value<feature_parameter_set_type >(&feature_parameters)->composing(), "feature function(s)")
     ("feature-function-list",   po::bool_switch(&feature_list),                                           "list of available feature function(s)")
     ("output-feature-function", po::value<path_type>(&output_feature),                                    "output feature function(s)")
+    ("output-trace",            po::value<path_type>(&output_trace),                                      "output per-sentence trace of operations (JSON lines)")
     
     //operatins...
     ("operation",      po::value<op_set_type>(&ops)->composing(), "operations")
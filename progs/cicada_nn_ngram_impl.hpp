@@ -11,6 +11,9 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 
 #define BOOST_SPIRIT_THREADSAFE
 #define PHOENIX_THREADSAFE
@@ -1009,6 +1012,22 @@ struct NGram
   tensor_type delta_context_;
   tensor_type delta_hidden_;
 
+  // for mini-batch
+  typedef std::vector<word_type, std::allocator<word_type> > word_set_type;
+  typedef std::pair<word_type::id_type, size_type> word_column_type;
+  typedef std::vector<word_column_type, std::allocator<word_column_type> > word_column_set_type;
+  
+  tensor_type embedding_target_;
+  tensor_type embedding_noise_;
+  tensor_type loss_target_;
+  tensor_type loss_noise_;
+  tensor_type delta_output_;
+
+  word_set_type        targets_;
+  word_set_type        noises_;
+  word_column_set_type columns_input_;
+  word_column_set_type columns_output_;
+
   struct hinge
   {
     // 50 for numerical stability...
@@ -1150,6 +1169,171 @@ struct NGram
 
     return log_likelihood;
   }
+
+  // mini-batch version of learn: the contexts of ngrams indexed by [first, last) in data are
+  // stacked into matrices, and the noise samples are shared by the ngrams in the mini-batch, so
+  // that the hidden and output layers are computed by matrix-matrix products. The gradients of
+  // the sparse embeddings are accumulated per unique word.
+  template <typename Data, typename Iterator, typename Gen>
+  void learn(const Data& data,
+	     Iterator first, Iterator last,
+	     const model_type& theta,
+	     gradient_type& gradient,
+	     log_likelihood_type& log_likelihood,
+	     Gen& gen)
+  {
+    const size_type dimension = theta.dimension_embedding_;
+    const size_type order     = theta.order_;
+    const size_type batch     = std::distance(first, last);
+    
+    if (! batch) return;
+    
+    layer_input_.resize(dimension * (order - 1), batch);
+    embedding_target_.resize(dimension + 1, batch);
+    targets_.resize(batch);
+    
+    // the column (b * (order - 1) + i) of the input gradients is the i-th context word of the b-th ngram
+    columns_input_.clear();
+    
+    for (size_type b = 0; first != last; ++ first, ++ b) {
+      typename Data::const_iterator iter = data.begin(*first);
+      
+      for (size_type i = 0; i != order - 1; ++ i, ++ iter) {
+	layer_input_.block(dimension * i, b, dimension, 1) = theta.embedding_input_.col(iter->id()) * theta.scale_;
+	
+	columns_input_.push_back(word_column_type(iter->id(), b * (order - 1) + i));
+      }
+      
+      targets_[b] = *iter;
+      embedding_target_.col(b) = theta.embedding_output_.col(iter->id());
+    }
+    
+    // shared noise samples
+    embedding_noise_.resize(dimension + 1, samples_);
+    noises_.resize(samples_);
+    
+    for (size_type k = 0; k != samples_; ++ k) {
+      noises_[k] = unigram_.draw(gen);
+      embedding_noise_.col(k) = theta.embedding_output_.col(noises_[k].id());
+    }
+    
+    // forward...
+    layer_context_.noalias() = theta.Wc_ * layer_input_;
+    layer_context_.colwise() += theta.bc_.col(0);
+    layer_context_ = layer_context_.unaryExpr(hinge());
+    
+    layer_hidden_.noalias() = theta.Wh_ * layer_context_;
+    layer_hidden_.colwise() += theta.bh_.col(0);
+    layer_hidden_ = layer_hidden_.unaryExpr(hinge());
+    
+    loss_noise_.noalias() = embedding_noise_.block(0, 0, dimension, samples_).transpose() * layer_hidden_ * theta.scale_;
+    loss_noise_.colwise() += embedding_noise_.row(dimension).transpose();
+    
+    loss_target_.resize(batch, 1);
+    
+    for (size_type b = 0; b != batch; ++ b) {
+      const word_type& word = targets_[b];
+      
+      // a noise sample identical to the target is ignored, thus the noise terms of this ngram
+      // assume the number of the samples actually used, not samples_
+      const size_type samples = samples_ - std::count(noises_.begin(), noises_.end(), word);
+      
+      if (! samples) {
+	loss_target_(b, 0) = 0.0;
+	loss_noise_.col(b).setZero();
+	continue;
+      }
+      
+      const double log_samples = std::log(double(samples));
+      
+      const double score = (embedding_target_.col(b).block(0, 0, dimension, 1).transpose() * layer_hidden_.col(b) * theta.scale_
+			    + embedding_target_.col(b).block(dimension, 0, 1, 1))(0, 0);
+      const double score_noise = log_samples + unigram_.logprob(word);
+      const double z = utils::mathop::logsum(score, score_noise);
+      const double logprob = score - z;
+      
+      loss_target_(b, 0) = - 1.0 + std::exp(logprob);
+      
+      double log_likelihood_ngram = logprob;
+      
+      for (size_type k = 0; k != samples_; ++ k) {
+	if (noises_[k] == word) {
+	  loss_noise_(k, b) = 0.0;
+	  continue;
+	}
+	
+	const double score = loss_noise_(k, b);
+	const double score_noise = log_samples + unigram_.logprob(noises_[k]);
+	const double z = utils::mathop::logsum(score, score_noise);
+	const double logprob = score - z;
+	const double logprob_noise = score_noise - z;
+	
+	log_likelihood_ngram += logprob_noise;
+	
+	loss_noise_(k, b) = std::exp(logprob);
+      }
+      
+      log_likelihood += log_likelihood_ngram;
+    }
+    
+    // output embedding, the targets followed by the noises
+    delta_output_.resize(dimension + 1, batch + samples_);
+    
+    delta_output_.block(0, 0, dimension, batch) = layer_hidden_ * loss_target_.col(0).asDiagonal();
+    delta_output_.block(dimension, 0, 1, batch) = loss_target_.transpose();
+    delta_output_.block(0, batch, dimension, samples_).noalias() = layer_hidden_ * loss_noise_.transpose();
+    delta_output_.block(dimension, batch, 1, samples_) = loss_noise_.rowwise().sum().transpose();
+    
+    columns_output_.clear();
+    for (size_type b = 0; b != batch; ++ b)
+      columns_output_.push_back(word_column_type(targets_[b].id(), b));
+    for (size_type k = 0; k != samples_; ++ k)
+      columns_output_.push_back(word_column_type(noises_[k].id(), batch + k));
+    
+    accumulate(columns_output_, delta_output_, gradient, true);
+    
+    // backward...
+    delta_hidden_.noalias() = embedding_noise_.block(0, 0, dimension, samples_) * loss_noise_;
+    delta_hidden_.noalias() += embedding_target_.block(0, 0, dimension, batch) * loss_target_.col(0).asDiagonal();
+    delta_hidden_ = (layer_hidden_.array().unaryExpr(dhinge()) * (delta_hidden_ * theta.scale_).array());
+    
+    gradient.Wh_.noalias() += delta_hidden_ * layer_context_.transpose();
+    gradient.bh_.noalias() += delta_hidden_.rowwise().sum();
+    
+    delta_context_ = (layer_context_.array().unaryExpr(dhinge()) * (theta.Wh_.transpose() * delta_hidden_).array());
+    
+    gradient.Wc_.noalias() += delta_context_ * layer_input_.transpose();
+    gradient.bc_.noalias() += delta_context_.rowwise().sum();
+    
+    // finally, input embedding...
+    delta_input_.noalias() = theta.Wc_.transpose() * delta_context_;
+    
+    accumulate(columns_input_,
+	       Eigen::Map<const tensor_type>(delta_input_.data(), dimension, batch * (order - 1)),
+	       gradient,
+	       false);
+    
+    gradient.count_ += batch;
+  }
+  
+  template <typename Matrix>
+  void accumulate(word_column_set_type& columns,
+		  const Eigen::MatrixBase<Matrix>& matrix,
+		  gradient_type& gradient,
+		  const bool output)
+  {
+    std::sort(columns.begin(), columns.end());
+    
+    word_column_set_type::const_iterator citer_end = columns.end();
+    for (word_column_set_type::const_iterator citer = columns.begin(); citer != citer_end; /**/) {
+      const word_type word(citer->first);
+      
+      tensor_type& dembedding = (output ? gradient.embedding_output(word) : gradient.embedding_input(word));
+      
+      for (/**/; citer != citer_end && citer->first == word.id(); ++ citer)
+	dembedding += matrix.col(citer->second);
+    }
+  }
 };
 
 struct Learn
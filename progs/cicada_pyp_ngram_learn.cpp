@@ -261,6 +261,13 @@ struct PYPLM
     root.table.decrement(word, sampler);
   }
   
+  // copy the root, with its hyperparameters, to each shard
+  void synchronize()
+  {
+    for (size_type i = 0; i != shards.size(); ++ i)
+      shards[i].root.table = root.table;
+  }
+  
   void initialize(const double __p0)
   {
     // assign p0
@@ -337,9 +344,6 @@ struct PYPLM
   {
     counts0 = root.table.size_table();
     
-    for (size_type i = 0; i != shards.size(); ++ i)
-      shards[i].root.table = root.table;
-    
     for (size_type order = 0; order != parameters.size(); ++ order) {
       
       for (int iter = 0; iter != num_loop; ++ iter) {
@@ -359,6 +363,8 @@ struct PYPLM
 	(*niter)->table.strength() = parameters[order].strength;
       }
     }
+    
+    synchronize();
   }
 
   template <typename Sampler>
@@ -399,9 +405,6 @@ struct PYPLM
   {
     counts0 = root.table.size_table();
     
-    for (size_type i = 0; i != shards.size(); ++ i)
-      shards[i].root.table = root.table;
-    
     for (size_type order = 0; order != parameters.size(); ++ order) {
       DiscountSampler discount_sampler(*this, order);
       StrengthSampler strength_sampler(*this, order);
@@ -444,6 +447,8 @@ struct PYPLM
 	(*niter)->table.strength() = parameters[order].strength;
       }
     }
+    
+    synchronize();
   }
 
   struct vocab_map_type
@@ -727,6 +732,9 @@ int resample_rate = 1;
 int resample_iterations = 1;
 bool slice_sampling = false;
 
+int sync_size = 0;
+int seed = -1;
+
 double discount_alpha = 1.0;
 double discount_beta  = 1.0;
 double strength_shape = 1.0;
@@ -768,6 +776,9 @@ int main(int argc, char ** argv)
       throw std::runtime_error("no training data?");
     
     sampler_type sampler;
+    if (seed >= 0)
+      sampler.generator().seed(seed);
+    
     sampler_set_type samplers(threads, sampler);
     
     PYPLM model(threads,
@@ -864,26 +875,28 @@ int main(int argc, char ** argv)
   return 0;
 }
 
-struct LearnMapReduce
-{
-  typedef std::pair<word_type, int> word_count_type;
-  
-  typedef utils::lockfree_list_queue<word_count_type, std::allocator<word_count_type> > queue_type;
-};
-
+// The shards are sampled in parallel, each against its own copy of the root (unigram) restaurant.
+// The changes to the root are kept per shard as deltas of customers, and merged into the root at the
+// end of each round, in the order of shards. When synchronized, each round covers sync_size entries
+// per shard, and the copies of the root are refreshed from the merged root after each round.
+// Otherwise, a single round covers the whole iteration, and the copies are refreshed when the
+// hyperparameters are resampled.
 struct LearnMapper
 {
-  typedef LearnMapReduce::word_count_type word_count_type;
-  typedef LearnMapReduce::queue_type      queue_type;
+  typedef std::vector<int, std::allocator<int> > count_set_type;
   
-  LearnMapper(queue_type& __queue,
+  LearnMapper(boost::barrier& __barrier,
 	      const data_set_type& __training,
 	      PYPLM::shard_type& __model,
+	      count_set_type& __counts,
 	      sampler_type& __sampler,
 	      const bool __baby,
 	      const double __temperature,
-	      const bool __remove)
-    : queue(__queue), training(__training), model(__model), sampler(__sampler), baby(__baby), temperature(__temperature), remove(__remove) {}
+	      const bool __remove,
+	      const size_type __rounds,
+	      const size_type __round_size)
+    : barrier(__barrier), training(__training), model(__model), counts(__counts), sampler(__sampler),
+      baby(__baby), temperature(__temperature), remove(__remove), rounds(__rounds), round_size(__round_size) {}
 
   template <typename Training>
   struct less_rank
@@ -901,10 +914,8 @@ struct LearnMapper
   void operator()()
   {
     typedef std::vector<size_type, std::allocator<size_type> > position_set_type;
-    typedef std::vector<int, std::allocator<int> > count_set_type;
 
     position_set_type positions(training.size());
-    count_set_type counts;
     
     for (size_type i = 0; i != training.size(); ++ i)
       positions[i] = i;
@@ -915,88 +926,54 @@ struct LearnMapper
     if (baby)
       std::sort(positions.begin(), positions.end(), less_rank<data_set_type>(training));
     
+    position_set_type::const_iterator piter = positions.begin();
     position_set_type::const_iterator piter_end = positions.end();
-    for (position_set_type::const_iterator piter = positions.begin(); piter != piter_end; ++ piter) {
-      const word_type& word = training[*piter].word;
-      
-      if (word.id() >= counts.size())
-	counts.resize(word.id() + 1, 0);
-      
-      int& counter = counts[word.id()];
+    
+    for (size_type round = 0; round != rounds; ++ round) {
+      const position_set_type::const_iterator piter_last = piter + std::min(round_size, size_type(piter_end - piter));
       
-      for (size_type i = 0; i != training[*piter].count; ++ i) {
-	if (remove)
-	  counter -= model.decrement(training[*piter].word, training[*piter].node, sampler);
+      for (/**/; piter != piter_last; ++ piter) {
+	const word_type& word = training[*piter].word;
+	
+	if (word.id() >= counts.size())
+	  counts.resize(word.id() + 1, 0);
 	
-	counter += model.increment(training[*piter].word, training[*piter].node, sampler, temperature);
+	int& counter = counts[word.id()];
+	
+	for (size_type i = 0; i != training[*piter].count; ++ i) {
+	  if (remove)
+	    counter -= model.decrement(training[*piter].word, training[*piter].node, sampler);
+	  
+	  counter += model.increment(training[*piter].word, training[*piter].node, sampler, temperature);
+	}
       }
+      
+      // the end of this round, then, wait until the deltas are merged
+      barrier.wait();
+      barrier.wait();
     }
-    
-    for (word_type::id_type id = 0; id != counts.size(); ++ id)
-      if (counts[id])
-	queue.push(std::make_pair(word_type(id), counts[id]));
-    
-    queue.push(std::make_pair(word_type(), 0));
   }
   
-  queue_type&          queue;
+  boost::barrier&      barrier;
   const data_set_type& training;
   PYPLM::shard_type&   model;
+  count_set_type&      counts;
   sampler_type&        sampler;
   
   const bool           baby;
   const double         temperature;
   const bool           remove;
+  const size_type      rounds;
+  const size_type      round_size;
 };
 
-struct LearnReducer
-{
-  typedef LearnMapReduce::word_count_type word_count_type;
-  typedef LearnMapReduce::queue_type      queue_type;
-  
-  LearnReducer(const size_type __size,
-              queue_type& __queue,
-              PYPLM& __model,
-              sampler_type& __sampler,
-              const double __temperature)
-    : reduce_size(__size), queue(__queue), model(__model), sampler(__sampler), temperature(__temperature) {}
-  
-  void operator()()
-  {
-    size_type finished = 0;
-    
-    while (finished != reduce_size) {
-      word_count_type word_count;
-      queue.pop(word_count);
-      
-      if (word_count.first.empty()) {
-       ++ finished;
-       continue;
-      }
-      
-      if (word_count.second < 0) {
-       for (int i = 0; i != - word_count.second; ++ i)
-         model.decrement(word_count.first, sampler);
-      } else if (word_count.second > 0) {
-       for (int i = 0; i != word_count.second; ++ i)
-         model.increment(word_count.first, sampler, temperature);
-      }
-    }
-  }
-  
-  const size_type      reduce_size;
-  queue_type&          queue;
-  PYPLM&               model;
-  sampler_type&        sampler;
-  
-  const double         temperature;
-};
-
-
 void learn(const data_map_type& training,
 	   PYPLM& model,
 	   sampler_set_type& samplers)
 {
+  typedef LearnMapper::count_set_type count_set_type;
+  typedef std::vector<count_set_type, std::allocator<count_set_type> > count_map_type;
+  
   if (samplers.size() != training.size() || model.shards.size() != training.size())
     throw std::runtime_error("invalid shard");
   
@@ -1016,6 +993,21 @@ void learn(const data_map_type& training,
 
   sampler_type sampler = samplers.front();
   
+  size_type training_size = 0;
+  size_type training_customers = 0;
+  for (size_type shard = 0; shard != shards_size; ++ shard) {
+    training_size = std::max(training_size, training[shard].size());
+    
+    data_set_type::const_iterator titer_end = training[shard].end();
+    for (data_set_type::const_iterator titer = training[shard].begin(); titer != titer_end; ++ titer)
+      training_customers += titer->count;
+  }
+  
+  const size_type round_size = (sync_size > 0 ? size_type(sync_size) : utils::bithack::max(training_size, size_type(1)));
+  const size_type rounds = utils::bithack::max((training_size + round_size - 1) / round_size, size_type(1));
+  
+  count_map_type counts(shards_size);
+  
   // sample parameters, first...
   model.sample_parameters(sampler, resample_iterations);
   
@@ -1058,25 +1050,58 @@ void learn(const data_map_type& training,
       else
 	std::cerr << "burn-in iteration: " << (iter + 1) << std::endl;
     }
-
-    LearnMapReduce::queue_type queue;
+    
+    utils::resource start;
+    
+    boost::barrier barrier(shards_size + 1);
     
     boost::thread_group workers;
     for (size_type i = 0; i != shards_size; ++ i)
-      workers.add_thread(new boost::thread(LearnMapper(queue,
+      workers.add_thread(new boost::thread(LearnMapper(barrier,
 						       training[i],
 						       model.shards[i],
+						       counts[i],
 						       samplers[i],
 						       ! baby_finished,
 						       temperature,
-						       iter)));
+						       iter,
+						       rounds,
+						       round_size)));
+    
+    for (size_type round = 0; round != rounds; ++ round) {
+      barrier.wait();
+      
+      // merge the deltas into the root
+      for (size_type shard = 0; shard != shards_size; ++ shard) {
+	for (word_type::id_type id = 0; id != counts[shard].size(); ++ id) {
+	  const int count = counts[shard][id];
+	  
+	  for (int i = 0; i < - count; ++ i)
+	    model.decrement(word_type(id), sampler);
+	  for (int i = 0; i < count; ++ i)
+	    model.increment(word_type(id), sampler, temperature);
+	}
+	
+	counts[shard].clear();
+      }
+      
+      if (sync_size > 0)
+	model.synchronize();
+      
+      barrier.wait();
+    }
     
-    // reduce!
-    LearnReducer(shards_size, queue, model, sampler, temperature)();
-
     // join
     workers.join_all();
     
+    utils::resource end;
+    
+    if (debug)
+      std::cerr << "cpu time: " << (end.cpu_time() - start.cpu_time())
+		<< " user time: " << (end.user_time() - start.user_time())
+		<< " samples/sec: " << (training_customers / std::max(end.cpu_time() - start.cpu_time(), 1e-6))
+		<< std::endl;
+    
     if (static_cast<int>(iter) % resample_rate == resample_rate - 1) {
       if (slice_sampling)
 	model.slice_sample_parameters(sampler, resample_iterations);
@@ -1312,6 +1337,8 @@ void options(int argc, char** argv)
     ("strength-shape", po::value<double>(&strength_shape)->default_value(strength_shape), "strength ~ Gamma(shape,rate)")
     ("strength-rate",  po::value<double>(&strength_rate)->default_value(strength_rate),   "strength ~ Gamma(shape,rate)")
     
+    ("sync",    po::value<int>(&sync_size)->default_value(sync_size), "synchronize the root every # of training entries per thread (0 for every iteration)")
+    ("seed",    po::value<int>(&seed)->default_value(seed),           "random seed (negative for a random seed)")
     ("threads", po::value<int>(&threads), "# of threads")
     
     ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
@@ -1429,7 +1429,9 @@ struct Task
       sampler(__sampler),
       order(__order),
       spell_length(__spell_length),
-      ignore_boundary(__ignore_boundary) {}
+      ignore_boundary(__ignore_boundary),
+      temperature(1.0),
+      delayed(false) {}
   
   void operator()()
   {
@@ -1443,6 +1445,20 @@ struct Task
       mapper.pop(pos);
       
       if (pos == size_type(-1)) break;
+      
+      // delayed: the derivations are removed/added by the synchronization outside of this task
+      if (delayed) {
+	{
+	  PYPLM::mutex_type::scoped_reader_lock lock(model.mutex);
+	  
+	  graph.forward(training[pos], model, spell_length, ignore_boundary);
+	}
+	
+	graph.backward(sampler, derivations[pos]);
+	
+	reducer.push(pos);
+	continue;
+      }
 	
       if (! derivations[pos].empty()) {
 	PYPLM::mutex_type::scoped_writer_lock lock(model.mutex);
@@ -1490,6 +1506,7 @@ struct Task
   bool ignore_boundary;
   
   double temperature;
+  bool   delayed;
 };
 
 
@@ -1541,6 +1558,8 @@ double spell_lambda = 8;
 double spell_lambda_shape = 0.2;
 double spell_lambda_rate = 0.1;
 
+int sync_size = 0;
+
 int threads = 1;
 int debug = 0;
 
@@ -1692,39 +1711,83 @@ int main(int argc, char ** argv)
       }
       
       // assign temperature and model...
-      for (size_type i = 0; i != tasks.size(); ++ i)
+      for (size_type i = 0; i != tasks.size(); ++ i) {
 	tasks[i].temperature = temperature;
+	tasks[i].delayed = (sync_size > 0);
+      }
       
       boost::random_number_generator<sampler_type::generator_type> gen(sampler.generator());
       std::random_shuffle(positions.begin(), positions.end(), gen);
       if (! baby_finished)
 	std::sort(positions.begin(), positions.end(), less_size(training));
       
-      position_set_type::const_iterator piter_end = positions.end();
-      for (position_set_type::const_iterator piter = positions.begin(); piter != piter_end; ++ piter)
-	queue_mapper.push(*piter);
+      utils::resource start;
       
-      for (size_type reduced = 0; reduced != positions.size(); ++ reduced) {
-	size_type pos = 0;
-	queue_reducer.pop(pos);
+      // When synchronized, the sentences are processed in rounds of sync_size * threads: the derivations
+      // of a round are removed from the model, the tasks sample new derivations in parallel against the
+      // model fixed during the round, and the new derivations are added back. Otherwise, a single round
+      // covers all the sentences, and each task updates the model sentence-wise under the writer lock.
+      const size_type round_size = (sync_size > 0 ? size_type(sync_size) * threads : positions.size());
+      
+      size_type reduced = 0;
+      position_set_type::const_iterator piter_end = positions.end();
+      for (position_set_type::const_iterator piter = positions.begin(); piter != piter_end; /**/) {
+	const position_set_type::const_iterator piter_last = piter + std::min(round_size, size_type(piter_end - piter));
 	
-	if (debug >= 3) {
-	  std::cerr << "training=" << pos << std::endl;
-	  derivation_type::const_iterator diter_end = derivations[pos].end();
-	  for (derivation_type::const_iterator diter = derivations[pos].begin(); diter != diter_end; ++ diter)
-	    std::cerr << "word=\"" << *diter << "\"" << std::endl;
-	}
+	if (sync_size > 0)
+	  for (position_set_type::const_iterator riter = piter; riter != piter_last; ++ riter)
+	    if (! derivations[*riter].empty()) {
+	      derivation_type::const_iterator diter_begin = derivations[*riter].begin();
+	      derivation_type::const_iterator diter_end   = derivations[*riter].end();
+	      
+	      for (derivation_type::const_iterator diter = diter_begin + 1; diter != diter_end; ++ diter)
+		lm.decrement(*diter, std::max(diter_begin, diter - (order - 1)), diter, sampler);
+	    }
 	
-	if (debug) {
-	  if ((reduced + 1) % 10000 == 0)
-	    std::cerr << '.';
-	  if ((reduced + 1) % 1000000 == 0)
-	    std::cerr << '\n';
+	for (position_set_type::const_iterator riter = piter; riter != piter_last; ++ riter)
+	  queue_mapper.push(*riter);
+	
+	for (const size_type reduced_last = reduced + (piter_last - piter); reduced != reduced_last; ++ reduced) {
+	  size_type pos = 0;
+	  queue_reducer.pop(pos);
+	  
+	  if (debug >= 3) {
+	    std::cerr << "training=" << pos << std::endl;
+	    derivation_type::const_iterator diter_end = derivations[pos].end();
+	    for (derivation_type::const_iterator diter = derivations[pos].begin(); diter != diter_end; ++ diter)
+	      std::cerr << "word=\"" << *diter << "\"" << std::endl;
+	  }
+	  
+	  if (debug) {
+	    if ((reduced + 1) % 10000 == 0)
+	      std::cerr << '.';
+	    if ((reduced + 1) % 1000000 == 0)
+	      std::cerr << '\n';
+	  }
 	}
+	
+	if (sync_size > 0)
+	  for (position_set_type::const_iterator riter = piter; riter != piter_last; ++ riter) {
+	    derivation_type::const_iterator diter_begin = derivations[*riter].begin();
+	    derivation_type::const_iterator diter_end   = derivations[*riter].end();
+	    
+	    for (derivation_type::const_iterator diter = diter_begin + 1; diter != diter_end; ++ diter)
+	      lm.increment(*diter, std::max(diter_begin, diter - (order - 1)), diter, sampler);
+	  }
+	
+	piter = piter_last;
       }
       
+      utils::resource end;
+      
       if (debug && positions.size() >= 10000 && positions.size() % 1000000 != 0)
 	std::cerr << std::endl;
+      
+      if (debug)
+	std::cerr << "cpu time: " << (end.cpu_time() - start.cpu_time())
+		  << " user time: " << (end.user_time() - start.user_time())
+		  << " sentences/sec: " << (positions.size() / std::max(end.user_time() - start.user_time(), 1e-6))
+		  << std::endl;
 
       if (static_cast<int>(iter) % resample_rate == resample_rate - 1) {
 	if (slice_sampling)
@@ -1851,6 +1914,7 @@ void options(int argc, char** argv)
     ("spell-lambda-shape", po::value<double>(&spell_lambda_shape)->default_value(spell_lambda_shape), "lambda ~ Gamma(shape,rate)")
     ("spell-lambda-rate",  po::value<double>(&spell_lambda_rate)->default_value(spell_lambda_rate),   "lambda ~ Gamma(shape,rate)")
     
+    ("sync",    po::value<int>(&sync_size)->default_value(sync_size), "sample in parallel against a fixed model, synchronized every # of sentences per thread (0 for sentence-wise updates)")
     ("threads", po::value<int>(&threads), "# of threads")
     
     ("debug", po::value<int>(&debug)->implicit_value(1), "debug level")
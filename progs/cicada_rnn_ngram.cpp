@@ -35,6 +35,7 @@
 #include <boost/random.hpp>
 #include <boost/thread.hpp>
 #include <boost/progress.hpp>
+#include <boost/iterator/counting_iterator.hpp>
 
 typedef boost::filesystem::path path_type;
 
@@ -64,6 +65,7 @@ bool mix_average = false;
 
 int iteration = 10;
 int batch_size = 64;
+bool batch_gemm = false;
 int samples = 100;
 int cutoff = 3;
 double lambda = 0;
@@ -214,7 +216,8 @@ struct TaskAccumulate
 		 const model_type& theta,
 		 queue_mapper_type& mapper,
 		 queue_merger_set_type& mergers,
-		 size_type batch_size)
+		 size_type batch_size,
+		 const bool batch_gemm)
     : learner_(learner),
       data_(data),
       theta_(theta),
@@ -223,7 +226,8 @@ struct TaskAccumulate
       ngram_(unigram, samples),
       log_likelihood_(),
       shard_(0),
-      batch_size_(batch_size)
+      batch_size_(batch_size),
+      batch_gemm_(batch_gemm)
   {
     generator_.seed(utils::random_seed());
   }
@@ -288,8 +292,17 @@ struct TaskAccumulate
 	  const size_type first = batch * batch_size_;
 	  const size_type last  = utils::bithack::min(first + batch_size_, data_.size());
 	  
-	  for (size_type id = first; id != last; ++ id)
-	    log_likelihood_ += ngram_.learn(data_.begin(id), data_.end(id), theta_, *grad, generator_);
+	  if (batch_gemm_)
+	    ngram_.learn(data_,
+			 boost::counting_iterator<size_type>(first),
+			 boost::counting_iterator<size_type>(last),
+			 theta_,
+			 *grad,
+			 log_likelihood_,
+			 generator_);
+	  else
+	    for (size_type id = first; id != last; ++ id)
+	      log_likelihood_ += ngram_.learn(data_.begin(id), data_.end(id), theta_, *grad, generator_);
 	  
 	  learner_(theta_, *grad);
 	  grad->increment();
@@ -346,6 +359,7 @@ struct TaskAccumulate
 
   int shard_;
   size_type batch_size_;
+  bool      batch_gemm_;
 
   boost::mt19937 generator_;
 };
@@ -409,7 +423,8 @@ void learn_online(const Learner& learner,
 					 theta,
 					 mapper,
 					 mergers,
-					 batch_size));
+					 batch_size,
+					 batch_gemm));
   
   // assign shard id
   for (size_type shard = 0; shard != tasks.size(); ++ shard)
@@ -456,7 +471,8 @@ void learn_online(const Learner& learner,
     
     if (debug)
       std::cerr << "cpu time:    " << end.cpu_time() - start.cpu_time() << std::endl
-		<< "user time:   " << end.user_time() - start.user_time() << std::endl;
+		<< "user time:   " << end.user_time() - start.user_time() << std::endl
+		<< "words/sec:   " << (data.size() / (end.user_time() - start.user_time())) << std::endl;
     
     // shuffle ngrams!
     std::random_shuffle(batches.begin(), batches.end());
@@ -723,6 +739,7 @@ void options(int argc, char** argv)
     
     ("iteration",         po::value<int>(&iteration)->default_value(iteration),   "max # of iterations")
     ("batch",             po::value<int>(&batch_size)->default_value(batch_size), "mini-batch size")
+    ("batch-gemm",        po::bool_switch(&batch_gemm),                           "mini-batch by matrix products with shared noise samples")
     ("samples",           po::value<int>(&samples)->default_value(samples),       "# of NCE samples")
     ("cutoff",            po::value<int>(&cutoff)->default_value(cutoff),         "cutoff count for vocabulary (<= 1 to keep all)")
     ("lambda",            po::value<double>(&lambda)->default_value(lambda),      "regularization constant")
@@ -11,6 +11,9 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 
 #define BOOST_SPIRIT_THREADSAFE
 #define PHOENIX_THREADSAFE
@@ -959,6 +962,27 @@ struct NGram
   tensor_type lattice_;
   tensor_type delta_;
 
+  // for mini-batch
+  typedef std::vector<tensor_type, std::allocator<tensor_type> > tensor_set_type;
+  typedef std::vector<word_type, std::allocator<word_type> > word_set_type;
+  typedef std::pair<word_type::id_type, size_type> word_column_type;
+  typedef std::vector<word_column_type, std::allocator<word_column_type> > word_column_set_type;
+  
+  tensor_set_type layers_;
+  tensor_set_type inputs_;
+  
+  tensor_type embedding_target_;
+  tensor_type embedding_noise_;
+  tensor_type loss_target_;
+  tensor_type loss_noise_;
+  tensor_type delta_input_;
+  tensor_type delta_output_;
+  
+  word_set_type        targets_;
+  word_set_type        noises_;
+  word_column_set_type columns_input_;
+  word_column_set_type columns_output_;
+
   struct hinge
   {
     // 50 for numerical stability...
@@ -1109,6 +1133,190 @@ struct NGram
     
     return log_likelihood;
   }
+
+  // mini-batch version of learn: the ngrams indexed by [first, last) in data are stacked into
+  // matrices, one for each position of the recurrence, and the noise samples are shared by the
+  // ngrams in the mini-batch, so that the recurrent and output layers are computed by
+  // matrix-matrix products. The gradients of the sparse embeddings are accumulated per unique word.
+  template <typename Data, typename Iterator, typename Gen>
+  void learn(const Data& data,
+	     Iterator first, Iterator last,
+	     const model_type& theta,
+	     gradient_type& gradient,
+	     log_likelihood_type& log_likelihood,
+	     Gen& gen)
+  {
+    const size_type dimension = theta.dimension_;
+    const size_type order     = theta.order_;
+    const size_type batch     = std::distance(first, last);
+    
+    const size_type offset_embedding = 0;
+    const size_type offset_context   = dimension;
+    
+    if (! batch) return;
+    
+    layers_.resize(order);
+    inputs_.resize(order);
+    
+    for (size_type i = 1; i != order; ++ i)
+      inputs_[i].resize(dimension, batch);
+    
+    embedding_target_.resize(dimension + 1, batch);
+    targets_.resize(batch);
+    
+    // the column ((i - 1) * batch + b) of the input gradients is the i-th word of the b-th ngram
+    columns_input_.clear();
+    
+    for (size_type b = 0; first != last; ++ first, ++ b) {
+      typename Data::const_iterator iter = data.begin(*first);
+      
+      for (size_type i = 1; i != order; ++ i, ++ iter) {
+	inputs_[i].col(b) = theta.embedding_input_.col(iter->id()) * theta.scale_;
+	
+	columns_input_.push_back(word_column_type(iter->id(), (i - 1) * batch + b));
+      }
+      
+      targets_[b] = *iter;
+      embedding_target_.col(b) = theta.embedding_output_.col(iter->id());
+    }
+    
+    // shared noise samples
+    embedding_noise_.resize(dimension + 1, samples_);
+    noises_.resize(samples_);
+    
+    for (size_type k = 0; k != samples_; ++ k) {
+      noises_[k] = unigram_.draw(gen);
+      embedding_noise_.col(k) = theta.embedding_output_.col(noises_[k].id());
+    }
+    
+    // forward...
+    layers_[0].resize(dimension, batch);
+    layers_[0].colwise() = theta.bi_.col(0).unaryExpr(hinge());
+    
+    for (size_type i = 1; i != order; ++ i) {
+      const size_type shift = (i - 1) * 2 * dimension;
+      
+      layers_[i].noalias() = theta.Wc_.block(0, shift + offset_embedding, dimension, dimension) * inputs_[i];
+      layers_[i].noalias() += theta.Wc_.block(0, shift + offset_context, dimension, dimension) * layers_[i - 1];
+      layers_[i].colwise() += theta.bc_.col(i - 1);
+      layers_[i] = layers_[i].unaryExpr(hinge());
+    }
+    
+    const tensor_type& layer_hidden = layers_[order - 1];
+    
+    loss_noise_.noalias() = embedding_noise_.block(0, 0, dimension, samples_).transpose() * layer_hidden * theta.scale_;
+    loss_noise_.colwise() += embedding_noise_.row(dimension).transpose();
+    
+    loss_target_.resize(batch, 1);
+    
+    for (size_type b = 0; b != batch; ++ b) {
+      const word_type& word = targets_[b];
+      
+      // a noise sample identical to the target is ignored, thus the noise terms of this ngram
+      // assume the number of the samples actually used, not samples_
+      const size_type samples = samples_ - std::count(noises_.begin(), noises_.end(), word);
+      
+      if (! samples) {
+	loss_target_(b, 0) = 0.0;
+	loss_noise_.col(b).setZero();
+	continue;
+      }
+      
+      const double log_samples = std::log(double(samples));
+      
+      const double score = ((embedding_target_.col(b).block(0, 0, dimension, 1).transpose() * layer_hidden.col(b) * theta.scale_)
+			    + embedding_target_.col(b).block(dimension, 0, 1, 1))(0, 0);
+      const double score_noise = log_samples + unigram_.logprob(word);
+      const double z = utils::mathop::logsum(score, score_noise);
+      const double logprob = score - z;
+      
+      loss_target_(b, 0) = - 1.0 + std::exp(logprob);
+      
+      double log_likelihood_ngram = logprob;
+      
+      for (size_type k = 0; k != samples_; ++ k) {
+	if (noises_[k] == word) {
+	  loss_noise_(k, b) = 0.0;
+	  continue;
+	}
+	
+	const double score = loss_noise_(k, b);
+	const double score_noise = log_samples + unigram_.logprob(noises_[k]);
+	const double z = utils::mathop::logsum(score, score_noise);
+	const double logprob = score - z;
+	const double logprob_noise = score_noise - z;
+	
+	log_likelihood_ngram += logprob_noise;
+	
+	loss_noise_(k, b) = std::exp(logprob);
+      }
+      
+      log_likelihood += log_likelihood_ngram;
+    }
+    
+    // output embedding, the targets followed by the noises
+    delta_output_.resize(dimension + 1, batch + samples_);
+    
+    delta_output_.block(0, 0, dimension, batch) = layer_hidden * loss_target_.col(0).asDiagonal();
+    delta_output_.block(dimension, 0, 1, batch) = loss_target_.transpose();
+    delta_output_.block(0, batch, dimension, samples_).noalias() = layer_hidden * loss_noise_.transpose();
+    delta_output_.block(dimension, batch, 1, samples_) = loss_noise_.rowwise().sum().transpose();
+    
+    columns_output_.clear();
+    for (size_type b = 0; b != batch; ++ b)
+      columns_output_.push_back(word_column_type(targets_[b].id(), b));
+    for (size_type k = 0; k != samples_; ++ k)
+      columns_output_.push_back(word_column_type(noises_[k].id(), batch + k));
+    
+    accumulate(columns_output_, delta_output_, gradient, true);
+    
+    // backward...
+    delta_.noalias() = embedding_noise_.block(0, 0, dimension, samples_) * loss_noise_;
+    delta_.noalias() += embedding_target_.block(0, 0, dimension, batch) * loss_target_.col(0).asDiagonal();
+    delta_ = (layer_hidden.array().unaryExpr(dhinge()) * (delta_ * theta.scale_).array());
+    
+    delta_input_.resize(dimension, batch * (order - 1));
+    
+    for (size_type i = order - 1; i != 0; -- i) {
+      const size_type shift = (i - 1) * 2 * dimension;
+      
+      gradient.Wc_.block(0, shift + offset_embedding, dimension, dimension).noalias() += delta_ * inputs_[i].transpose();
+      gradient.Wc_.block(0, shift + offset_context, dimension, dimension).noalias()   += delta_ * layers_[i - 1].transpose();
+      gradient.bc_.block(0, i - 1, dimension, 1).noalias() += delta_.rowwise().sum();
+      
+      delta_input_.block(0, (i - 1) * batch, dimension, batch).noalias()
+	= theta.Wc_.block(0, shift + offset_embedding, dimension, dimension).transpose() * delta_;
+      
+      // propagate this...
+      delta_ = (layers_[i - 1].array().unaryExpr(dhinge())
+		* (theta.Wc_.block(0, shift + offset_context, dimension, dimension).transpose() * delta_).array());
+    }
+    
+    accumulate(columns_input_, delta_input_, gradient, false);
+    
+    gradient.count_ += batch;
+    
+    gradient.bi_.noalias() += delta_.rowwise().sum();
+  }
+  
+  template <typename Matrix>
+  void accumulate(word_column_set_type& columns,
+		  const Eigen::MatrixBase<Matrix>& matrix,
+		  gradient_type& gradient,
+		  const bool output)
+  {
+    std::sort(columns.begin(), columns.end());
+    
+    word_column_set_type::const_iterator citer_end = columns.end();
+    for (word_column_set_type::const_iterator citer = columns.begin(); citer != citer_end; /**/) {
+      const word_type word(citer->first);
+      
+      tensor_type& dembedding = (output ? gradient.embedding_output(word) : gradient.embedding_input(word));
+      
+      for (/**/; citer != citer_end && citer->first == word.id(); ++ citer)
+	dembedding += matrix.col(citer->second);
+    }
+  }
 };
 
 struct Learn
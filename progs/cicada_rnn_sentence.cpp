@@ -63,6 +63,7 @@ bool mix_average = false;
 
 int iteration = 10;
 int batch_size = 8;
+bool batch_gemm = false;
 int samples = 100;
 int cutoff = 3;
 double lambda = 0;
@@ -200,24 +201,29 @@ struct TaskAccumulate
   typedef std::vector<queue_merger_type, std::allocator<queue_merger_type> > queue_merger_set_type;
   
   typedef std::deque<gradient_type, std::allocator<gradient_type> > gradient_set_type;
+  typedef std::vector<size_type, std::allocator<size_type> > position_set_type;
   
   TaskAccumulate(const Learner& learner,
 		 const data_type& data,
+		 const position_set_type& positions,
 		 const unigram_type& unigram,
 		 const size_type& samples,
 		 const model_type& theta,
 		 queue_mapper_type& mapper,
 		 queue_merger_set_type& mergers,
-		 size_type batch_size)
+		 size_type batch_size,
+		 const bool batch_gemm)
     : learner_(learner),
       data_(data),
+      positions_(positions),
       theta_(theta),
       mapper_(mapper),
       mergers_(mergers),
       ngram_(unigram, samples),
       log_likelihood_(),
       shard_(0),
-      batch_size_(batch_size)
+      batch_size_(batch_size),
+      batch_gemm_(batch_gemm)
   {
     generator_.seed(utils::random_seed());
   }
@@ -282,8 +288,16 @@ struct TaskAccumulate
 	  const size_type first = batch * batch_size_;
 	  const size_type last  = utils::bithack::min(first + batch_size_, data_.size());
 	  
-	  for (size_type id = first; id != last; ++ id)
-	    log_likelihood_ += ngram_.learn(data_.begin(id), data_.end(id), theta_, *grad, generator_);
+	  if (batch_gemm_)
+	    log_likelihood_ += ngram_.learn(data_,
+					    positions_.begin() + first,
+					    positions_.begin() + last,
+					    theta_,
+					    *grad,
+					    generator_);
+	  else
+	    for (size_type id = first; id != last; ++ id)
+	      log_likelihood_ += ngram_.learn(data_.begin(positions_[id]), data_.end(positions_[id]), theta_, *grad, generator_);
 	  
 	  learner_(theta_, *grad);
 	  grad->increment();
@@ -327,11 +341,12 @@ struct TaskAccumulate
     log_likelihood_ = log_likelihood_type();
   }
   
-  Learner                learner_;
-  const data_type&       data_;
-  model_type             theta_;
-  queue_mapper_type&     mapper_;
-  queue_merger_set_type& mergers_;
+  Learner                  learner_;
+  const data_type&         data_;
+  const position_set_type& positions_;
+  model_type               theta_;
+  queue_mapper_type&       mapper_;
+  queue_merger_set_type&   mergers_;
   
   ngram_type ngram_;
   
@@ -340,6 +355,7 @@ struct TaskAccumulate
 
   int shard_;
   size_type batch_size_;
+  bool      batch_gemm_;
 
   boost::mt19937 generator_;
 };
@@ -370,6 +386,18 @@ path_type add_suffix(const path_type& path, const std::string& suffix)
   return path_added;
 }
 
+struct less_length
+{
+  less_length(const data_type& data) : data_(data) {}
+  
+  bool operator()(const data_type::size_type& x, const data_type::size_type& y) const
+  {
+    return (data_.end(x) - data_.begin(x)) < (data_.end(y) - data_.begin(y));
+  }
+  
+  const data_type& data_;
+};
+
 template <typename Learner>
 void learn_online(const Learner& learner,
 		  const data_type& data,
@@ -384,11 +412,18 @@ void learn_online(const Learner& learner,
 
   typedef typename task_type::queue_mapper_type     queue_mapper_type;
   typedef typename task_type::queue_merger_set_type queue_merger_set_type;
+  typedef typename task_type::position_set_type     position_set_type;
   
   typedef std::vector<size_type, std::allocator<size_type> > batch_set_type;
   
   const size_type batches_size = (data.size() + batch_size - 1) / batch_size;
   
+  // the sentences of the mini-batches. For the matrix products, they are bucketed by length, so
+  // that the sentences in a mini-batch are of (almost) the same length
+  position_set_type positions(data.size());
+  for (size_type pos = 0; pos != positions.size(); ++ pos)
+    positions[pos] = pos;
+  
   batch_set_type batches(batches_size);
   for (size_type batch = 0; batch != batches_size; ++ batch)
     batches[batch] = batch;
@@ -398,12 +433,14 @@ void learn_online(const Learner& learner,
   
   task_set_type tasks(threads, task_type(learner,
 					 data,
+					 positions,
 					 unigram,
 					 samples,
 					 theta,
 					 mapper,
 					 mergers,
-					 batch_size));
+					 batch_size,
+					 batch_gemm));
   
   // assign shard id
   for (size_type shard = 0; shard != tasks.size(); ++ shard)
@@ -413,6 +450,12 @@ void learn_online(const Learner& learner,
     if (debug)
       std::cerr << "iteration: " << (t + 1) << std::endl;
     
+    // re-bucket, so that the sentences of the same length are grouped differently for each iteration
+    if (batch_gemm) {
+      std::random_shuffle(positions.begin(), positions.end());
+      std::stable_sort(positions.begin(), positions.end(), less_length(data));
+    }
+    
     std::auto_ptr<boost::progress_display> progress(debug
 						    ? new boost::progress_display(batches_size, std::cerr, "", "", "")
 						    : 0);
@@ -450,7 +493,8 @@ void learn_online(const Learner& learner,
     
     if (debug)
       std::cerr << "cpu time:    " << end.cpu_time() - start.cpu_time() << std::endl
-		<< "user time:   " << end.user_time() - start.user_time() << std::endl;
+		<< "user time:   " << end.user_time() - start.user_time() << std::endl
+		<< "words/sec:   " << (data.data_.size() / (end.user_time() - start.user_time())) << std::endl;
     
     // shuffle ngrams!
     std::random_shuffle(batches.begin(), batches.end());
@@ -706,6 +750,7 @@ void options(int argc, char** argv)
     
     ("iteration",         po::value<int>(&iteration)->default_value(iteration),   "max # of iterations")
     ("batch",             po::value<int>(&batch_size)->default_value(batch_size), "mini-batch size")
+    ("batch-gemm",        po::bool_switch(&batch_gemm),                           "mini-batch by matrix products over length-bucketed sentences")
     ("samples",           po::value<int>(&samples)->default_value(samples),       "# of NCE samples")
     ("cutoff",            po::value<int>(&cutoff)->default_value(cutoff),         "cutoff count for vocabulary (<= 1 to keep all)")
     ("lambda",            po::value<double>(&lambda)->default_value(lambda),      "regularization constant")
@@ -7,6 +7,10 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
 
 #define BOOST_SPIRIT_THREADSAFE
 #define PHOENIX_THREADSAFE
@@ -935,6 +939,32 @@ struct NGram
   tensor_type lattice_;
   tensor_type delta_;
 
+  // for mini-batch
+  typedef std::vector<word_type, std::allocator<word_type> > word_set_type;
+  typedef std::pair<word_type::id_type, size_type> word_column_type;
+  typedef std::vector<word_column_type, std::allocator<word_column_type> > word_column_set_type;
+  typedef std::pair<size_type, size_type> length_type;
+  typedef std::vector<length_type, std::allocator<length_type> > length_set_type;
+  typedef std::vector<size_type, std::allocator<size_type> > offset_set_type;
+  
+  tensor_type inputs_;
+  tensor_type lengths_;
+  
+  tensor_type embedding_target_;
+  tensor_type embedding_noise_;
+  tensor_type loss_target_;
+  tensor_type loss_noise_;
+  tensor_type delta_hidden_;
+  tensor_type delta_input_;
+  tensor_type delta_output_;
+  
+  word_set_type        targets_;
+  word_set_type        noises_;
+  word_column_set_type columns_input_;
+  word_column_set_type columns_output_;
+  length_set_type      sentences_;
+  offset_set_type      offsets_;
+  
   struct hinge
   {
     // 50 for numerical stability...
@@ -1089,6 +1119,255 @@ struct NGram
     
     return log_likelihood;
   }
+
+  // mini-batch version of learn: the sentences indexed by [first, last) in data are sorted by
+  // their lengths in descending order, so that the sentences still active at the i-th word are
+  // the leftmost columns, and the shorter ones are masked by taking only those columns. The
+  // hidden layers of all the words are stacked in lattice_, the noise samples are shared by the
+  // sentences at the same position, and the gradients of the sparse embeddings are accumulated
+  // per unique word.
+  template <typename Data, typename Iterator, typename Gen>
+  log_likelihood_type learn(const Data& data,
+			    Iterator first, Iterator last,
+			    const model_type& theta,
+			    gradient_type& gradient,
+			    Gen& gen)
+  {
+    const size_type dimension = theta.dimension_;
+    
+    log_likelihood_type log_likelihood;
+    
+    sentences_.clear();
+    for (/**/; first != last; ++ first)
+      sentences_.push_back(length_type(data.end(*first) - data.begin(*first), *first));
+    
+    if (sentences_.empty()) return log_likelihood;
+    
+    std::sort(sentences_.begin(), sentences_.end(), std::greater<length_type>());
+    
+    const size_type batch    = sentences_.size();
+    const size_type max_size = sentences_.front().first;
+    
+    // the columns [offsets_[i - 1], offsets_[i]) of lattice_ are the hidden layers of the (i - 1)-th
+    // words of the active sentences, and the first batch columns are the initial layers. The
+    // columns of inputs_ and targets_ are shifted by batch.
+    offsets_.resize(max_size + 1);
+    offsets_[0] = batch;
+    
+    lengths_.resize(batch, 1);
+    for (size_type b = 0; b != batch; ++ b)
+      lengths_(b, 0) = sentences_[b].first;
+    
+    for (size_type i = 1; i <= max_size; ++ i) {
+      size_type active = 0;
+      while (active != batch && sentences_[active].first >= i)
+	++ active;
+      
+      offsets_[i] = offsets_[i - 1] + active;
+    }
+    
+    const size_type words = offsets_[max_size] - batch;
+    
+    inputs_.resize(dimension, words);
+    embedding_target_.resize(dimension + 1, words);
+    targets_.resize(words);
+    
+    columns_input_.clear();
+    
+    for (size_type i = 1; i <= max_size; ++ i)
+      for (size_type b = 0; b != offsets_[i] - offsets_[i - 1]; ++ b) {
+	const size_type col = offsets_[i - 1] - batch + b;
+	
+	typename Data::const_iterator iter = data.begin(sentences_[b].second) + (i - 1);
+	
+	const word_type prev(i == 1 ? vocab_type::BOS : *(iter - 1));
+	
+	inputs_.col(col) = theta.embedding_input_.col(prev.id()) * theta.scale_;
+	columns_input_.push_back(word_column_type(prev.id(), col));
+	
+	targets_[col] = *iter;
+	embedding_target_.col(col) = theta.embedding_output_.col(iter->id());
+      }
+    
+    // noise samples, the columns [(i - 1) * samples_, i * samples_) are shared at the i-th position
+    embedding_noise_.resize(dimension + 1, samples_ * max_size);
+    noises_.resize(samples_ * max_size);
+    
+    for (size_type k = 0; k != samples_ * max_size; ++ k) {
+      noises_[k] = unigram_.draw(gen);
+      embedding_noise_.col(k) = theta.embedding_output_.col(noises_[k].id());
+    }
+    
+    // forward...
+    lattice_.resize(dimension, offsets_[max_size]);
+    lattice_.block(0, 0, dimension, batch).colwise() = theta.bi_.col(0).unaryExpr(hinge());
+    
+    for (size_type i = 1; i <= max_size; ++ i) {
+      const size_type active = offsets_[i] - offsets_[i - 1];
+      const size_type prev   = (i == 1 ? size_type(0) : offsets_[i - 2]);
+      
+      lattice_.block(0, offsets_[i - 1], dimension, active).noalias()
+	= theta.Wc_.block(0, 0, dimension, dimension) * inputs_.block(0, offsets_[i - 1] - batch, dimension, active);
+      lattice_.block(0, offsets_[i - 1], dimension, active).noalias()
+	+= theta.Wc_.block(0, dimension, dimension, dimension) * lattice_.block(0, prev, dimension, active);
+      lattice_.block(0, offsets_[i - 1], dimension, active).colwise() += theta.bc_.col(0);
+      lattice_.block(0, offsets_[i - 1], dimension, active)
+	= lattice_.block(0, offsets_[i - 1], dimension, active).unaryExpr(hinge());
+    }
+    
+    const Eigen::Block<const tensor_type> layer_hidden(lattice_, 0, batch, dimension, words);
+    
+    loss_noise_.resize(samples_, words);
+    
+    for (size_type i = 1; i <= max_size; ++ i) {
+      const size_type active = offsets_[i] - offsets_[i - 1];
+      
+      loss_noise_.block(0, offsets_[i - 1] - batch, samples_, active).noalias()
+	= (embedding_noise_.block(0, (i - 1) * samples_, dimension, samples_).transpose()
+	   * layer_hidden.block(0, offsets_[i - 1] - batch, dimension, active)
+	   * theta.scale_);
+      loss_noise_.block(0, offsets_[i - 1] - batch, samples_, active).colwise()
+	+= embedding_noise_.row(dimension).segment((i - 1) * samples_, samples_).transpose();
+    }
+    
+    loss_target_.resize(words, 1);
+    
+    for (size_type i = 1; i <= max_size; ++ i)
+      for (size_type w = offsets_[i - 1] - batch; w != offsets_[i] - batch; ++ w) {
+	const word_type& word = targets_[w];
+	const word_set_type::const_iterator nfirst = noises_.begin() + (i - 1) * samples_;
+	const word_set_type::const_iterator nlast  = nfirst + samples_;
+	
+	// a noise sample identical to the target is ignored, thus the noise terms of this word
+	// assume the number of the samples actually used, not samples_
+	const size_type samples = samples_ - std::count(nfirst, nlast, word);
+	
+	if (! samples) {
+	  loss_target_(w, 0) = 0.0;
+	  loss_noise_.col(w).setZero();
+	  continue;
+	}
+	
+	const double log_samples = std::log(double(samples));
+	
+	const double score = ((embedding_target_.col(w).block(0, 0, dimension, 1).transpose() * layer_hidden.col(w) * theta.scale_)
+			      + embedding_target_.col(w).block(dimension, 0, 1, 1))(0, 0);
+	const double score_noise = log_samples + unigram_.logprob(word);
+	const double z = utils::mathop::logsum(score, score_noise);
+	const double logprob = score - z;
+	
+	loss_target_(w, 0) = - 1.0 + std::exp(logprob);
+	
+	double log_likelihood_word = logprob;
+	
+	for (size_type k = 0; k != samples_; ++ k) {
+	  if (*(nfirst + k) == word) {
+	    loss_noise_(k, w) = 0.0;
+	    continue;
+	  }
+	
+	  const double score = loss_noise_(k, w);
+	  const double score_noise = log_samples + unigram_.logprob(*(nfirst + k));
+	  const double z = utils::mathop::logsum(score, score_noise);
+	  const double logprob = score - z;
+	  const double logprob_noise = score_noise - z;
+	
+	  log_likelihood_word += logprob_noise;
+	
+	  loss_noise_(k, w) = std::exp(logprob);
+	}
+	
+	log_likelihood += log_likelihood_word;
+      }
+    
+    // output embedding, the targets followed by the noises
+    delta_output_.resize(dimension + 1, words + samples_ * max_size);
+    
+    delta_output_.block(0, 0, dimension, words) = layer_hidden * loss_target_.col(0).asDiagonal();
+    delta_output_.block(dimension, 0, 1, words) = loss_target_.transpose();
+    
+    delta_hidden_.noalias() = embedding_target_.block(0, 0, dimension, words) * loss_target_.col(0).asDiagonal();
+    
+    for (size_type i = 1; i <= max_size; ++ i) {
+      const size_type active = offsets_[i] - offsets_[i - 1];
+      const size_type col    = offsets_[i - 1] - batch;
+      
+      delta_output_.block(0, words + (i - 1) * samples_, dimension, samples_).noalias()
+	= layer_hidden.block(0, col, dimension, active) * loss_noise_.block(0, col, samples_, active).transpose();
+      delta_output_.block(dimension, words + (i - 1) * samples_, 1, samples_)
+	= loss_noise_.block(0, col, samples_, active).rowwise().sum().transpose();
+      
+      delta_hidden_.block(0, col, dimension, active).noalias()
+	+= embedding_noise_.block(0, (i - 1) * samples_, dimension, samples_) * loss_noise_.block(0, col, samples_, active);
+    }
+    
+    delta_hidden_ *= theta.scale_;
+    
+    columns_output_.clear();
+    for (size_type w = 0; w != words; ++ w)
+      columns_output_.push_back(word_column_type(targets_[w].id(), w));
+    for (size_type k = 0; k != samples_ * max_size; ++ k)
+      columns_output_.push_back(word_column_type(noises_[k].id(), words + k));
+    
+    accumulate(columns_output_, delta_output_, gradient, true);
+    
+    // backward...
+    
+    delta_input_.resize(dimension, words);
+    delta_ = tensor_type::Zero(dimension, 0);
+    
+    for (size_type i = max_size; i != 0; -- i) {
+      const size_type active = offsets_[i] - offsets_[i - 1];
+      const size_type prev   = (i == 1 ? size_type(0) : offsets_[i - 2]);
+      
+      // the errors from the output layer, and those propagated from the (longer) active sentences
+      delta_hidden_.block(0, offsets_[i - 1] - batch, dimension, delta_.cols()) += delta_;
+      
+      delta_ = (lattice_.block(0, offsets_[i - 1], dimension, active).array().unaryExpr(dhinge())
+		* delta_hidden_.block(0, offsets_[i - 1] - batch, dimension, active).array());
+      
+      gradient.Wc_.block(0, 0, dimension, dimension).noalias()
+	+= delta_ * inputs_.block(0, offsets_[i - 1] - batch, dimension, active).transpose();
+      gradient.Wc_.block(0, dimension, dimension, dimension).noalias()
+	+= delta_ * lattice_.block(0, prev, dimension, active).transpose();
+      gradient.bc_.noalias() += delta_.rowwise().sum();
+      
+      delta_input_.block(0, offsets_[i - 1] - batch, dimension, active).noalias()
+	= theta.Wc_.block(0, 0, dimension, dimension).transpose() * delta_;
+      
+      // propagate this...
+      delta_ = (lattice_.block(0, prev, dimension, active).array().unaryExpr(dhinge())
+		* (theta.Wc_.block(0, dimension, dimension, dimension).transpose() * delta_).array());
+    }
+    
+    accumulate(columns_input_, delta_input_, gradient, false);
+    
+    gradient.count_ += words;
+    
+    // we will rescale this to avoid rescaling by # of words
+    gradient.bi_.noalias() += delta_ * lengths_;
+    
+    return log_likelihood;
+  }
+  
+  template <typename Matrix>
+  void accumulate(word_column_set_type& columns,
+		  const Eigen::MatrixBase<Matrix>& matrix,
+		  gradient_type& gradient,
+		  const bool output)
+  {
+    std::sort(columns.begin(), columns.end());
+    
+    word_column_set_type::const_iterator citer_end = columns.end();
+    for (word_column_set_type::const_iterator citer = columns.begin(); citer != citer_end; /**/) {
+      const word_type word(citer->first);
+      
+      tensor_type& dembedding = (output ? gradient.embedding_output(word) : gradient.embedding_input(word));
+      
+      for (/**/; citer != citer_end && citer->first == word.id(); ++ citer)
+	dembedding += matrix.col(citer->second);
+    }
+  }
 };
 
 struct Learn
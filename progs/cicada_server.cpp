@@ -0,0 +1,501 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// resident decoder: grammars, models and operations are loaded once, and
+// id-prefixed requests from many clients, either by a unix domain socket or by a local tcp port,
+// are fed into the mapper queue. Results are returned to each client as soon as they are decoded,
+// not in the order of ids. See cicada_server_impl.hpp for the protocol.
+// The number of concurrent connections is bounded, and SIGINT/SIGTERM stops accepting,
+// finishes the requests already read and exits.
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <csignal>
+#include <cstdlib>
+#include <set>
+
+#include <poll.h>
+
+#include "cicada_impl.hpp"
+#include "cicada_server_impl.hpp"
+
+#include "utils/program_options.hpp"
+#include "utils/lockfree_list_queue.hpp"
+#include "utils/lexical_cast.hpp"
+#include "utils/bithack.hpp"
+#include "utils/random_seed.hpp"
+#include "utils/getline.hpp"
+#include "utils/resource.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+typedef std::string op_type;
+typedef std::vector<op_type, std::allocator<op_type> > op_set_type;
+
+bool input_bitext_mode = false;
+bool input_sentence_mode = false;
+bool input_lattice_mode = false;
+bool input_forest_mode = false;
+bool input_span_mode = false;
+bool input_alignment_mode = false;
+bool input_dependency_mode = false;
+
+std::string symbol_goal         = vocab_type::S;
+
+grammar_file_set_type grammar_files;
+grammar_file_set_type tree_grammar_files;
+feature_parameter_set_type feature_parameters;
+
+op_set_type ops;
+
+std::string socket_file;
+int         port = 0;
+double      deadline = 0.0;
+int         queue_size = 0;
+int         connections = 64;
+
+int threads = 1;
+
+int debug = 0;
+
+void options(int argc, char** argv);
+
+struct Connection
+{
+  typedef ServerSocket::istream_type istream_type;
+  typedef ServerSocket::ostream_type ostream_type;
+
+  Connection(const int __fd)
+    : fd(__fd),
+      is(boost::iostreams::file_descriptor_source(__fd, boost::iostreams::never_close_handle)),
+      os(boost::iostreams::file_descriptor_sink(__fd, boost::iostreams::never_close_handle)) {}
+  ~Connection() { ::close(fd); }
+
+  // responses are written by the mapper threads, and the reader thread (on errors)
+  void write(const size_t id, const std::string& status, const std::string& output)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    write_response(os, id, status, output);
+  }
+
+  int          fd;
+  istream_type is;
+  ostream_type os;
+
+  boost::mutex mutex;
+};
+typedef boost::shared_ptr<Connection> connection_ptr_type;
+
+struct Request
+{
+  typedef operation_set_type::operation_type::id_type id_type;
+
+  Request(const id_type& __id, const std::string& __line, const double& __deadline, const connection_ptr_type& __connection)
+    : id(__id), line(__line), deadline(__deadline), connection(__connection) {}
+
+  id_type     id;
+  std::string line;
+
+  // absolute (wall-clock) time, by which we should start decoding this request. zero for no deadline.
+  // This is a start deadline: a request which already started decoding is never interrupted.
+  double      deadline;
+
+  connection_ptr_type connection;
+};
+typedef boost::shared_ptr<Request> request_ptr_type;
+
+// bounded, thus, the readers are blocked, and so are the clients, when all the mappers are busy
+typedef utils::lockfree_list_queue<request_ptr_type, std::allocator<request_ptr_type> > queue_type;
+
+struct Task
+{
+  Task(queue_type&   __queue,
+       const model_type& __model,
+       const grammar_type& __grammar,
+       const tree_grammar_type& __tree_grammar)
+    : queue(__queue),
+      _model(__model),
+      _grammar(__grammar),
+      _tree_grammar(__tree_grammar) {}
+
+  void operator()()
+  {
+    // cloning should be performed in thread... otherwise, strangething may happen
+    const model_type        model(_model.clone());
+    const grammar_type      grammar(_grammar.clone());
+    const tree_grammar_type tree_grammar(_tree_grammar.clone());
+
+    // id-prefixed input, and the output is buffered
+    operation_set_type operations(ops.begin(), ops.end(),
+				  model,
+				  grammar,
+				  tree_grammar,
+				  symbol_goal,
+				  true,
+				  input_sentence_mode,
+				  input_lattice_mode,
+				  input_forest_mode,
+				  input_span_mode,
+				  input_alignment_mode,
+				  input_dependency_mode,
+				  input_bitext_mode,
+				  true,
+				  debug);
+
+    request_ptr_type request;
+
+    for (;;) {
+      request.reset();
+      queue.pop_swap(request);
+      if (! request) break;
+
+      if (request->deadline > 0.0 && utils::resource().user_time() > request->deadline) {
+	request->connection->write(request->id, "timeout", std::string());
+	continue;
+      }
+
+      try {
+	operations(request->line);
+
+	request->connection->write(request->id, "ok", operations.get_output_data().buffer);
+      }
+      catch (const std::exception& err) {
+	request->connection->write(request->id, "error", err.what());
+      }
+    }
+
+    operations.clear();
+    const_cast<operation_set_type::data_type&>(operations.get_data()).clear();
+  }
+
+  queue_type&   queue;
+  const model_type& _model;
+  const grammar_type& _grammar;
+  const tree_grammar_type& _tree_grammar;
+};
+
+// bound the number of concurrent connections, i.e. reader threads, so that many idle clients
+// do not exhaust threads. When full, we stop accepting and new clients wait in the listen backlog.
+struct ConnectionLimit
+{
+  typedef std::set<int, std::less<int>, std::allocator<int> > fd_set_type;
+
+  ConnectionLimit(const size_t __limit) : limit(__limit) {}
+
+  void acquire(const int fd)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    fds.insert(fd);
+  }
+
+  void release(const int fd)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    fds.erase(fd);
+    cond.notify_all();
+  }
+
+  bool full()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    return fds.size() >= limit;
+  }
+
+  // wait at most a few milli-seconds until a connection is released
+  void wait()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    if (fds.size() >= limit)
+      cond.timed_wait(lock, boost::posix_time::milliseconds(200));
+  }
+
+  // stop reading from the clients, and wait until all the readers quit.
+  // Responses of the requests already queued can still be written.
+  void shutdown()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+
+    for (fd_set_type::const_iterator fiter = fds.begin(); fiter != fds.end(); ++ fiter)
+      ::shutdown(*fiter, SHUT_RD);
+
+    while (! fds.empty())
+      cond.wait(lock);
+  }
+
+  size_t      limit;
+  fd_set_type fds;
+
+  boost::mutex              mutex;
+  boost::condition_variable cond;
+};
+
+struct Reader
+{
+  Reader(queue_type& __queue, ConnectionLimit& __limit, const connection_ptr_type& __connection)
+    : queue(__queue), limit(__limit), connection(__connection) {}
+
+  // release the connection even when the reader is terminated by an exception
+  struct release_type
+  {
+    release_type(ConnectionLimit& __limit, const int __fd) : limit(__limit), fd(__fd) {}
+    ~release_type() { limit.release(fd); }
+
+    ConnectionLimit& limit;
+    int fd;
+  };
+
+  void operator()()
+  {
+    release_type release(limit, connection->fd);
+
+    std::string line;
+
+    while (utils::getline(connection->is, line)) {
+      if (line.empty()) continue;
+
+      size_t id = 0;
+      std::string::const_iterator iter = line.begin();
+      if (! parse_id(id, iter, std::string::const_iterator(line.end()))) {
+	connection->write(size_t(-1), "error", "invalid id-prefixed format: " + line);
+	continue;
+      }
+
+      const double time_deadline = (deadline > 0.0 ? utils::resource().user_time() + deadline : 0.0);
+
+      queue.push(request_ptr_type(new Request(id, line, time_deadline, connection)));
+    }
+
+    if (debug)
+      std::cerr << "closed connection: " << connection->fd << std::endl;
+  }
+
+  queue_type&         queue;
+  ConnectionLimit&    limit;
+  connection_ptr_type connection;
+};
+
+volatile sig_atomic_t terminated = 0;
+
+void terminate_handler(int)
+{
+  terminated = 1;
+}
+
+int main(int argc, char ** argv)
+{
+  try {
+    options(argc, argv);
+
+    if (socket_file.empty() == (port <= 0))
+      throw std::runtime_error("either one of --socket or --port");
+
+    threads     = utils::bithack::max(1, threads);
+    queue_size  = (queue_size <= 0 ? threads * 4 : queue_size);
+    connections = utils::bithack::max(1, connections);
+
+    // clients may disconnect before receiving responses
+    ::signal(SIGPIPE, SIG_IGN);
+
+    // graceful shutdown. The accept loop polls, thus we do not rely on interrupted system calls
+    ::signal(SIGINT,  terminate_handler);
+    ::signal(SIGTERM, terminate_handler);
+
+    // random number seed
+    ::srandom(utils::random_seed());
+
+    // read grammars...
+    grammar_type grammar(grammar_files.begin(), grammar_files.end());
+    if (debug)
+      std::cerr << "grammar: " << grammar.size() << std::endl;
+
+    tree_grammar_type tree_grammar(tree_grammar_files.begin(), tree_grammar_files.end());
+    if (debug)
+      std::cerr << "tree grammar: " << tree_grammar.size() << std::endl;
+
+    // read features...
+    model_type model;
+    for (feature_parameter_set_type::const_iterator piter = feature_parameters.begin(); piter != feature_parameters.end(); ++ piter)
+      model.push_back(feature_function_type::create(*piter));
+    model.initialize();
+
+    if (debug)
+      std::cerr << "feature functions: " << model.size() << std::endl;
+
+    // check the operations
+    {
+      operation_set_type operations(ops.begin(), ops.end(),
+				    model,
+				    grammar,
+				    tree_grammar,
+				    symbol_goal,
+				    true,
+				    input_sentence_mode,
+				    input_lattice_mode,
+				    input_forest_mode,
+				    input_span_mode,
+				    input_alignment_mode,
+				    input_dependency_mode,
+				    input_bitext_mode,
+				    true,
+				    debug);
+
+      if (! operations.get_output_data().directory.empty())
+	throw std::runtime_error("no directory output for the server");
+
+      if (debug)
+	std::cerr << "operations: " << operations.size() << std::endl;
+    }
+
+    queue_type queue(queue_size);
+
+    boost::thread_group mapper;
+    std::vector<Task, std::allocator<Task> > tasks(threads, Task(queue, model, grammar, tree_grammar));
+
+    for (int i = 0; i != threads; ++ i)
+      mapper.add_thread(new boost::thread(boost::ref(tasks[i])));
+
+    const bool tcp = socket_file.empty();
+    const int  fd  = (tcp
+		      ? ServerSocket::listen_tcp(port, 128)
+		      : ServerSocket::listen_unix(socket_file, 128));
+
+    if (debug)
+      std::cerr << "listening: " << (tcp ? "port " + utils::lexical_cast<std::string>(port) : socket_file) << std::endl;
+
+    ConnectionLimit limit(connections);
+
+    // we will run until SIGINT or SIGTERM
+    while (! terminated) {
+      if (limit.full()) {
+	limit.wait();
+	continue;
+      }
+
+      struct pollfd pfd;
+      pfd.fd      = fd;
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+
+      const int ready = ::poll(&pfd, 1, 200);
+
+      if (ready < 0 && errno != EINTR)
+	ServerSocket::error("poll");
+      if (ready <= 0) continue;
+
+      const int client = ServerSocket::accept(fd, tcp);
+
+      if (debug)
+	std::cerr << "accepted connection: " << client << std::endl;
+
+      limit.acquire(client);
+
+      try {
+	boost::thread(Reader(queue, limit, connection_ptr_type(new Connection(client)))).detach();
+      }
+      catch (...) {
+	limit.release(client);
+	throw;
+      }
+    }
+
+    if (debug)
+      std::cerr << "shutting down" << std::endl;
+
+    ::close(fd);
+    if (! tcp)
+      ::unlink(socket_file.c_str());
+
+    // no more requests, then, finish the queued ones
+    limit.shutdown();
+
+    for (int i = 0; i != threads; ++ i)
+      queue.push(request_ptr_type());
+
+    mapper.join_all();
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void options(int argc, char** argv)
+{
+  namespace po = boost::program_options;
+
+  po::options_description opts_config("configuration options");
+  opts_config.add_options()
+    // options for input/output format
+    ("input-bitext",     po::bool_switch(&input_bitext_mode),     "target sentence prefixed input")
+    ("input-sentence",   po::bool_switch(&input_sentence_mode),   "sentence input")
+    ("input-lattice",    po::bool_switch(&input_lattice_mode),    "lattice input")
+    ("input-forest",     po::bool_switch(&input_forest_mode),     "forest input")
+    ("input-span",       po::bool_switch(&input_span_mode),       "span input")
+    ("input-alignment",  po::bool_switch(&input_alignment_mode),  "alignment input")
+    ("input-dependency", po::bool_switch(&input_dependency_mode), "dependency input")
+
+    // grammar
+    ("goal",              po::value<std::string>(&symbol_goal)->default_value(symbol_goal),    "goal symbol")
+    ("grammar",           po::value<grammar_file_set_type >(&grammar_files)->composing(),      "grammar specification(s)")
+    ("tree-grammar",      po::value<grammar_file_set_type >(&tree_grammar_files)->composing(), "tree grammar specification(s)")
+
+    // models...
+    ("feature-function",  po::value<feature_parameter_set_type >(&feature_parameters)->composing(), "feature function(s)")
+
+    //operatins...
+    ("operation",         po::value<op_set_type>(&ops)->composing(), "operations")
+    ;
+
+  po::options_description opts_command("command line options");
+  opts_command.add_options()
+    ("socket",     po::value<std::string>(&socket_file), "unix domain socket to listen")
+    ("port",       po::value<int>(&port),                "local tcp port to listen")
+    ("deadline",    po::value<double>(&deadline),         "seconds by which a request should be started decoding, not finished (zero for no deadline)")
+    ("queue-size",  po::value<int>(&queue_size),          "# of queued requests (default: 4 * # of threads)")
+    ("connections", po::value<int>(&connections)->default_value(connections), "# of concurrent connections")
+
+    ("config",  po::value<path_type>(),                    "configuration file")
+    ("threads", po::value<int>(&threads),                  "# of threads")
+    ("debug",   po::value<int>(&debug)->implicit_value(1), "debug level")
+    ("help", "help message");
+
+  po::options_description desc_config;
+  po::options_description desc_command;
+
+  desc_config.add(opts_config);
+  desc_command.add(opts_config).add(opts_command);
+
+  po::variables_map variables;
+
+  po::store(po::parse_command_line(argc, argv, desc_command, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), variables);
+  if (variables.count("config")) {
+    const path_type path_config = variables["config"].as<path_type>();
+    if (! boost::filesystem::exists(path_config))
+      throw std::runtime_error("no config file: " + path_config.string());
+
+    utils::compress_istream is(path_config);
+    po::store(po::parse_config_file(is, desc_config), variables);
+  }
+
+  po::notify(variables);
+
+  if (variables.count("help")) {
+
+    std::cout << argv[0] << " [options]\n"
+	      << desc_command << std::endl;
+    exit(0);
+  }
+}
@@ -0,0 +1,205 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// socket and protocol for the cicada server and its clients
+//
+// request:  one line of id-prefixed input, i.e. "id ||| sentence (or lattice etc.)"
+// response: a header line "id status size", followed by size bytes of output,
+//           where status is one of "ok", "timeout" or "error" (the output is an error message)
+//
+
+#ifndef __CICADA__SERVER_IMPL__HPP__
+#define __CICADA__SERVER_IMPL__HPP__ 1
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <iostream>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+
+#include <utils/lexical_cast.hpp>
+
+struct ServerSocket
+{
+  typedef boost::iostreams::stream<boost::iostreams::file_descriptor_source> istream_type;
+  typedef boost::iostreams::stream<boost::iostreams::file_descriptor_sink>   ostream_type;
+
+  static void error(const std::string& message)
+  {
+    throw std::runtime_error(message + ": " + std::strerror(errno));
+  }
+
+  static void no_delay(const int fd)
+  {
+    int flag = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+
+  static sockaddr_un address_unix(const std::string& path)
+  {
+    sockaddr_un addr;
+
+    if (path.size() >= sizeof(addr.sun_path))
+      throw std::runtime_error("too long socket path: " + path);
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    return addr;
+  }
+
+  static sockaddr_in address_tcp(const std::string& host, const int port)
+  {
+    sockaddr_in addr;
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+      throw std::runtime_error("invalid address: " + host);
+
+    return addr;
+  }
+
+  // listen on a unix domain socket. A stale socket file will be removed.
+  static int listen_unix(const std::string& path, const int backlog)
+  {
+    const sockaddr_un addr = address_unix(path);
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+      ::unlink(path.c_str());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      error("socket");
+
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+      ::close(fd);
+      error("bind " + path);
+    }
+
+    if (::listen(fd, backlog) < 0) {
+      ::close(fd);
+      error("listen " + path);
+    }
+
+    return fd;
+  }
+
+  // listen on a local tcp port, i.e. only on the loopback interface
+  static int listen_tcp(const int port, const int backlog)
+  {
+    const sockaddr_in addr = address_tcp("127.0.0.1", port);
+
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      error("socket");
+
+    int flag = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+      ::close(fd);
+      error("bind port " + utils::lexical_cast<std::string>(port));
+    }
+
+    if (::listen(fd, backlog) < 0) {
+      ::close(fd);
+      error("listen port " + utils::lexical_cast<std::string>(port));
+    }
+
+    return fd;
+  }
+
+  static int accept(const int fd, const bool tcp)
+  {
+    for (;;) {
+      const int client = ::accept(fd, 0, 0);
+
+      if (client >= 0) {
+	if (tcp)
+	  no_delay(client);
+	return client;
+      }
+
+      if (errno != EINTR && errno != ECONNABORTED)
+	error("accept");
+    }
+  }
+
+  static int connect_unix(const std::string& path)
+  {
+    const sockaddr_un addr = address_unix(path);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      error("socket");
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+      ::close(fd);
+      error("connect " + path);
+    }
+
+    return fd;
+  }
+
+  static int connect_tcp(const std::string& host, const int port)
+  {
+    const sockaddr_in addr = address_tcp(host, port);
+
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      error("socket");
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+      ::close(fd);
+      error("connect " + host + ':' + utils::lexical_cast<std::string>(port));
+    }
+
+    no_delay(fd);
+
+    return fd;
+  }
+};
+
+inline
+void write_response(std::ostream& os, const size_t id, const std::string& status, const std::string& output)
+{
+  os << id << ' ' << status << ' ' << output.size() << '\n';
+  os.write(output.c_str(), output.size());
+  os << std::flush;
+}
+
+inline
+bool read_response(std::istream& is, size_t& id, std::string& status, std::string& output)
+{
+  size_t size = 0;
+
+  if (! (is >> id >> status >> size)) return false;
+  if (is.get() != '\n') return false;
+
+  output.resize(size);
+  if (size && ! is.read(&(*output.begin()), size)) return false;
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,233 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// load generator for cicada_server: each client keeps # of window requests in flight,
+// and we measure the throughput and the latency of the responses.
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+
+#include "cicada_server_impl.hpp"
+
+#include "utils/program_options.hpp"
+#include "utils/compress_stream.hpp"
+#include "utils/getline.hpp"
+#include "utils/resource.hpp"
+#include "utils/bithack.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+typedef boost::filesystem::path path_type;
+
+typedef std::vector<std::string, std::allocator<std::string> > line_set_type;
+typedef std::vector<double, std::allocator<double> > latency_set_type;
+
+path_type input_file = "-";
+
+std::string socket_file;
+std::string host = "127.0.0.1";
+int         port = 0;
+
+int clients  = 1;
+int window   = 1;
+int requests = 0;
+
+int debug = 0;
+
+void options(int argc, char** argv);
+
+struct Client
+{
+  typedef std::map<size_t, double, std::less<size_t>, std::allocator<std::pair<const size_t, double> > > pending_type;
+
+  Client(const line_set_type& __lines, const int __client)
+    : lines(__lines), client(__client), num_ok(0), num_timeout(0), num_error(0) {}
+
+  void operator()()
+  {
+    const int fd = (socket_file.empty()
+		    ? ServerSocket::connect_tcp(host, port)
+		    : ServerSocket::connect_unix(socket_file));
+
+    ServerSocket::istream_type is(boost::iostreams::file_descriptor_source(fd, boost::iostreams::never_close_handle));
+    ServerSocket::ostream_type os(boost::iostreams::file_descriptor_sink(fd, boost::iostreams::never_close_handle));
+
+    pending_type pending;
+
+    // the requests of this client are client, client + clients, client + 2 * clients ...
+    size_t id = client;
+
+    size_t id_response;
+    std::string status;
+    std::string output;
+
+    for (;;) {
+      while (int(pending.size()) < window && id < size_t(requests)) {
+	pending[id] = utils::resource().user_time();
+
+	os << id << " ||| " << lines[id % lines.size()] << '\n';
+
+	id += clients;
+      }
+      os << std::flush;
+
+      if (pending.empty()) break;
+
+      if (! read_response(is, id_response, status, output))
+	throw std::runtime_error("connection closed");
+
+      const double time_end = utils::resource().user_time();
+
+      pending_type::iterator piter = pending.find(id_response);
+      if (piter == pending.end())
+	throw std::runtime_error("unknown response: " + utils::lexical_cast<std::string>(id_response) + ' ' + status + ' ' + output);
+
+      latencies.push_back(time_end - piter->second);
+      pending.erase(piter);
+
+      if (status == "ok")
+	++ num_ok;
+      else if (status == "timeout")
+	++ num_timeout;
+      else {
+	++ num_error;
+
+	if (debug)
+	  std::cerr << "error: " << id_response << ' ' << output << std::endl;
+      }
+    }
+
+    ::close(fd);
+  }
+
+  const line_set_type& lines;
+  int client;
+
+  latency_set_type latencies;
+
+  size_t num_ok;
+  size_t num_timeout;
+  size_t num_error;
+};
+
+int main(int argc, char** argv)
+{
+  try {
+    options(argc, argv);
+
+    if (socket_file.empty() == (port <= 0))
+      throw std::runtime_error("either one of --socket or --port");
+
+    clients = utils::bithack::max(1, clients);
+    window  = utils::bithack::max(1, window);
+
+    line_set_type lines;
+    {
+      utils::compress_istream is(input_file, 1024 * 1024);
+
+      std::string line;
+      while (utils::getline(is, line))
+	if (! line.empty())
+	  lines.push_back(line);
+    }
+
+    if (lines.empty())
+      throw std::runtime_error("no input?");
+
+    if (requests <= 0)
+      requests = lines.size();
+
+    std::vector<Client, std::allocator<Client> > tasks;
+    for (int i = 0; i != clients; ++ i)
+      tasks.push_back(Client(lines, i));
+
+    utils::resource start;
+
+    boost::thread_group workers;
+    for (int i = 0; i != clients; ++ i)
+      workers.add_thread(new boost::thread(boost::ref(tasks[i])));
+    workers.join_all();
+
+    utils::resource end;
+
+    latency_set_type latencies;
+    size_t num_ok = 0;
+    size_t num_timeout = 0;
+    size_t num_error = 0;
+
+    for (int i = 0; i != clients; ++ i) {
+      latencies.insert(latencies.end(), tasks[i].latencies.begin(), tasks[i].latencies.end());
+
+      num_ok      += tasks[i].num_ok;
+      num_timeout += tasks[i].num_timeout;
+      num_error   += tasks[i].num_error;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    const double elapsed = end.user_time() - start.user_time();
+
+    std::cout << "requests: " << latencies.size()
+	      << " ok: " << num_ok
+	      << " timeout: " << num_timeout
+	      << " error: " << num_error
+	      << '\n';
+    std::cout << "throughput: " << (latencies.size() / elapsed) << " requests/sec"
+	      << " elapsed: " << elapsed
+	      << '\n';
+
+    if (! latencies.empty())
+      std::cout << "latency"
+		<< " p50: " << latencies[latencies.size() * 50 / 100]
+		<< " p90: " << latencies[latencies.size() * 90 / 100]
+		<< " p99: " << latencies[latencies.size() * 99 / 100]
+		<< " max: " << latencies.back()
+		<< '\n';
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void options(int argc, char** argv)
+{
+  namespace po = boost::program_options;
+
+  po::options_description desc("options");
+  desc.add_options()
+    ("input",    po::value<path_type>(&input_file)->default_value(input_file), "input file (without ids)")
+
+    ("socket",   po::value<std::string>(&socket_file),                 "unix domain socket to connect")
+    ("host",     po::value<std::string>(&host)->default_value(host),   "host to connect")
+    ("port",     po::value<int>(&port),                                "tcp port to connect")
+
+    ("clients",  po::value<int>(&clients)->default_value(clients),     "# of clients (connections)")
+    ("window",   po::value<int>(&window)->default_value(window),       "# of requests in flight for each client")
+    ("requests", po::value<int>(&requests),                            "# of requests in total (default: # of input lines)")
+
+    ("debug",    po::value<int>(&debug)->implicit_value(1), "debug level")
+
+    ("help", "help message");
+
+  po::variables_map variables;
+  po::store(po::parse_command_line(argc, argv, desc, po::command_line_style::unix_style & (~po::command_line_style::allow_guessing)), variables);
+  po::notify(variables);
+
+  if (variables.count("help")) {
+    std::cout << argv[0] << " [options]\n"
+	      << desc << std::endl;
+    exit(0);
+  }
+}
@@ -23,6 +23,7 @@
 #include <utils/map_file.hpp>
 #include <utils/repository.hpp>
 #include <utils/succinct_vector.hpp>
+#include <utils/succinct_vector_rank9.hpp>
 #include <utils/filesystem.hpp>
 #include <utils/packed_vector.hpp>
 #include <utils/packed_device.hpp>
@@ -615,8 +616,8 @@ namespace succinctdb
     typedef typename Alloc::template rebind<key_type>::other  key_alloc_type;
     typedef typename Alloc::template rebind<data_type>::other data_alloc_type;
     
-    typedef utils::succinct_vector_mapped<bit_alloc_type> position_set_type;
-    typedef utils::succinct_vector_mapped<bit_alloc_type> index_map_type;
+    typedef utils::succinct_vector_rank9_mapped<bit_alloc_type> position_set_type;
+    typedef utils::succinct_vector_rank9_mapped<bit_alloc_type> index_map_type;
     typedef __succinct_trie_mapped_index<key_type, key_alloc_type> index_set_type;
     typedef __succinct_trie_mapped_data<data_type, data_alloc_type> mapped_set_type;
 
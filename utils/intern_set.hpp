@@ -0,0 +1,189 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __UTILS__INTERN_SET__HPP__
+#define __UTILS__INTERN_SET__HPP__ 1
+
+//
+// append-only set of strings, indexed by the order of insertion, for interning symbols.
+//
+// find(), operator[] and size() are lock-free, and may run concurrently with insert(), but
+// insert() should be serialized by the caller, e.g. by a writer lock.
+// Strings are stored in segments of doubling sizes, and the open-addressed hash table is replaced
+// by a larger one, which is published atomically. Nothing seen by readers is ever moved nor freed
+// (old tables are released when the set is destroyed).
+//
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <utils/piece.hpp>
+#include <utils/hashmurmur3.hpp>
+#include <utils/atomicop.hpp>
+#include <utils/bithack.hpp>
+
+#include <boost/noncopyable.hpp>
+
+namespace utils
+{
+  class intern_set : private boost::noncopyable
+  {
+  public:
+    typedef std::string  value_type;
+    typedef utils::piece piece_type;
+    typedef uint32_t     index_type;
+    typedef size_t       size_type;
+    typedef uint32_t     hash_type;
+
+    static const index_type npos = index_type(-1);
+
+  private:
+    // the first segment holds 2^segment_base strings, and the k-th one holds 2^(k + segment_base)
+    static const size_type segment_base = 10;
+    static const size_type segment_size = 32 - segment_base + 1;
+
+    // a slot: the hash value in the upper 32 bits, and the index + 1 in the lower 32 bits. zero for empty.
+    typedef uint64_t slot_type;
+
+    struct table_type
+    {
+      table_type(const size_type __capacity) : mask(__capacity - 1), slots(new slot_type[__capacity])
+      {
+	std::fill(slots, slots + __capacity, slot_type(0));
+      }
+      ~table_type() { delete [] slots; }
+
+      size_type capacity() const { return mask + 1; }
+
+      size_type  mask;
+      slot_type* slots;
+    };
+
+    typedef std::vector<table_type*, std::allocator<table_type*> > table_set_type;
+
+  public:
+    intern_set() : __table(new table_type(1024)), __size(0)
+    {
+      std::fill(__segments, __segments + segment_size, (value_type*) 0);
+    }
+
+    ~intern_set()
+    {
+      for (size_type i = 0; i != segment_size; ++ i)
+	delete [] __segments[i];
+
+      delete __table;
+      for (table_set_type::iterator titer = __tables.begin(); titer != __tables.end(); ++ titer)
+	delete *titer;
+    }
+
+  public:
+    static hash_type hash(const piece_type& x)
+    {
+      const uint64_t value = utils::hashmurmur3<uint64_t>()(x.begin(), x.end(), 0);
+
+      return (value >> 32) ^ value;
+    }
+
+    size_type size() const { return __size; }
+    bool empty() const { return __size == 0; }
+
+    const value_type& operator[](const index_type& pos) const
+    {
+      const size_type pos_base = size_type(pos) + (size_type(1) << segment_base);
+      const size_type msb = utils::bithack::floor_log2(pos_base);
+
+      return __segments[msb - segment_base][pos_base - (size_type(1) << msb)];
+    }
+
+    // returns npos when not found
+    index_type find(const piece_type& x) const { return find(x, hash(x)); }
+
+    index_type find(const piece_type& x, const hash_type& hash_value) const
+    {
+      const table_type* table = __table;
+
+      for (size_type pos = hash_value & table->mask; /**/; pos = (pos + 1) & table->mask) {
+	const slot_type slot = const_cast<const volatile slot_type*>(table->slots)[pos];
+
+	if (! slot) return npos;
+
+	if (hash_type(slot >> 32) == hash_value && operator[](index_type(slot) - 1) == x)
+	  return index_type(slot) - 1;
+      }
+    }
+
+    std::pair<index_type, bool> insert(const piece_type& x) { return insert(x, hash(x)); }
+
+    std::pair<index_type, bool> insert(const piece_type& x, const hash_type& hash_value)
+    {
+      const index_type found = find(x, hash_value);
+      if (found != npos)
+	return std::make_pair(found, false);
+
+      const index_type pos = __size;
+
+      // store the string, then publish it by the size and the slot
+      const size_type pos_base = size_type(pos) + (size_type(1) << segment_base);
+      const size_type msb = utils::bithack::floor_log2(pos_base);
+
+      if (! __segments[msb - segment_base])
+	__segments[msb - segment_base] = new value_type[size_type(1) << msb];
+
+      __segments[msb - segment_base][pos_base - (size_type(1) << msb)].assign(x.begin(), x.end());
+
+      utils::atomicop::memory_barrier();
+
+      __size = pos + 1;
+
+      if ((__size << 1) > __table->capacity())
+	grow();
+
+      insert(*__table, (slot_type(hash_value) << 32) | (slot_type(pos) + 1));
+
+      utils::atomicop::memory_barrier();
+
+      return std::make_pair(pos, true);
+    }
+
+  private:
+    static void insert(table_type& table, const slot_type& slot)
+    {
+      size_type pos = hash_type(slot >> 32) & table.mask;
+      while (table.slots[pos])
+	pos = (pos + 1) & table.mask;
+
+      const_cast<volatile slot_type*>(table.slots)[pos] = slot;
+    }
+
+    void grow()
+    {
+      table_type* table = new table_type(__table->capacity() << 1);
+
+      for (size_type i = 0; i != __table->capacity(); ++ i)
+	if (__table->slots[i])
+	  insert(*table, __table->slots[i]);
+
+      utils::atomicop::memory_barrier();
+
+      // readers may still be probing the old table
+      __tables.push_back(const_cast<table_type*>(__table));
+      __table = table;
+    }
+
+  private:
+    table_type* volatile __table;
+    table_set_type       __tables;
+
+    value_type* volatile __segments[segment_size];
+    volatile size_type   __size;
+  };
+};
+
+#endif
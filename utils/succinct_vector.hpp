@@ -26,6 +26,7 @@
 #include <utils/map_file.hpp>
 #include <utils/array_power2.hpp>
 #include <utils/filesystem.hpp>
+#include <utils/succinct_vector_rank9.hpp>
 
 namespace utils
 {
@@ -750,6 +751,22 @@ namespace utils
       dump_file(repository.path("rank-high"), __rank_high);
       dump_file(repository.path("rank-low"), __rank_low);
       
+      // the rank9 directory and the select samples, mapped by succinct_vector_rank9_mapped
+      {
+	typedef __succinct_vector_rank9_base rank9_type;
+	typedef rank9_type::block_words<bit_block_type> word_set_type;
+	
+	std::vector<rank9_type::count_type, std::allocator<rank9_type::count_type> >   counts;
+	std::vector<rank9_type::sample_type, std::allocator<rank9_type::sample_type> > samples0;
+	std::vector<rank9_type::sample_type, std::allocator<rank9_type::sample_type> > samples1;
+	
+	rank9_type::build(word_set_type(__blocks), word_set_type::size(__blocks), counts, samples0, samples1);
+	
+	dump_file(repository.path("rank9"), counts);
+	dump_file(repository.path("rank9-select0"), samples0);
+	dump_file(repository.path("rank9-select1"), samples1);
+      }
+      
       std::ostringstream stream;
       stream << __size;
       repository["size"] = stream.str();
@@ -0,0 +1,598 @@
+// -*- mode: c++ -*-
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+#ifndef __UTILS__SUCCINCT_VECTOR_RANK9__HPP__
+#define __UTILS__SUCCINCT_VECTOR_RANK9__HPP__ 1
+
+//
+// rank9 and sampled select over the succinct_vector on-disk format
+//
+// The bits written by succinct_vector are mapped as is, and viewed as 64-bit words. Instead of the
+// rank-high/rank-low directories, we use the rank9 directory of Vigna,
+// "Broadword Implementation of Rank/Select Queries", 2008: a pair of 64-bit counters for each basic
+// block of 512 bits, the absolute rank before the block and seven 9-bit relative ranks of its words,
+// interleaved so that a rank touches a single cache line of the directory. A select starts from the
+// sampled block of every 512th bit, and finds the block by the absolute ranks, the word by comparing
+// the relative ranks in parallel, and the bit by a broadword in-word select, or pdep when BMI2 is
+// available.
+//
+// The directory is 25% of the bits, and the samples are less than 1% for dense vectors.
+// succinct_vector::write() dumps the directory and the samples, "rank9", "rank9-select0" and
+// "rank9-select1", next to the bits, and they are simply mapped when opened. For an index written
+// before them, they are built when opened, and shared among the copies of the vector.
+//
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <utils/bithack.hpp>
+#include <utils/repository.hpp>
+#include <utils/map_file.hpp>
+#include <utils/filesystem.hpp>
+
+#if (defined(__BMI2__) && defined(__BMI__)) || defined(__POPCNT__)
+#include <immintrin.h>
+#endif
+
+namespace utils
+{
+  struct __succinct_vector_rank9_base
+  {
+    typedef boost::filesystem::path path_type;
+
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef uint32_t block_type;
+    typedef uint64_t word_type;
+    typedef uint64_t count_type;
+    typedef uint32_t sample_type;
+
+    static const size_type word_size       = sizeof(word_type) * 8;  // 64 bit
+    static const size_type basic_block_size = word_size * 8;          // 512 bit
+    static const size_type sample_size     = 512;                     // sample every 512th bit
+
+    static const size_type shift_word        = 6;
+    static const size_type shift_basic_block = 9;
+    static const size_type shift_sample      = 9;
+
+    static const word_type ones_step_9 = (word_type(1) << 0) | (word_type(1) << 9) | (word_type(1) << 18) | (word_type(1) << 27) | (word_type(1) << 36) | (word_type(1) << 45) | (word_type(1) << 54);
+    static const word_type msbs_step_9 = ones_step_9 << 8;
+    static const word_type ones_step_8 = 0x0101010101010101LLU;
+    static const word_type msbs_step_8 = 0x8080808080808080LLU;
+
+    // j * 64 for the j-th 9-bit relative rank, in order to count zeros
+    static const word_type bits_step_9 = ((word_type(64 * 1) << 0)  | (word_type(64 * 2) << 9)  | (word_type(64 * 3) << 18)
+					  | (word_type(64 * 4) << 27) | (word_type(64 * 5) << 36) | (word_type(64 * 6) << 45)
+					  | (word_type(64 * 7) << 54));
+
+    struct __select_in_byte
+    {
+      __select_in_byte()
+      {
+	for (size_type value = 0; value != 256; ++ value) {
+	  size_type rank = 0;
+	  for (size_type bit = 0; bit != 8; ++ bit)
+	    if (value & (1 << bit)) {
+	      table[(rank << 8) | value] = bit;
+	      ++ rank;
+	    }
+	  for (/**/; rank != 8; ++ rank)
+	    table[(rank << 8) | value] = 8;
+	}
+      }
+
+      uint8_t table[256 * 8];
+    };
+
+    static size_type bit_count(const word_type& x)
+    {
+#if defined(__POPCNT__)
+      return _mm_popcnt_u64(x);
+#else
+      return utils::bithack::bit_count(x);
+#endif
+    }
+
+    // the position of the k-th one in x, starting from zero
+    static size_type select_in_word(const word_type& x, const size_type k)
+    {
+#if defined(__BMI2__) && defined(__BMI__)
+      return _tzcnt_u64(_pdep_u64(word_type(1) << k, x));
+#else
+      static const __select_in_byte __table;
+
+      // byte-wise bit count, accumulated
+      word_type byte_sums = x - ((x >> 1) & 0x5555555555555555LLU);
+      byte_sums = (byte_sums & 0x3333333333333333LLU) + ((byte_sums >> 2) & 0x3333333333333333LLU);
+      byte_sums = (byte_sums + (byte_sums >> 4)) & 0x0f0f0f0f0f0f0f0fLLU;
+      byte_sums *= ones_step_8;
+
+      // # of bytes whose accumulated count is <= k
+      const word_type k_step_8 = k * ones_step_8;
+      const word_type leq_step_8 = ((k_step_8 | msbs_step_8) - byte_sums) & msbs_step_8;
+      const size_type place = bit_count(leq_step_8) << 3;
+      const size_type byte_rank = k - (((byte_sums << 8) >> place) & 0xff);
+
+      return place + __table.table[((x >> place) & 0xff) | (byte_rank << 8)];
+#endif
+    }
+
+    // the # of 9-bit fields of x which are <= y
+    static size_type count_leq_step_9(const word_type& x, const size_type y)
+    {
+      const word_type y_step_9 = y * ones_step_9;
+      const word_type leq = ((((y_step_9 | msbs_step_9) - (x & ~msbs_step_9)) | (x ^ y_step_9)) ^ (x & ~y_step_9)) & msbs_step_9;
+
+      // the flags are summed up at the highest field
+      return (((leq >> 8) * ones_step_9) >> 54) & 0x1ff;
+    }
+
+    // the j-th relative rank, where j = -1 is the zero in the highest bit
+    static size_type relative_rank(const word_type& x, const difference_type j)
+    {
+      return (x >> ((j + ((j >> 60) & 8)) * 9)) & 0x1ff;
+    }
+
+    // a read-only view of an array, either mapped or built in memory
+    template <typename Tp>
+    struct array_view
+    {
+      array_view() : first(0), length(0) {}
+      array_view(const Tp* __first, const size_type __length) : first(__first), length(__length) {}
+
+      const Tp& operator[](size_type pos) const { return first[pos]; }
+      size_type size() const { return length; }
+      bool empty() const { return length == 0; }
+
+      const Tp* first;
+      size_type length;
+    };
+
+    // 64-bit words over 32-bit blocks. The last word may consist of a single block
+    template <typename Blocks>
+    struct block_words
+    {
+      block_words(const Blocks& __blocks) : blocks(__blocks) {}
+
+      word_type operator()(size_type pos) const
+      {
+	const size_type first = pos << 1;
+
+	return (first + 1 < blocks.size()
+		? word_type(blocks[first]) | (word_type(blocks[first + 1]) << 32)
+		: word_type(blocks[first]));
+      }
+
+      static size_type size(const Blocks& blocks) { return (blocks.size() + 1) >> 1; }
+
+      const Blocks& blocks;
+    };
+
+    // the size of the directory for num_words, including the sentinel
+    static size_type directory_size(const size_type num_words)
+    {
+      return (((num_words + 7) >> 3) + 1) * 2;
+    }
+
+    // build the directory from words, and the samples
+    template <typename Words, typename Counts, typename Samples>
+    static void build(const Words& words, const size_type num_words, Counts& counts, Samples& samples0, Samples& samples1)
+    {
+      const size_type num_blocks = (num_words + 7) >> 3;
+
+      counts.clear();
+      samples0.clear();
+      samples1.clear();
+
+      counts.reserve((num_blocks + 1) * 2);
+
+      size_type rank1 = 0;
+      for (size_type block = 0; block != num_blocks; ++ block) {
+	const size_type rank0 = (block << shift_basic_block) - rank1;
+
+	// samples for the ones and zeros in this block
+	size_type rank1_block = 0;
+	for (size_type i = 0; i != 8; ++ i) {
+	  const size_type pos = (block << 3) + i;
+	  rank1_block += (pos < num_words ? bit_count(words(pos)) : size_type(0));
+	}
+	const size_type rank0_block = basic_block_size - rank1_block;
+
+	for (size_type sample = (rank1 + sample_size - 1) >> shift_sample; (sample << shift_sample) < rank1 + rank1_block; ++ sample)
+	  samples1.push_back(block);
+	for (size_type sample = (rank0 + sample_size - 1) >> shift_sample; (sample << shift_sample) < rank0 + rank0_block; ++ sample)
+	  samples0.push_back(block);
+
+	counts.push_back(rank1);
+
+	word_type relative = 0;
+	size_type rank1_relative = 0;
+	for (size_type i = 0; i != 7; ++ i) {
+	  const size_type pos = (block << 3) + i;
+	  rank1_relative += (pos < num_words ? bit_count(words(pos)) : size_type(0));
+
+	  relative |= word_type(rank1_relative) << (9 * i);
+	}
+	counts.push_back(relative);
+
+	rank1 += rank1_block;
+      }
+
+      // sentinel
+      counts.push_back(rank1);
+      counts.push_back(0);
+    }
+
+    template <typename Words, typename Counts>
+    static size_type rank1(const Words& words, const Counts& counts, const size_type pos)
+    {
+      const size_type pos_word  = pos >> shift_word;
+      const size_type pos_block = pos_word >> 3;
+
+      const difference_type offset = difference_type(pos_word & 7) - 1;
+
+      return (counts[pos_block << 1]
+	      + relative_rank(counts[(pos_block << 1) + 1], offset)
+	      + bit_count(words(pos_word) & (~word_type(0) >> (63 - (pos & 63)))));
+    }
+
+    // the position of the x-th one, x >= 1
+    template <typename Words, typename Counts, typename Samples>
+    static size_type select1(const Words& words, const size_type num_words, const Counts& counts, const Samples& samples, const size_type x)
+    {
+      const size_type num_blocks = (counts.size() >> 1) - 1;
+
+      if (x == 0 || x > counts[num_blocks << 1]) return size_type(-1);
+
+      const size_type rank = x - 1;
+      const size_type sample = rank >> shift_sample;
+
+      // the last block whose rank is <= rank in [first, last)
+      size_type first = samples[sample];
+      size_type last  = (sample + 1 < samples.size() ? size_type(samples[sample + 1]) + 1 : num_blocks);
+
+      while (last - first > 8) {
+	const size_type middle = first + ((last - first) >> 1);
+	const bool is_leq = counts[middle << 1] <= rank;
+
+	first = utils::bithack::branch(is_leq, middle, first);
+	last  = utils::bithack::branch(is_leq, last, middle);
+      }
+      for (/**/; first + 1 < last && counts[(first + 1) << 1] <= rank; ++ first) {}
+
+      const size_type block = first;
+      const size_type rank_block = rank - counts[block << 1];
+      const word_type relative = counts[(block << 1) + 1];
+
+      const size_type offset = count_leq_step_9(relative, rank_block);
+      const size_type pos_word = (block << 3) + offset;
+      const size_type rank_word = rank_block - relative_rank(relative, difference_type(offset) - 1);
+
+      return (pos_word << shift_word) + select_in_word(words(pos_word), rank_word);
+    }
+
+    // the position of the x-th zero, x >= 1. The zeros after the last word are not counted
+    template <typename Words, typename Counts, typename Samples>
+    static size_type select0(const Words& words, const size_type num_words, const Counts& counts, const Samples& samples, const size_type x)
+    {
+      const size_type num_blocks = (counts.size() >> 1) - 1;
+
+      if (x == 0 || x > (num_blocks << shift_basic_block) - counts[num_blocks << 1]) return size_type(-1);
+
+      const size_type rank = x - 1;
+      const size_type sample = rank >> shift_sample;
+
+      size_type first = samples[sample];
+      size_type last  = (sample + 1 < samples.size() ? size_type(samples[sample + 1]) + 1 : num_blocks);
+
+      while (last - first > 8) {
+	const size_type middle = first + ((last - first) >> 1);
+	const bool is_leq = (middle << shift_basic_block) - counts[middle << 1] <= rank;
+
+	first = utils::bithack::branch(is_leq, middle, first);
+	last  = utils::bithack::branch(is_leq, last, middle);
+      }
+      for (/**/; first + 1 < last && ((first + 1) << shift_basic_block) - counts[(first + 1) << 1] <= rank; ++ first) {}
+
+      const size_type block = first;
+      const size_type rank_block = rank - ((block << shift_basic_block) - counts[block << 1]);
+      const word_type relative = bits_step_9 - counts[(block << 1) + 1];
+
+      const size_type offset = count_leq_step_9(relative, rank_block);
+      const size_type pos_word = (block << 3) + offset;
+      const size_type rank_word = rank_block - relative_rank(relative, difference_type(offset) - 1);
+
+      if (pos_word >= num_words) return size_type(-1);
+
+      return (pos_word << shift_word) + select_in_word(~words(pos_word), rank_word);
+    }
+  };
+
+  template <typename _Alloc=std::allocator<uint32_t> >
+  class succinct_vector_rank9_mapped : protected __succinct_vector_rank9_base
+  {
+  private:
+    typedef typename _Alloc::template rebind<block_type>::other  block_allocator_type;
+    typedef typename _Alloc::template rebind<count_type>::other  count_allocator_type;
+    typedef typename _Alloc::template rebind<sample_type>::other sample_allocator_type;
+
+    typedef utils::map_file<block_type, block_allocator_type>   bit_block_type;
+    typedef utils::map_file<count_type, count_allocator_type>   count_mapped_type;
+    typedef utils::map_file<sample_type, sample_allocator_type> sample_mapped_type;
+    typedef std::vector<count_type, count_allocator_type>       count_set_type;
+    typedef std::vector<sample_type, sample_allocator_type>     sample_set_type;
+
+    typedef array_view<count_type>  count_view_type;
+    typedef array_view<sample_type> sample_view_type;
+
+    // storage of the directory: either mapped from the files written by succinct_vector, or built
+    // in memory. Shared by the copies of a vector, e.g. the per-thread clones of a grammar.
+    struct directory_type
+    {
+      count_mapped_type  counts_mapped;
+      sample_mapped_type samples0_mapped;
+      sample_mapped_type samples1_mapped;
+
+      count_set_type  counts;
+      sample_set_type samples0;
+      sample_set_type samples1;
+    };
+    typedef boost::shared_ptr<directory_type> directory_ptr_type;
+
+    typedef __succinct_vector_rank9_base base_type;
+    typedef succinct_vector_rank9_mapped<_Alloc> self_type;
+
+  public:
+    typedef base_type::size_type       size_type;
+    typedef base_type::difference_type difference_type;
+
+  private:
+    // 64-bit words over the 32-bit blocks. The last word may consist of a single block
+    struct word_set_type
+    {
+      word_set_type(const self_type& __vector) : vector(__vector) {}
+
+      word_type operator()(size_type pos) const
+      {
+	const size_type first = pos << 1;
+
+	return (first + 1 < vector.__blocks.size()
+		? word_type(vector.__blocks[first]) | (word_type(vector.__blocks[first + 1]) << 32)
+		: word_type(vector.__blocks[first]));
+      }
+
+      const self_type& vector;
+    };
+
+  public:
+    succinct_vector_rank9_mapped()
+      : __size(0), __blocks(), __directory(), __counts(), __samples0(), __samples1() {}
+    succinct_vector_rank9_mapped(const path_type& path)
+      : __size(0), __blocks(), __directory(), __counts(), __samples0(), __samples1() { open(path); }
+
+    bool operator[](size_type pos) const { return test(pos); }
+    bool test(size_type pos) const
+    {
+      return (__blocks[pos >> 5] >> (pos & 0x1f)) & 1;
+    }
+    size_type size() const { return __size; }
+    bool empty() const { return __size == 0; }
+    bool is_open() const { return __blocks.is_open(); }
+
+    uint64_t size_bytes() const { return __blocks.size_bytes() + size_directory(); }
+    uint64_t size_compressed() const { return __blocks.size_compressed() + size_directory(); }
+    uint64_t size_cache() const { return 0; }
+
+    void clear()
+    {
+      __size = 0;
+      __blocks.clear();
+      __directory.reset();
+      __counts = count_view_type();
+      __samples0 = sample_view_type();
+      __samples1 = sample_view_type();
+    }
+    void close() { clear(); }
+
+    void swap(succinct_vector_rank9_mapped& x)
+    {
+      std::swap(__size, x.__size);
+      __blocks.swap(x.__blocks);
+      __directory.swap(x.__directory);
+      std::swap(__counts, x.__counts);
+      std::swap(__samples0, x.__samples0);
+      std::swap(__samples1, x.__samples1);
+    }
+
+    size_type select(size_type pos, bool bit) const
+    {
+      if (__counts.empty())
+	throw std::runtime_error("no ranks...");
+
+      const size_type num_words = (__blocks.size() + 1) >> 1;
+      const size_type result = (bit
+				? base_type::select1(word_set_type(*this), num_words, __counts, __samples1, pos)
+				: base_type::select0(word_set_type(*this), num_words, __counts, __samples0, pos));
+
+      return utils::bithack::branch(result < __size, result, size_type(-1));
+    }
+
+    size_type rank(size_type pos, bool bit) const
+    {
+      if (__counts.empty())
+	throw std::runtime_error("no ranks...");
+
+      const size_type rank1_value = base_type::rank1(word_set_type(*this), __counts, pos);
+      return (~size_type(bit - 1) & rank1_value) | (size_type(bit - 1) & (pos + 1 - rank1_value));
+    }
+
+    path_type path() const { return __blocks.path().parent_path(); }
+
+    static bool exists(const path_type& path)
+    {
+      if (! utils::repository::exists(path)) return false;
+      if (! bit_block_type::exists(path / "bits")) return false;
+      return true;
+    }
+
+    void read(const path_type& path) { open(path); }
+    void open(const path_type& path)
+    {
+      typedef utils::repository repository_type;
+
+      close();
+
+      repository_type repository(path, repository_type::read);
+      __blocks.open(repository.path("bits"));
+
+      repository_type::const_iterator iter = repository.find("size");
+      if (iter == repository.end())
+	throw std::runtime_error("no size...");
+      __size = boost::lexical_cast<size_type>(iter->second);
+
+      repository_type::const_iterator titer = repository.find("type");
+      if (titer == repository.end())
+	throw std::runtime_error("no type...");
+      if (titer->second != "succinct-vector")
+	throw std::runtime_error("not a succinct vector...");
+
+      const size_type num_words = (__blocks.size() + 1) >> 1;
+
+      __directory.reset(new directory_type());
+      directory_type& directory = *__directory;
+
+      // map the rank9 directory and the select samples, when written by succinct_vector
+      if (count_mapped_type::exists(repository.path("rank9"))
+	  && sample_mapped_type::exists(repository.path("rank9-select0"))
+	  && sample_mapped_type::exists(repository.path("rank9-select1"))) {
+	directory.counts_mapped.open(repository.path("rank9"));
+	directory.samples0_mapped.open(repository.path("rank9-select0"));
+	directory.samples1_mapped.open(repository.path("rank9-select1"));
+
+	if (directory.counts_mapped.size() != base_type::directory_size(num_words))
+	  throw std::runtime_error("invalid rank9 directory...");
+
+	__counts   = view(directory.counts_mapped);
+	__samples0 = view(directory.samples0_mapped);
+	__samples1 = view(directory.samples1_mapped);
+      } else {
+	// otherwise, build them
+	base_type::build(word_set_type(*this), num_words, directory.counts, directory.samples0, directory.samples1);
+
+	__counts   = view(directory.counts);
+	__samples0 = view(directory.samples0);
+	__samples1 = view(directory.samples1);
+      }
+    }
+
+    void write(const path_type& file) const
+    {
+      if (path() == file) return;
+
+      // remove first...
+      if (boost::filesystem::exists(file) && ! boost::filesystem::is_directory(file))
+	boost::filesystem::remove_all(file);
+
+      // create directory
+      if (! boost::filesystem::exists(file))
+	boost::filesystem::create_directories(file);
+
+      // wait!
+      while (! boost::filesystem::exists(file)) {
+	::sync();
+	boost::thread::yield();
+      }
+
+      // remove all the files...
+      boost::filesystem::directory_iterator iter_end;
+      for (boost::filesystem::directory_iterator iter(file); iter != iter_end; ++ iter)
+	boost::filesystem::remove_all(*iter);
+
+      // copy all...
+      for (boost::filesystem::directory_iterator iter(path()); iter != iter_end; ++ iter)
+	utils::filesystem::copy_files(*iter, file);
+    }
+
+    void populate()
+    {
+      __blocks.populate();
+
+      if (__directory) {
+	__directory->counts_mapped.populate();
+	__directory->samples0_mapped.populate();
+	__directory->samples1_mapped.populate();
+      }
+    }
+
+  private:
+    template <typename Array>
+    static array_view<typename Array::value_type> view(const Array& x)
+    {
+      return array_view<typename Array::value_type>(x.empty() ? 0 : &(*x.begin()), x.size());
+    }
+
+    uint64_t size_directory() const
+    {
+      return (__counts.size() * sizeof(count_type)
+	      + __samples0.size() * sizeof(sample_type)
+	      + __samples1.size() * sizeof(sample_type));
+    }
+
+  public:
+    template <typename A>
+    friend
+    bool operator==(const succinct_vector_rank9_mapped<A>& x, const succinct_vector_rank9_mapped<A>& y);
+    template <typename A>
+    friend
+    bool operator!=(const succinct_vector_rank9_mapped<A>& x, const succinct_vector_rank9_mapped<A>& y);
+
+  public:
+    size_type       __size;
+    bit_block_type  __blocks;
+
+  private:
+    directory_ptr_type __directory;
+
+    count_view_type  __counts;
+    sample_view_type __samples0;
+    sample_view_type __samples1;
+  };
+
+  template <typename A>
+  inline
+  bool operator==(const succinct_vector_rank9_mapped<A>& x, const succinct_vector_rank9_mapped<A>& y)
+  {
+    return (x.__size == y.__size && x.__blocks == y.__blocks);
+  }
+
+  template <typename A>
+  inline
+  bool operator!=(const succinct_vector_rank9_mapped<A>& x, const succinct_vector_rank9_mapped<A>& y)
+  {
+    return !(x == y);
+  }
+};
+
+namespace std
+{
+  template <typename A>
+  inline
+  void swap(utils::succinct_vector_rank9_mapped<A>& x, utils::succinct_vector_rank9_mapped<A>& y)
+  {
+    x.swap(y);
+  }
+};
+
+#endif
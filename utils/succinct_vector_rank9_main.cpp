@@ -0,0 +1,196 @@
+//
+//  Copyright(C) 2013 Taro Watanabe <taro.watanabe@nict.go.jp>
+//
+
+//
+// [# of bits] [# of queries]
+//
+// compare rank/select by succinct_vector_rank9_mapped against succinct_vector_mapped over random
+// vectors of various densities, and report the rank/select operations per second.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+
+#include <boost/random.hpp>
+#include <boost/filesystem.hpp>
+
+#include "utils/succinct_vector.hpp"
+#include "utils/succinct_vector_rank9.hpp"
+#include "utils/resource.hpp"
+#include "utils/lexical_cast.hpp"
+
+typedef utils::succinct_vector<std::allocator<int32_t> >              succinct_vector_type;
+typedef utils::succinct_vector_mapped<std::allocator<int32_t> >       succinct_vector_mapped_type;
+typedef utils::succinct_vector_rank9_mapped<std::allocator<int32_t> > succinct_vector_rank9_type;
+
+typedef std::vector<size_t, std::allocator<size_t> > query_set_type;
+
+template <typename Vector>
+size_t benchmark_select(const Vector& vector, const query_set_type& queries, const bool bit, double& time)
+{
+  utils::resource start;
+
+  size_t sum = 0;
+  query_set_type::const_iterator qiter_end = queries.end();
+  for (query_set_type::const_iterator qiter = queries.begin(); qiter != qiter_end; ++ qiter)
+    sum += vector.select(*qiter, bit);
+
+  utils::resource end;
+
+  time += end.user_time() - start.user_time();
+
+  return sum;
+}
+
+template <typename Vector>
+size_t benchmark_rank(const Vector& vector, const query_set_type& queries, double& time)
+{
+  utils::resource start;
+
+  size_t sum = 0;
+  query_set_type::const_iterator qiter_end = queries.end();
+  for (query_set_type::const_iterator qiter = queries.begin(); qiter != qiter_end; ++ qiter)
+    sum += vector.rank(*qiter, true);
+
+  utils::resource end;
+
+  time += end.user_time() - start.user_time();
+
+  return sum;
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const size_t num_bits    = (argc > 1 ? utils::lexical_cast<size_t>(argv[1]) : size_t(1024 * 1024 * 16 + 37));
+    const size_t num_queries = (argc > 2 ? utils::lexical_cast<size_t>(argv[2]) : size_t(1024 * 1024 * 4));
+
+    const boost::filesystem::path path("tmptmp-succinct-rank9");
+
+    boost::mt19937 generator;
+
+    const double densities[] = {0.01, 0.1, 0.5, 0.9, 0.99};
+
+    for (size_t d = 0; d != sizeof(densities) / sizeof(double); ++ d) {
+      boost::random::bernoulli_distribution<double> bit_dist(densities[d]);
+
+      succinct_vector_type bits;
+      std::vector<size_t, std::allocator<size_t> > ones;
+      std::vector<size_t, std::allocator<size_t> > zeros;
+
+      // small vectors first, for the boundaries of the blocks
+      const size_t size = (d == 0 ? size_t(37) : (d == 1 ? size_t(1024 + 33) : num_bits));
+
+      for (size_t i = 0; i != size; ++ i) {
+	const bool bit = (i + 1 == size) || bit_dist(generator);
+
+	bits.set(i, bit);
+
+	if (bit)
+	  ones.push_back(i);
+	else
+	  zeros.push_back(i);
+      }
+      bits.build();
+      bits.write(path);
+
+      succinct_vector_mapped_type bits_mapped(path);
+      succinct_vector_rank9_type  bits_rank9(path);
+
+      if (bits_rank9.size() != bits_mapped.size())
+	throw std::runtime_error("different size");
+      
+      // an index written without the rank9 directory, which is built when opened, and its copy sharing it
+      boost::filesystem::remove(path / "rank9");
+      boost::filesystem::remove(path / "rank9-select0");
+      boost::filesystem::remove(path / "rank9-select1");
+      
+      const succinct_vector_rank9_type bits_built(path);
+      const succinct_vector_rank9_type bits_copied(bits_built);
+      
+      for (size_t i = 0; i != size; ++ i)
+	if (bits_built.rank(i, true) != bits_rank9.rank(i, true) || bits_copied.rank(i, true) != bits_rank9.rank(i, true))
+	  throw std::runtime_error("different rank1 of the built directory at " + utils::lexical_cast<std::string>(i));
+      for (size_t i = 0; i != ones.size(); ++ i)
+	if (bits_built.select(i + 1, true) != ones[i] || bits_copied.select(i + 1, true) != ones[i])
+	  throw std::runtime_error("different select1 of the built directory at " + utils::lexical_cast<std::string>(i + 1));
+
+      // exhaustive check
+      for (size_t i = 0; i != ones.size(); ++ i)
+	if (bits_rank9.select(i + 1, true) != ones[i])
+	  throw std::runtime_error("different select1 at " + utils::lexical_cast<std::string>(i + 1));
+      for (size_t i = 0; i != zeros.size(); ++ i)
+	if (bits_rank9.select(i + 1, false) != zeros[i])
+	  throw std::runtime_error("different select0 at " + utils::lexical_cast<std::string>(i + 1));
+
+      if (bits_rank9.select(ones.size() + 1, true) != size_t(-1))
+	throw std::runtime_error("select1 beyond the ones");
+      if (bits_rank9.select(zeros.size() + 1, false) != size_t(-1))
+	throw std::runtime_error("select0 beyond the zeros");
+
+      for (size_t i = 0; i != size; ++ i) {
+	if (bits_rank9.test(i) != bits_mapped.test(i))
+	  throw std::runtime_error("different bit at " + utils::lexical_cast<std::string>(i));
+	if (bits_rank9.rank(i, true) != bits_mapped.rank(i, true))
+	  throw std::runtime_error("different rank1 at " + utils::lexical_cast<std::string>(i));
+	if (bits_rank9.rank(i, false) != bits_mapped.rank(i, false))
+	  throw std::runtime_error("different rank0 at " + utils::lexical_cast<std::string>(i));
+      }
+
+      // random queries
+      query_set_type queries_rank(num_queries);
+      query_set_type queries_select1(num_queries);
+      query_set_type queries_select0(num_queries);
+
+      for (size_t i = 0; i != num_queries; ++ i) {
+	queries_rank[i]    = boost::random::uniform_int_distribution<size_t>(0, size - 1)(generator);
+	queries_select1[i] = boost::random::uniform_int_distribution<size_t>(1, ones.size())(generator);
+	queries_select0[i] = (zeros.empty() ? size_t(1) : boost::random::uniform_int_distribution<size_t>(1, zeros.size())(generator));
+      }
+
+      double time_rank_mapped = 0.0;
+      double time_rank_rank9 = 0.0;
+      double time_select1_mapped = 0.0;
+      double time_select1_rank9 = 0.0;
+      double time_select0_mapped = 0.0;
+      double time_select0_rank9 = 0.0;
+
+      const size_t sum_rank_mapped    = benchmark_rank(bits_mapped, queries_rank, time_rank_mapped);
+      const size_t sum_rank_rank9     = benchmark_rank(bits_rank9, queries_rank, time_rank_rank9);
+      const size_t sum_select1_mapped = benchmark_select(bits_mapped, queries_select1, true, time_select1_mapped);
+      const size_t sum_select1_rank9  = benchmark_select(bits_rank9, queries_select1, true, time_select1_rank9);
+
+      if (sum_rank_mapped != sum_rank_rank9 || sum_select1_mapped != sum_select1_rank9)
+	throw std::runtime_error("different ranks or selects");
+
+      if (! zeros.empty()) {
+	const size_t sum_select0_mapped = benchmark_select(bits_mapped, queries_select0, false, time_select0_mapped);
+	const size_t sum_select0_rank9  = benchmark_select(bits_rank9, queries_select0, false, time_select0_rank9);
+
+	if (sum_select0_mapped != sum_select0_rank9)
+	  throw std::runtime_error("different selects");
+      }
+
+      std::cout << "density: " << densities[d] << " bits: " << size
+		<< " bytes: " << bits_mapped.size_bytes() << " (mapped) " << bits_rank9.size_bytes() << " (rank9)"
+		<< std::endl;
+      std::cout << "\trank:    " << (num_queries / time_rank_mapped) << " ops/sec (mapped) "
+		<< (num_queries / time_rank_rank9) << " ops/sec (rank9)" << std::endl;
+      std::cout << "\tselect1: " << (num_queries / time_select1_mapped) << " ops/sec (mapped) "
+		<< (num_queries / time_select1_rank9) << " ops/sec (rank9)" << std::endl;
+      if (! zeros.empty())
+	std::cout << "\tselect0: " << (num_queries / time_select0_mapped) << " ops/sec (mapped) "
+		  << (num_queries / time_select0_rank9) << " ops/sec (rank9)" << std::endl;
+    }
+
+    boost::filesystem::remove_all(path);
+  }
+  catch (const std::exception& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}